@@ -23,73 +23,398 @@ void* HOC_MALLOC_EH(size_t sz)
 }
 
 
+static const char DIGIT_PAIRS[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+size_t HOC::FormatUInt(char* buf, uint64_t v)
+{
+	char tmp[20];
+	char* p = tmp + 20;
+	while (v >= 100)
+	{
+		unsigned r = unsigned(v % 100);
+		v /= 100;
+		p -= 2;
+		memcpy(p, DIGIT_PAIRS + r * 2, 2);
+	}
+	if (v >= 10)
+	{
+		p -= 2;
+		memcpy(p, DIGIT_PAIRS + v * 2, 2);
+	}
+	else
+		*--p = char('0' + v);
+	size_t len = size_t(tmp + 20 - p);
+	memcpy(buf, p, len);
+	return len;
+}
+
+size_t HOC::FormatInt(char* buf, int64_t v)
+{
+	if (v < 0)
+	{
+		*buf = '-';
+		return 1 + FormatUInt(buf + 1, 0 - uint64_t(v));
+	}
+	return FormatUInt(buf, uint64_t(v));
+}
+
+
+/* shortest round-trip float32 -> decimal conversion
+- Ryu algorithm (Ulf Adams, 2018): finds the shortest decimal in the rounding interval
+  of the value using 64-bit multiplications with precomputed powers of 5
+- tables: POW5_INV_SPLIT[i] = 2^(bitlength(5^i)-1+59) / 5^i + 1,
+  POW5_SPLIT[i] = 5^i scaled to 61 significant bits
+*/
+#define FLOAT_POW5_INV_BITCOUNT 59
+static const uint64_t FLOAT_POW5_INV_SPLIT[31] =
+{
+	576460752303423489u, 461168601842738791u, 368934881474191033u,
+	295147905179352826u, 472236648286964522u, 377789318629571618u,
+	302231454903657294u, 483570327845851670u, 386856262276681336u,
+	309485009821345069u, 495176015714152110u, 396140812571321688u,
+	316912650057057351u, 507060240091291761u, 405648192073033409u,
+	324518553658426727u, 519229685853482763u, 415383748682786211u,
+	332306998946228969u, 531691198313966350u, 425352958651173080u,
+	340282366920938464u, 544451787073501542u, 435561429658801234u,
+	348449143727040987u, 557518629963265579u, 446014903970612463u,
+	356811923176489971u, 570899077082383953u, 456719261665907162u,
+	365375409332725730u,
+};
+#define FLOAT_POW5_BITCOUNT 61
+static const uint64_t FLOAT_POW5_SPLIT[47] =
+{
+	1152921504606846976u, 1441151880758558720u, 1801439850948198400u,
+	2251799813685248000u, 1407374883553280000u, 1759218604441600000u,
+	2199023255552000000u, 1374389534720000000u, 1717986918400000000u,
+	2147483648000000000u, 1342177280000000000u, 1677721600000000000u,
+	2097152000000000000u, 1310720000000000000u, 1638400000000000000u,
+	2048000000000000000u, 1280000000000000000u, 1600000000000000000u,
+	2000000000000000000u, 1250000000000000000u, 1562500000000000000u,
+	1953125000000000000u, 1220703125000000000u, 1525878906250000000u,
+	1907348632812500000u, 1192092895507812500u, 1490116119384765625u,
+	1862645149230957031u, 1164153218269348144u, 1455191522836685180u,
+	1818989403545856475u, 2273736754432320594u, 1421085471520200371u,
+	1776356839400250464u, 2220446049250313080u, 1387778780781445675u,
+	1734723475976807094u, 2168404344971008868u, 1355252715606880542u,
+	1694065894508600678u, 2117582368135750847u, 1323488980084844279u,
+	1654361225106055349u, 2067951531382569187u, 1292469707114105741u,
+	1615587133892632177u, 2019483917365790221u,
+};
+
+// bit length of 5^e
+static FINLINE int32_t Pow5Bits(int32_t e) { return int32_t((uint32_t(e) * 1217359) >> 19) + 1; }
+// floor(log10(2^e)), floor(log10(5^e))
+static FINLINE uint32_t Log10Pow2(int32_t e) { return (uint32_t(e) * 78913) >> 18; }
+static FINLINE uint32_t Log10Pow5(int32_t e) { return (uint32_t(e) * 732923) >> 20; }
+
+static bool IsMultipleOfPow5(uint32_t v, uint32_t p)
+{
+	uint32_t count = 0;
+	while (v % 5 == 0)
+	{
+		v /= 5;
+		count++;
+	}
+	return count >= p;
+}
+
+static FINLINE bool IsMultipleOfPow2(uint32_t v, uint32_t p)
+{
+	return (v & ((1u << p) - 1)) == 0;
+}
+
+static FINLINE uint32_t MulShift(uint32_t m, uint64_t factor, int32_t shift)
+{
+	uint64_t lo = uint64_t(m) * uint32_t(factor);
+	uint64_t hi = uint64_t(m) * uint32_t(factor >> 32);
+	return uint32_t(((lo >> 32) + hi) >> (shift - 32));
+}
+
+// finite nonzero values only, returns the decimal digits and sets the base 10 exponent
+static uint32_t Float32ToDecimal(uint32_t ieeeMantissa, uint32_t ieeeExponent, int32_t& exp10)
+{
+	int32_t e2;
+	uint32_t m2;
+	if (ieeeExponent == 0)
+	{
+		e2 = 1 - 127 - 23 - 2;
+		m2 = ieeeMantissa;
+	}
+	else
+	{
+		e2 = int32_t(ieeeExponent) - 127 - 23 - 2;
+		m2 = (1u << 23) | ieeeMantissa;
+	}
+	bool acceptBounds = (m2 & 1) == 0;
+
+	// interval of values that round to the input (scaled by 4)
+	uint32_t mv = 4 * m2;
+	uint32_t mp = 4 * m2 + 2;
+	uint32_t mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+	uint32_t mm = 4 * m2 - 1 - mmShift;
+
+	uint32_t vr, vp, vm;
+	int32_t e10;
+	bool vmIsTrailingZeros = false;
+	bool vrIsTrailingZeros = false;
+	uint32_t lastRemovedDigit = 0;
+	if (e2 >= 0)
+	{
+		uint32_t q = Log10Pow2(e2);
+		e10 = int32_t(q);
+		int32_t k = FLOAT_POW5_INV_BITCOUNT + Pow5Bits(int32_t(q)) - 1;
+		int32_t i = -e2 + int32_t(q) + k;
+		vr = MulShift(mv, FLOAT_POW5_INV_SPLIT[q], i);
+		vp = MulShift(mp, FLOAT_POW5_INV_SPLIT[q], i);
+		vm = MulShift(mm, FLOAT_POW5_INV_SPLIT[q], i);
+		if (q != 0 && (vp - 1) / 10 <= vm / 10)
+		{
+			// the last removed digit is needed for rounding if the loop below does not run
+			int32_t l = FLOAT_POW5_INV_BITCOUNT + Pow5Bits(int32_t(q - 1)) - 1;
+			lastRemovedDigit = MulShift(mv, FLOAT_POW5_INV_SPLIT[q - 1], -e2 + int32_t(q) - 1 + l) % 10;
+		}
+		if (q <= 9)
+		{
+			// only one of mp, mv, mm can be a multiple of 5
+			if (mv % 5 == 0)
+				vrIsTrailingZeros = IsMultipleOfPow5(mv, q);
+			else if (acceptBounds)
+				vmIsTrailingZeros = IsMultipleOfPow5(mm, q);
+			else
+				vp -= IsMultipleOfPow5(mp, q);
+		}
+	}
+	else
+	{
+		uint32_t q = Log10Pow5(-e2);
+		e10 = int32_t(q) + e2;
+		int32_t i = -e2 - int32_t(q);
+		int32_t k = Pow5Bits(i) - FLOAT_POW5_BITCOUNT;
+		int32_t j = int32_t(q) - k;
+		vr = MulShift(mv, FLOAT_POW5_SPLIT[i], j);
+		vp = MulShift(mp, FLOAT_POW5_SPLIT[i], j);
+		vm = MulShift(mm, FLOAT_POW5_SPLIT[i], j);
+		if (q != 0 && (vp - 1) / 10 <= vm / 10)
+		{
+			j = int32_t(q) - 1 - (Pow5Bits(i + 1) - FLOAT_POW5_BITCOUNT);
+			lastRemovedDigit = MulShift(mv, FLOAT_POW5_SPLIT[i + 1], j) % 10;
+		}
+		if (q <= 1)
+		{
+			// mv has at least q trailing zero bits
+			vrIsTrailingZeros = true;
+			if (acceptBounds)
+				vmIsTrailingZeros = mmShift == 1;
+			else
+				--vp;
+		}
+		else if (q < 31)
+			vrIsTrailingZeros = IsMultipleOfPow2(mv, q - 1);
+	}
+
+	// remove digits while the interval still contains a shorter number
+	int32_t removed = 0;
+	uint32_t output;
+	if (vmIsTrailingZeros || vrIsTrailingZeros)
+	{
+		while (vp / 10 > vm / 10)
+		{
+			vmIsTrailingZeros &= vm % 10 == 0;
+			vrIsTrailingZeros &= lastRemovedDigit == 0;
+			lastRemovedDigit = vr % 10;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed++;
+		}
+		if (vmIsTrailingZeros)
+		{
+			while (vm % 10 == 0)
+			{
+				vrIsTrailingZeros &= lastRemovedDigit == 0;
+				lastRemovedDigit = vr % 10;
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				removed++;
+			}
+		}
+		// round half to even
+		if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0)
+			lastRemovedDigit = 4;
+		output = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros)) || lastRemovedDigit >= 5);
+	}
+	else
+	{
+		while (vp / 10 > vm / 10)
+		{
+			lastRemovedDigit = vr % 10;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed++;
+		}
+		output = vr + (vr == vm || lastRemovedDigit >= 5);
+	}
+	exp10 = e10 + removed;
+	return output;
+}
+
+size_t HOC::FormatFloat32(char* buf, float v)
+{
+	uint32_t bits;
+	memcpy(&bits, &v, 4);
+	uint32_t ieeeMantissa = bits & ((1u << 23) - 1);
+	uint32_t ieeeExponent = (bits >> 23) & 0xff;
+
+	char* p = buf;
+	if (ieeeExponent == 0xff && ieeeMantissa)
+	{
+		memcpy(p, "nan", 3);
+		return 3;
+	}
+	if (bits >> 31)
+		*p++ = '-';
+	if (ieeeExponent == 0xff)
+	{
+		memcpy(p, "inf", 3);
+		return size_t(p + 3 - buf);
+	}
+	if (ieeeExponent == 0 && ieeeMantissa == 0)
+	{
+		*p++ = '0';
+		return size_t(p - buf);
+	}
+
+	int32_t exp10;
+	char digits[20];
+	int32_t ndigits = int32_t(FormatUInt(digits, Float32ToDecimal(ieeeMantissa, ieeeExponent, exp10)));
+	int32_t sciExp = exp10 + ndigits - 1;
+	// same notation choice as printf("%.18g"), exponents only for very large and small values
+	if (sciExp >= -4 && sciExp < 18)
+	{
+		if (exp10 >= 0)
+		{
+			// integer
+			memcpy(p, digits, size_t(ndigits));
+			p += ndigits;
+			for (int32_t i = 0; i < exp10; ++i)
+				*p++ = '0';
+		}
+		else if (sciExp >= 0)
+		{
+			memcpy(p, digits, size_t(sciExp + 1));
+			p += sciExp + 1;
+			*p++ = '.';
+			memcpy(p, digits + sciExp + 1, size_t(ndigits - sciExp - 1));
+			p += ndigits - sciExp - 1;
+		}
+		else
+		{
+			*p++ = '0';
+			*p++ = '.';
+			for (int32_t i = -1; i > sciExp; --i)
+				*p++ = '0';
+			memcpy(p, digits, size_t(ndigits));
+			p += ndigits;
+		}
+	}
+	else
+	{
+		*p++ = digits[0];
+		if (ndigits > 1)
+		{
+			*p++ = '.';
+			memcpy(p, digits + 1, size_t(ndigits - 1));
+			p += ndigits - 1;
+		}
+		*p++ = 'e';
+		p += FormatInt(p, sciExp);
+	}
+	return size_t(p - buf);
+}
+
+
 OutStream& OutStream::operator << (short v)
 {
 	char bfr[32];
-	Write(bfr, sprintf(bfr, "%hd", v));
+	Write(bfr, FormatInt(bfr, v));
 	return *this;
 }
 
 OutStream& OutStream::operator << (unsigned short v)
 {
 	char bfr[32];
-	Write(bfr, sprintf(bfr, "%hu", v));
+	Write(bfr, FormatUInt(bfr, v));
 	return *this;
 }
 
 OutStream& OutStream::operator << (int v)
 {
 	char bfr[32];
-	Write(bfr, sprintf(bfr, "%d", v));
+	Write(bfr, FormatInt(bfr, v));
 	return *this;
 }
 
 OutStream& OutStream::operator << (unsigned int v)
 {
 	char bfr[32];
-	Write(bfr, sprintf(bfr, "%u", v));
+	Write(bfr, FormatUInt(bfr, v));
 	return *this;
 }
 
 OutStream& OutStream::operator << (long v)
 {
 	char bfr[32];
-	Write(bfr, sprintf(bfr, "%ld", v));
+	Write(bfr, FormatInt(bfr, v));
 	return *this;
 }
 
 OutStream& OutStream::operator << (unsigned long v)
 {
 	char bfr[32];
-	Write(bfr, sprintf(bfr, "%lu", v));
+	Write(bfr, FormatUInt(bfr, v));
 	return *this;
 }
 
 OutStream& OutStream::operator << (long long v)
 {
 	char bfr[32];
-	Write(bfr, sprintf(bfr, "%lld", v));
+	Write(bfr, FormatInt(bfr, v));
 	return *this;
 }
 
 OutStream& OutStream::operator << (unsigned long long v)
 {
 	char bfr[32];
-	Write(bfr, sprintf(bfr, "%llu", v));
+	Write(bfr, FormatUInt(bfr, v));
 	return *this;
 }
 
 OutStream& OutStream::operator << (float v)
 {
 	char bfr[32];
-	Write(bfr, sprintf(bfr, "%.6g", v));
+	Write(bfr, FormatFloat32(bfr, v));
 	return *this;
 }
 
 OutStream& OutStream::operator << (double v)
 {
 	char bfr[32];
-	Write(bfr, sprintf(bfr, "%.18g", v));
+	if (double(float(v)) == v)
+		Write(bfr, FormatFloat32(bfr, float(v)));
+	else
+		Write(bfr, sprintf(bfr, "%.18g", v));
 	return *this;
 }
 
@@ -149,6 +474,55 @@ void CallbackStream::Write(const char* str, size_t size)
 		textOut->func(str, size, textOut->userData);
 }
 
+void FixedBufferStream::Write(const char* str, size_t size)
+{
+	if (this->size < capacity)
+	{
+		size_t left = capacity - this->size;
+		memcpy(buffer + this->size, str, size < left ? size : left);
+	}
+	this->size += size;
+}
+
+BufferedStream::~BufferedStream()
+{
+	FlushBuffer();
+	if (buffer)
+		HOC_FREE(buffer);
+}
+
+void BufferedStream::Write(const char* str, size_t size)
+{
+	if (used + size > capacity)
+	{
+		FlushBuffer();
+		if (size >= capacity)
+		{
+			target->Write(str, size);
+			return;
+		}
+	}
+	if (!buffer)
+		buffer = (char*) HOC_MALLOC_EH(capacity);
+	memcpy(buffer + used, str, size);
+	used += size;
+}
+
+void BufferedStream::Flush()
+{
+	FlushBuffer();
+	target->Flush();
+}
+
+void BufferedStream::FlushBuffer()
+{
+	if (used)
+	{
+		target->Write(buffer, used);
+		used = 0;
+	}
+}
+
 
 double HOC::GetTime()
 {
@@ -3,9 +3,13 @@
 #pragma once
 #define _HAS_EXCEPTIONS 0
 #include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <new>
+#include <utility>
+#include <functional>
 
 #define HOC_INTERNAL
 #include "hlsloptconv.h"
@@ -44,8 +48,12 @@ using OutputShaderFormat = HOC_OutputShaderFormat;
 using ShaderVarType = HOC_ShaderVarType;
 using ShaderDataType = HOC_ShaderDataType;
 using ShaderVariable = HOC_ShaderVariable;
+using ShaderVariableLayout = HOC_ShaderVariableLayout;
 using ShaderMacro = HOC_ShaderMacro;
+using UniformValue = HOC_UniformValue;
 using LoadIncludeFilePFN = HOC_LoadIncludeFilePFN;
+using CompileStage = HOC_CompileStage;
+using CompileStats = HOC_CompileStats;
 
 
 #ifdef _MSC_VER
@@ -56,7 +64,7 @@ using LoadIncludeFilePFN = HOC_LoadIncludeFilePFN;
 #ifdef _MSC_VER
 #  define FINLINE __forceinline
 #else
-#  define FINLINE __attribute__((always_inline))
+#  define FINLINE inline __attribute__((always_inline))
 #endif
 
 #define STRLIT_SIZE(s) s, (sizeof(s)-1)
@@ -526,9 +534,72 @@ struct CallbackStream : OutStream
 	HOC_TextOutput* textOut;
 };
 
+// writes into a caller-owned buffer, data that does not fit is only counted
+struct FixedBufferStream : OutStream
+{
+	FixedBufferStream(char* b, size_t cap) : buffer(b), capacity(cap) {}
+	void Write(const char* str, size_t size) override;
+	void Flush() override {}
+
+	char* buffer;
+	size_t capacity;
+	size_t size = 0;
+};
+
+// collects small writes in one contiguous buffer and forwards them to the target in large chunks
+// (pending data is forwarded on Flush and destruction, writes larger than the buffer bypass it)
+struct BufferedStream : OutStream
+{
+	enum { DEFAULT_CAPACITY = 64 * 1024 };
+
+	BufferedStream(OutStream* t, size_t cap = DEFAULT_CAPACITY) : target(t), capacity(cap) {}
+	BufferedStream(const BufferedStream&) = delete;
+	BufferedStream& operator = (const BufferedStream&) = delete;
+	~BufferedStream();
+	void Write(const char* str, size_t size) override;
+	void Flush() override;
+	void FlushBuffer();
+
+	OutStream* target;
+	char* buffer = nullptr;
+	size_t used = 0;
+	size_t capacity;
+};
+
+
+// number formatting without the C library, returns the number of characters written (no terminator)
+// integers and floats need up to 20 characters, floats use the shortest digit sequence that parses back to the same value
+size_t FormatUInt(char* buf, uint64_t v);
+size_t FormatInt(char* buf, int64_t v);
+size_t FormatFloat32(char* buf, float v);
+
 
 double GetTime();
 
+// accumulates time spent in compilation stages, does nothing without stats
+struct StageTimer
+{
+	StageTimer(CompileStats* s) : stats(s), lastTime(s ? GetTime() : 0) {}
+	void EndStage(CompileStage stage)
+	{
+		if (stats)
+		{
+			double t = GetTime();
+			stats->stageTime[stage] += t - lastTime;
+			lastTime = t;
+		}
+	}
+	// exclude time since the end of the last stage
+	void Skip()
+	{
+		if (stats)
+			lastTime = GetTime();
+	}
+
+	CompileStats* stats;
+	double lastTime;
+};
+
 
 template<class StrClass>
 inline StrClass GetFileContents(const char* filename, bool text = false)
@@ -139,11 +139,6 @@ static const char* gMtxNumbers[16] =
 };
 void ASTType::Dump(OutStream& out) const
 {
-	if (this == nullptr)
-	{
-		out << "<NULL>";
-		return;
-	}
 	switch (kind)
 	{
 	case Void:        out << "void"; break;
@@ -659,24 +654,24 @@ void CBufferDecl::Dump(OutStream& out, int level) const
 	level--; LVL(out, level); out << "}\n";
 }
 
-void DeclRefExpr::Dump(OutStream& out, int level) const
+void DeclRefExpr::Dump(OutStream& out, int) const
 {
 	out << "declref(" << (decl ? decl->name.c_str() : "NULL") << ") [";
 	GetReturnType()->Dump(out);
 	out << "]\n";
 }
 
-void BoolExpr::Dump(OutStream& out, int level) const
+void BoolExpr::Dump(OutStream& out, int) const
 {
 	out << "bool(" << value << ")\n";
 }
 
-void Int32Expr::Dump(OutStream& out, int level) const
+void Int32Expr::Dump(OutStream& out, int) const
 {
 	out << "int32(" << value << ")\n";
 }
 
-void Float32Expr::Dump(OutStream& out, int level) const
+void Float32Expr::Dump(OutStream& out, int) const
 {
 	out << "float32(" << value << ")\n";
 }
@@ -1546,15 +1541,15 @@ void VariableAccessValidator::RunOnAST(const AST& ast)
 
 void VariableAccessValidator::ProcessReadExpr(const Expr* node)
 {
-	if (auto* bexpr = dyn_cast<const BoolExpr>(node))
+	if (dyn_cast<const BoolExpr>(node))
 	{
 		return;
 	}
-	else if (auto* i32expr = dyn_cast<const Int32Expr>(node))
+	else if (dyn_cast<const Int32Expr>(node))
 	{
 		return;
 	}
-	else if (auto* f32expr = dyn_cast<const Float32Expr>(node))
+	else if (dyn_cast<const Float32Expr>(node))
 	{
 		return;
 	}
@@ -1951,16 +1946,16 @@ bool VariableAccessValidator::ProcessStmt(const Stmt* node)
 		ValidateCheckOutputElementsWritten(retstmt->loc);
 		return true;
 	}
-	else if (auto* dscstmt = dyn_cast<const DiscardStmt>(node))
+	else if (dyn_cast<const DiscardStmt>(node))
 	{
 		// still need to return something somewhere, otherwise shader is somewhat pointless
 		return false;
 	}
-	else if (auto* brkstmt = dyn_cast<const BreakStmt>(node))
+	else if (dyn_cast<const BreakStmt>(node))
 	{
 		return false;
 	}
-	else if (auto* cntstmt = dyn_cast<const ContinueStmt>(node))
+	else if (dyn_cast<const ContinueStmt>(node))
 	{
 		return false;
 	}
@@ -2149,6 +2144,27 @@ struct ContentValidator : ASTWalker<ContentValidator>
 					break;
 				}
 			}
+			if (outputFmt == OSF_SPIRV)
+			{
+				switch (op->opKind)
+				{
+				case Op_MulMM:
+				case Op_MulMV:
+				case Op_MulVM:
+					// generated like the GLSL operator '*', which requires matching column/row sizes
+					for (ASTNode* arg = op->GetFirstArg(); arg; arg = arg->next)
+					{
+						auto* t = arg->ToExpr()->GetReturnType();
+						if (t->kind == ASTType::Matrix && t->sizeX != t->sizeY)
+						{
+							diag.EmitError("multiplication of non-square matrices is not supported for this output",
+								op->loc);
+							break;
+						}
+					}
+					break;
+				}
+			}
 		}
 	}
 	Diagnostic& diag;
@@ -2183,8 +2199,33 @@ static void InOutFixSemanticsAndNames(VarDecl* vd, const Info& info)
 			return;
 		}
 		return;
+	case OSF_SPIRV:
+		// built-ins that GLSL outputs do not support, the rest is named like in GLSL
+		if (in && info.stage == ShaderStage_Pixel &&
+			(vd->semanticName == "POSITION" || vd->semanticName == "SV_POSITION" || vd->semanticName == "VPOS"))
+		{
+			vd->name = "gl_FragCoord";
+			vd->flags |= VarDecl::ATTR_Hidden;
+			return;
+		}
+		if (out && info.stage == ShaderStage_Pixel &&
+			(vd->semanticName == "DEPTH" || vd->semanticName == "SV_DEPTH"))
+		{
+			vd->name = "gl_FragDepth";
+			vd->flags |= VarDecl::ATTR_Hidden;
+			return;
+		}
+		if (out && info.stage == ShaderStage_Vertex && vd->semanticName == "SV_POSITION")
+		{
+			vd->name = "gl_Position";
+			vd->flags |= VarDecl::ATTR_Hidden;
+			return;
+		}
+		// fallthrough
 	case OSF_GLSL_ES_100:
 	case OSF_GLSL_140:
+	case OSF_GLSL_330:
+	case OSF_GLSL_ES_300:
 		if (out)
 		{
 			if (info.stage == ShaderStage_Vertex)
@@ -2198,7 +2239,7 @@ static void InOutFixSemanticsAndNames(VarDecl* vd, const Info& info)
 			}
 			if (info.stage == ShaderStage_Pixel)
 			{
-				if (vd->semanticName == "COLOR")
+				if (vd->semanticName == "COLOR" || (info.outputFmt == OSF_SPIRV && vd->semanticName == "SV_TARGET"))
 				{
 					if (info.outputFmt == OSF_GLSL_ES_100)
 					{
@@ -2233,7 +2274,8 @@ static void InOutFixSemanticsAndNames(VarDecl* vd, const Info& info)
 		}
 
 		// TODO geometry shaders?
-		if (info.outputFlags & HOC_OF_GLSL_RENAME_VARYINGS)
+		if ((info.outputFlags & HOC_OF_GLSL_RENAME_VARYINGS) || HasLayoutLocations(info.outputFmt) ||
+			info.outputFmt == OSF_SPIRV)
 		{
 			// force rename varyings to semantics to automate linkage
 			if ((out && info.stage == ShaderStage_Vertex) ||
@@ -2259,7 +2301,7 @@ struct StructLevel
 	uint32_t mmbID;
 	ASTNode* levILE;
 };
-static void GLSLAppendShaderIOVar(AST& ast, ASTFunction* F, const Info& info,
+static void GLSLAppendShaderIOVar(AST&, ASTFunction* F, const Info& info,
 	ASTNode* outILE, ASTNode* inSRC, ASTStructType* topStc)
 {
 	Array<StructLevel> mmbIndices;
@@ -2546,7 +2588,7 @@ static void UnpackEntryPoint(AST& ast, const Info& info)
 		});
 	//	F->Dump(FILEStream(stderr),0);
 	}
-	if (info.outputFmt == OSF_GLSL_140 || info.outputFmt == OSF_GLSL_ES_100)
+	if (IsGLSLBased(info.outputFmt))
 	{
 		while (F->GetFirstArg())
 			ast.globalVars.AppendChild(F->GetFirstArg());
@@ -2626,7 +2668,7 @@ static void ExpandBlock(Stmt* stmt)
 	}
 }
 
-static Stmt* FindParentStatement(Expr* expr)
+Stmt* HOC::FindParentStatement(Expr* expr)
 {
 	ASTNode* n = expr->parent;
 	while (n)
@@ -2682,11 +2724,8 @@ static void FoldInLoopCond(Expr* expr)
 	}
 }
 
-static DeclRefExpr* FoldOut(Expr* expr)
+DeclRefExpr* HOC::FoldOutBefore(Expr* expr, Stmt* marker)
 {
-	FoldInLoopCond(expr);
-
-	Stmt* marker = FindParentStatement(expr);
 	ExpandBlock(marker);
 
 	auto* vds = new VarDeclStmt;
@@ -2706,6 +2745,12 @@ static DeclRefExpr* FoldOut(Expr* expr)
 	return dre;
 }
 
+static DeclRefExpr* FoldOut(Expr* expr)
+{
+	FoldInLoopCond(expr);
+	return FoldOutBefore(expr, FindParentStatement(expr));
+}
+
 static Expr* FoldOutIfBest(Expr* expr)
 {
 	bool inLoop = IsExprInPreCondLoop(expr);
@@ -2742,6 +2787,16 @@ static ASTNode* GetWriteContext(Expr* expr)
 struct MatrixSwizzleUnpacker : ASTWalker<MatrixSwizzleUnpacker>
 {
 	MatrixSwizzleUnpacker(AST& a) : ast(a) {}
+	// swizzle index = row + col * rows -> M[col][row] for square matrices (stored by column),
+	// M[row][col] for others (GLSL matRxC = R vectors of C components, stored by row)
+	static void GetCellIndices(const ASTType* mtxType, unsigned idx, unsigned& vecIdx, unsigned& compIdx)
+	{
+		unsigned row = idx % mtxType->sizeX;
+		unsigned col = idx / mtxType->sizeX;
+		bool square = mtxType->sizeX == mtxType->sizeY;
+		vecIdx = square ? col : row;
+		compIdx = square ? row : col;
+	}
 	void PostVisit(ASTNode* node)
 	{
 		if (auto* mmbexpr = dyn_cast<MemberExpr>(node))
@@ -2755,18 +2810,18 @@ struct MatrixSwizzleUnpacker : ASTWalker<MatrixSwizzleUnpacker>
 				{
 					// just change to double array index lookup
 					unsigned idx = mmbexpr->memberID & 0xf;
-					unsigned row = idx % mtxType->sizeY;
-					unsigned col = idx / mtxType->sizeY;
+					unsigned col, row;
+					GetCellIndices(mtxType, idx, col, row);
 
 					IndexExpr* cellExpr = new IndexExpr;
 					IndexExpr* colExpr = new IndexExpr;
 
 					cellExpr->AppendChild(colExpr);
 					cellExpr->AppendChild(new Int32Expr(row, ast.GetInt32Type()));
-					cellExpr->SetReturnType(ast.CastToVector(scalarType, 4));
+					cellExpr->SetReturnType(scalarType);
 					colExpr->AppendChild(mmbexpr->GetSource());
 					colExpr->AppendChild(new Int32Expr(col, ast.GetInt32Type()));
-					colExpr->SetReturnType(scalarType);
+					colExpr->SetReturnType(ast.GetVectorType(scalarType, mtxType->sizeY));
 					delete mmbexpr->ReplaceWith(cellExpr);
 					return;
 				}
@@ -2840,8 +2895,8 @@ struct MatrixSwizzleUnpacker : ASTWalker<MatrixSwizzleUnpacker>
 								Expr* mySrc = i == 0 ? src : src->DeepClone()->ToExpr();
 
 								unsigned idx = (mmbexpr->memberID >> (4 * i)) & 0xf;
-								unsigned row = idx % mtxType->sizeY;
-								unsigned col = idx / mtxType->sizeY;
+								unsigned col, row;
+								GetCellIndices(mtxType, idx, col, row);
 
 								auto* exprStmt = new ExprStmt;
 								auto* elBinOp = new BinaryOpExpr;
@@ -2851,10 +2906,10 @@ struct MatrixSwizzleUnpacker : ASTWalker<MatrixSwizzleUnpacker>
 
 								cellExpr->AppendChild(colExpr);
 								cellExpr->AppendChild(new Int32Expr(row, ast.GetInt32Type()));
-								cellExpr->SetReturnType(ast.CastToVector(scalarType, mtxType->sizeX));
+								cellExpr->SetReturnType(scalarType);
 								colExpr->AppendChild(myDst);
 								colExpr->AppendChild(new Int32Expr(col, ast.GetInt32Type()));
-								colExpr->SetReturnType(scalarType);
+								colExpr->SetReturnType(ast.GetVectorType(scalarType, mtxType->sizeY));
 								elExpr->AppendChild(mySrc);
 								elExpr->AppendChild(new Int32Expr(i, ast.GetInt32Type()));
 								elExpr->SetReturnType(scalarType);
@@ -2896,18 +2951,18 @@ struct MatrixSwizzleUnpacker : ASTWalker<MatrixSwizzleUnpacker>
 							Expr* mySrc = i == 0 ? src : src->DeepClone()->ToExpr();
 
 							unsigned idx = (mmbexpr->memberID >> (4 * i)) & 0xf;
-							unsigned row = idx % mtxType->sizeY;
-							unsigned col = idx / mtxType->sizeY;
+							unsigned col, row;
+							GetCellIndices(mtxType, idx, col, row);
 
 							IndexExpr* cellExpr = new IndexExpr;
 							IndexExpr* colExpr = new IndexExpr;
 
 							cellExpr->AppendChild(colExpr);
 							cellExpr->AppendChild(new Int32Expr(row, ast.GetInt32Type()));
-							cellExpr->SetReturnType(ast.CastToVector(scalarType, mtxType->sizeX));
+							cellExpr->SetReturnType(scalarType);
 							colExpr->AppendChild(mySrc);
 							colExpr->AppendChild(new Int32Expr(col, ast.GetInt32Type()));
-							colExpr->SetReturnType(scalarType);
+							colExpr->SetReturnType(ast.GetVectorType(scalarType, mtxType->sizeY));
 
 							ile->AppendChild(cellExpr);
 						}
@@ -2945,7 +3000,7 @@ static Expr* CastExprTo(Expr* val, ASTType* to)
 static Expr* GetReferenceToElement(AST& ast, Expr* src, unsigned accessPointNum)
 {
 	ASTType* t = src->GetReturnType();
-	assert(accessPointNum >= 0 && accessPointNum < t->GetAccessPointCount());
+	assert(accessPointNum < t->GetAccessPointCount());
 	switch (t->kind)
 	{
 	case ASTType::Bool:
@@ -2974,10 +3029,10 @@ static Expr* GetReferenceToElement(AST& ast, Expr* src, unsigned accessPointNum)
 			auto* idxexprA = new IndexExpr;
 			auto* idxexprB = new IndexExpr;
 			idxexprA->SetSource(src);
-			idxexprA->AppendChild(new Int32Expr(accessPointNum / t->sizeX, ast.GetInt32Type()));
-			idxexprA->SetReturnType(ast.GetVectorType(t->subType, t->sizeX));
+			idxexprA->AppendChild(new Int32Expr(accessPointNum / t->sizeY, ast.GetInt32Type()));
+			idxexprA->SetReturnType(ast.GetVectorType(t->subType, t->sizeY));
 			idxexprB->SetSource(idxexprA);
-			idxexprB->AppendChild(new Int32Expr(accessPointNum % t->sizeX, ast.GetInt32Type()));
+			idxexprB->AppendChild(new Int32Expr(accessPointNum % t->sizeY, ast.GetInt32Type()));
 			idxexprB->SetReturnType(t->subType);
 			return idxexprB;
 		}
@@ -2998,6 +3053,7 @@ static Expr* GetReferenceToElement(AST& ast, Expr* src, unsigned accessPointNum)
 				}
 				offset += apc;
 			}
+			return nullptr;
 		}
 	case ASTType::Array:
 		{
@@ -3017,7 +3073,6 @@ static Expr* GetReferenceToElement(AST& ast, Expr* src, unsigned accessPointNum)
 static void GenerateComponentAssignments(AST& ast, Expr* ile_or_cast, bool transpose = false)
 {
 	int numAPs = ile_or_cast->GetReturnType()->GetAccessPointCount();
-	int origInputs = ile_or_cast->childCount;
 
 	VarDecl* vd;
 	if (VarDecl* pvd = dyn_cast<VarDecl>(ile_or_cast->parent))
@@ -3042,7 +3097,7 @@ static void GenerateComponentAssignments(AST& ast, Expr* ile_or_cast, bool trans
 		if (transpose)
 		{
 			auto* mt = ile_or_cast->GetReturnType();
-			assert(mt->kind == ASTType::Matrix);
+			assert(mt->kind == ASTType::Matrix && mt->sizeX == mt->sizeY);
 			unsigned x = dsti % mt->sizeX;
 			unsigned y = dsti / mt->sizeX;
 			dsti = y + x * mt->sizeY;
@@ -3186,6 +3241,8 @@ struct GLSLConversionPass : ASTWalker<GLSLConversionPass>
 		ile->SetReturnType(recombineMode == MURM_Matrix ? mtxTy : ast.GetVectorType(retTy, numCols));
 		fcintrin->ReplaceWith(ile);
 		ile->AppendChild(fcintrin);
+		if (recombineMode == MURM_Matrix)
+			fcintrin->SetReturnType(ast.GetVectorType(retTy->subType, retTy->sizeY)); // one column
 
 		for (auto* arg = fcintrin->GetFirstArg(); arg; )
 		{
@@ -3241,7 +3298,7 @@ struct GLSLConversionPass : ASTWalker<GLSLConversionPass>
 		if (outputFmt == OSF_GLSL_ES_100)
 			CastArgsToFloat(fcintrin, preserveInts);
 	}
-	bool IsNewSamplingAPI(){ return outputFmt == OSF_GLSL_140; }
+	bool IsNewSamplingAPI(){ return outputFmt != OSF_GLSL_ES_100; }
 	void PreVisit(ASTNode* node)
 	{
 		if (auto* op = dyn_cast<OpExpr>(node))
@@ -3355,7 +3412,7 @@ struct GLSLConversionPass : ASTWalker<GLSLConversionPass>
 						auto* srcTy = binop->GetLft()->GetReturnType();
 						switch (srcTy->kind)
 						{
-						case ASTType::Bool: CastExprTo(binop->GetLft(), ast.GetInt32Type()); // ...
+						case ASTType::Bool: CastExprTo(binop->GetLft(), ast.GetInt32Type()); // fallthrough
 						case ASTType::Int32:
 						case ASTType::UInt32: cnst = new Int32Expr(0, srcTy); break;
 						case ASTType::Float16:
@@ -3400,8 +3457,10 @@ struct GLSLConversionPass : ASTWalker<GLSLConversionPass>
 				}
 				else
 				{
+					// unpacked columns are siblings of op, stop before any original sibling
+					ASTNode* origNext = op->next;
 					MatrixUnpack(op, MURM_Cascade);
-					for (ASTNode* expr = op; expr; expr = expr->next)
+					for (ASTNode* expr = op; expr && expr != origNext; expr = expr->next)
 					{
 						auto* opin = dyn_cast<OpExpr>(expr);
 						auto* arg = opin->GetFirstArg()->ToExpr();
@@ -3435,7 +3494,10 @@ struct GLSLConversionPass : ASTWalker<GLSLConversionPass>
 			}
 			else if (ile->GetReturnType()->kind == ASTType::Matrix && !ile->isTargetCompatible)
 			{
-				GenerateComponentAssignments(ast, ile, true);
+				// square matrices are stored by column (as used by mul), the others have
+				// GLSL matRxC types (R vectors of C components), so they are stored by row
+				auto* mt = ile->GetReturnType();
+				GenerateComponentAssignments(ast, ile, mt->sizeX == mt->sizeY);
 			}
 			return;
 		}
@@ -3462,8 +3524,7 @@ struct GLSLConversionPass : ASTWalker<GLSLConversionPass>
 
 	Expr* FindNumberCreateConst(Expr* src, unsigned accessPointNum)
 	{
-		ASTType* t = src->GetReturnType();
-		assert(accessPointNum >= 0 && accessPointNum < t->GetAccessPointCount());
+		assert(accessPointNum < src->GetReturnType()->GetAccessPointCount());
 		if (auto* i32expr = dyn_cast<Int32Expr>(src))
 		{
 			return i32expr->Clone()->ToExpr();
@@ -3528,6 +3589,375 @@ static void GLSLConvert(AST& ast, const Info& info)
 	GLSLConversionPass(ast, info.diag, info.outputFmt).VisitAST(ast);
 }
 
+// where each packed varying is placed, computed for the VS and reused for the PS
+struct VaryingPackLayout
+{
+	struct Entry
+	{
+		String semanticName;
+		int semanticIndex;
+		int numComps;
+		int pack;
+		int firstComp;
+	};
+
+	Array<Entry> entries;
+	Array<int> packSizes;
+};
+
+// packs varyings with less than 4 components into the fewest vec4s (V2P_PACK#)
+// - only done by HOC_CompileShaderPair: the layout depends on the varyings that the VS keeps,
+//   so the PS must be given the same layout instead of computing its own
+// - sorted by size (largest first), then by semantic, then first-fit into the packs
+// - PS inputs that are not in the layout (not written by the VS or with another size) are not packed
+// - the original variables become locals of the entry point, copied to/from the packs
+struct VaryingPacker
+{
+	struct Varying
+	{
+		VarDecl* vd;
+		int numComps;
+		int pack;
+		int firstComp;
+	};
+
+	VaryingPacker(AST& a, VaryingPackLayout& l, bool ul) : ast(a), layout(l), useLayout(ul) {}
+	bool IsPackable(const VarDecl* vd)
+	{
+		if (!(vd->flags & VarDecl::ATTR_StageIO) || (vd->flags & VarDecl::ATTR_Hidden))
+			return false;
+		if (ast.stage == ShaderStage_Vertex ? !(vd->flags & VarDecl::ATTR_Out) : !(vd->flags & VarDecl::ATTR_In))
+			return false;
+		if (vd->semanticName == "POSITION")
+			return false;
+		const ASTType* t = vd->GetType();
+		return t->IsFloat() || (t->kind == ASTType::Vector && t->subType->IsFloat() && t->sizeX < 4);
+	}
+	Expr* CreatePackRef(const Varying& v)
+	{
+		VarDecl* pvd = packs[v.pack];
+		auto* dre = new DeclRefExpr;
+		dre->decl = pvd;
+		dre->SetReturnType(pvd->GetType());
+		if (v.numComps == layout.packSizes[v.pack])
+			return dre;
+
+		auto* swizzle = new MemberExpr;
+		swizzle->swizzleComp = v.numComps;
+		for (int i = 0; i < v.numComps; ++i)
+			swizzle->memberID |= uint32_t(v.firstComp + i) << (i * 2);
+		swizzle->SetReturnType(v.numComps == 1 ? ast.GetFloat32Type() : ast.GetFloat32VecType(v.numComps));
+		swizzle->AppendChild(dre);
+		return swizzle;
+	}
+	void PlaceVaryings()
+	{
+		std::sort(varyings.begin(), varyings.end(), [](const Varying& a, const Varying& b)
+		{
+			if (a.numComps != b.numComps)
+				return a.numComps > b.numComps;
+			int name_diff = a.vd->semanticName.compare(b.vd->semanticName);
+			if (name_diff)
+				return name_diff < 0;
+			return a.vd->GetSemanticIndex() < b.vd->GetSemanticIndex();
+		});
+		auto& packSizes = layout.packSizes;
+		for (auto& v : varyings)
+		{
+			for (size_t i = 0; i < packSizes.size(); ++i)
+			{
+				if (packSizes[i] + v.numComps <= 4)
+				{
+					v.pack = int(i);
+					break;
+				}
+			}
+			if (v.pack < 0)
+			{
+				v.pack = int(packSizes.size());
+				packSizes.push_back(0);
+			}
+			v.firstComp = packSizes[v.pack];
+			packSizes[v.pack] += v.numComps;
+			layout.entries.push_back({ v.vd->semanticName, v.vd->GetSemanticIndex(), v.numComps, v.pack, v.firstComp });
+		}
+	}
+	void ApplyLayout()
+	{
+		size_t numPlaced = 0;
+		for (auto& v : varyings)
+		{
+			for (const auto& e : layout.entries)
+			{
+				if (e.semanticName == v.vd->semanticName && e.semanticIndex == v.vd->GetSemanticIndex() &&
+					e.numComps == v.numComps)
+				{
+					v.pack = e.pack;
+					v.firstComp = e.firstComp;
+					varyings[numPlaced++] = v;
+					break;
+				}
+			}
+		}
+		varyings.resize(numPlaced);
+	}
+	void RunOnAST()
+	{
+		for (ASTNode* g = ast.globalVars.firstChild; g; g = g->next)
+		{
+			auto* vd = dyn_cast<VarDecl>(g);
+			if (vd && IsPackable(vd))
+				varyings.push_back({ vd, int(vd->GetType()->GetElementCount()), -1, 0 });
+		}
+		if (useLayout)
+			ApplyLayout();
+		else
+			PlaceVaryings();
+		if (varyings.empty())
+			return;
+
+		bool isVS = ast.stage == ShaderStage_Vertex;
+		const auto& packSizes = layout.packSizes;
+		for (size_t i = 0; i < packSizes.size(); ++i)
+		{
+			auto* pvd = new VarDecl;
+			ast.globalVars.AppendChild(pvd);
+			pvd->name = "V2P_PACK";
+			pvd->name += StdToString(int(i));
+			pvd->semanticName = "PACK";
+			pvd->semanticIndex = int(i);
+			pvd->SetType(packSizes[i] == 1 ? ast.GetFloat32Type() : ast.GetFloat32VecType(packSizes[i]));
+			pvd->flags = (isVS ? VarDecl::ATTR_Out : VarDecl::ATTR_In) | VarDecl::ATTR_StageIO | VarDecl::ATTR_Global;
+			packs.push_back(pvd);
+		}
+		for (const auto& e : layout.entries)
+		{
+			AccessPointDecl apd;
+			apd.name = packs[e.pack]->name;
+			apd.semanticName = e.semanticName;
+			apd.semanticIndex = e.semanticIndex;
+			ast.varyingPackLayout.push_back(apd);
+		}
+
+		ASTFunction* F = ast.entryPoint;
+		auto* vds = new VarDeclStmt;
+		F->GetCode()->PrependChild(vds);
+		for (auto& v : varyings)
+		{
+			AccessPointDecl apd;
+			apd.name = packs[v.pack]->name;
+			if (v.numComps != packSizes[v.pack])
+			{
+				apd.name += ".";
+				for (int i = 0; i < v.numComps; ++i)
+					apd.name += "xyzw"[v.firstComp + i];
+			}
+			apd.type = v.vd->GetType();
+			apd.semanticName = v.vd->semanticName;
+			apd.semanticIndex = v.vd->semanticIndex;
+			ast.packedVaryings.push_back(apd);
+
+			// the original variable is now a local
+			v.vd->flags &= ~(VarDecl::ATTR_In | VarDecl::ATTR_Out | VarDecl::ATTR_StageIO | VarDecl::ATTR_Global);
+			vds->AppendChild(v.vd);
+			if (!isVS)
+			{
+				v.vd->SetInitExpr(CreatePackRef(v));
+				CastExprTo(v.vd->GetInitExpr(), v.vd->GetType());
+				continue;
+			}
+
+			for (ReturnStmt* ret = F->firstRetStmt; ret; ret = ret->nextRetStmt)
+			{
+				if (dyn_cast<BlockStmt>(ret->parent) == nullptr)
+				{
+					BlockStmt* blk = new BlockStmt;
+					ret->ReplaceWith(blk);
+					blk->AppendChild(ret);
+				}
+
+				auto* exprst = new ExprStmt;
+				auto* assign = new BinaryOpExpr;
+				auto* dre = new DeclRefExpr;
+				dre->decl = v.vd;
+				dre->SetReturnType(v.vd->GetType());
+				ret->InsertBeforeMe(exprst);
+				exprst->AppendChild(assign);
+				Expr* packRef = CreatePackRef(v);
+				assign->AppendChild(packRef);
+				assign->AppendChild(dre);
+				assign->opType = STT_OP_Assign;
+				assign->SetReturnType(packRef->GetReturnType());
+				CastExprTo(dre, packRef->GetReturnType());
+			}
+		}
+	}
+
+	AST& ast;
+	VaryingPackLayout& layout;
+	bool useLayout;
+	Array<Varying> varyings;
+	Array<VarDecl*> packs;
+};
+
+static bool PackVaryings(AST& ast, const Info& info, VaryingPackLayout& layout, bool useLayout)
+{
+	if (!(info.outputFlags & HOC_OF_GLSL_PACK_VARYINGS) ||
+		!IsGLSLBased(info.outputFmt))
+		return false;
+	VaryingPacker(ast, layout, useLayout).RunOnAST();
+	return true;
+}
+
+
+// cross-stage interface trimming (HOC_CompileShaderPair)
+// - varyings are matched by semantic, VS outputs without a PS reader are turned into locals
+static String GetVaryingKey(const VarDecl* vd)
+{
+	String key = vd->semanticName;
+	key += "#";
+	key += StdToString(vd->GetSemanticIndex());
+	return key;
+}
+
+static bool IsVaryingDecl(const VarDecl* vd, uint32_t ioFlag)
+{
+	return (vd->flags & ioFlag) && !(vd->flags & VarDecl::ATTR_Uniform) && vd->semanticName.empty() == false;
+}
+
+// struct inputs are unpacked into a local that is initialized from all of the members,
+// inputs behind members that are never read are replaced with zeroes
+struct StructInputMemberReads : ASTWalker<StructInputMemberReads>
+{
+	struct Entry
+	{
+		VarDecl* vd;
+		uint32_t readMask;
+	};
+
+	void PreVisit(ASTNode* node)
+	{
+		if (auto* dre = dyn_cast<DeclRefExpr>(node))
+		{
+			for (auto& e : locals)
+			{
+				if (e.vd != dre->decl)
+					continue;
+				auto* mmb = dyn_cast<MemberExpr>(dre->parent);
+				e.readMask |= mmb && mmb->swizzleComp == 0 ? 1u << mmb->memberID : ~0u;
+			}
+		}
+	}
+	void RunOnAST(AST& ast)
+	{
+		for (ASTNode* s = ast.entryPoint->GetCode()->firstChild; s; s = s->next)
+		{
+			auto* vds = dyn_cast<VarDeclStmt>(s);
+			if (!vds)
+				continue;
+			for (ASTNode* ch = vds->firstChild; ch; ch = ch->next)
+			{
+				auto* vd = ch->ToVarDecl();
+				auto* ile = vd->GetInitExpr() ? dyn_cast<InitListExpr>(vd->GetInitExpr()) : nullptr;
+				if (ile &&
+					vd->GetType()->kind == ASTType::Structure &&
+					vd->GetType()->ToStructType()->members.size() <= 32 &&
+					size_t(ile->childCount) == vd->GetType()->ToStructType()->members.size())
+					locals.push_back({ vd, 0 });
+			}
+		}
+		VisitFunction(ast.entryPoint);
+
+		for (const auto& e : locals)
+		{
+			uint32_t i = 0;
+			for (ASTNode* ch = e.vd->GetInitExpr()->firstChild; ch; ++i)
+			{
+				ASTNode* n = ch->next;
+				auto* dre = dyn_cast<DeclRefExpr>(ch);
+				if (dre &&
+					!(e.readMask & (1u << i)) &&
+					IsVaryingDecl(dre->decl, VarDecl::ATTR_In))
+				{
+					auto* zero = new Float32Expr(0, ast.GetFloat32Type());
+					dre->ReplaceWith(zero);
+					delete dre;
+					CastExprTo(zero, e.vd->GetType()->ToStructType()->members[i].type);
+				}
+				ch = n;
+			}
+		}
+	}
+
+	Array<Entry> locals;
+};
+
+static void RemoveUnreadPSInputs(AST& ast, Array<String>& outReadInputs)
+{
+	StructInputMemberReads().RunOnAST(ast);
+	MarkUnusedVariables().RunOnAST(ast);
+	ASTNode* lists[2] = { ast.globalVars.firstChild, ast.entryPoint->GetFirstArg() };
+	for (ASTNode* list : lists)
+	{
+		for (ASTNode* n = list; n; )
+		{
+			auto* vd = dyn_cast<VarDecl>(n);
+			n = n->next;
+			if (!vd || !IsVaryingDecl(vd, VarDecl::ATTR_In))
+				continue;
+			if (vd->used)
+				outReadInputs.push_back(GetVaryingKey(vd));
+			else
+				delete vd;
+		}
+	}
+}
+
+static int TrimVSOutputs(AST& ast, const Array<String>& readInputs)
+{
+	int numRemoved = 0;
+	ASTFunction* F = ast.entryPoint;
+	VarDeclStmt* vds = nullptr;
+	ASTNode* lists[2] = { ast.globalVars.firstChild, F->GetFirstArg() };
+	for (ASTNode* list : lists)
+	{
+		for (ASTNode* n = list; n; )
+		{
+			auto* vd = dyn_cast<VarDecl>(n);
+			n = n->next;
+			if (!vd || !IsVaryingDecl(vd, VarDecl::ATTR_Out))
+				continue;
+			// values used by the fixed function parts of the pipeline
+			if (vd->semanticName == "POSITION" ||
+				vd->semanticName == "SV_POSITION" ||
+				vd->semanticName == "PSIZE" ||
+				vd->semanticName == "FOG")
+				continue;
+			String key = GetVaryingKey(vd);
+			bool isRead = false;
+			for (const auto& rdkey : readInputs)
+				if (rdkey == key)
+					isRead = true;
+			if (isRead)
+				continue;
+
+			// the output becomes a local, optimization removes it with all the code that computes it
+			if (!vds)
+			{
+				vds = new VarDeclStmt;
+				F->GetCode()->PrependChild(vds);
+			}
+			vd->flags &= ~(VarDecl::ATTR_In | VarDecl::ATTR_Out | VarDecl::ATTR_StageIO |
+				VarDecl::ATTR_Global | VarDecl::ATTR_Hidden);
+			vd->semanticName = "";
+			vd->semanticIndex = -1;
+			vds->AppendChild(vd);
+			numRemoved++;
+		}
+	}
+	return numRemoved;
+}
+
 static void GLSLPostConvert(AST& ast, const Info& info)
 {
 	if (info.outputFlags & (HOC_OF_GLSL_RENAME_SAMPLERS|HOC_OF_GLSL_RENAME_CBUFFERS))
@@ -3558,6 +3988,138 @@ static void GLSLPostConvert(AST& ast, const Info& info)
 	}
 }
 
+static int NumLayoutLocations(const ASTType* t)
+{
+	if (t->kind == ASTType::Array)
+		return int(t->elementCount) * NumLayoutLocations(t->subType);
+	if (t->kind == ASTType::Matrix)
+		return t->sizeX; // one location per column
+	return 1;
+}
+
+// VS inputs get consecutive locations in declaration order, PS color outputs use the semantic index
+// - varyings have no locations (not in core GLSL 3.30/ES 3.00), they are linked by their semantic-based names
+static void AssignLayoutLocations(AST& ast)
+{
+	int nextLocation = 0;
+	for (ASTNode* g = ast.globalVars.firstChild; g; g = g->next)
+	{
+		auto* vd = g->ToVarDecl();
+		if (!vd || !(vd->flags & VarDecl::ATTR_StageIO) || (vd->flags & VarDecl::ATTR_Hidden))
+			continue;
+		if (ast.stage == ShaderStage_Vertex && (vd->flags & VarDecl::ATTR_In))
+		{
+			vd->regID = nextLocation;
+			nextLocation += NumLayoutLocations(vd->GetType());
+		}
+		else if (ast.stage == ShaderStage_Pixel && (vd->flags & VarDecl::ATTR_Out) &&
+			(vd->semanticName == "COLOR" || vd->semanticName == "SV_TARGET"))
+		{
+			vd->regID = vd->GetSemanticIndex();
+		}
+	}
+}
+
+// SPIR-V has no name-based linkage, so varying locations only depend on the semantic
+// - each stage can be compiled separately and keep any subset of the varyings
+// - types that take multiple locations also take the following semantic indices, like in D3D
+// - the common SM3 pixel shader inputs (COLOR0-1, TEXCOORD0-7) fit in the first 10 locations, all fit in 32
+struct VaryingLocationRange
+{
+	const char* semanticName;
+	int firstLocation;
+	int count;
+};
+static const VaryingLocationRange g_varyingLocationRanges[] =
+{
+	{ "COLOR",    0,  2 },
+	{ "TEXCOORD", 2,  16 },
+	{ "FOG",      18, 1 },
+	{ "NORMAL",   19, 4 },
+	{ "TANGENT",  23, 2 },
+	{ "BINORMAL", 25, 2 },
+};
+
+static int GetVaryingLocation(const String& semanticName, int semanticIndex, int numLocations)
+{
+	for (const auto& r : g_varyingLocationRanges)
+	{
+		if (semanticName == r.semanticName)
+			return semanticIndex + numLocations <= r.count ? r.firstLocation + semanticIndex : -1;
+	}
+	return -1;
+}
+
+static void AssignVaryingLocations(AST& ast, const Info& info)
+{
+	uint32_t ioFlag = ast.stage == ShaderStage_Vertex ? VarDecl::ATTR_Out : VarDecl::ATTR_In;
+	uint32_t usedLocations = 0;
+	for (ASTNode* g = ast.globalVars.firstChild; g; g = g->next)
+	{
+		auto* vd = g->ToVarDecl();
+		if (!vd || !(vd->flags & VarDecl::ATTR_StageIO) || (vd->flags & VarDecl::ATTR_Hidden) ||
+			!IsVaryingDecl(vd, ioFlag))
+			continue;
+		int numLocations = NumLayoutLocations(vd->GetType());
+		int location = -1;
+		if (vd->semanticName == "PACK")
+		{
+			// a pack takes the lowest location of the varyings in it, which no other varying can use
+			// (the layout is shared by both stages, even if one of them does not use all of it)
+			for (const auto& apd : ast.varyingPackLayout)
+			{
+				if (apd.name != vd->name)
+					continue;
+				int loc = GetVaryingLocation(apd.semanticName, apd.GetSemanticIndex(), 1);
+				if (loc < 0)
+				{
+					location = -1;
+					break;
+				}
+				if (location < 0 || loc < location)
+					location = loc;
+			}
+		}
+		else
+			location = GetVaryingLocation(vd->semanticName, vd->GetSemanticIndex(), numLocations);
+		if (location < 0)
+		{
+			info.diag.EmitError("varying semantic has no SPIR-V location"
+				" (supported: COLOR0-1, TEXCOORD0-15, FOG, NORMAL0-3, TANGENT0-1, BINORMAL0-1)", vd->loc);
+			continue;
+		}
+		uint32_t mask = ((1u << numLocations) - 1) << location;
+		if (usedLocations & mask)
+		{
+			info.diag.EmitError("varying semantic overlaps with another varying", vd->loc);
+			continue;
+		}
+		usedLocations |= mask;
+		vd->regID = location;
+	}
+}
+
+// Vulkan has no uniforms outside of blocks, the loose ones are moved to the $Globals block
+static void MoveLooseUniformsToBlock(AST& ast)
+{
+	CBufferDecl* globalsBlock = nullptr;
+	for (ASTNode* g = ast.globalVars.firstChild; g; )
+	{
+		auto* vd = g->ToVarDecl();
+		g = g->next;
+		if (!vd || (vd->flags & (VarDecl::ATTR_Uniform | VarDecl::ATTR_Static)) != VarDecl::ATTR_Uniform ||
+			vd->GetType()->IsSampler())
+			continue;
+		if (!globalsBlock)
+		{
+			globalsBlock = new CBufferDecl;
+			globalsBlock->name = "$Globals";
+			ast.globalVars.PrependChild(globalsBlock);
+		}
+		globalsBlock->AppendChild(vd);
+	}
+}
+
 
 struct SplitTexSampleArgsPass : ASTWalker<SplitTexSampleArgsPass>
 {
@@ -3645,8 +4207,9 @@ struct SplitTexSampleArgsPass : ASTWalker<SplitTexSampleArgsPass>
 				break;
 			}
 
-			if (outputFmt == OSF_GLSL_ES_100)
+			if (outputFmt == OSF_GLSL_ES_100 || outputFmt == OSF_GLSL_ES_300)
 			{
+				// GLSL ES has no 1D textures, they are replaced with 2D textures
 				switch (op->opKind)
 				{
 				case Op_Tex1D:
@@ -3668,6 +4231,20 @@ struct SplitTexSampleArgsPass : ASTWalker<SplitTexSampleArgsPass>
 				case Op_Tex1DProj:
 					op->opKind = Op_Tex2DProj;
 					break;
+				case Op_Tex1DCmp:
+					op->opKind = Op_Tex2DCmp;
+					ConvertV1ToV2(op->GetFirstArg()->next);
+					break;
+				case Op_Tex1DLOD0Cmp:
+					op->opKind = Op_Tex2DLOD0Cmp;
+					ConvertV1ToV2(op->GetFirstArg()->next);
+					break;
+				}
+			}
+			if (outputFmt == OSF_GLSL_ES_100)
+			{
+				switch (op->opKind)
+				{
 				case Op_Tex3D:
 				case Op_Tex3DBias:
 				case Op_Tex3DGrad:
@@ -3681,7 +4258,7 @@ struct SplitTexSampleArgsPass : ASTWalker<SplitTexSampleArgsPass>
 					break;
 				}
 			}
-			else if (outputFmt == OSF_GLSL_140)
+			else if (IsGLSL(outputFmt))
 			{
 				switch (op->opKind)
 				{
@@ -3703,7 +4280,7 @@ struct SplitTexSampleArgsPass : ASTWalker<SplitTexSampleArgsPass>
 					break;
 				}
 			}
-			else if (outputFmt == OSF_HLSL_SM4)
+			else if (outputFmt == OSF_HLSL_SM4 || outputFmt == OSF_SPIRV)
 			{
 				switch (op->opKind)
 				{
@@ -3732,39 +4309,124 @@ struct SplitTexSampleArgsPass : ASTWalker<SplitTexSampleArgsPass>
 	OutputShaderFormat outputFmt;
 };
 
-static void SplitTexSampleArgs(AST& ast, Diagnostic& diag, OutputShaderFormat outputFmt)
+// half uniforms are stored with 32-bit precision (constant registers/buffers have no 16-bit layout)
+// - the variables get float types, reads are converted back to half
+// - arrays are only converted if every use is indexed
+struct UniformStorageConversion : ASTWalker<UniformStorageConversion>
 {
-	if (outputFmt == OSF_GLSL_ES_100)
+	UniformStorageConversion(AST& a) : ast(a) {}
+	ASTType* GetStorageType(ASTType* t)
 	{
-		// replace sampler1D with sampler2D for GLSL ES 1.0
-		auto* typeS1D = ast.GetSampler1DType();
-		auto* typeS2D = ast.GetSampler2DType();
-		while (typeS1D->firstUse)
-			typeS1D->firstUse->ChangeAssocType(typeS2D);
+		switch (t->kind)
+		{
+		case ASTType::Float16: return ast.GetFloat32Type();
+		case ASTType::Vector:
+			return t->subType->kind == ASTType::Float16 ? ast.GetFloat32VecType(t->sizeX) : nullptr;
+		case ASTType::Matrix:
+			return t->subType->kind == ASTType::Float16 ? ast.GetFloat32MtxType(t->sizeX, t->sizeY) : nullptr;
+		case ASTType::Array:
+			if (ASTType* elt = GetStorageType(t->subType))
+				return ast.GetArrayType(elt, t->elementCount);
+			return nullptr;
+		default:
+			return nullptr;
+		}
 	}
-	SplitTexSampleArgsPass(ast, diag, outputFmt).VisitAST(ast);
-}
-
-
-static void ReplaceVM1Type(AST& ast, ASTType* type)
-{
-	// cast all return/declaration types in code
-	ASTType* scalarType = ast.CastToScalar(type);
-	while (type->firstUse)
-		type->firstUse->ChangeAssocType(scalarType);
-}
-
-static void ReplaceM1DType(AST& ast, ASTType* type, bool useY)
-{
-	// cast all return/declaration types in code
-	ASTType* scalarType = ast.CastToScalar(type);
-	ASTType* vectorType = ast.GetVectorType(scalarType, useY ? type->sizeY : type->sizeX);
-	while (type->firstUse)
-		type->firstUse->ChangeAssocType(vectorType);
-}
-
-static void RemoveVM1AndM1DTypes(AST& ast)
-{
+	void VisitGlobal(VarDecl* vd)
+	{
+		if ((vd->flags & VarDecl::ATTR_Uniform) && GetStorageType(vd->GetType()))
+		{
+			vd->optSlot = int(uniforms.size());
+			uniforms.push_back(vd);
+			convertible.push_back(true);
+		}
+	}
+	void PreVisit(ASTNode* node)
+	{
+		if (auto* dre = dyn_cast<DeclRefExpr>(node))
+		{
+			if (dre->decl->optSlot < 0)
+				return;
+			if (dre->GetReturnType()->kind == ASTType::Array)
+			{
+				auto* idx = dyn_cast<IndexExpr>(dre->parent);
+				if (!idx || idx->GetSource() != dre)
+					convertible[dre->decl->optSlot] = false;
+			}
+			refs.push_back(dre);
+		}
+	}
+	void RunOnAST()
+	{
+		VisitAST(ast);
+		for (DeclRefExpr* dre : refs)
+		{
+			VarDecl* vd = dre->decl;
+			if (!convertible[vd->optSlot])
+				continue;
+			ASTType* halfType = dre->GetReturnType();
+			ASTType* storageType = GetStorageType(halfType);
+			dre->SetReturnType(storageType);
+			if (halfType->kind == ASTType::Array)
+			{
+				auto* idx = dre->parent->ToExpr();
+				idx->SetReturnType(storageType->subType);
+				CastExprTo(idx, halfType->subType);
+			}
+			else
+				CastExprTo(dre, halfType);
+		}
+		for (size_t i = 0; i < uniforms.size(); ++i)
+		{
+			if (convertible[i])
+				uniforms[i]->SetType(GetStorageType(uniforms[i]->GetType()));
+			uniforms[i]->optSlot = -1;
+		}
+	}
+
+	AST& ast;
+	Array<VarDecl*> uniforms; // optSlot = index
+	Array<bool> convertible;
+	Array<DeclRefExpr*> refs;
+};
+
+static void SplitTexSampleArgs(AST& ast, Diagnostic& diag, OutputShaderFormat outputFmt)
+{
+	if (outputFmt == OSF_GLSL_ES_100 || outputFmt == OSF_GLSL_ES_300)
+	{
+		// replace sampler1D with sampler2D for GLSL ES
+		auto* typeS1D = ast.GetSampler1DType();
+		auto* typeS2D = ast.GetSampler2DType();
+		while (typeS1D->firstUse)
+			typeS1D->firstUse->ChangeAssocType(typeS2D);
+		auto* typeS1DCmp = ast.GetSampler1DCmpType();
+		auto* typeS2DCmp = ast.GetSampler2DCmpType();
+		while (typeS1DCmp->firstUse)
+			typeS1DCmp->firstUse->ChangeAssocType(typeS2DCmp);
+	}
+	SplitTexSampleArgsPass(ast, diag, outputFmt).VisitAST(ast);
+}
+
+
+static void ReplaceVM1Type(AST& ast, ASTType* type)
+{
+	// cast all return/declaration types in code
+	ASTType* scalarType = ast.CastToScalar(type);
+	while (type->firstUse)
+		type->firstUse->ChangeAssocType(scalarType);
+}
+
+static void ReplaceM1DType(AST& ast, ASTType* type, bool useY)
+{
+	// cast all return/declaration types in code
+	ASTType* scalarType = ast.CastToScalar(type);
+	ASTType* vectorType = ast.GetVectorType(scalarType, useY ? type->sizeY : type->sizeX);
+	while (type->firstUse)
+		type->firstUse->ChangeAssocType(vectorType);
+}
+
+static void RemoveVM1AndM1DTypes(AST& ast)
+{
 	ReplaceVM1Type(ast, ast.GetBoolVecType(1));
 	ReplaceVM1Type(ast, ast.GetInt32VecType(1));
 	ReplaceVM1Type(ast, ast.GetFloat16VecType(1));
@@ -3899,6 +4561,691 @@ struct RenameGLSLKeywords : ASTWalker<RenameGLSLKeywords>
 	}
 };
 
+// declares GLSL ES variables mediump when that cannot change the results
+// - every value is tracked as an interval, the magnitude of its finest term and the number of rounding steps
+// - mediump is assumed to guarantee the range +-2^14 and the relative precision 2^-10 (GLSL ES 1.00 4.5.2)
+// - statements are interpreted in order, loops until the variables stop changing (widened to unknown after a few passes)
+// - varyings, uniforms, arguments and integers are unknown, texture samples are in [-2;2] (lowp samplers)
+// - variables used in texture coordinates or periodic/exponential functions keep the default precision
+// - expressions that only use mediump variables are evaluated at mediump, so they are checked as well
+struct GLSLPrecisionInference
+{
+	enum Prec
+	{
+		Prec_None, // constants
+		Prec_Low, // mediump candidates
+		Prec_High,
+	};
+
+	struct Value
+	{
+		static Value Empty() { Value v; v.empty = true; return v; }
+		static Value Unknown(uint8_t prec = Prec_High) { Value v; v.known = false; v.prec = prec; return v; }
+		static Value Range(double lo, double hi, uint8_t prec = Prec_None)
+		{
+			Value v;
+			v.lo = lo;
+			v.hi = hi;
+			v.scale = v.fine = MaxAbs(lo, hi);
+			v.prec = prec;
+			return v;
+		}
+		bool operator == (const Value& o) const
+		{
+			return known == o.known && empty == o.empty && prec == o.prec &&
+				(!known || empty || (lo == o.lo && hi == o.hi && scale == o.scale && fine == o.fine && ops == o.ops));
+		}
+
+		double lo = 0;
+		double hi = 0;
+		double scale = 0; // magnitude that the rounding errors are relative to
+		double fine = 0; // magnitude of the smallest term that must be preserved (0 if there are none)
+		int ops = 0; // rounding steps
+		uint8_t prec = Prec_None;
+		bool known = true;
+		bool empty = false; // no values
+	};
+
+	struct State
+	{
+		bool reachable = true;
+		Array<Value> vars; // by candidate slot
+	};
+
+	struct LoopContext
+	{
+		LoopContext() { brk.reachable = false; cont.reachable = false; }
+		State brk;
+		State cont;
+	};
+
+	static double MaxAbs(double a, double b) { return std::max(fabs(a), fabs(b)); }
+	static double MinFine(double a, double b) { return a == 0 ? b : b == 0 ? a : std::min(a, b); }
+	static uint8_t MaxPrec(const Value& a, const Value& b) { return std::max(a.prec, b.prec); }
+	static int AddOps(int a, int b) { return std::min(a + b + 1, 0x10000); }
+	static bool Fits(const Value& v)
+	{
+		if (v.empty)
+			return true;
+		if (!v.known || v.scale > 16384)
+			return false;
+		return v.scale == 0 ||
+			(v.fine >= 1.0 / 16384 && v.fine >= v.scale * std::max(v.ops, 1) / 1024);
+	}
+
+	static Value Join(const Value& a, const Value& b)
+	{
+		if (a.empty)
+			return b;
+		if (b.empty)
+			return a;
+		if (!a.known || !b.known)
+			return Value::Unknown(MaxPrec(a, b));
+		Value v;
+		v.lo = std::min(a.lo, b.lo);
+		v.hi = std::max(a.hi, b.hi);
+		v.scale = std::max(a.scale, b.scale);
+		v.fine = MinFine(a.fine, b.fine);
+		v.ops = std::max(a.ops, b.ops);
+		v.prec = MaxPrec(a, b);
+		return v;
+	}
+	static Value Neg(const Value& a)
+	{
+		Value v = a;
+		v.lo = -a.hi;
+		v.hi = -a.lo;
+		return v;
+	}
+	static Value Add(const Value& a, const Value& b)
+	{
+		if (!a.known || !b.known)
+			return Value::Unknown(MaxPrec(a, b));
+		Value v;
+		v.lo = a.lo + b.lo;
+		v.hi = a.hi + b.hi;
+		v.scale = std::max(std::max(a.scale, b.scale), MaxAbs(v.lo, v.hi));
+		v.fine = MinFine(a.fine, b.fine);
+		v.ops = AddOps(a.ops, b.ops);
+		v.prec = MaxPrec(a, b);
+		return v;
+	}
+	static Value Sub(const Value& a, const Value& b) { return Add(a, Neg(b)); }
+	static Value Mul(const Value& a, const Value& b)
+	{
+		if (!a.known || !b.known)
+			return Value::Unknown(MaxPrec(a, b));
+		if (a.scale == 0 || b.scale == 0)
+			return Value::Range(0, 0, MaxPrec(a, b));
+		double p0 = a.lo * b.lo, p1 = a.lo * b.hi, p2 = a.hi * b.lo, p3 = a.hi * b.hi;
+		Value v;
+		v.lo = std::min(std::min(p0, p1), std::min(p2, p3));
+		v.hi = std::max(std::max(p0, p1), std::max(p2, p3));
+		v.scale = a.scale * b.scale;
+		v.fine = std::min(a.fine * b.scale, b.fine * a.scale);
+		v.ops = AddOps(a.ops, b.ops);
+		v.prec = MaxPrec(a, b);
+		return v;
+	}
+	static Value Recip(const Value& a)
+	{
+		if (!a.known || (a.lo <= 0 && a.hi >= 0))
+			return Value::Unknown(a.prec);
+		Value v;
+		v.lo = 1 / a.hi;
+		v.hi = 1 / a.lo;
+		v.scale = MaxAbs(v.lo, v.hi);
+		v.fine = a.fine / a.scale * v.scale;
+		v.ops = AddOps(a.ops, 0);
+		v.prec = a.prec;
+		return v;
+	}
+	static Value Div(const Value& a, const Value& b) { return Mul(a, Recip(b)); }
+	static Value Sqrt(const Value& a)
+	{
+		if (!a.known || a.hi < 0)
+			return Value::Unknown(a.prec);
+		Value v;
+		v.lo = sqrt(std::max(a.lo, 0.0));
+		v.hi = sqrt(a.hi);
+		v.scale = sqrt(a.scale);
+		v.fine = a.scale != 0 ? a.fine / a.scale * v.scale : 0;
+		v.ops = AddOps(a.ops, 0);
+		v.prec = a.prec;
+		return v;
+	}
+	static Value Abs(const Value& a)
+	{
+		if (!a.known || a.lo >= 0)
+			return a;
+		if (a.hi <= 0)
+			return Neg(a);
+		Value v = a;
+		v.lo = 0;
+		v.hi = MaxAbs(a.lo, a.hi);
+		return v;
+	}
+	static Value MinMax(const Value& a, const Value& b, bool isMax)
+	{
+		if (!a.known || !b.known)
+			return Value::Unknown(MaxPrec(a, b));
+		Value v = Join(a, b);
+		v.lo = isMax ? std::max(a.lo, b.lo) : std::min(a.lo, b.lo);
+		v.hi = isMax ? std::max(a.hi, b.hi) : std::min(a.hi, b.hi);
+		return v;
+	}
+	static Value Dot(const Value& a, const Value& b, int n)
+	{
+		Value p = Mul(a, b);
+		Value v = p;
+		for (int i = 1; i < n; ++i)
+			v = Add(v, p);
+		return v;
+	}
+	static Value Length(const Value& a, int n) { return Sqrt(Dot(a, a, n)); }
+	static Value Normalize(const Value& a, int n)
+	{
+		Value d = Dot(a, a, n);
+		if (!d.known || (d.prec == Prec_Low && !Fits(d)) || a.scale == 0)
+			return Value::Unknown(d.prec);
+		Value v = Value::Range(-1, 1, a.prec);
+		v.fine = a.fine / a.scale;
+		v.ops = AddOps(d.ops, 1);
+		return v;
+	}
+	static Value Integers(const Value& a)
+	{
+		if (!a.known)
+			return a;
+		Value v = Value::Range(floor(a.lo), ceil(a.hi), a.prec);
+		v.fine = v.scale != 0 ? 1 : 0;
+		return v;
+	}
+	static int GetVecSize(const Expr* e)
+	{
+		const ASTType* t = e->GetReturnType();
+		return t->kind == ASTType::Vector ? t->sizeX : t->kind == ASTType::Matrix ? std::max(t->sizeX, t->sizeY) : 1;
+	}
+	static bool IsFloat32Based(const ASTType* t)
+	{
+		return t->kind == ASTType::Float32 ||
+			((t->kind == ASTType::Vector || t->kind == ASTType::Matrix) && t->subType->kind == ASTType::Float32);
+	}
+	static bool NeedsHighArgs(OpKind op)
+	{
+		switch (op)
+		{
+		case Op_ACos: case Op_ASin: case Op_ATan: case Op_ATan2: case Op_Ceil: case Op_Cos: case Op_CosH:
+		case Op_Exp: case Op_Exp2: case Op_Floor: case Op_FMod: case Op_Frac: case Op_LdExp: case Op_Log:
+		case Op_Log10: case Op_Log2: case Op_ModGLSL: case Op_Modulus: case Op_Pow: case Op_Round: case Op_Sin:
+		case Op_SinH: case Op_SmoothStep: case Op_Tan: case Op_TanH: case Op_Trunc:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	void AddCandidate(VarDecl* vd)
+	{
+		vd->optSlot = int(candidates.size());
+		candidates.push_back(vd);
+		isHigh.push_back(false);
+	}
+	void MarkHigh(VarDecl* vd)
+	{
+		if (vd && vd->optSlot >= 0 && !isHigh[vd->optSlot])
+		{
+			isHigh[vd->optSlot] = true;
+			changed = true;
+		}
+	}
+	void MarkAllHigh(ASTNode* node)
+	{
+		if (auto* dre = dyn_cast<DeclRefExpr>(node))
+			MarkHigh(dre->decl);
+		for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+			MarkAllHigh(ch);
+	}
+	static VarDecl* GetWrittenVar(Expr* e)
+	{
+		while (auto* sve = dyn_cast<SubValExpr>(e))
+			e = sve->GetSource();
+		auto* dre = dyn_cast<DeclRefExpr>(e);
+		return dre ? dre->decl : nullptr;
+	}
+	void CollectCandidates(ASTNode* node)
+	{
+		if (auto* vd = dyn_cast<VarDecl>(node))
+		{
+			if (dyn_cast<VarDeclStmt>(vd->parent) && IsFloat32Based(vd->GetType()))
+				AddCandidate(vd);
+		}
+		for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+			CollectCandidates(ch);
+	}
+	void MarkHighUses(ASTNode* node)
+	{
+		if (auto* op = dyn_cast<OpExpr>(node))
+		{
+			if (op->opKind == Op_FCall)
+			{
+				// written by out arguments
+				for (ASTNode* arg = op->GetFirstArg(); arg; arg = arg->next)
+					MarkHigh(GetWrittenVar(arg->ToExpr()));
+			}
+			else if (op->opKind >= Op_Tex1D && op->opKind < Op_COUNT)
+			{
+				// texture coordinates need the full precision
+				for (ASTNode* arg = op->GetFirstArg()->next; arg; arg = arg->next)
+					MarkAllHigh(arg);
+			}
+			else if (NeedsHighArgs(op->opKind))
+				MarkAllHigh(op);
+		}
+		else if (auto* incdec = dyn_cast<IncDecOpExpr>(node))
+			MarkHigh(GetWrittenVar(incdec->GetSource()));
+		else if (auto* binop = dyn_cast<BinaryOpExpr>(node))
+		{
+			if (binop->opType == STT_OP_Mod || binop->opType == STT_OP_ModEq)
+				MarkAllHigh(binop);
+		}
+		else if (auto* cast = dyn_cast<CastExpr>(node))
+		{
+			// float -> int conversions
+			if (cast->GetReturnType()->IsIntBased() && cast->GetSource()->GetReturnType()->IsFloatBased())
+				MarkAllHigh(cast);
+		}
+		for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+			MarkHighUses(ch);
+	}
+
+	void Store(Expr* dst, const Value& val)
+	{
+		VarDecl* vd = GetWrittenVar(dst);
+		if (!vd || vd->optSlot < 0)
+			return;
+		Value v = val;
+		v.prec = Prec_None;
+		if (!Fits(v))
+			MarkHigh(vd);
+		stored[vd->optSlot] = Join(stored[vd->optSlot], v);
+		Value& cv = cur.vars[vd->optSlot];
+		cv = dyn_cast<DeclRefExpr>(dst) ? v : Join(cv, v);
+	}
+	Value Arith(SLTokenType op, const Value& a, const Value& b)
+	{
+		switch (op)
+		{
+		case STT_OP_Add: case STT_OP_AddEq: return Add(a, b);
+		case STT_OP_Sub: case STT_OP_SubEq: return Sub(a, b);
+		case STT_OP_Mul: case STT_OP_MulEq: return Mul(a, b);
+		case STT_OP_Div: case STT_OP_DivEq: return Div(a, b);
+		case STT_OP_Assign: return b;
+		default: return Value::Unknown(MaxPrec(a, b));
+		}
+	}
+	Value EvalBranch(Expr* e, State& outState)
+	{
+		State saved = cur;
+		Value v = Eval(e);
+		outState = cur;
+		cur = saved;
+		return v;
+	}
+	Value Eval(Expr* e)
+	{
+		int prevNumFailed = numFailed;
+		Value v = EvalInner(e);
+		// evaluated at mediump, only the innermost failing expressions are changed (the rest is retried in the next pass)
+		if (v.prec == Prec_Low && !Fits(v) && numFailed == prevNumFailed)
+		{
+			MarkAllHigh(e);
+			numFailed++;
+		}
+		return v;
+	}
+	Value EvalInner(Expr* e)
+	{
+		if (auto* dre = dyn_cast<DeclRefExpr>(e))
+		{
+			const VarDecl* vd = dre->decl;
+			if (vd->optSlot >= 0)
+			{
+				Value v = cur.vars[vd->optSlot];
+				v.prec = isHigh[vd->optSlot] ? Prec_High : Prec_Low;
+				return v;
+			}
+			if (vd->GetType()->IsBoolBased())
+				return Value::Range(0, 1);
+			return Value::Unknown();
+		}
+		if (auto* be = dyn_cast<BoolExpr>(e))
+			return Value::Range(be->value, be->value);
+		if (auto* i32 = dyn_cast<Int32Expr>(e))
+			return Value::Range(i32->value, i32->value);
+		if (auto* f32 = dyn_cast<Float32Expr>(e))
+			return Value::Range(f32->value, f32->value);
+		if (auto* cast = dyn_cast<CastExpr>(e))
+		{
+			Value v = Eval(cast->GetSource());
+			return cast->GetReturnType()->IsBoolBased() ? Value::Range(0, 1) : v;
+		}
+		if (auto* ile = dyn_cast<InitListExpr>(e))
+		{
+			Value v = Value::Empty();
+			for (ASTNode* ch = ile->firstChild; ch; ch = ch->next)
+				v = Join(v, Eval(ch->ToExpr()));
+			return v.empty ? Value::Unknown() : v;
+		}
+		if (auto* mmb = dyn_cast<MemberExpr>(e))
+		{
+			Value v = Eval(mmb->GetSource());
+			return mmb->swizzleComp ? v : Value::Unknown();
+		}
+		if (auto* idx = dyn_cast<IndexExpr>(e))
+		{
+			Eval(idx->GetIndex());
+			return Eval(idx->GetSource());
+		}
+		if (auto* unop = dyn_cast<UnaryOpExpr>(e))
+		{
+			Value v = Eval(unop->GetSource());
+			switch (unop->opType)
+			{
+			case STT_OP_Add: return v;
+			case STT_OP_Sub: return Neg(v);
+			case STT_OP_Not: return Value::Range(0, 1);
+			default: return Value::Unknown(std::max(v.prec, uint8_t(Prec_High)));
+			}
+		}
+		if (auto* binop = dyn_cast<BinaryOpExpr>(e))
+		{
+			if (TokenIsOpAssign(binop->opType))
+			{
+				Value a = binop->opType != STT_OP_Assign ? Eval(binop->GetLft()) : Value();
+				Value v = Arith(binop->opType, a, Eval(binop->GetRgt()));
+				Store(binop->GetLft(), v);
+				return v;
+			}
+			Value a = Eval(binop->GetLft());
+			switch (binop->opType)
+			{
+			case STT_OP_LogicalAnd: case STT_OP_LogicalOr:
+				{
+					State rgtState;
+					EvalBranch(binop->GetRgt(), rgtState);
+					cur = JoinStates(cur, rgtState);
+					return Value::Range(0, 1);
+				}
+			case STT_OP_Eq: case STT_OP_NEq: case STT_OP_Less: case STT_OP_LEq: case STT_OP_Greater: case STT_OP_GEq:
+				Eval(binop->GetRgt());
+				return Value::Range(0, 1);
+			default:
+				return Arith(binop->opType, a, Eval(binop->GetRgt()));
+			}
+		}
+		if (auto* tern = dyn_cast<TernaryOpExpr>(e))
+		{
+			Eval(tern->GetCond());
+			State trueState;
+			Value t = EvalBranch(tern->GetTrueExpr(), trueState);
+			Value f = Eval(tern->GetFalseExpr());
+			cur = JoinStates(trueState, cur);
+			return Join(t, f);
+		}
+		if (auto* incdec = dyn_cast<IncDecOpExpr>(e))
+		{
+			Eval(incdec->GetSource());
+			Store(incdec->GetSource(), Value::Unknown());
+			return Value::Unknown();
+		}
+		if (auto* op = dyn_cast<OpExpr>(e))
+		{
+			Value args[3];
+			int i = 0;
+			for (ASTNode* arg = op->GetFirstArg(); arg; arg = arg->next)
+			{
+				Value v = Eval(arg->ToExpr());
+				if (i < 3)
+					args[i++] = v;
+			}
+			Value& a = args[0];
+			Value& b = args[1];
+			Value& c = args[2];
+			uint8_t prec = std::max(MaxPrec(a, b), c.prec);
+			if (op->opKind >= Op_Tex1D && op->opKind < Op_COUNT)
+			{
+				if (op->opKind >= Op_Tex1DCmp)
+					return Value::Range(0, 1);
+				if (op->opKind >= Op_Tex3D && op->opKind <= Op_Tex3DProj)
+					return Value::Unknown(); // sampler3D has no default precision
+				return Value::Range(-2, 2);
+			}
+			switch (op->opKind)
+			{
+			case Op_FCall:
+				for (ASTNode* arg = op->GetFirstArg(); arg; arg = arg->next)
+					Store(arg->ToExpr(), Value::Unknown());
+				return Value::Unknown();
+			case Op_Add: return Add(a, b);
+			case Op_Subtract: return Sub(a, b);
+			case Op_Multiply: return Mul(a, b);
+			case Op_Divide: return Div(a, b);
+			case Op_Abs: return Abs(a);
+			case Op_All: case Op_Any: case Op_IsFinite: case Op_IsInf: case Op_IsNaN: case Op_Step:
+				return Value::Range(0, 1);
+			case Op_Sign: return Value::Range(-1, 1);
+			case Op_Ceil: case Op_Floor: case Op_Round: case Op_Trunc: return Integers(a);
+			case Op_Clamp: return MinMax(MinMax(a, b, true), c, false);
+			case Op_Saturate: return MinMax(MinMax(a, Value::Range(0, 0), true), Value::Range(1, 1), false);
+			case Op_Min: return MinMax(a, b, false);
+			case Op_Max: return MinMax(a, b, true);
+			case Op_Cos: case Op_Sin: case Op_TanH: return Value::Range(-1, 1, prec);
+			case Op_Frac: case Op_SmoothStep: return Value::Range(0, 1, prec);
+			case Op_ACos: return Value::Range(0, 3.15, prec);
+			case Op_ASin: case Op_ATan: return Value::Range(-1.58, 1.58, prec);
+			case Op_ATan2: return Value::Range(-3.15, 3.15, prec);
+			case Op_Cross: return Sub(Mul(a, b), Mul(a, b));
+			case Op_Distance: return Length(Sub(a, b), GetVecSize(op->GetLft()));
+			case Op_Dot: return Dot(a, b, GetVecSize(op->GetLft()));
+			case Op_Length: return Length(a, GetVecSize(op->GetSource()));
+			case Op_Lerp: return Add(a, Mul(c, Sub(b, a)));
+			case Op_MulMM: case Op_MulMV: return Dot(a, b, GetVecSize(op->GetLft()));
+			case Op_MulVM: return Dot(a, b, GetVecSize(op->GetRgt()));
+			case Op_Normalize: return Normalize(a, GetVecSize(op->GetSource()));
+			case Op_Reflect: return Sub(a, Mul(Mul(Value::Range(2, 2), Dot(a, b, GetVecSize(op->GetLft()))), b));
+			case Op_FaceForward: return Join(a, Neg(a));
+			case Op_RSqrt: return Recip(Sqrt(a));
+			case Op_Sqrt: return Sqrt(a);
+			case Op_Transpose: return a;
+			case Op_Degrees: return Mul(a, Value::Range(180 / M_PI, 180 / M_PI));
+			case Op_Radians: return Mul(a, Value::Range(M_PI / 180, M_PI / 180));
+			default:
+				return Value::Unknown(std::max(prec, uint8_t(Prec_High)));
+			}
+		}
+		for (ASTNode* ch = e->firstChild; ch; ch = ch->next)
+			if (auto* sub = dyn_cast<Expr>(ch))
+				Eval(sub);
+		return Value::Unknown();
+	}
+
+	static State JoinStates(const State& a, const State& b)
+	{
+		if (!a.reachable)
+			return b;
+		if (!b.reachable)
+			return a;
+		State s = a;
+		for (size_t i = 0; i < s.vars.size(); ++i)
+			s.vars[i] = Join(a.vars[i], b.vars[i]);
+		return s;
+	}
+	static bool StatesEqual(const State& a, const State& b)
+	{
+		if (a.reachable != b.reachable)
+			return false;
+		for (size_t i = 0; i < a.vars.size(); ++i)
+			if (!(a.vars[i] == b.vars[i]))
+				return false;
+		return true;
+	}
+	void ExecLoop(Expr* cond, Stmt* body, Expr* incr, bool condFirst)
+	{
+		State entry = cur;
+		State head = entry;
+		for (int iter = 0;; ++iter)
+		{
+			cur = head;
+			loops.push_back(LoopContext());
+			State exitState;
+			exitState.reachable = false;
+			if (condFirst && cond)
+			{
+				Eval(cond);
+				exitState = cur;
+			}
+			if (body)
+				Exec(body);
+			cur = JoinStates(cur, loops.back().cont);
+			if (!condFirst && cond)
+			{
+				Eval(cond);
+				exitState = cur;
+			}
+			if (incr)
+				Eval(incr);
+			exitState = JoinStates(exitState, loops.back().brk);
+			loops.pop_back();
+
+			State next = JoinStates(entry, cur);
+			if (StatesEqual(next, head))
+			{
+				cur = exitState;
+				return;
+			}
+			if (iter >= 8)
+			{
+				// the values keep growing, accumulation in loops is not bounded
+				for (size_t i = 0; i < next.vars.size(); ++i)
+					if (!(next.vars[i] == head.vars[i]))
+						next.vars[i] = Value::Unknown(Prec_None);
+			}
+			head = next;
+		}
+	}
+	void Exec(Stmt* s)
+	{
+		if (!s || !cur.reachable)
+			return;
+		if (auto* blk = dyn_cast<BlockStmt>(s))
+		{
+			for (ASTNode* ch = blk->firstChild; ch; ch = ch->next)
+				Exec(ch->ToStmt());
+		}
+		else if (auto* es = dyn_cast<ExprStmt>(s))
+			Eval(es->GetExpr());
+		else if (auto* vds = dyn_cast<VarDeclStmt>(s))
+		{
+			for (ASTNode* ch = vds->firstChild; ch; ch = ch->next)
+			{
+				VarDecl* vd = ch->ToVarDecl();
+				Value v = vd->GetInitExpr() ? Eval(vd->GetInitExpr()) : Value::Unknown(Prec_None);
+				if (vd->optSlot >= 0)
+				{
+					if (vd->GetInitExpr())
+					{
+						v.prec = Prec_None;
+						if (!Fits(v))
+							MarkHigh(vd);
+						stored[vd->optSlot] = Join(stored[vd->optSlot], v);
+					}
+					cur.vars[vd->optSlot] = v;
+				}
+			}
+		}
+		else if (auto* ifelse = dyn_cast<IfElseStmt>(s))
+		{
+			Eval(ifelse->GetCond());
+			State saved = cur;
+			Exec(ifelse->GetTrueBr());
+			State trueState = cur;
+			cur = saved;
+			Exec(ifelse->GetFalseBr());
+			cur = JoinStates(trueState, cur);
+		}
+		else if (auto* whilestmt = dyn_cast<WhileStmt>(s))
+			ExecLoop(whilestmt->GetCond(), whilestmt->GetBody(), nullptr, true);
+		else if (auto* dowhile = dyn_cast<DoWhileStmt>(s))
+			ExecLoop(dowhile->GetCond(), dowhile->GetBody(), nullptr, false);
+		else if (auto* forstmt = dyn_cast<ForStmt>(s))
+		{
+			Exec(forstmt->GetInit());
+			ExecLoop(forstmt->GetCond(), forstmt->GetBody(), forstmt->GetIncr(), true);
+		}
+		else if (auto* ret = dyn_cast<ReturnStmt>(s))
+		{
+			if (ret->GetExpr())
+				Eval(ret->GetExpr());
+			cur.reachable = false;
+		}
+		else if (dyn_cast<DiscardStmt>(s))
+			cur.reachable = false;
+		else if (dyn_cast<BreakStmt>(s) || dyn_cast<ContinueStmt>(s))
+		{
+			if (!loops.empty())
+			{
+				State& dst = dyn_cast<BreakStmt>(s) ? loops.back().brk : loops.back().cont;
+				dst = JoinStates(dst, cur);
+			}
+			cur.reachable = false;
+		}
+	}
+
+	int RunOnAST(AST& ast)
+	{
+		for (ASTNode* fn = ast.functionList.firstChild; fn; fn = fn->next)
+			CollectCandidates(fn);
+		for (ASTNode* fn = ast.functionList.firstChild; fn; fn = fn->next)
+			MarkHighUses(fn);
+
+		do
+		{
+			changed = false;
+			stored.clear();
+			stored.resize(candidates.size(), Value::Empty());
+			for (ASTNode* fn = ast.functionList.firstChild; fn; fn = fn->next)
+			{
+				cur.reachable = true;
+				cur.vars.clear();
+				cur.vars.resize(candidates.size(), Value::Unknown(Prec_None));
+				Exec(static_cast<ASTFunction*>(fn)->GetCode());
+			}
+		}
+		while (changed);
+
+		int numDemoted = 0;
+		for (size_t i = 0; i < candidates.size(); ++i)
+		{
+			candidates[i]->optSlot = -1;
+			if (!isHigh[i])
+			{
+				candidates[i]->precision = VarDecl::Prec_Medium;
+				numDemoted++;
+			}
+		}
+		return numDemoted;
+	}
+
+	Array<VarDecl*> candidates; // optSlot = index
+	Array<bool> isHigh;
+	Array<Value> stored; // all values stored in each candidate
+	Array<LoopContext> loops;
+	State cur;
+	int numFailed = 0;
+	bool changed = false;
+};
+
 
 static unsigned GetNumSlots(ASTType* type)
 {
@@ -4078,6 +5425,182 @@ static void SpecifyGlobalRegisters(AST& ast, const Info& info)
 	}
 }
 
+// shares c# registers between global uniforms with less than 4 components (HLSL SM3)
+// - uniforms are packed like varyings, biggest first, each one within a single register
+// - packs are assigned registers around the explicitly specified ones
+// - uniforms that do not share a register with another one are left as they are
+struct UniformPacker : ASTWalker<UniformPacker>
+{
+	struct Uniform
+	{
+		VarDecl* vd;
+		int numComps;
+		int pack;
+		int firstComp;
+	};
+
+	UniformPacker(AST& a, bool bs) : ast(a), bufferSlots(bs) {}
+	bool IsPackable(const VarDecl* vd)
+	{
+		if ((vd->flags & (VarDecl::ATTR_Uniform | VarDecl::ATTR_Static)) != VarDecl::ATTR_Uniform ||
+			vd->regID >= 0 || vd->GetInitExpr())
+			return false;
+		for (const auto& apd : ast.preshaderOutputs)
+			if (apd.name == vd->name)
+				return false;
+		const ASTType* t = vd->GetType();
+		return t->IsFloat() ||
+			(t->kind == ASTType::Vector && t->subType->IsFloat() && t->sizeX < 4);
+	}
+	void PostVisit(ASTNode* node)
+	{
+		auto* dre = dyn_cast<DeclRefExpr>(node);
+		if (!dre || !dre->decl || dre->decl->optSlot < 0 || !(dre->decl->flags & VarDecl::ATTR_Uniform))
+			return;
+		const Uniform& u = uniforms[dre->decl->optSlot];
+		ASTType* origType = dre->GetReturnType();
+
+		VarDecl* pvd = packs[u.pack];
+		auto* pdre = new DeclRefExpr;
+		pdre->decl = pvd;
+		pdre->SetReturnType(pvd->GetType());
+		auto* swizzle = new MemberExpr;
+		swizzle->swizzleComp = u.numComps;
+		for (int i = 0; i < u.numComps; ++i)
+			swizzle->memberID |= uint32_t(u.firstComp + i) << (i * 2);
+		swizzle->SetReturnType(u.numComps == 1 ? ast.GetFloat32Type() : ast.GetFloat32VecType(u.numComps));
+		swizzle->AppendChild(pdre);
+		delete dre->ReplaceWith(swizzle);
+		CastExprTo(swizzle, origType);
+	}
+	void VisitGlobal(VarDecl* vd)
+	{
+		if (vd->GetInitExpr())
+			WalkNode(vd->GetInitExpr());
+	}
+	void MarkUsedRegisters(Array<uint8_t>& slots)
+	{
+		for (ASTNode* g = ast.globalVars.firstChild; g; g = g->next)
+		{
+			if (auto* cbuf = dyn_cast<CBufferDecl>(g))
+			{
+				for (ASTNode* cbv = cbuf->firstChild; cbv; cbv = cbv->next)
+				{
+					auto* vd = cbv->ToVarDecl();
+					if (vd->regID >= 0)
+					{
+						// component offsets, relative to the buffer slot if those are applied
+						unsigned firstSlot = vd->regID / 4;
+						if (bufferSlots && cbuf->bufRegID >= 0)
+							firstSlot += cbuf->bufRegID;
+						MarkSlots(slots, firstSlot, GetNumSlots(vd->GetType()));
+					}
+				}
+			}
+			else if (auto* vd = g->ToVarDecl())
+			{
+				if (vd->regID >= 0 && (vd->flags & VarDecl::ATTR_Uniform) && !vd->GetType()->IsSampler())
+					MarkSlots(slots, vd->regID, GetNumSlots(vd->GetType()));
+			}
+		}
+	}
+	int RunOnAST()
+	{
+		for (ASTNode* g = ast.globalVars.firstChild; g; g = g->next)
+		{
+			auto* vd = dyn_cast<VarDecl>(g);
+			if (vd && IsPackable(vd))
+				uniforms.push_back({ vd, int(vd->GetType()->GetElementCount()), -1, 0 });
+		}
+		std::sort(uniforms.begin(), uniforms.end(), [](const Uniform& a, const Uniform& b)
+		{
+			if (a.numComps != b.numComps)
+				return a.numComps > b.numComps;
+			return a.vd->name.compare(b.vd->name) < 0;
+		});
+		Array<int> packUsers;
+		for (auto& u : uniforms)
+		{
+			for (size_t i = 0; i < packSizes.size(); ++i)
+			{
+				if (packSizes[i] + u.numComps <= 4)
+				{
+					u.pack = int(i);
+					break;
+				}
+			}
+			if (u.pack < 0)
+			{
+				u.pack = int(packSizes.size());
+				packSizes.push_back(0);
+				packUsers.push_back(0);
+			}
+			u.firstComp = packSizes[u.pack];
+			packSizes[u.pack] += u.numComps;
+			packUsers[u.pack]++;
+		}
+
+		// drop the packs with a single user, renumber the rest
+		Array<int> packRemap;
+		int numPacks = 0;
+		for (size_t i = 0; i < packUsers.size(); ++i)
+			packRemap.push_back(packUsers[i] > 1 ? numPacks++ : -1);
+		size_t numPacked = 0;
+		for (auto& u : uniforms)
+		{
+			u.pack = packRemap[u.pack];
+			if (u.pack >= 0)
+				uniforms[numPacked++] = u;
+		}
+		uniforms.resize(numPacked);
+		if (uniforms.empty())
+			return 0;
+
+		Array<uint8_t> slots;
+		MarkUsedRegisters(slots);
+		size_t searchStart = 0;
+		for (int i = 0; i < numPacks; ++i)
+		{
+			while (searchStart < slots.size() && slots[searchStart])
+				searchStart++;
+			auto* pvd = new VarDecl;
+			ast.globalVars.AppendChild(pvd);
+			pvd->name = "UNI_PACK";
+			pvd->name += StdToString(i);
+			pvd->SetType(ast.GetFloat32VecType(4));
+			pvd->flags = VarDecl::ATTR_Uniform | VarDecl::ATTR_Global;
+			pvd->regID = int32_t(searchStart);
+			MarkSlots(slots, searchStart, 1);
+			packs.push_back(pvd);
+		}
+
+		for (size_t i = 0; i < uniforms.size(); ++i)
+		{
+			const Uniform& u = uniforms[i];
+			u.vd->optSlot = int(i);
+			u.vd->regID = packs[u.pack]->regID * 4 + u.firstComp;
+			u.vd->semanticName = packs[u.pack]->name;
+			u.vd->semanticName += ".";
+			for (int c = 0; c < u.numComps; ++c)
+				u.vd->semanticName += "xyzw"[u.firstComp + c];
+			u.vd->semanticIndex = -1;
+		}
+		VisitAST(ast);
+		for (const auto& u : uniforms)
+		{
+			u.vd->optSlot = -1;
+			ast.packedUniforms.AppendChild(u.vd);
+		}
+		return int(uniforms.size());
+	}
+
+	AST& ast;
+	bool bufferSlots;
+	Array<Uniform> uniforms; // optSlot = index
+	Array<int> packSizes;
+	Array<VarDecl*> packs;
+};
+
 static void HLSL_SM3_ApplyBufferSlots(AST& ast)
 {
 	for (auto* gv = ast.globalVars.firstChild; gv; )
@@ -4123,25 +5646,362 @@ static ShaderDataType ASTTypeKindToShaderDataType(ASTType::Kind k)
 	case ASTType::Function:
 	case ASTType::Vector:
 	case ASTType::Matrix:
-	case ASTType::Array:
+	case ASTType::Array:
+	case ASTType::Structure:
+		return SDT_None;
+	}
+	return SDT_None;
+}
+
+// read masks of uniforms for the interface output (HOC_OF_EXPORT_USAGE_MASKS)
+// - one bit per access point, VarDecl::optSlot = index of the first one
+// - constant indices and swizzles narrow down the read range, anything else reads the whole value
+struct UniformUsageAnalysis : ASTWalker<UniformUsageAnalysis>
+{
+	void PreVisit(ASTNode* node)
+	{
+		auto* dre = dyn_cast<DeclRefExpr>(node);
+		if (!dre || !dre->decl || dre->decl->optSlot < 0)
+			return;
+
+		// each base is the first access point of a copy of `t`
+		ASTType* t = dre->decl->GetType();
+		bases.clear();
+		bases.push_back(0);
+		for (Expr* e = dre; ; )
+		{
+			auto* sve = dyn_cast<SubValExpr>(e->parent);
+			if (!sve || sve->GetSource() != e)
+				break;
+			if (auto* idx = dyn_cast<IndexExpr>(sve))
+			{
+				unsigned count = t->kind == ASTType::Array ? t->elementCount
+					: t->kind == ASTType::Matrix ? t->sizeY
+					: t->kind == ASTType::Vector ? t->sizeX : 0;
+				if (!count)
+					break;
+				ASTType* sub = idx->GetReturnType();
+				unsigned stride = sub->GetAccessPointCount();
+				auto* cidx = dyn_cast<Int32Expr>(idx->GetIndex());
+				if (cidx && cidx->value >= 0 && unsigned(cidx->value) < count)
+				{
+					for (auto& b : bases)
+						b += unsigned(cidx->value) * stride;
+				}
+				else
+				{
+					newBases.clear();
+					for (auto b : bases)
+						for (unsigned i = 0; i < count; ++i)
+							newBases.push_back(b + i * stride);
+					std::swap(bases, newBases);
+				}
+				t = sub;
+			}
+			else if (auto* mmb = dyn_cast<MemberExpr>(sve))
+			{
+				if (mmb->swizzleComp)
+				{
+					if (t->kind != ASTType::Vector && t->GetAccessPointCount() != 1)
+						break;
+					newBases.clear();
+					for (auto b : bases)
+						for (int i = 0; i < mmb->swizzleComp; ++i)
+							newBases.push_back(b + ((mmb->memberID >> (i * 2)) & 3));
+					std::swap(bases, newBases);
+					t = t->kind == ASTType::Vector ? t->subType : t;
+				}
+				else if (t->kind == ASTType::Structure)
+				{
+					auto* strTy = t->ToStructType();
+					unsigned offset = 0;
+					for (uint32_t i = 0; i < mmb->memberID; ++i)
+						offset += strTy->members[i].type->GetAccessPointCount();
+					for (auto& b : bases)
+						b += offset;
+					t = strTy->members[mmb->memberID].type;
+				}
+				else
+					break;
+			}
+			else
+				break;
+			e = sve;
+		}
+
+		unsigned apc = t->GetAccessPointCount();
+		for (auto b : bases)
+			for (unsigned i = 0; i < apc; ++i)
+				bits[dre->decl->optSlot + b + i] = 1;
+	}
+	void VisitGlobal(VarDecl* vd)
+	{
+		if (vd->GetInitExpr())
+			WalkNode(vd->GetInitExpr());
+	}
+	void AddVar(VarDecl* vd)
+	{
+		if (!(vd->flags & VarDecl::ATTR_Uniform) || vd->GetType()->IsSampler())
+			return;
+		vd->optSlot = int(bits.size());
+		bits.resize(bits.size() + vd->GetType()->GetAccessPointCount(), 0);
+		vars.push_back(vd);
+	}
+	void RunOnAST(AST& ast)
+	{
+		for (ASTNode* g = ast.globalVars.firstChild; g; g = g->next)
+		{
+			if (auto* cbuf = dyn_cast<CBufferDecl>(g))
+			{
+				for (ASTNode* cbv = cbuf->firstChild; cbv; cbv = cbv->next)
+					AddVar(cbv->ToVarDecl());
+			}
+			else
+				AddVar(g->ToVarDecl());
+		}
+		VisitAST(ast);
+
+		// packed uniforms are read through their pack
+		for (ASTNode* pu = ast.packedUniforms.firstChild; pu; pu = pu->next)
+		{
+			VarDecl* vd = pu->ToVarDecl();
+			String packName = vd->semanticName.substr(0, vd->semanticName.find("."));
+			for (VarDecl* pvd : vars)
+			{
+				if (pvd->name != packName)
+					continue;
+				int packSlot = pvd->optSlot;
+				AddVar(vd);
+				for (unsigned i = 0; i < vd->GetType()->GetAccessPointCount(); ++i)
+					bits[vd->optSlot + i] = bits[packSlot + vd->regID % 4 + i];
+				break;
+			}
+		}
+	}
+	void Reset()
+	{
+		for (VarDecl* vd : vars)
+			vd->optSlot = -1;
+	}
+
+	Array<uint8_t> bits;
+	Array<VarDecl*> vars;
+	Array<uint32_t> bases;
+	Array<uint32_t> newBases;
+};
+
+static uint32_t RoundUp16(uint32_t v)
+{
+	return (v + 15) & ~15u;
+}
+
+static const ASTType* GetLayoutBaseType(const ASTType* type)
+{
+	while (type->kind == ASTType::Array)
+		type = type->subType;
+	return type;
+}
+
+uint32_t HOC::PlaceInUniformLayout(uint32_t cursor, const ASTType* type, const UniformTypeLayout& tl, UniformLayoutRules rules)
+{
+	if (rules == ULR_D3D11)
+	{
+		if (type->kind == ASTType::Array || type->kind == ASTType::Matrix || type->kind == ASTType::Structure ||
+			cursor % 16 + tl.size > 16)
+			return RoundUp16(cursor);
+		return cursor;
+	}
+	return (cursor + tl.align - 1) / tl.align * tl.align;
+}
+
+uint32_t HOC::EndOfUniformLayout(uint32_t offset, const ASTType* type, const UniformTypeLayout& tl, UniformLayoutRules rules)
+{
+	bool padded;
+	switch (rules)
+	{
+	case ULR_D3D11:
+		// structures force the next variable to start in the next register
+		padded = GetLayoutBaseType(type)->kind == ASTType::Structure;
+		break;
+	case ULR_STD140:
+		// arrays/matrices/structures are padded to their (16-byte) alignment
+		padded = type->kind == ASTType::Array || type->kind == ASTType::Matrix || type->kind == ASTType::Structure;
+		break;
+	default:
+		padded = true;
+		break;
+	}
+	return padded ? RoundUp16(offset + tl.size) : offset + tl.size;
+}
+
+UniformTypeLayout HOC::GetUniformTypeLayout(const ASTType* type, UniformLayoutRules rules, bool glsl)
+{
+	// all numeric types use 32 bits per component in uniform storage
+	UniformTypeLayout tl = { 4, rules == ULR_Registers ? 16u : 4u, 0, 0 };
+	switch (type->kind)
+	{
+	case ASTType::Bool:
+	case ASTType::Int32:
+	case ASTType::UInt32:
+	case ASTType::Float16:
+	case ASTType::Float32:
+		break;
+	case ASTType::Vector:
+		tl.size = 4 * type->sizeX;
+		if (rules == ULR_STD140)
+			tl.align = type->sizeX == 1 ? 4 : type->sizeX == 2 ? 8 : 16;
+		break;
+	case ASTType::Matrix:
+		{
+			// HLSL floatRxC is stored as C columns, GLSL matCxR has the same number of columns
+			uint32_t cols = glsl ? type->sizeX : type->sizeY;
+			uint32_t rows = glsl ? type->sizeY : type->sizeX;
+			tl.size = 16 * (cols - 1) + 4 * rows;
+			tl.align = 16;
+			tl.matrixStride = 16;
+		}
+		break;
 	case ASTType::Structure:
-		return SDT_None;
+		{
+			uint32_t cursor = 0;
+			tl.size = 0;
+			tl.align = 16;
+			for (auto& mmb : type->ToStructType()->members)
+			{
+				auto mtl = GetUniformTypeLayout(mmb.type, rules, glsl);
+				uint32_t offset = PlaceInUniformLayout(cursor, mmb.type, mtl, rules);
+				cursor = EndOfUniformLayout(offset, mmb.type, mtl, rules);
+				tl.size = offset + mtl.size;
+			}
+		}
+		break;
+	case ASTType::Array:
+		{
+			auto etl = GetUniformTypeLayout(type->subType, rules, glsl);
+			tl.arrayStride = RoundUp16(etl.size);
+			tl.size = type->elementCount ? tl.arrayStride * (type->elementCount - 1) + etl.size : 0;
+			tl.align = 16;
+			tl.matrixStride = etl.matrixStride;
+		}
+		break;
+	default:
+		tl.size = 0;
+		break;
 	}
-	return SDT_None;
+	return tl;
 }
 
 struct InterfaceOutputGenerator
 {
+	InterfaceOutputGenerator(HOC_Config* cfg, const AST& a, ShaderVariable* ov, char* osb, size_t* mbs,
+		const Array<uint8_t>* ubits = nullptr, Array<uint32_t>* uhdr = nullptr, Array<uint32_t>* udata = nullptr,
+		Array<ShaderVariableLayout>* lays = nullptr, Array<int32_t>* locs = nullptr) :
+		config(cfg), ast(a), outVars(ov), outStrBuf(osb), measureBufSizes(mbs),
+		usageBits(ubits), usageHeader(uhdr), usageData(udata), layouts(lays), locations(locs){}
+
 	HOC_Config* config;
 	const AST& ast;
 	ShaderVariable* outVars;
 	char* outStrBuf;
 	size_t* measureBufSizes; // 2 element array
+	// usage masks (UniformUsageAnalysis), collected while measuring
+	const Array<uint8_t>* usageBits;
+	Array<uint32_t>* usageHeader; // mask offsets in usageData, one for each variable
+	Array<uint32_t>* usageData;
+	Array<ShaderVariableLayout>* layouts; // one for each variable, collected while measuring
+	Array<int32_t>* locations; // one for each variable, collected while measuring
 
 	// state
-	char* outsbp;
+	char* outsbp = nullptr;
+	Array<uint32_t> usageBases; // first access points of the current variable in usageBits
+	UniformLayoutRules layoutRules;
+	bool layoutGLSL = false;       // matrix columns are GLSL columns
+	bool layoutHasOffsets = false; // in uniform block (or SM4 $Globals)
+	bool layoutEnabled = false;    // current variable is a uniform stored in memory
+	int layoutStructDepth = 0;     // struct members are placed relative to the struct
+	uint32_t layoutCursor = 0;
+	uint32_t layoutEnd = 0;
+
+	void SetUsageBases(const VarDecl* vd)
+	{
+		usageBases.clear();
+		if (usageBits && vd->optSlot >= 0)
+			usageBases.push_back(uint32_t(vd->optSlot));
+		layoutEnabled = true;
+	}
+	void AddUsageMask(const AccessPointDecl* apd)
+	{
+		if (!usageBits || !measureBufSizes)
+			return;
+		if (!apd || usageBases.empty())
+		{
+			usageHeader->push_back(0xffffffff);
+			return;
+		}
+		unsigned numBits = apd->type->GetAccessPointCount();
+		size_t first = usageData->size();
+		usageHeader->push_back(uint32_t(first));
+		usageData->resize(first + (numBits + 31) / 32, 0);
+		for (auto b : usageBases)
+			for (unsigned i = 0; i < numBits; ++i)
+				if ((*usageBits)[b + i])
+					(*usageData)[first + i / 32] |= 1u << (i % 32);
+	}
+	void BeginLayout(bool hasOffsets)
+	{
+		layoutRules = config->outputFmt == OSF_HLSL_SM4 ? ULR_D3D11
+			: IsGLSLBased((OutputShaderFormat) config->outputFmt) && config->outputFmt != OSF_GLSL_ES_100 && hasOffsets
+				? ULR_STD140
+			: ULR_Registers;
+		layoutGLSL = IsGLSLBased((OutputShaderFormat) config->outputFmt);
+		layoutHasOffsets = hasOffsets;
+		layoutCursor = 0;
+		layoutEnd = 0;
+	}
+	void AddLayout(const AccessPointDecl* apd, ShaderVarType svt, int regID, bool ub)
+	{
+		if (!layouts || !measureBufSizes)
+			return;
+		ShaderVariableLayout svl = { 0xffffffff, 0, 0, 0 };
+		if (apd && layoutEnabled)
+		{
+			auto tl = GetUniformTypeLayout(apd->type, layoutRules, layoutGLSL);
+			bool hasOffset = layoutHasOffsets;
+			uint32_t offset;
+			if (svt == SVT_PackedUniform)
+			{
+				// register * 4 + component
+				offset = uint32_t(regID) * 4;
+				hasOffset = true;
+			}
+			else
+			{
+				if (regID >= 0 && !layoutGLSL && !layoutStructDepth)
+				{
+					offset = uint32_t(regID) * (ub ? 4 : 16);
+					hasOffset = true;
+				}
+				else
+					offset = PlaceInUniformLayout(layoutCursor, apd->type, tl, layoutRules);
+				layoutCursor = EndOfUniformLayout(offset, apd->type, tl, layoutRules);
+				if (layoutEnd < offset + tl.size)
+					layoutEnd = offset + tl.size;
+			}
+			svl.offset = hasOffset ? offset : 0xffffffff;
+			svl.size = tl.size;
+			svl.arrayStride = tl.arrayStride;
+			svl.matrixStride = tl.matrixStride;
+		}
+		layouts->push_back(svl);
+	}
+	void AddLocation(int32_t location)
+	{
+		if (!locations || !measureBufSizes)
+			return;
+		locations->push_back(location);
+	}
 
-	void AppendAPDecl(const AccessPointDecl* apd, uint32_t flags, int regID, bool ub)
+	void AppendAPDecl(const AccessPointDecl* apd, uint32_t flags, int regID, bool ub, ShaderVarType uniformType = SVT_Uniform)
 	{
 		auto stage = (ShaderStage) config->stage;
 		ShaderVarType svt;
@@ -4149,11 +6009,22 @@ struct InterfaceOutputGenerator
 		auto* vmTy = apd->type;
 		if (vmTy->kind == ASTType::Array)
 			vmTy = vmTy->subType;
-		if ((flags & VarDecl::ATTR_In) && stage == ShaderStage_Vertex)
+		if (uniformType == SVT_PackedVarying)
+		{
+			svt = SVT_PackedVarying;
+			regSemIdx = apd->GetSemanticIndex();
+		}
+		else if ((flags & VarDecl::ATTR_In) && stage == ShaderStage_Vertex)
 		{
 			svt = SVT_VSInput;
 			regSemIdx = apd->GetSemanticIndex();
 		}
+		else if ((config->outputFlags & HOC_OF_EXPORT_VARYINGS) && !(flags & VarDecl::ATTR_Uniform) &&
+			(flags & (stage == ShaderStage_Vertex ? VarDecl::ATTR_Out : VarDecl::ATTR_In)))
+		{
+			svt = stage == ShaderStage_Vertex ? SVT_VSOutput : SVT_PSInput;
+			regSemIdx = apd->GetSemanticIndex();
+		}
 		else if ((flags & VarDecl::ATTR_Out) && stage == ShaderStage_Pixel)
 		{
 			if (apd->semanticName == "COLOR" || apd->semanticName == "SV_TARGET")
@@ -4169,18 +6040,27 @@ struct InterfaceOutputGenerator
 		else if (flags & VarDecl::ATTR_Uniform)
 		{
 			svt = vmTy->kind == ASTType::Structure ? SVT_StructBegin
-				: vmTy->IsSampler() ? SVT_Sampler : SVT_Uniform;
+				: vmTy->IsSampler() ? SVT_Sampler
+				: uniformType;
 			regSemIdx = regID;
 		}
 		else
 			return;
 
 		ShaderVariable* curVar = outVars;
+		AddUsageMask(svt == SVT_Uniform || svt == SVT_PackedUniform ? apd : nullptr);
+		AddLayout(svt == SVT_Uniform || svt == SVT_PackedUniform || svt == SVT_StructBegin ? apd : nullptr,
+			svt, regID, ub);
+		bool hasLocation = svt == SVT_VSInput || svt == SVT_PSOutputColor
+			? HasLayoutLocations((OutputShaderFormat) config->outputFmt) || config->outputFmt == OSF_SPIRV
+			: (svt == SVT_VSOutput || svt == SVT_PSInput) && config->outputFmt == OSF_SPIRV;
+		AddLocation(hasLocation ? regID : -1);
 		if (measureBufSizes)
 		{
 			measureBufSizes[0]++;
 			measureBufSizes[1] += apd->name.size() + 1;
-			if (svt == SVT_VSInput)
+			if (svt == SVT_VSInput || svt == SVT_VSOutput ||
+				svt == SVT_PSInput || svt == SVT_PackedVarying || svt == SVT_PackedUniform)
 				measureBufSizes[1] += apd->semanticName.size() + 1;
 		}
 		else
@@ -4193,7 +6073,8 @@ struct InterfaceOutputGenerator
 			memcpy(outsbp, apd->name.c_str(), apd->name.size() + 1);
 			outsbp += apd->name.size() + 1;
 			outVars->semantic  = 0;
-			if (svt == SVT_VSInput)
+			if (svt == SVT_VSInput || svt == SVT_VSOutput ||
+				svt == SVT_PSInput || svt == SVT_PackedVarying || svt == SVT_PackedUniform)
 			{
 				outVars->semantic = uint32_t(outsbp - outStrBuf);
 				memcpy(outsbp, apd->semanticName.c_str(), apd->semanticName.size() + 1);
@@ -4216,13 +6097,38 @@ struct InterfaceOutputGenerator
 		if (svt == SVT_StructBegin)
 		{
 			auto* strTy = vmTy->ToStructType();
+			// member masks combine all elements of struct arrays
+			Array<uint32_t> structBases;
+			std::swap(structBases, usageBases);
+			unsigned numElements = apd->type->kind == ASTType::Array ? apd->type->elementCount : 1;
+			unsigned mmbOffset = 0;
+			ShaderVariableLayout strLayout = { 0xffffffff, 0, 0, 0 };
+			if (layouts && measureBufSizes)
+				strLayout = layouts->back();
+			uint32_t prevCursor = layoutCursor;
+			bool prevHasOffsets = layoutHasOffsets;
+			layoutCursor = strLayout.offset != 0xffffffff ? strLayout.offset : 0;
+			layoutHasOffsets = strLayout.offset != 0xffffffff;
+			layoutStructDepth++;
 			for (auto& mmb : strTy->members)
 			{
+				usageBases.clear();
+				for (auto b : structBases)
+					for (unsigned i = 0; i < numElements; ++i)
+						usageBases.push_back(b + i * strTy->totalAccessPointCount + mmbOffset);
+				mmbOffset += mmb.type->GetAccessPointCount();
 				AppendAPDecl(&mmb, flags, regID, ub);
 				if (regID >= 0)
 					regID += GetNumSlots(mmb.type) * (ub ? 4 : 1);
 			}
-
+			layoutStructDepth--;
+			layoutCursor = prevCursor;
+			layoutHasOffsets = prevHasOffsets;
+
+			AddUsageMask(nullptr);
+			if (layouts && measureBufSizes)
+				layouts->push_back(strLayout);
+			AddLocation(-1);
 			if (measureBufSizes)
 			{
 				measureBufSizes[0]++;
@@ -4239,13 +6145,25 @@ struct InterfaceOutputGenerator
 	void IterateVariables()
 	{
 		outsbp = outStrBuf;
+		layoutEnabled = false;
+		layoutStructDepth = 0;
 
+		// SM4 globals are stored in the $Globals constant buffer
+		BeginLayout(config->outputFmt == OSF_HLSL_SM4);
+		uint32_t globalsCursor = 0;
 		for (const ASTNode* gv = ast.globalVars.firstChild; gv; gv = gv->next)
 		{
 			if (auto* cbuf = dyn_cast<const CBufferDecl>(gv))
 			{
 				// beginning of uniform block
 				uint32_t bufNameOff = uint32_t(outsbp - outStrBuf);
+				AddUsageMask(nullptr);
+				size_t blockLayoutIdx = layouts ? layouts->size() : 0;
+				if (layouts && measureBufSizes)
+					layouts->push_back({ 0, 0, 0, 0 });
+				AddLocation(-1);
+				globalsCursor = layoutCursor;
+				BeginLayout(true);
 				if (measureBufSizes)
 				{
 					measureBufSizes[0]++;
@@ -4269,10 +6187,22 @@ struct InterfaceOutputGenerator
 				for (const ASTNode* cbv = cbuf->firstChild; cbv; cbv = cbv->next)
 				{
 					if (auto* vd = dyn_cast<const VarDecl>(cbv))
+					{
+						SetUsageBases(vd);
 						AppendAPDecl(vd, vd->flags, vd->regID, true);
+					}
 				}
 
 				// end of uniform block
+				AddUsageMask(nullptr);
+				if (layouts && measureBufSizes)
+				{
+					(*layouts)[blockLayoutIdx].size = RoundUp16(layoutEnd);
+					layouts->push_back((*layouts)[blockLayoutIdx]);
+				}
+				AddLocation(-1);
+				BeginLayout(config->outputFmt == OSF_HLSL_SM4);
+				layoutCursor = globalsCursor;
 				if (measureBufSizes)
 				{
 					measureBufSizes[0]++;
@@ -4293,72 +6223,46 @@ struct InterfaceOutputGenerator
 			}
 			else if (auto* vd = dyn_cast<const VarDecl>(gv))
 			{
+				SetUsageBases(vd);
 				AppendAPDecl(vd, vd->flags, vd->regID, false);
 			}
 		}
 
+		usageBases.clear();
+		layoutEnabled = false;
 		for (const ASTNode* arg = ast.entryPoint->GetFirstArg(); arg; arg = arg->next)
 		{
 			if (auto* vd = dyn_cast<const VarDecl>(arg))
 				AppendAPDecl(vd, vd->flags, vd->regID, false);
 		}
-	}
-};
 
+		for (const ASTNode* ru = ast.removedUniforms.firstChild; ru; ru = ru->next)
+		{
+			if (auto* vd = dyn_cast<const VarDecl>(ru))
+				AppendAPDecl(vd, vd->flags, -1, false, SVT_RemovedUniform);
+		}
 
-
-HOC_BoolU8 HOC_CompileShader(const char* name, const char* code, HOC_Config* config)
-{
-	auto stage = (ShaderStage) config->stage;
-	auto outputFmt = (OutputShaderFormat) config->outputFmt;
-
-	FILEStream outStream(stdout);
-	FILEStream errStream(stderr);
-	CallbackStream cbCodeStream(config->codeOutputStream);
-	CallbackStream cbErrStream(config->errorOutputStream);
-	auto* codeStream = config->codeOutputStream
-		? (OutStream*) &cbCodeStream
-		: (OutStream*) &outStream;
-	auto* errorStream = config->errorOutputStream
-		? (OutStream*) &cbErrStream
-		: (OutStream*) &errStream;
-
-	Diagnostic diag(errorStream, name);
-	Info info(diag, stage, outputFmt, config->outputFlags);
-	Parser p(diag, config);
-
-	String codeWithDefines;
-	if (config->defines)
-	{
-		ShaderMacro* d = config->defines;
-		codeWithDefines += "#line 1 \"<arguments>\"\n";
-		while (d->name)
+		for (const auto& apd : ast.preshaderInputs)
+			AppendAPDecl(&apd, VarDecl::ATTR_Uniform, -1, false, SVT_PreshaderInput);
+		for (const auto& apd : ast.preshaderOutputs)
+			AppendAPDecl(&apd, VarDecl::ATTR_Uniform, -1, false, SVT_PreshaderOutput);
+		for (const auto& apd : ast.packedVaryings)
+			AppendAPDecl(&apd, 0, -1, false, SVT_PackedVarying);
+		for (const ASTNode* pu = ast.packedUniforms.firstChild; pu; pu = pu->next)
 		{
-			codeWithDefines += "#define ";
-			size_t pos = codeWithDefines.size();
-			codeWithDefines += d->name;
-			if (const char* eqsp = strchr(d->name, '='))
-			{
-				codeWithDefines[pos + (eqsp - d->name)] = ' ';
-			}
-			if (d->value)
+			if (auto* vd = dyn_cast<const VarDecl>(pu))
 			{
-				codeWithDefines += " ";
-				codeWithDefines += d->value;
+				SetUsageBases(vd);
+				AppendAPDecl(vd, vd->flags, vd->regID, false, SVT_PackedUniform);
 			}
-			codeWithDefines += "\n";
-			d++;
 		}
-		codeWithDefines += "#line 1 \"";
-		codeWithDefines += name;
-		codeWithDefines += "\"\n";
-		codeWithDefines += code;
-
-		code = codeWithDefines.c_str();
 	}
-//	FILEStream(stderr) << code;
+};
+
+
 
-	const char* featureDefs[3] = {};
+void HOC::GetFeatureDefs(ShaderStage stage, OutputShaderFormat outputFmt, const char* featureDefs[3])
+{
 	const char** fdWP = featureDefs;
 	switch (stage)
 	{
@@ -4371,140 +6275,558 @@ HOC_BoolU8 HOC_CompileShader(const char* name, const char* code, HOC_Config* con
 	case OSF_HLSL_SM4:    *fdWP++ = "__HLSL_SM4__";    break;
 	case OSF_GLSL_140:    *fdWP++ = "__GLSL_140__";    break;
 	case OSF_GLSL_ES_100: *fdWP++ = "__GLSL_ES_100__"; break;
+	case OSF_GLSL_330:    *fdWP++ = "__GLSL_330__";    break;
+	case OSF_GLSL_ES_300: *fdWP++ = "__GLSL_ES_300__"; break;
+	case OSF_SPIRV:       *fdWP++ = "__SPIRV__";       break;
 	}
-	assert(fdWP < std::end(featureDefs));
-
-	if (!p.ParseCode(code, featureDefs))
-		return false;
-	p.ast.MarkUsed(diag);
-	if (diag.hasErrors)
-		return false;
-
-	if (config->ASTDumpStream)
-	{
-		CallbackStream cbASTStream(config->ASTDumpStream);
-		cbASTStream << "AST before optimization:\n";
-		p.ast.Dump(cbASTStream);
-	}
+	*fdWP = nullptr;
+}
 
+bool HOC::ValidateAST(AST& ast, Diagnostic& diag, OutputShaderFormat outputFmt)
+{
 	// ignore unused functions entirely
-	RemoveUnusedFunctions().RunOnAST(p.ast);
+	RemoveUnusedFunctions().RunOnAST(ast);
 
 	// validate all
-	VariableAccessValidator(diag).RunOnAST(p.ast);
+	VariableAccessValidator(diag).RunOnAST(ast);
 	if (diag.hasErrors)
 		return false;
-	ContentValidator(diag, outputFmt).RunOnAST(p.ast);
-	if (diag.hasErrors)
+	ContentValidator(diag, outputFmt).RunOnAST(ast);
+	return !diag.hasErrors;
+}
+
+bool HOC::TransformAST(AST& ast, const Info& info)
+{
+	// uniforms are replaced while they still have the original types and layout
+	if (info.uniformValues && !UniformSpecialization(info.diag).RunOnAST(ast, info.uniformValues))
 		return false;
+	// matrices are still in the HLSL layout, so the CPU program can use them as they are
+	if (info.outputFlags & HOC_OF_PRESHADER)
+	{
+		PreshaderExtraction preshader;
+		preshader.RunOnAST(ast);
+		if (info.compileStats)
+			info.compileStats->numPreshaderExprs += preshader.numExtracted;
+	}
 
 	// output-specific transformations (emulation/feature mapping)
-	PadAPI(p.ast, diag, outputFmt);
-	UnpackEntryPoint(p.ast, info);
-	if (outputFmt != OSF_HLSL_SM3)
+	PadAPI(ast, info.diag, info.outputFmt);
+	UnpackEntryPoint(ast, info);
+	if (info.outputFlags & HOC_OF_NATIVE_HALF)
 	{
-		SplitTexSampleArgs(p.ast, diag, outputFmt);
+		UniformStorageConversion(ast).RunOnAST();
+		ast.nativeHalf = true;
 	}
-	switch (outputFmt)
+	if (info.outputFmt != OSF_HLSL_SM3)
+	{
+		SplitTexSampleArgs(ast, info.diag, info.outputFmt);
+	}
+	switch (info.outputFmt)
 	{
 	case OSF_GLSL_140:
 	case OSF_GLSL_ES_100:
-		UnpackMatrixSwizzle(p.ast);
-		RemoveVM1AndM1DTypes(p.ast);
-		RemoveArraysOfArrays(p.ast);
+	case OSF_GLSL_330:
+	case OSF_GLSL_ES_300:
+	case OSF_SPIRV:
+		UnpackMatrixSwizzle(ast);
+		RemoveVM1AndM1DTypes(ast);
+		RemoveArraysOfArrays(ast);
 		// needed for matrix init list transposition
-		ConstantPropagation().RunOnAST(p.ast);
-		GLSLConvert(p.ast, info);
+		ConstantPropagation().RunOnAST(ast);
+		GLSLConvert(ast, info);
+		// the layout of packed varyings must be shared by both stages
+		if (!info.deferVaryingPacking && (info.outputFlags & HOC_OF_GLSL_PACK_VARYINGS))
+			info.diag.EmitError("varying packing is only supported by HOC_CompileShaderPair", Location::BAD());
 		break;
 	}
+	return !info.diag.hasErrors;
+}
 
-	if (diag.hasErrors)
-		return false;
+void HOC::OptimizeAST(AST& ast, const Info& info)
+{
+	// folding and unused variable removal run at every level, the other passes from level 1
+	bool optimize = info.optimizationLevel > 0;
+	bool foldMatrices = info.outputFmt == OSF_HLSL_SM3 || info.outputFmt == OSF_HLSL_SM4;
+	bool fastMath = (info.outputFlags & HOC_OF_FAST_MATH) != 0;
+	if (optimize)
+	{
+		FunctionInliner inliner(info.optimizationLevel);
+		inliner.RunOnAST(ast);
+		if (info.compileStats)
+			info.compileStats->numInlinedCalls += inliner.numInlined;
+	}
 
-	// optimizations
-	ConstantPropagation().RunOnAST(p.ast);
-	MarkUnusedVariables().RunOnAST(p.ast);
-	RemoveUnusedVariables().RunOnAST(p.ast);
+	ConstantPropagation(foldMatrices).RunOnAST(ast);
+	if (optimize)
+	{
+		VariableConstantPropagation(foldMatrices).RunOnAST(ast);
+		AlgebraicSimplification simplifier(fastMath, foldMatrices);
+		simplifier.RunOnAST(ast);
+		if (info.maxUnrollSize > 0)
+		{
+			LoopUnroller unroller(info.maxUnrollSize);
+			unroller.RunOnAST(ast);
+			if (info.compileStats)
+				info.compileStats->numUnrolledLoops += unroller.numUnrolled;
+			if (unroller.numUnrolled)
+			{
+				// fold the substituted loop indices
+				ConstantPropagation(foldMatrices).RunOnAST(ast);
+				VariableConstantPropagation(foldMatrices).RunOnAST(ast);
+				simplifier.RunOnAST(ast);
+			}
+		}
+		if (info.compileStats)
+			info.compileStats->numSimplifiedExprs += simplifier.numSimplified;
+		LoopInvariantCodeMotion licm;
+		licm.RunOnAST(ast);
+		if (info.compileStats)
+			info.compileStats->numHoistedExprs += licm.numHoisted;
+		if (info.optimizationLevel >= 2)
+		{
+			CommonSubexpressionElimination().RunOnAST(ast);
+		}
+		DeadStoreElimination().RunOnAST(ast);
+		DeadMemberStoreElimination dmse;
+		dmse.RunOnAST(ast);
+		if (dmse.numRemoved)
+		{
+			// struct copies and member values are dead now
+			DeadStoreElimination().RunOnAST(ast);
+		}
+	}
+	MarkUnusedVariables().RunOnAST(ast);
+	RemoveUnusedVariables().RunOnAST(ast);
+}
 
+void HOC::PrepareASTForOutput(AST& ast, const Info& info)
+{
 	// fixing up before codegen
-	AssignVarDeclNames().VisitAST(p.ast);
-	if (config->outputFlags & HOC_OF_SPECIFY_REGISTERS)
+	AssignVarDeclNames().VisitAST(ast);
+	if (info.outputFmt == OSF_HLSL_SM3 && (info.outputFlags & HOC_OF_HLSL3_PACK_UNIFORMS))
+	{
+		// before other registers are picked, packs are placed at the beginning of the free space
+		int numPacked = UniformPacker(ast, (info.outputFlags & HOC_OF_HLSL3_BUFFER_SLOTS) != 0).RunOnAST();
+		if (info.compileStats)
+			info.compileStats->numPackedUniforms += numPacked;
+	}
+	if (info.outputFmt == OSF_SPIRV)
 	{
-		SpecifyGlobalRegisters(p.ast, info);
+		// before block registers are picked, so that $Globals gets the first free one
+		MoveLooseUniformsToBlock(ast);
 	}
-	if (config->outputFmt == OSF_HLSL_SM3 && (config->outputFlags & HOC_OF_HLSL3_BUFFER_SLOTS))
+	if ((info.outputFlags & HOC_OF_SPECIFY_REGISTERS) || info.outputFmt == OSF_SPIRV)
+	{
+		// SPIR-V bindings are always explicit
+		SpecifyGlobalRegisters(ast, info);
+	}
+	if (info.outputFmt == OSF_HLSL_SM3 && (info.outputFlags & HOC_OF_HLSL3_BUFFER_SLOTS))
 	{
 		// if registers are not guaranteed to be specified, ...
 		// ... some may be undefined and cbuffers cannot be broken up ...
 		// ... however fxc ignores registers inside buffers and reallocates those uniforms
-		HLSL_SM3_ApplyBufferSlots(p.ast);
+		HLSL_SM3_ApplyBufferSlots(ast);
 	}
-	switch (outputFmt)
+	switch (info.outputFmt)
 	{
 	case OSF_GLSL_ES_100:
 	case OSF_GLSL_140:
-		GLSLPostConvert(p.ast, info);
-		RenameGLSLKeywords().VisitAST(p.ast);
+	case OSF_GLSL_330:
+	case OSF_GLSL_ES_300:
+		GLSLPostConvert(ast, info);
+		RenameGLSLKeywords().VisitAST(ast);
+		if (HasLayoutLocations(info.outputFmt))
+			AssignLayoutLocations(ast);
+		if ((info.outputFmt == OSF_GLSL_ES_100 || info.outputFmt == OSF_GLSL_ES_300) &&
+			(info.outputFlags & HOC_OF_GLSL_AUTO_PRECISION))
+		{
+			int numDemoted = GLSLPrecisionInference().RunOnAST(ast);
+			if (info.compileStats)
+				info.compileStats->numLowPrecisionVars += numDemoted;
+		}
+		break;
+	case OSF_SPIRV:
+		GLSLPostConvert(ast, info);
+		AssignLayoutLocations(ast);
+		AssignVaryingLocations(ast, info);
 		break;
 	}
+}
 
-	if (config->ASTDumpStream)
-	{
-		CallbackStream cbASTStream(config->ASTDumpStream);
-		cbASTStream << "AST after optimization:\n";
-		p.ast.Dump(cbASTStream);
-	}
-
+void HOC::GenerateCode(const AST& ast, OutputShaderFormat outputFmt, OutStream& out)
+{
 	switch (outputFmt)
 	{
 	case OSF_HLSL_SM3:
-		GenerateHLSL_SM3(p.ast, *codeStream);
+		GenerateHLSL_SM3(ast, out);
 		break;
 	case OSF_HLSL_SM4:
-		GenerateHLSL_SM4(p.ast, *codeStream);
+		GenerateHLSL_SM4(ast, out);
 		break;
 	case OSF_GLSL_140:
-		GenerateGLSL_140(p.ast, *codeStream);
+		GenerateGLSL_140(ast, out);
 		break;
 	case OSF_GLSL_ES_100:
-		GenerateGLSL_ES_100(p.ast, *codeStream);
+		GenerateGLSL_ES_100(ast, out);
 		break;
+	case OSF_GLSL_330:
+		GenerateGLSL_330(ast, out);
+		break;
+	case OSF_GLSL_ES_300:
+		GenerateGLSL_ES_300(ast, out);
+		break;
+	case OSF_SPIRV:
+		GenerateSPIRV(ast, out);
+		break;
+	}
+}
+
+
+
+bool HOC::GenerateCodeToBuffer(const AST& ast, OutputShaderFormat outputFmt, HOC_CodeOutput* co)
+{
+	// one byte is reserved for the terminator
+	size_t cap = co->outBuf && co->outBufSize ? co->outBufSize - 1 : 0;
+	FixedBufferStream fbs(co->outBuf, cap);
+	GenerateCode(ast, outputFmt, fbs);
+	co->outCodeSize = fbs.size;
+	co->didOverflow = fbs.size > cap || !co->outBuf;
+
+	if (co->didOverflow && co->overflowAlloc)
+	{
+		// the generator is deterministic, run it again on a buffer of the exact size
+		size_t size = fbs.size + 1;
+		char* buf = (char*) (co->allocFunc
+			? co->allocFunc(size, co->allocUserData)
+			: HOC_MALLOC_EH(size));
+		if (!buf)
+			return false;
+		co->outBuf = buf;
+		co->outBufSize = size;
+		fbs.buffer = buf;
+		fbs.capacity = size - 1;
+		fbs.size = 0;
+		GenerateCode(ast, outputFmt, fbs);
+	}
+	if (fbs.buffer)
+		fbs.buffer[fbs.size < fbs.capacity ? fbs.size : fbs.capacity] = '\0';
+	return true;
+}
+
+// state of one shader compilation, split into steps so that HOC_CompileShaderPair can work in between
+struct ShaderCompileJob
+{
+	ShaderCompileJob(const char* name, HOC_Config* cfg) :
+		config(cfg),
+		outStream(stdout),
+		errStream(stderr),
+		cbCodeStream(cfg->codeOutputStream),
+		cbErrStream(cfg->errorOutputStream),
+		codeStream(cfg->codeOutputStream ? (OutStream*) &cbCodeStream : (OutStream*) &outStream),
+		errorStream(cfg->errorOutputStream ? (OutStream*) &cbErrStream : (OutStream*) &errStream),
+		diag(errorStream, name),
+		info(diag, (ShaderStage) cfg->stage, (OutputShaderFormat) cfg->outputFmt,
+			cfg->outputFlags, cfg->optimizationLevel),
+		p(diag, cfg),
+		timer(cfg->compileStats),
+		name(name)
+	{
+		info.maxUnrollSize = int(config->maxUnrollSize);
+		info.compileStats = config->compileStats;
+		info.uniformValues = config->uniformValues;
+	}
+
+	// preprocessing, parsing and validation
+	bool Parse(const char* code)
+	{
+		timer.Skip();
+		if (config->defines)
+		{
+			ShaderMacro* d = config->defines;
+			codeWithDefines += "#line 1 \"<arguments>\"\n";
+			while (d->name)
+			{
+				codeWithDefines += "#define ";
+				size_t pos = codeWithDefines.size();
+				codeWithDefines += d->name;
+				if (const char* eqsp = strchr(d->name, '='))
+				{
+					codeWithDefines[pos + (eqsp - d->name)] = ' ';
+				}
+				if (d->value)
+				{
+					codeWithDefines += " ";
+					codeWithDefines += d->value;
+				}
+				codeWithDefines += "\n";
+				d++;
+			}
+			codeWithDefines += "#line 1 \"";
+			codeWithDefines += name;
+			codeWithDefines += "\"\n";
+			codeWithDefines += code;
+
+			code = codeWithDefines.c_str();
+		}
+	//	FILEStream(stderr) << code;
+
+		const char* featureDefs[3];
+		GetFeatureDefs(info.stage, info.outputFmt, featureDefs);
+		timer.EndStage(CS_Preprocess);
+
+		// parser measures its own stages
+		if (!p.ParseCode(code, featureDefs))
+			return false;
+		timer.Skip();
+		p.ast.MarkUsed(diag);
+		timer.EndStage(CS_Parse);
+		if (diag.hasErrors)
+			return false;
+
+		if (config->ASTDumpStream)
+		{
+			CallbackStream cbASTStream(config->ASTDumpStream);
+			cbASTStream << "AST before optimization:\n";
+			p.ast.Dump(cbASTStream);
+			timer.Skip();
+		}
+
+		if (!ValidateAST(p.ast, diag, info.outputFmt))
+			return false;
+		timer.EndStage(CS_Validate);
+		return true;
+	}
+
+	bool Transform()
+	{
+		timer.Skip();
+		if (!TransformAST(p.ast, info))
+			return false;
+		timer.EndStage(CS_Transform);
+		return true;
 	}
 
-	if (auto* ifo = config->interfaceOutput)
+	void Optimize()
 	{
-		size_t bufSizes[2] = { 0, 0 };
+		timer.Skip();
+		OptimizeAST(p.ast, info);
+		timer.EndStage(CS_Optimize);
+	}
 
-		InterfaceOutputGenerator ifog1 = { config, p.ast, nullptr, nullptr, bufSizes };
-		ifog1.IterateVariables();
+	// code and interface output
+	bool Finish()
+	{
+		timer.Skip();
+		PrepareASTForOutput(p.ast, info);
+		timer.EndStage(CS_Transform);
+		if (diag.hasErrors)
+			return false;
 
-		if (bufSizes[0] > ifo->outVarBufSize)
-			ifo->didOverflowVar = true;
-		if (bufSizes[1] > ifo->outVarStrBufSize)
-			ifo->didOverflowStr = true;
+		if (config->ASTDumpStream)
+		{
+			CallbackStream cbASTStream(config->ASTDumpStream);
+			cbASTStream << "AST after optimization:\n";
+			p.ast.Dump(cbASTStream);
+			timer.Skip();
+		}
 
-		if (ifo->overflowAlloc)
+		if (auto* co = config->codeOutput)
 		{
-			ifo->outVarBufSize = bufSizes[0];
-			if (ifo->didOverflowVar)
-				ifo->outVarBuf = new ShaderVariable[bufSizes[0]];
-			ifo->outVarStrBufSize = bufSizes[1];
-			if (ifo->didOverflowStr)
-				ifo->outVarStrBuf = new char[bufSizes[1]];
+			if (!GenerateCodeToBuffer(p.ast, info.outputFmt, co))
+			{
+				diag.EmitError("failed to allocate the code output buffer", Location::BAD());
+				return false;
+			}
 		}
 		else
 		{
-			if (ifo->outVarBufSize > bufSizes[0])
+			// the generator emits many small fragments, forward them in large chunks
+			BufferedStream bufCodeStream(codeStream);
+			GenerateCode(p.ast, info.outputFmt, bufCodeStream);
+		}
+
+		if (auto* ifo = config->interfaceOutput)
+		{
+			size_t bufSizes[2] = { 0, 0 };
+
+			UniformUsageAnalysis usage;
+			Array<uint32_t> usageHeader;
+			Array<uint32_t> usageData;
+			bool exportUsage = (info.outputFlags & HOC_OF_EXPORT_USAGE_MASKS) != 0;
+			if (exportUsage)
+				usage.RunOnAST(p.ast);
+
+			Array<ShaderVariableLayout> layouts;
+			bool exportLayout = (info.outputFlags & HOC_OF_EXPORT_LAYOUT) != 0;
+			Array<int32_t> locations;
+			bool exportLocations = HasLayoutLocations(info.outputFmt) || info.outputFmt == OSF_SPIRV;
+
+			InterfaceOutputGenerator ifog1(config, p.ast, nullptr, nullptr, bufSizes,
+				exportUsage ? &usage.bits : nullptr, &usageHeader, &usageData,
+				exportLayout ? &layouts : nullptr, exportLocations ? &locations : nullptr);
+			ifog1.IterateVariables();
+			usage.Reset();
+
+			if (bufSizes[0] > ifo->outVarBufSize)
+				ifo->didOverflowVar = true;
+			if (bufSizes[1] > ifo->outVarStrBufSize)
+				ifo->didOverflowStr = true;
+
+			if (ifo->overflowAlloc)
+			{
 				ifo->outVarBufSize = bufSizes[0];
-			if (ifo->outVarStrBufSize > bufSizes[1])
+				if (ifo->didOverflowVar)
+					ifo->outVarBuf = new ShaderVariable[bufSizes[0]];
 				ifo->outVarStrBufSize = bufSizes[1];
+				if (ifo->didOverflowStr)
+					ifo->outVarStrBuf = new char[bufSizes[1]];
+			}
+			else
+			{
+				if (ifo->outVarBufSize > bufSizes[0])
+					ifo->outVarBufSize = bufSizes[0];
+				if (ifo->outVarStrBufSize > bufSizes[1])
+					ifo->outVarStrBufSize = bufSizes[1];
+			}
+
+			InterfaceOutputGenerator ifog2(config, p.ast, ifo->outVarBuf, ifo->outVarStrBuf, nullptr);
+			ifog2.IterateVariables();
+
+			size_t preshaderSize = p.ast.preshaderCode.size();
+			if (preshaderSize > ifo->outPreshaderBufSize)
+				ifo->didOverflowPreshader = true;
+			if (ifo->overflowAlloc)
+			{
+				ifo->outPreshaderBufSize = preshaderSize;
+				if (ifo->didOverflowPreshader)
+					ifo->outPreshaderBuf = new uint32_t[preshaderSize];
+			}
+			else if (ifo->outPreshaderBufSize > preshaderSize)
+				ifo->outPreshaderBufSize = preshaderSize;
+			if (ifo->outPreshaderBufSize)
+				memcpy(ifo->outPreshaderBuf, p.ast.preshaderCode.data(), ifo->outPreshaderBufSize * sizeof(uint32_t));
+
+			// mask offsets are relative to the beginning of the buffer
+			for (auto& off : usageHeader)
+				if (off != 0xffffffff)
+					off += uint32_t(usageHeader.size());
+			for (auto mask : usageData)
+				usageHeader.push_back(mask);
+			size_t usageSize = usageHeader.size();
+			if (usageSize > ifo->outUsageMaskBufSize)
+				ifo->didOverflowUsageMask = true;
+			if (ifo->overflowAlloc)
+			{
+				ifo->outUsageMaskBufSize = usageSize;
+				if (ifo->didOverflowUsageMask)
+					ifo->outUsageMaskBuf = new uint32_t[usageSize];
+			}
+			else if (ifo->outUsageMaskBufSize > usageSize)
+				ifo->outUsageMaskBufSize = usageSize;
+			if (ifo->outUsageMaskBufSize)
+				memcpy(ifo->outUsageMaskBuf, usageHeader.data(), ifo->outUsageMaskBufSize * sizeof(uint32_t));
+
+			size_t layoutSize = layouts.size();
+			if (layoutSize > ifo->outLayoutBufSize)
+				ifo->didOverflowLayout = true;
+			if (ifo->overflowAlloc)
+			{
+				ifo->outLayoutBufSize = layoutSize;
+				if (ifo->didOverflowLayout)
+					ifo->outLayoutBuf = new ShaderVariableLayout[layoutSize];
+			}
+			else if (ifo->outLayoutBufSize > layoutSize)
+				ifo->outLayoutBufSize = layoutSize;
+			if (ifo->outLayoutBufSize)
+				memcpy(ifo->outLayoutBuf, layouts.data(), ifo->outLayoutBufSize * sizeof(ShaderVariableLayout));
+
+			size_t locationSize = locations.size();
+			if (locationSize > ifo->outLocationBufSize)
+				ifo->didOverflowLocation = true;
+			if (ifo->overflowAlloc)
+			{
+				ifo->outLocationBufSize = locationSize;
+				if (ifo->didOverflowLocation)
+					ifo->outLocationBuf = new int32_t[locationSize];
+			}
+			else if (ifo->outLocationBufSize > locationSize)
+				ifo->outLocationBufSize = locationSize;
+			if (ifo->outLocationBufSize)
+				memcpy(ifo->outLocationBuf, locations.data(), ifo->outLocationBufSize * sizeof(int32_t));
 		}
+		timer.EndStage(CS_Generate);
 
-		InterfaceOutputGenerator ifog2 = { config, p.ast, ifo->outVarBuf, ifo->outVarStrBuf, nullptr };
-		ifog2.IterateVariables();
+		return true;
 	}
 
-	return true;
+	HOC_Config* config;
+	FILEStream outStream;
+	FILEStream errStream;
+	CallbackStream cbCodeStream;
+	CallbackStream cbErrStream;
+	OutStream* codeStream;
+	OutStream* errorStream;
+	Diagnostic diag;
+	Info info;
+	Parser p;
+	StageTimer timer;
+	const char* name;
+	String codeWithDefines;
+};
+
+HOC_BoolU8 HOC_CompileShader(const char* name, const char* code, HOC_Config* config)
+{
+	ShaderCompileJob job(name, config);
+	if (!job.Parse(code) || !job.Transform())
+		return false;
+	job.Optimize();
+	return job.Finish();
+}
+
+HOC_BoolU8 HOC_CompileShaderPair(const char* vsName, const char* vsCode, HOC_Config* vsConfig,
+	const char* psName, const char* psCode, HOC_Config* psConfig)
+{
+	ShaderCompileJob vs(vsName, vsConfig);
+	ShaderCompileJob ps(psName, psConfig);
+	if (vs.info.stage != ShaderStage_Vertex || ps.info.stage != ShaderStage_Pixel)
+	{
+		vs.diag.EmitError("shader pair must consist of a vertex and a pixel shader", Location::BAD());
+		return false;
+	}
+	if (vs.info.outputFmt != ps.info.outputFmt)
+	{
+		vs.diag.EmitError("shader pair must use the same output format", Location::BAD());
+		return false;
+	}
+	if ((vs.info.outputFlags ^ ps.info.outputFlags) & HOC_OF_GLSL_PACK_VARYINGS)
+	{
+		vs.diag.EmitError("shader pair must use the same varying packing flag", Location::BAD());
+		return false;
+	}
+	// varyings are packed after the interface is trimmed
+	vs.info.deferVaryingPacking = true;
+	ps.info.deferVaryingPacking = true;
+
+	// only the inputs that are still read after PS optimization are needed
+	if (!ps.Parse(psCode) || !ps.Transform())
+		return false;
+	ps.Optimize();
+	Array<String> readInputs;
+	RemoveUnreadPSInputs(ps.p.ast, readInputs);
+
+	if (!vs.Parse(vsCode) || !vs.Transform())
+		return false;
+	int numRemoved = TrimVSOutputs(vs.p.ast, readInputs);
+	if (vsConfig->compileStats)
+		vsConfig->compileStats->numRemovedVSOutputs += numRemoved;
+	VaryingPackLayout packLayout;
+	PackVaryings(vs.p.ast, vs.info, packLayout, false);
+	vs.Optimize();
+	// fold the copies from the packs into the shader
+	if (PackVaryings(ps.p.ast, ps.info, packLayout, true))
+		ps.Optimize();
+
+	return vs.Finish() && ps.Finish();
 }
 
 void HOC_FreeInterfaceOutputBuffers(HOC_InterfaceOutput* ifo)
@@ -4521,6 +6843,42 @@ void HOC_FreeInterfaceOutputBuffers(HOC_InterfaceOutput* ifo)
 			delete [] ifo->outVarStrBuf;
 			ifo->outVarStrBuf = nullptr;
 		}
+		if (ifo->didOverflowPreshader && ifo->outPreshaderBuf && ifo->outPreshaderBufSize)
+		{
+			delete [] ifo->outPreshaderBuf;
+			ifo->outPreshaderBuf = nullptr;
+		}
+		if (ifo->didOverflowUsageMask && ifo->outUsageMaskBuf && ifo->outUsageMaskBufSize)
+		{
+			delete [] ifo->outUsageMaskBuf;
+			ifo->outUsageMaskBuf = nullptr;
+		}
+		if (ifo->didOverflowLayout && ifo->outLayoutBuf && ifo->outLayoutBufSize)
+		{
+			delete [] ifo->outLayoutBuf;
+			ifo->outLayoutBuf = nullptr;
+		}
+		if (ifo->didOverflowLocation && ifo->outLocationBuf && ifo->outLocationBufSize)
+		{
+			delete [] ifo->outLocationBuf;
+			ifo->outLocationBuf = nullptr;
+		}
+	}
+}
+
+HOC_BoolU8 HOC_RunPreshader(const uint32_t* code, size_t codeSize,
+	const float* const* inputs, float* const* outputs)
+{
+	return RunPreshader(code, codeSize, inputs, outputs);
+}
+
+void HOC_FreeCodeOutputBuffer(HOC_CodeOutput* co)
+{
+	if (co && co->overflowAlloc && co->didOverflow && !co->allocFunc && co->outBuf)
+	{
+		HOC_FREE(co->outBuf);
+		co->outBuf = nullptr;
+		co->outBufSize = 0;
 	}
 }
 
@@ -4537,6 +6895,13 @@ const char* HOC_ShaderVarTypeToString(int svType)
 	case SVT_Sampler:           return "Sampler";
 	case SVT_PSOutputDepth:     return "PSOutputDepth";
 	case SVT_PSOutputColor:     return "PSOutputColor";
+	case SVT_RemovedUniform:    return "RemovedUniform";
+	case SVT_PreshaderInput:    return "PreshaderInput";
+	case SVT_PreshaderOutput:   return "PreshaderOutput";
+	case SVT_PackedVarying:     return "PackedVarying";
+	case SVT_VSOutput:          return "VSOutput";
+	case SVT_PSInput:           return "PSInput";
+	case SVT_PackedUniform:     return "PackedUniform";
 	default:                    return "[UNKNOWN SHADER VAR TYPE]";
 	}
 }
@@ -4562,6 +6927,21 @@ const char* HOC_ShaderDataTypeToString(int dataType)
 	}
 }
 
+const char* HOC_CompileStageToString(int stage)
+{
+	switch ((CompileStage) stage)
+	{
+	case CS_Tokenize:   return "tokenize";
+	case CS_Preprocess: return "preprocess";
+	case CS_Parse:      return "parse";
+	case CS_Validate:   return "validate";
+	case CS_Transform:  return "transform";
+	case CS_Optimize:   return "optimize";
+	case CS_Generate:   return "generate";
+	default:            return "[UNKNOWN COMPILE STAGE]";
+	}
+}
+
 void HOC_DumpShaderInterfaceOutput(HOC_InterfaceOutput* ifo, HOC_TextOutput* to)
 {
 	CallbackStream out(to);
@@ -4593,7 +6973,8 @@ void HOC_DumpShaderInterfaceOutput(HOC_InterfaceOutput* ifo, HOC_TextOutput* to)
 			out << "[" << sv.arraySize << "]";
 		}
 		out << " " << &ifo->outVarStrBuf[sv.name];
-		if (sv.svType == SVT_VSInput)
+		if (sv.svType == SVT_VSInput || sv.svType == SVT_VSOutput ||
+			sv.svType == SVT_PSInput || sv.svType == SVT_PackedVarying || sv.svType == SVT_PackedUniform)
 		{
 			out << " :" << &ifo->outVarStrBuf[sv.semantic];
 		}
@@ -4608,6 +6989,39 @@ void HOC_DumpShaderInterfaceOutput(HOC_InterfaceOutput* ifo, HOC_TextOutput* to)
 		{
 			out << " #" << sv.regSemIdx;
 		}
+		if (i < ifo->outLocationBufSize && ifo->outLocationBuf[i] >= 0)
+		{
+			out << " loc=" << ifo->outLocationBuf[i];
+		}
+		if (i < ifo->outUsageMaskBufSize && ifo->outUsageMaskBuf[i] != 0xffffffff)
+		{
+			size_t numBits = (sv.sizeX ? sv.sizeX : 1) * (sv.sizeY ? sv.sizeY : 1) * (sv.arraySize ? sv.arraySize : 1);
+			size_t off = ifo->outUsageMaskBuf[i];
+			out << " read=";
+			for (size_t w = 0; w < (numBits + 31) / 32 && off + w < ifo->outUsageMaskBufSize; ++w)
+			{
+				char bfr[16];
+				sprintf(bfr, w ? ",0x%x" : "0x%x", ifo->outUsageMaskBuf[off + w]);
+				out << bfr;
+			}
+		}
+		if (i < ifo->outLayoutBufSize && ifo->outLayoutBuf[i].size)
+		{
+			const ShaderVariableLayout& svl = ifo->outLayoutBuf[i];
+			if (svl.offset != 0xffffffff)
+			{
+				out << " offset=" << svl.offset;
+			}
+			out << " size=" << svl.size;
+			if (svl.arrayStride)
+			{
+				out << " astride=" << svl.arrayStride;
+			}
+			if (svl.matrixStride)
+			{
+				out << " mstride=" << svl.matrixStride;
+			}
+		}
 		out << "\n";
 	}
 }
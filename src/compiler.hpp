@@ -172,6 +172,7 @@ struct ASTType
 	bool IsIntBased() const { return kind == Int32 || kind == UInt32 || ((kind == Vector || kind == Matrix) && (subType->kind == Int32 || subType->kind == UInt32)); }
 	bool IsFloatBased() const { return kind == Float16 || kind == Float32
 		|| ((kind == Vector || kind == Matrix) && (subType->kind == Float16 || subType->kind == Float32)); }
+	bool IsFloat16Based() const { return kind == Float16 || ((kind == Vector || kind == Matrix) && subType->kind == Float16); }
 	bool IsNumeric() const { return kind == Bool || IsNumber(); }
 	bool IsNumericBased() const { return kind == Bool || IsNumber() || kind == Vector || kind == Matrix; }
 	bool IsVM1() const { return (kind == Vector && sizeX == 1) || (kind == Matrix && sizeX * sizeY == 1); }
@@ -314,6 +315,9 @@ struct ASTNode
 	struct VarDecl* ToVarDecl();
 	ASTFunction* ToFunction();
 	FINLINE const ASTFunction* ToFunction() const { return const_cast<ASTNode*>(this)->ToFunction(); }
+	FINLINE const Expr* ToExpr() const { return const_cast<ASTNode*>(this)->ToExpr(); }
+	FINLINE const Stmt* ToStmt() const { return const_cast<ASTNode*>(this)->ToStmt(); }
+	FINLINE const VarDecl* ToVarDecl() const { return const_cast<ASTNode*>(this)->ToVarDecl(); }
 	void ChangeAssocType(ASTType* t);
 
 	FINLINE void InsertBeforeMe(ASTNode* ch) { parent->InsertBefore(ch, this); }
@@ -379,6 +383,12 @@ struct VarDecl : ASTNode, AccessPointDecl
 		ATTR_StageIO = 0x0040, // whether the vardecl is stage i/o, not (just) function i/o
 		ATTR_Global  = 0x0080,
 	};
+	enum Precision
+	{
+		Prec_Default, // highp in GLSL ES output
+		Prec_Medium,
+		Prec_Low,
+	};
 
 	VarDecl(const VarDecl& o);
 	~VarDecl();
@@ -393,6 +403,7 @@ struct VarDecl : ASTNode, AccessPointDecl
 
 	uint32_t flags = 0;
 	int32_t regID = -1;
+	uint8_t precision = Prec_Default; // GLSL ES qualifier, picked by precision inference
 
 	VarDecl* prevScopeDecl = nullptr; // previous declaration in scope
 
@@ -402,6 +413,8 @@ struct VarDecl : ASTNode, AccessPointDecl
 	mutable int APRangeTo = 0;
 	// - usage
 	mutable bool used = false;
+	// - index into the per-variable state of the current optimization pass (-1 = not tracked)
+	mutable int optSlot = -1;
 };
 
 struct CBufferDecl : ASTNode
@@ -682,6 +695,7 @@ struct ReturnStmt : Stmt
 {
 	~ReturnStmt() { RemoveFromFunction(); }
 	IMPLEMENT_NODE(ReturnStmt);
+	ReturnStmt(const ReturnStmt& o) : Stmt(o) {} // copies are not added to the function
 
 	void AddToFunction(ASTFunction* fn);
 	void RemoveFromFunction();
@@ -786,6 +800,8 @@ struct ASTFunction : ASTNode
 	ReturnStmt* lastRetStmt = nullptr;
 	Array<VarDecl*> tmpVars;
 	bool used = false;
+	// index into the per-function state of the current optimization pass (-1 = not tracked)
+	mutable int optSlot = -1;
 };
 
 struct TypeSystem
@@ -882,19 +898,34 @@ struct AST : TypeSystem
 	ASTFunction* entryPoint = nullptr;
 
 	BlockStmt unassignedNodes;
+	BlockStmt removedUniforms; // VarDecl nodes replaced by constants (UniformSpecialization)
+
+	// CPU program that computes uniforms (PreshaderExtraction), inputs/outputs are in program order
+	Array<uint32_t> preshaderCode;
+	Array<AccessPointDecl> preshaderInputs;
+	Array<AccessPointDecl> preshaderOutputs;
+
+	// varyings moved into V2P_PACK# variables (VaryingPacker), name = pack variable with swizzle
+	Array<AccessPointDecl> packedVaryings;
+	// all varyings of the V2P_PACK# layout shared by both stages (VaryingPacker), name = pack variable
+	Array<AccessPointDecl> varyingPackLayout;
+	// VarDecl nodes moved into UNI_PACK# registers (HLSL SM3 UniformPacker)
+	// regID = register * 4 + first component, semanticName = pack variable with swizzle
+	BlockStmt packedUniforms;
 
 	bool usingDerivatives = false;
 	bool usingLODTextureSampling = false;
 	bool usingGradTextureSampling = false;
+	bool nativeHalf = false; // HOC_OF_NATIVE_HALF, half-based types are emitted with reduced precision
 };
 
 template<class V> struct ASTVisitor
 {
-	void PreVisit(ASTNode* node) {}
-	void PostVisit(ASTNode* node) {}
-	void PreVisitCBuffer(CBufferDecl* cbd) {}
-	void PostVisitCBuffer(CBufferDecl* cbd) {}
-	void VisitGlobal(VarDecl* vd) {}
+	void PreVisit(ASTNode*) {}
+	void PostVisit(ASTNode*) {}
+	void PreVisitCBuffer(CBufferDecl*) {}
+	void PostVisitCBuffer(CBufferDecl*) {}
+	void VisitGlobal(VarDecl*) {}
 	void VisitNode(ASTNode* node)
 	{
 		static_cast<V*>(this)->PreVisit(node);
@@ -946,11 +977,11 @@ template<class V> struct ASTWalker
 	//   d - no child, no next node, backtrack to [b], then go to [e] (next)
 	//  e  - has child
 	//   f - no child, no next, backtrack to [a] (end)
-	void PreVisit(ASTNode* node) {}
-	void PostVisit(ASTNode* node) {}
-	void PreVisitCBuffer(CBufferDecl* cbd) {}
-	void PostVisitCBuffer(CBufferDecl* cbd) {}
-	void VisitGlobal(VarDecl* vd) {}
+	void PreVisit(ASTNode*) {}
+	void PostVisit(ASTNode*) {}
+	void PreVisitCBuffer(CBufferDecl*) {}
+	void PostVisitCBuffer(CBufferDecl*) {}
+	void VisitGlobal(VarDecl*) {}
 	void VisitFunction(ASTFunction* fn)
 	{
 		WalkNode(fn->GetCode());
@@ -1051,25 +1082,430 @@ struct VariableAccessValidator
 	int endOfOutputElements = 0;
 };
 
+inline bool IsGLSL(OutputShaderFormat f)
+{
+	return f == OSF_GLSL_140 || f == OSF_GLSL_ES_100 || f == OSF_GLSL_330 || f == OSF_GLSL_ES_300;
+}
+// VS inputs and PS outputs are declared with layout(location=N), N stored in VarDecl::regID
+inline bool HasLayoutLocations(OutputShaderFormat f)
+{
+	return f == OSF_GLSL_330 || f == OSF_GLSL_ES_300;
+}
+// SPIR-V is generated from the same transformed AST as GLSL
+inline bool IsGLSLBased(OutputShaderFormat f)
+{
+	return IsGLSL(f) || f == OSF_SPIRV;
+}
+
 struct Info
 {
-	Info(Diagnostic& d, ShaderStage s, OutputShaderFormat of, uint32_t fl)
-		: diag(d), stage(s), outputFmt(of), outputFlags(fl)
+	Info(Diagnostic& d, ShaderStage s, OutputShaderFormat of, uint32_t fl, int ol = 1)
+		: diag(d), stage(s), outputFmt(of), outputFlags(fl), optimizationLevel(ol)
 	{}
 
 	Diagnostic& diag;
 	ShaderStage stage;
 	OutputShaderFormat outputFmt;
 	uint32_t outputFlags;
+	int optimizationLevel;
+	int maxUnrollSize = 256;
+	const UniformValue* uniformValues = nullptr; // terminated by name=NULL
+	CompileStats* compileStats = nullptr; // optional, optimization counters are added to it
+	bool deferVaryingPacking = false; // HOC_CompileShaderPair packs varyings after trimming the interface
 };
 
+// compiler.cpp - compilation stages in the order of execution (Parser::ParseCode runs in between)
+void GetFeatureDefs(ShaderStage stage, OutputShaderFormat outputFmt, const char* featureDefs[3]); // null-terminated
+bool ValidateAST(AST& ast, Diagnostic& diag, OutputShaderFormat outputFmt);
+bool TransformAST(AST& ast, const Info& info); // output-specific transformations
+void OptimizeAST(AST& ast, const Info& info);
+void PrepareASTForOutput(AST& ast, const Info& info); // naming, registers, output-specific fixups
+void GenerateCode(const AST& ast, OutputShaderFormat outputFmt, OutStream& out);
+bool GenerateCodeToBuffer(const AST& ast, OutputShaderFormat outputFmt, HOC_CodeOutput* co); // false if overflow allocation failed
+
+// compiler.cpp - AST editing helpers
+Stmt* FindParentStatement(Expr* expr);
+DeclRefExpr* FoldOutBefore(Expr* expr, Stmt* marker); // moves the expression to a new unnamed variable declared before the statement
+
+// compiler.cpp - uniform memory layout
+enum UniformLayoutRules
+{
+	ULR_D3D11,     // constant buffer packing, vectors do not cross 16-byte boundaries
+	ULR_STD140,    // GLSL std140
+	ULR_Registers, // each vector/matrix column/array element in a separate 16-byte register
+};
+
+struct UniformTypeLayout
+{
+	uint32_t size;
+	uint32_t align;
+	uint32_t arrayStride;
+	uint32_t matrixStride;
+};
+
+// glsl: matrices are laid out as GLSL matCxR columns instead of HLSL floatRxC columns
+UniformTypeLayout GetUniformTypeLayout(const ASTType* type, UniformLayoutRules rules, bool glsl);
+uint32_t PlaceInUniformLayout(uint32_t cursor, const ASTType* type, const UniformTypeLayout& tl, UniformLayoutRules rules);
+// returns the first offset available to the next variable
+uint32_t EndOfUniformLayout(uint32_t offset, const ASTType* type, const UniformTypeLayout& tl, UniformLayoutRules rules);
+
 
 // optimizer.cpp
+// scalar/vector/matrix constant, matrix elements are in row-major order (like in init lists)
+struct ConstValue
+{
+	ASTType::Kind kind = ASTType::Void; // Bool, Int32 or Float32 (Float16 is evaluated as Float32)
+	int count = 0;
+	double v[16];
+};
+
+// replaces reads of uniforms with the values specified by the user
+// - runs before the output-specific transformations (values of matrices are in row-major order)
+// - uniforms outside cbuffers are moved to AST::removedUniforms, cbuffer members are kept to preserve the layout
+struct UniformSpecialization : ASTWalker<UniformSpecialization>
+{
+	UniformSpecialization(Diagnostic& d) : diag(d) {}
+	bool AddValue(AST& ast, const UniformValue& uv);
+	void PostVisit(ASTNode* node);
+	void VisitGlobal(VarDecl* vd);
+	bool RunOnAST(AST& ast, const UniformValue* uvs);
+
+	Diagnostic& diag;
+	Array<VarDecl*> vars; // optSlot = index
+	Array<ConstValue> values;
+};
+
+// moves maximal expressions that only depend on uniforms and constants to a CPU program (preshader)
+// - each expression is replaced with a new uniform, identical expressions share it
+// - runs before the output-specific transformations (the program uses HLSL semantics, row-major matrices)
+// - uniforms that are modified by the shader and calls to user functions are not extracted
+struct PreshaderExtraction
+{
+	// stack machine, each instruction is followed by its operand words
+	enum Opcode
+	{
+		PSO_Input,   // input index, component offset
+		PSO_Const,   // one word per component (int32/float32 bits)
+		PSO_Unary,   // SLTokenType
+		PSO_Binary,  // SLTokenType
+		PSO_Op,      // OpKind, argument count in instruction
+		PSO_Swizzle, // member ID
+		PSO_Index,
+		PSO_Cast,
+		PSO_List,    // element count in instruction
+		PSO_Select,
+		PSO_Output,  // output index
+
+		PSO_COUNT,
+	};
+	enum { Magic = 0x50434F48, HeaderSize = 4 }; // "HOCP", input count, output count, stack size
+
+	struct ExprInfo
+	{
+		bool uniformOnly = false;
+		bool hasInput = false;
+		int numOps = 0;
+	};
+
+	static bool IsExtractable(const ExprInfo& info) { return info.uniformOnly && info.hasInput && info.numOps > 0; }
+	bool IsInputVar(const VarDecl* vd) const;
+	bool IsArrayInput(const IndexExpr* idx, int& offset) const;
+	ExprInfo Classify(Expr* expr);
+	void ProcessChildren(ASTNode* node);
+	void Extract(Expr* expr);
+	int GetInputIndex(VarDecl* vd);
+	void Emit(uint32_t opcode, uint32_t argc, const ASTType* t, int numPops, int numPushes);
+	void EmitExpr(const Expr* expr);
+	void FindWrittenVars(ASTNode* node);
+	void RunOnAST(AST& a);
+
+	AST* ast = nullptr;
+	Array<VarDecl*> writtenVars;
+	Array<ExprInfo> childInfos;
+	Array<VarDecl*> inputs; // optSlot = index
+	Array<VarDecl*> outputs;
+	Array<Expr*> extracted; // for each output
+	int stackSize = 0;
+	int maxStackSize = 0;
+	int numExtracted = 0;
+};
+bool RunPreshader(const uint32_t* code, size_t codeSize, const float* const* inputs, float* const* outputs);
+
 struct ConstantPropagation : ASTWalker<ConstantPropagation>
 {
+	// matrix constants cannot be evaluated after GLSL conversion (transposed init lists, reordered mul)
+	ConstantPropagation(bool fm = true) : foldMatrices(fm) {}
+	bool Evaluate(Expr* expr, ConstValue& out);
+	void PostVisit(ASTNode* node);
+	void VisitGlobal(VarDecl* vd);
+	void RunOnAST(AST& ast) { VisitAST(ast); }
+
+	bool foldMatrices;
+};
+
+// propagates constants through local variables and static const globals (SCCP-style)
+// - values are tracked per variable along the structured control flow and merged after branches
+// - branches with constant conditions are removed as soon as they are found, only the taken one is analyzed
+// - variables written inside a loop are not constant inside or after it
+struct VariableConstantPropagation
+{
+	struct VarWrite
+	{
+		int slot;
+		Expr* node; // assignment, increment/decrement or function call
+		bool conditional; // under &&, || or ?:
+	};
+
+	VariableConstantPropagation(bool fm = true) : folder(fm) {}
+	void AssignSlots(ASTNode* node);
+	void CollectWrites(ASTNode* node, bool conditional);
+	void SubstituteReads(ASTNode* node, int rootSlot);
+	bool EvaluateWrite(const VarWrite& w, ConstValue& out);
+	Expr* ProcessExpr(Expr* expr);
+	void ProcessStmt(Stmt* stmt);
+	void ProcessLoop(Stmt* loop);
+	void ProcessFunction(ASTFunction* fn);
+	void RunOnAST(AST& ast);
+
+	ConstantPropagation folder;
+	Array<ConstValue> globalValues;
+	Array<ConstValue> values; // indexed by VarDecl::optSlot, count = 0 - not constant
+	Array<VarDecl*> slotVars;
+	Array<VarWrite> writes;
+	bool unreachable = false;
+};
+
+// peephole rewrites of scalar/vector expressions (identities, idempotent intrinsics, cast and swizzle chains)
+// - by default, only rewrites with bit-identical results are done (x+0 is not one of them for floats: -0+0=+0)
+// - fast math allows those that differ for signed zeros, infinities, NaNs or by rounding
+// - the results are folded again, to propagate the constants produced by the rewrites
+struct AlgebraicSimplification : ASTWalker<AlgebraicSimplification>
+{
+	AlgebraicSimplification(bool fast = false, bool fm = true) : folder(fm), fastMath(fast) {}
+	Expr* Simplify(Expr* expr); // returns the replacement or nullptr
 	void PostVisit(ASTNode* node);
 	void VisitGlobal(VarDecl* vd);
 	void RunOnAST(AST& ast) { VisitAST(ast); }
+
+	ConstantPropagation folder;
+	bool fastMath;
+	int numSimplified = 0;
+};
+
+// value numbering CSE over the statements of a block and the blocks nested in it
+// - pure expressions get the same value number if their operation, type and operand value numbers match
+// - variables take the value number of the value assigned to them, writes give them a new one
+// - repeated expressions are replaced with a temporary (or a variable still holding the first result),
+//   which is declared before the statement containing the first occurrence
+// - temporaries left with a single use (the other occurrences were part of a larger repeated expression)
+//   are inlined back into that use
+// - statements with nested side effects, loop conditions/increments and branches/loop bodies
+//   that are not blocks are not optimized
+struct CommonSubexpressionElimination
+{
+	struct Value
+	{
+		uint32_t hash;
+		int next; // previous entry in the same hash bucket
+		int vn; // value number
+		ASTNode::Kind kind;
+		uint32_t op;
+		const ASTType* type;
+		double constVal;
+		int firstArg; // in valueArgs
+		int numArgs;
+		Expr* node; // first occurrence, null if not worth replacing
+		VarDecl* temp;
+		VarDecl* holder; // variable the first occurrence was assigned to
+	};
+
+	int NewValue() { return nextValue++; }
+	int GetVarValue(VarDecl* vd);
+	void SetVarValue(VarDecl* vd, int vn);
+	void ApplyWrites(ASTNode* node);
+	int FindOrAddValue(Expr* expr, uint32_t op, double constVal, const int* args, int numArgs);
+	void PopValues(size_t count);
+	int NumberExpr(Expr* expr);
+	void NumberAssignment(Expr* expr);
+	void ProcessStmt(Stmt* stmt);
+	void ProcessBlock(Stmt* stmt);
+	void CountTempUses(ASTNode* node);
+	void InlineSingleUseTemps();
+	void ProcessFunction(ASTFunction* fn);
+	void RunOnAST(AST& ast);
+
+	ASTFunction* curFunction = nullptr;
+	Array<VarDecl*> temps; // created in the current function
+	Array<int> tempUses; // indexed by VarDecl::optSlot
+	Array<DeclRefExpr*> tempLastUse; // indexed by VarDecl::optSlot
+	Array<Value> values;
+	Array<int> valueArgs;
+	Array<int> buckets;
+	Array<int> varValues; // indexed by VarDecl::optSlot
+	Array<VarDecl*> slotVars;
+	Array<VarDecl*> writableGlobals;
+	int nextValue = 0;
+};
+
+// removes stores to local variables that are not read afterwards (backward liveness analysis)
+// - assignments whose value has side effects are reduced to the value, out arguments are kept
+// - loops are iterated to a fixed point before any stores in them are removed
+struct DeadStoreElimination
+{
+	typedef Array<uint8_t> LiveSet; // indexed by VarDecl::optSlot
+
+	struct LoopTargets
+	{
+		const LiveSet* breakLive;
+		const LiveSet* continueLive;
+	};
+
+	void AssignSlots(ASTNode* node);
+	void AddReads(ASTNode* node);
+	void AddLValueReads(Expr* expr);
+	void RemoveStmt(Stmt* stmt);
+	bool ProcessStore(ExprStmt* stmt);
+	void ProcessStmt(Stmt* stmt);
+	void ProcessLoop(Stmt* loop);
+	void ProcessFunction(ASTFunction* fn);
+	void RunOnAST(AST& ast);
+
+	LiveSet live;
+	Array<VarDecl*> slotVars;
+	const LoopTargets* curLoop = nullptr;
+	bool apply = true; // false while loops are iterated to a fixed point
+};
+
+// removes stores to members of local structs that are never read (flow-insensitive)
+// - whole struct copies to other locals make the members read from the copy read from the source
+// - helps after entry point unpacking, where output structs are copied member by member
+struct DeadMemberStoreElimination
+{
+	struct Copy
+	{
+		int dst;
+		int src;
+	};
+
+	void AssignSlots(ASTNode* node);
+	void FindReads(ASTNode* node);
+	void FindStores(ASTNode* node, Array<ExprStmt*>& out);
+	void ProcessFunction(ASTFunction* fn);
+	void RunOnAST(AST& ast);
+
+	Array<VarDecl*> slotVars;
+	Array<uint32_t> readMasks; // indexed by VarDecl::optSlot, bit per member
+	Array<Copy> copies;
+	int numRemoved = 0;
+};
+
+// replaces calls to user functions with their bodies
+// - functions reachable from the entry point are processed callers first, the calls in inlined bodies
+//   are processed as part of the caller, so only original bodies are inlined
+// - the last remaining call of a function gets the body itself, the function is removed right after
+// - other calls get copies if the function is tiny and makes no calls or if the caller's size
+//   stays within the growth budget (nodes added by copies)
+// - calls are inlined in evaluation order until the first side effect that cannot be moved before
+//   the statement, calls under &&, || and ?: and in loop conditions/increments are not inlined
+// - parameters become local variables (or are replaced with the arguments if those are constants or
+//   variables the function cannot modify), out/inout parameters are copied back after the body
+// - returns are restructured into if/else so that nothing follows them, functions with returns in
+//   loops or static local variables are not inlined
+// - inlined local variables are renamed to _inl<N>_<name>
+// - functions that are no longer called are removed
+struct FunctionInliner
+{
+	struct FuncInfo
+	{
+		int state = 0; // 0 - not checked, 1 - can be inlined, -1 - cannot be inlined
+		int visit = 0; // 0 - not found, 1 - found, 2 - callees being processed, 3 - done
+		int size = 0; // number of nodes in the body
+		int numCalls = 0; // remaining calls in reachable code
+		bool makesCalls = false;
+		uint32_t writtenParams = 0; // bit per parameter
+	};
+	struct Replacement
+	{
+		VarDecl* var;
+		Expr* expr; // for parameters replaced with the argument
+	};
+
+	FunctionInliner(int ol = 1) : maxGrowth(ol >= 2 ? 512 : 64) {}
+	FuncInfo& GetInfo(ASTFunction* fn);
+	Stmt* CloneWithLocals(const Stmt* stmt);
+	void ApplyReplacements(ASTNode* node);
+	bool PrepareFunction(ASTFunction* fn, FuncInfo& fi);
+	bool ShouldInline(ASTFunction* fn);
+	bool InlineCall(OpExpr* call, Stmt* stmt, bool& stmtRemoved);
+	bool ProcessExpr(ASTNode* holder, Stmt* stmt); // false if the statement was removed
+	void ProcessStmt(Stmt* stmt);
+	void CountCalls(ASTNode* node);
+	void SortFunctions(Array<int>& order);
+	void MarkUsed(ASTFunction* fn);
+	void RunOnAST(AST& ast);
+
+	Array<FuncInfo> funcInfos; // indexed by ASTFunction::optSlot
+	Array<ASTFunction*> slotFuncs;
+	Array<Replacement> replacements; // indexed by VarDecl::optSlot
+	Array<VarDecl*> clonedVars;
+	Array<Stmt*> pending; // inlined statements, processed after the current one
+	ASTFunction* entryPoint = nullptr;
+	ASTFunction* curFunction = nullptr;
+	int maxGrowth; // max. number of nodes copied into one function
+	int curGrowth = 0;
+	int numInlined = 0;
+};
+
+// fully unrolls `for` loops with a constant trip count
+// - the loop must have the form `for (i = C0; i <cmp> C1; i += C2)` (also ++, --, -= and `i = i +/- C2`),
+//   with i declared in the loop or a local variable, of int/uint type and not written in the body
+// - loops containing break/continue (of the loop itself) or static variables are not unrolled
+// - each iteration gets a copy of the body with i replaced by its value, copied local variables are
+//   renamed like the originals (each copy is in its own block), i is set to its final value after them
+// - inner loops are unrolled first, a loop is unrolled only if (body size * trip count) is within the budget
+struct LoopUnroller
+{
+	LoopUnroller(int maxSize = 256) : maxSize(maxSize) {}
+	bool MatchLoop(ForStmt* loop, int64_t& start, int64_t& step, int& tripCount);
+	Expr* CreateIndexConst(int64_t value);
+	void ApplyIndex(ASTNode* node, int64_t value);
+	void UnrollLoop(ForStmt* loop, int64_t start, int64_t step, int tripCount);
+	void ProcessStmt(Stmt* stmt);
+	void RunOnAST(AST& ast);
+
+	AST* ast = nullptr;
+	ASTFunction* curFunction = nullptr;
+	VarDecl* indexVar = nullptr;
+	Array<VarDecl*> clonedVars;
+	int maxSize; // max. number of nodes in the unrolled code
+	int numUnrolled = 0;
+};
+
+// moves loop invariant expressions into temporaries declared before the loop
+// - invariant expressions are pure and only read constants, uniforms, const globals and local
+//   variables that are neither declared nor written in the loop
+// - function calls, clip, texture sampling and derivatives are not moved (their arguments can be)
+// - conditions of for/while loops are evaluated on entry and can always be hoisted from, bodies and
+//   increments only if the first iteration is known to be taken (do/while, constant true condition,
+//   `for` with a constant index that passes the condition)
+// - inner loops are processed first, unnamed temporaries declared directly in the body of the outer
+//   loop with an invariant value are moved out as a whole
+struct LoopInvariantCodeMotion
+{
+	void MarkLoopVars(ASTNode* node);
+	void UnmarkLoopVars();
+	bool IsInvariantVar(const VarDecl* vd) const;
+	void Hoist(Expr* expr);
+	bool ProcessExpr(Expr* expr); // returns whether the expression is invariant
+	void ProcessLValue(Expr* expr);
+	void ProcessStmt(Stmt* stmt);
+	void ProcessLoop(Stmt* loop);
+	void FindLoops(Stmt* stmt);
+	void RunOnAST(AST& ast);
+
+	Stmt* curLoop = nullptr;
+	Array<VarDecl*> loopVars; // declared or written in the current loop, marked with optSlot = 0
+	int numHoisted = 0;
 };
 
 struct RemoveUnusedFunctions
@@ -1080,13 +1516,19 @@ struct RemoveUnusedFunctions
 struct MarkUnusedVariables : ASTWalker<MarkUnusedVariables>
 {
 	void PreVisit(ASTNode* node);
+	void VisitGlobal(VarDecl* vd);
 	void VisitFunction(ASTFunction* fn);
 	void RunOnAST(AST& ast);
 };
 
 struct RemoveUnusedVariables : ASTWalker<RemoveUnusedVariables>
 {
+	void PostVisit(ASTNode* node);
+	void VisitFunction(ASTFunction* fn);
 	void RunOnAST(AST& ast);
+
+	ASTFunction* curFunction = nullptr;
+	Array<VarDecl*> removedVars; // deleted after the function, indexed by VarDecl::optSlot
 };
 
 
@@ -1095,6 +1537,12 @@ void GenerateHLSL_SM3(const AST& ast, OutStream& out);
 void GenerateHLSL_SM4(const AST& ast, OutStream& out);
 void GenerateGLSL_140(const AST& ast, OutStream& out);
 void GenerateGLSL_ES_100(const AST& ast, OutStream& out);
+void GenerateGLSL_330(const AST& ast, OutStream& out);
+void GenerateGLSL_ES_300(const AST& ast, OutStream& out);
+
+
+// spirv.cpp
+void GenerateSPIRV(const AST& ast, OutStream& out);
 
 
 } /* namespace HOC */
@@ -12,12 +12,20 @@ struct SLGenerator
 	virtual void EmitTypeRef(const ASTType* type) = 0;
 	virtual void EmitAccessPointTypeAndName(ASTType* type, const String& name);
 	virtual void EmitAccessPointDecl(const AccessPointDecl& apd);
+	virtual void EmitPrecision(const ASTType*, uint8_t) {}
 	virtual void EmitVarDecl(const VarDecl* vd);
 	virtual void EmitExpr(const Expr* node);
 	virtual void EmitStmt(const Stmt* node, int level);
 	void GenerateStructs();
 	void GenerateFunctions();
 
+	static bool IsHalfBased(const ASTType* type)
+	{
+		while (type->kind == ASTType::Array)
+			type = type->subType;
+		return type->IsFloat16Based();
+	}
+
 	void LVL(int level)
 	{
 		while (level-- > 0)
@@ -65,10 +73,12 @@ struct GLSLGenerator : SLGenerator
 		supportsScalarSwizzle = false;
 	}
 	void EmitTypeRef(const ASTType* type);
+	void EmitPrecision(const ASTType* type, uint8_t precision);
 	void EmitExpr(const Expr* node);
 	void Generate();
 
 	int version = 140;
+	bool layoutLocations = false;
 };
 
 
@@ -134,6 +144,7 @@ void SLGenerator::EmitVarDecl(const VarDecl* vd)
 	}
 	if (vd->flags & VarDecl::ATTR_Uniform)
 		out << "uniform ";
+	EmitPrecision(vd->GetType(), vd->precision);
 
 	EmitAccessPointDecl(*vd);
 
@@ -175,11 +186,9 @@ void SLGenerator::EmitExpr(const Expr* node)
 	else if (auto* f32expr = dyn_cast<const Float32Expr>(node))
 	{
 		char bfr[32];
-		sprintf(bfr, "%.18g", f32expr->value);
-		out << bfr;
-		if (strstr(bfr, ".") == nullptr &&
-			strstr(bfr, "e") == nullptr &&
-			strstr(bfr, "E") == nullptr)
+		size_t len = FormatFloat32(bfr, float(f32expr->value));
+		out.Write(bfr, len);
+		if (!memchr(bfr, '.', len) && !memchr(bfr, 'e', len))
 			out << ".0";
 		if (supportsDoubles)
 			out << "f";
@@ -498,6 +507,7 @@ void SLGenerator::GenerateStructs()
 		{
 			out << "\n";
 			LVL(1);
+			EmitPrecision(m.type, VarDecl::Prec_Default);
 			EmitAccessPointDecl(m);
 			out << ";";
 		}
@@ -511,6 +521,7 @@ void SLGenerator::GenerateFunctions()
 	{
 		const ASTFunction* F = fnn->ToFunction();
 
+		EmitPrecision(F->GetReturnType(), VarDecl::Prec_Default);
 		EmitTypeRef(F->GetReturnType());
 		out << " " << F->mangledName << "(";
 		for (ASTNode* arg = F->GetFirstArg(); arg; arg = arg->next)
@@ -545,7 +556,7 @@ void HLSLGenerator::EmitTypeRef(const ASTType* type)
 	case ASTType::Bool:        out << "bool"; break;
 	case ASTType::Int32:       out << "int"; break;
 	case ASTType::UInt32:      out << "uint"; break;
-	case ASTType::Float16:     out << "half"; break;
+	case ASTType::Float16:     out << (IsGE4() && ast.nativeHalf ? "min16float" : "half"); break;
 	case ASTType::Float32:     out << "float"; break;
 	case ASTType::Sampler1D:   out << (IsGE4() ? "SAMPLER_1D" : "sampler1D"); break;
 	case ASTType::Sampler2D:   out << (IsGE4() ? "SAMPLER_2D" : "sampler2D"); break;
@@ -840,7 +851,7 @@ void GLSLGenerator::EmitTypeRef(const ASTType* type)
 	case ASTType::Bool: out << "bool"; break;
 	case ASTType::Int32: out << "int"; break;
 	case ASTType::UInt32: out << "uint"; break;
-	case ASTType::Float16: out << "mediump float"; break;
+	case ASTType::Float16: out << (ast.nativeHalf ? "float" : "mediump float"); break;
 	case ASTType::Float32: out << "float"; break;
 	case ASTType::Sampler1D: out << "sampler1D"; break;
 	case ASTType::Sampler2D: out << "sampler2D"; break;
@@ -858,7 +869,7 @@ void GLSLGenerator::EmitTypeRef(const ASTType* type)
 		case ASTType::Bool: out << "bvec"; break;
 		case ASTType::Int32: out << "ivec"; break;
 		case ASTType::UInt32: out << "uvec"; break;
-		case ASTType::Float16: out << "mediump vec"; break;
+		case ASTType::Float16: out << (ast.nativeHalf ? "vec" : "mediump vec"); break;
 		case ASTType::Float32: out << "vec"; break;
 		}
 		out << int(type->sizeX);
@@ -869,7 +880,7 @@ void GLSLGenerator::EmitTypeRef(const ASTType* type)
 		case ASTType::Bool: out << "mat"; break;
 		case ASTType::Int32: out << "mat"; break;
 		case ASTType::UInt32: out << "mat"; break;
-		case ASTType::Float16: out << "mediump mat"; break;
+		case ASTType::Float16: out << (ast.nativeHalf ? "mat" : "mediump mat"); break;
 		case ASTType::Float32: out << "mat"; break;
 		}
 		out << int(type->sizeX);
@@ -883,6 +894,17 @@ void GLSLGenerator::EmitTypeRef(const ASTType* type)
 	}
 }
 
+void GLSLGenerator::EmitPrecision(const ASTType* type, uint8_t precision)
+{
+	// native half: qualifiers are only valid in declarations, not in constructors (otherwise the type names contain them)
+	if (precision == VarDecl::Prec_Default && ast.nativeHalf && IsHalfBased(type))
+		precision = VarDecl::Prec_Medium;
+	if (precision == VarDecl::Prec_Medium)
+		out << "mediump ";
+	else if (precision == VarDecl::Prec_Low)
+		out << "lowp ";
+}
+
 void GLSLGenerator::EmitExpr(const Expr* node)
 {
 	if (auto* castexpr = dyn_cast<const CastExpr>(node))
@@ -975,7 +997,7 @@ void GLSLGenerator::EmitExpr(const Expr* node)
 		case Op_Tex1DLOD0Cmp:
 		case Op_Tex2DLOD0Cmp:
 		case Op_TexCubeLOD0Cmp: fnEnd = ",-32)"; // <- bias LOD away from lower mip levels
-			// passthrough
+			// fallthrough
 		case Op_Tex1DCmp:
 		case Op_Tex2DCmp:
 		case Op_TexCubeCmp: fnstr = version < 140 ? "UNAVAILABLE" : "texture"; break;
@@ -1025,7 +1047,15 @@ void GLSLGenerator::EmitExpr(const Expr* node)
 
 void GLSLGenerator::Generate()
 {
-	out << "#version " << version << "\n";
+	out << "#version " << version << (shaderFormat == OSF_GLSL_ES_300 ? " es\n" : "\n");
+	if (shaderFormat == OSF_GLSL_ES_300)
+	{
+		out << "precision highp float;\n";
+		// these sampler types have no default precision
+		out << "precision highp sampler3D;\n";
+		out << "precision highp sampler2DShadow;\n";
+		out << "precision highp samplerCubeShadow;\n";
+	}
 	if (version == 100)
 	{
 		out << "precision highp float;\n";
@@ -1067,6 +1097,8 @@ void GLSLGenerator::Generate()
 			auto* gv = g->ToVarDecl();
 			if (gv->flags & VarDecl::ATTR_Hidden)
 				continue;
+			if (layoutLocations && (gv->flags & VarDecl::ATTR_StageIO) && gv->regID >= 0)
+				out << "layout(location=" << gv->regID << ") ";
 			EmitVarDecl(gv);
 			out << ";\n";
 		}
@@ -1104,3 +1136,21 @@ void HOC::GenerateGLSL_ES_100(const AST& ast, OutStream& out)
 	gen.Generate();
 }
 
+void HOC::GenerateGLSL_330(const AST& ast, OutStream& out)
+{
+	GLSLGenerator gen(ast, out);
+	gen.shaderFormat = OSF_GLSL_330;
+	gen.version = 330;
+	gen.layoutLocations = true;
+	gen.Generate();
+}
+
+void HOC::GenerateGLSL_ES_300(const AST& ast, OutStream& out)
+{
+	GLSLGenerator gen(ast, out);
+	gen.shaderFormat = OSF_GLSL_ES_300;
+	gen.version = 300;
+	gen.layoutLocations = true;
+	gen.Generate();
+}
+
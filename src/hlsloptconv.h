@@ -37,6 +37,13 @@ enum HOC_OutputShaderFormat
 	HOC_(OSF_HLSL_SM4),
 	HOC_(OSF_GLSL_140),
 	HOC_(OSF_GLSL_ES_100),
+	HOC_(OSF_GLSL_330),    /* explicit layout(location) on VS inputs and PS outputs */
+	HOC_(OSF_GLSL_ES_300), /* explicit layout(location) on VS inputs and PS outputs */
+	HOC_(OSF_SPIRV),       /* binary SPIR-V 1.0 module (Vulkan), code is a word array, not zero-terminated:
+	                          - uniform blocks: DescriptorSet 0, Binding = block register
+	                            (non-block uniforms are moved to the "$Globals" block first)
+	                          - samplers: DescriptorSet 1, Binding = sampler register
+	                          - Location on VS inputs, PS outputs and varyings (ordered by semantic) */
 };
 
 struct HOC_ShaderMacro
@@ -45,6 +52,16 @@ struct HOC_ShaderMacro
 	const char* value;
 };
 
+/* value of a uniform that is known at compile time
+- numValues must be 1 (used for all components) or the number of components (matrices are row-major)
+- values are converted to the type of the uniform (only bool/int/half/float based types are supported) */
+struct HOC_UniformValue
+{
+	const char*  name;
+	const float* values;
+	uint32_t     numValues;
+};
+
 enum HOC_ShaderVarType
 {
 	HOC_(SVT_StructBegin)       = 1, /* nested structs are possible */
@@ -56,6 +73,14 @@ enum HOC_ShaderVarType
 	HOC_(SVT_Sampler)           = 7, /* only SDT_Sampler* types */
 	HOC_(SVT_PSOutputDepth)     = 8, /* only scalar types */
 	HOC_(SVT_PSOutputColor)     = 9, /* only vector types */
+	HOC_(SVT_RemovedUniform)    = 10, /* uniform replaced by its value from HOC_Config::uniformValues */
+	HOC_(SVT_PreshaderInput)    = 11, /* uniform read by the preshader, listed in program input order */
+	HOC_(SVT_PreshaderOutput)   = 12, /* uniform computed by the preshader, listed in program output order */
+	HOC_(SVT_PackedVarying)     = 13, /* varying stored in a part of V2P_PACK#, name = "V2P_PACK#.<swizzle>" */
+	HOC_(SVT_VSOutput)          = 14, /* only with HOC_OF_EXPORT_VARYINGS */
+	HOC_(SVT_PSInput)           = 15, /* only with HOC_OF_EXPORT_VARYINGS */
+	HOC_(SVT_PackedUniform)     = 16, /* uniform stored in a part of UNI_PACK#, register quad=/4, comp=%4,
+	                                     semantic = "UNI_PACK#.<swizzle>" */
 };
 
 enum HOC_ShaderDataType
@@ -64,7 +89,7 @@ enum HOC_ShaderDataType
 	HOC_(SDT_Bool)    = 1,
 	HOC_(SDT_Int32)   = 2,
 	HOC_(SDT_UInt32)  = 3,
-	HOC_(SDT_Float16) = 4,
+	HOC_(SDT_Float16) = 4, /* with HOC_OF_NATIVE_HALF: emitted as min16float/mediump (uniforms are Float32) */
 	HOC_(SDT_Float32) = 5,
 
 	HOC_(SDT_Sampler1D)       = 20,
@@ -89,6 +114,14 @@ struct HOC_ShaderVariable /* 20 bytes */
 	uint8_t  sizeY;     /* 0 if scalar/vector, 1-4 for matrix */
 };
 
+struct HOC_ShaderVariableLayout /* 16 bytes, one for each HOC_ShaderVariable (HOC_OF_EXPORT_LAYOUT) */
+{
+	uint32_t offset;       /* in bytes from the beginning of the uniform block, 0xffffffff if unknown/not applicable */
+	uint32_t size;         /* in bytes, without the padding after the last array element/matrix column */
+	uint32_t arrayStride;  /* in bytes between array elements, 0 if no array */
+	uint32_t matrixStride; /* in bytes between matrix columns, 0 if no matrix */
+};
+
 
 /* loads include file
 - file is the exact string in #include
@@ -111,7 +144,7 @@ template<class Str> inline void HOC_WriteStr_String(const char* str, size_t size
 #endif
 
 #ifndef HOC_HEADER_NO_STDIO
-static void HOC_WriteStr_FILE(const char* str, size_t size, void* userData)
+static inline void HOC_WriteStr_FILE(const char* str, size_t size, void* userData)
 {
 	fwrite(str, size, 1, (FILE*) userData);
 }
@@ -132,9 +165,21 @@ struct HOC_InterfaceOutput
 		outVarBufSize = 0;
 		outVarStrBuf = NULL;
 		outVarStrBufSize = 0;
+		outPreshaderBuf = NULL;
+		outPreshaderBufSize = 0;
+		outUsageMaskBuf = NULL;
+		outUsageMaskBufSize = 0;
+		outLayoutBuf = NULL;
+		outLayoutBufSize = 0;
+		outLocationBuf = NULL;
+		outLocationBufSize = 0;
 		overflowAlloc = HOC_TRUE;
 		didOverflowVar = HOC_FALSE;
 		didOverflowStr = HOC_FALSE;
+		didOverflowPreshader = HOC_FALSE;
+		didOverflowUsageMask = HOC_FALSE;
+		didOverflowLayout = HOC_FALSE;
+		didOverflowLocation = HOC_FALSE;
 	}
 #endif
 
@@ -145,6 +190,118 @@ struct HOC_InterfaceOutput
 	HOC_BoolU8 overflowAlloc;
 	HOC_BoolU8 didOverflowVar;
 	HOC_BoolU8 didOverflowStr;
+
+	/* fields added after the initial release are appended to keep the layout compatible */
+	uint32_t* outPreshaderBuf;  /* preshader code (HOC_OF_PRESHADER), for HOC_RunPreshader */
+	size_t outPreshaderBufSize; /* in 32-bit words, changed to output data size after compilation (0 - no preshader) */
+	HOC_BoolU8 didOverflowPreshader;
+	uint32_t* outUsageMaskBuf;  /* uniform read masks (HOC_OF_EXPORT_USAGE_MASKS), see below */
+	size_t outUsageMaskBufSize; /* in 32-bit words, changed to output data size after compilation */
+	HOC_BoolU8 didOverflowUsageMask;
+	HOC_ShaderVariableLayout* outLayoutBuf; /* uniform memory layout (HOC_OF_EXPORT_LAYOUT), see below */
+	size_t outLayoutBufSize;  /* changed to output data size after compilation (same as outVarBufSize or 0) */
+	HOC_BoolU8 didOverflowLayout;
+	int32_t* outLocationBuf;    /* layout locations, one for each HOC_ShaderVariable, see below */
+	size_t outLocationBufSize;  /* changed to output data size after compilation (same as outVarBufSize or 0) */
+	HOC_BoolU8 didOverflowLocation;
+};
+
+/* usage mask buffer layout
+- one word for each variable in outVarBuf: offset of its mask in this buffer or 0xffffffff if there is none
+  (only SVT_Uniform/SVT_PackedUniform variables have masks, including struct members)
+- masks: one bit for each scalar component that is read after optimization (bit N = word N/32, 1 << N%32)
+  - components are counted from the first array element, matrices by row (float4x4[2]: 32 bits)
+  - members of arrays of structs combine the reads from all elements */
+
+/* layout buffer contents (matching the packing rules of the output format)
+- HLSL SM4: D3D10+ constant buffer packing, globals are laid out in the $Globals buffer
+  - vectors do not cross 16-byte boundaries, arrays/matrices/structs start at one
+  - offsets from packoffset/register() are used if they are specified
+- GLSL 1.40: std140 for uniform blocks, other uniforms have no offset
+- SPIR-V: std140 for all uniform blocks, including $Globals
+- HLSL SM3/GLSL ES 1.00: one 16-byte register for each vector/matrix column/array element,
+  offsets for uniform blocks and (SM3) uniforms with assigned registers
+- matrix columns are HLSL floatRxC columns (C x R-component vectors) for HLSL outputs
+  and GLSL matCxR columns (C x R-component vectors) for GLSL outputs
+- uniform block begin/end entries have offset 0 and the size of the whole block (rounded to 16 bytes)
+- struct members have offsets of the first array element, add arrayStride of the struct for others */
+
+/* location buffer contents (GLSL 3.30/ES 3.00/SPIR-V only, empty for other formats)
+- layout(location) of VS inputs and PS color outputs, and of varyings @ SPIR-V
+- -1 for all other variables */
+
+/* allocates memory for output buffers
+- the returned memory is owned by the caller (no free function is called by the library) */
+typedef void*(*HOC_AllocPFN)(size_t size, void* userData);
+
+/* writes generated code directly into a caller-owned buffer
+- on overflow, the needed size is returned in outCodeSize and outBuf receives as much as fits
+- with overflowAlloc, a buffer of the exact size is allocated instead and the code is written to it
+  (using allocFunc if set, otherwise free the buffer using HOC_FreeCodeOutputBuffer) */
+struct HOC_CodeOutput
+{
+#ifdef __cplusplus
+	HOC_CodeOutput()
+	{
+		outBuf = NULL;
+		outBufSize = 0;
+		outCodeSize = 0;
+		allocFunc = NULL;
+		allocUserData = NULL;
+		overflowAlloc = HOC_TRUE;
+		didOverflow = HOC_FALSE;
+	}
+#endif
+
+	char* outBuf;             /* code is zero-terminated if it fits */
+	size_t outBufSize;        /* changed to the new buffer size if overflowAlloc is used */
+	size_t outCodeSize;       /* length of code after compilation, without the terminator */
+	HOC_AllocPFN allocFunc;   /* optional allocator for overflowAlloc */
+	void* allocUserData;
+	HOC_BoolU8 overflowAlloc;
+	HOC_BoolU8 didOverflow;
+};
+
+enum HOC_CompileStage
+{
+	HOC_(CS_Tokenize),   /* includes tokenization of included files */
+	HOC_(CS_Preprocess),
+	HOC_(CS_Parse),      /* declarations, statements, expressions and their validation */
+	HOC_(CS_Validate),   /* variable access and output format support */
+	HOC_(CS_Transform),  /* output-specific transformations, register assignment */
+	HOC_(CS_Optimize),
+	HOC_(CS_Generate),   /* code and interface output */
+};
+#define HOC_NUM_COMPILE_STAGES 7
+
+struct HOC_CompileStats
+{
+#ifdef __cplusplus
+	HOC_CompileStats()
+	{
+		for (int i = 0; i < HOC_NUM_COMPILE_STAGES; ++i)
+			stageTime[i] = 0;
+		numInlinedCalls = 0;
+		numUnrolledLoops = 0;
+		numHoistedExprs = 0;
+		numSimplifiedExprs = 0;
+		numPreshaderExprs = 0;
+		numLowPrecisionVars = 0;
+		numRemovedVSOutputs = 0;
+		numPackedUniforms = 0;
+	}
+#endif
+
+	/* all values are added to, to allow accumulating over multiple compilations */
+	double stageTime[HOC_NUM_COMPILE_STAGES]; /* seconds spent in each HOC_CompileStage */
+	uint32_t numInlinedCalls; /* function calls replaced with the function body */
+	uint32_t numUnrolledLoops; /* loops replaced with copies of the body */
+	uint32_t numHoistedExprs; /* loop invariant expressions moved out of loops */
+	uint32_t numSimplifiedExprs; /* algebraic rewrites (x*1 -> x, pow(x,2) -> x*x, ...) */
+	uint32_t numPreshaderExprs; /* uniform-only expressions replaced with preshader outputs */
+	uint32_t numLowPrecisionVars; /* GLSL ES variables declared mediump by HOC_OF_GLSL_AUTO_PRECISION */
+	uint32_t numRemovedVSOutputs; /* VS outputs not read by the PS (HOC_CompileShaderPair) */
+	uint32_t numPackedUniforms;   /* HLSL SM3 uniforms sharing a register by HOC_OF_HLSL3_PACK_UNIFORMS */
 };
 
 #define HOC_OF_SPECIFY_REGISTERS    0x0001 /* pick and export the registers of unassigned I/O vars */
@@ -154,6 +311,16 @@ struct HOC_InterfaceOutput
 #define HOC_OF_GLSL_RENAME_CBUFFERS 0x0040 /* rename constant buffers to CBUF# */
 #define HOC_OF_GLSL_RENAME_VSINPUT  0x0080 /* rename VS inputs (attributes) to ATTR_<semantic> */
 #define HOC_OF_GLSL_RENAME_VARYINGS 0x0100 /* rename VS outputs/PS inputs to V2P_<semantic> */
+#define HOC_OF_FAST_MATH            0x0200 /* allow optimizations that are not exact for -0, inf, NaN or rounding */
+#define HOC_OF_PRESHADER            0x0400 /* move uniform-only expressions to a CPU program (see HOC_RunPreshader) */
+#define HOC_OF_GLSL_AUTO_PRECISION  0x0800 /* GLSL ES: declare variables as mediump where the value ranges allow it */
+#define HOC_OF_NATIVE_HALF          0x1000 /* emit half as min16float (HLSL SM4) / mediump (GLSL), uniforms stay 32-bit */
+#define HOC_OF_GLSL_PACK_VARYINGS   0x2000 /* pack VS outputs/PS inputs with less than 4 components into V2P_PACK# vec4s
+                                               (HOC_CompileShaderPair only, HOC_CompileShader fails with this flag) */
+#define HOC_OF_EXPORT_VARYINGS      0x4000 /* list VS outputs/PS inputs in the interface output */
+#define HOC_OF_HLSL3_PACK_UNIFORMS  0x8000 /* HLSL SM3: share c# registers between global scalar/float2/float3 uniforms */
+#define HOC_OF_EXPORT_USAGE_MASKS  0x10000 /* export read masks of uniforms in the interface output (outUsageMaskBuf) */
+#define HOC_OF_EXPORT_LAYOUT       0x20000 /* export byte offsets/sizes/strides of uniforms in the interface output (outLayoutBuf) */
 
 struct HOC_Config
 {
@@ -169,13 +336,18 @@ struct HOC_Config
 			HOC_OF_GLSL_RENAME_CBUFFERS |
 			HOC_OF_GLSL_RENAME_VSINPUT |
 			HOC_OF_GLSL_RENAME_VARYINGS;
+		optimizationLevel = 1;
+		maxUnrollSize = 256;
 		loadIncludeFileFunc = NULL;
 		loadIncludeFileUserData = NULL;
 		defines = NULL;
+		uniformValues = NULL;
 		errorOutputStream = NULL;
 		codeOutputStream = NULL;
+		codeOutput = NULL;
 		ASTDumpStream = NULL;
 		interfaceOutput = NULL;
+		compileStats = NULL;
 	}
 #endif
 
@@ -194,13 +366,124 @@ struct HOC_Config
 	HOC_TextOutput*        ASTDumpStream;     /* no output if null */
 
 	HOC_InterfaceOutput*   interfaceOutput;
+	HOC_CompileStats*      compileStats;      /* no statistics if null */
+
+	/* fields added after the initial release are appended to keep the layout compatible */
+	HOC_CodeOutput*        codeOutput;        /* replaces codeOutputStream if not null */
+	uint8_t                optimizationLevel; /* 0 - folding and unused variable removal only, 1 - default, 2 - aggressive (adds CSE) */
+	uint32_t               maxUnrollSize;     /* max. AST nodes in a fully unrolled loop (0 - no unrolling) */
+
+	/* uniform specialization, terminated by an entry with name=NULL
+	- uniforms outside cbuffers are removed (reported as SVT_RemovedUniform), cbuffer layouts are kept
+	- names that do not match a uniform of the shader are errors */
+	HOC_UniformValue*      uniformValues;
 };
 
 
 HOC_APIFUNC HOC_BoolU8 HOC_CompileShader(const char* name, const char* code, HOC_Config* config);
+
+/* compiles a vertex and a pixel shader together, trimming the interface between them
+- PS inputs that are not read after optimization are removed
+- VS outputs that the PS does not read are removed along with the code that only computes them
+  (matched by semantic, POSITION/PSIZE/FOG are always kept)
+- both configs must use the same output format, each one receives its own outputs
+- HOC_OF_GLSL_PACK_VARYINGS (set in both configs) packs the remaining varyings, the layout is computed
+  for the VS and reused for the PS (inputs that the VS does not write stay unpacked)
+- use HOC_OF_EXPORT_VARYINGS to get the remaining varyings in the interface outputs */
+HOC_APIFUNC HOC_BoolU8 HOC_CompileShaderPair(const char* vsName, const char* vsCode, HOC_Config* vsConfig,
+	const char* psName, const char* psCode, HOC_Config* psConfig);
 HOC_APIFUNC void HOC_FreeInterfaceOutputBuffers(HOC_InterfaceOutput* ifo);
+HOC_APIFUNC void HOC_FreeCodeOutputBuffer(HOC_CodeOutput* co);
+
+/* computes the uniforms replaced by the preshader (HOC_InterfaceOutput::outPreshaderBuf)
+- inputs/outputs are in the order of SVT_PreshaderInput/SVT_PreshaderOutput variables,
+  each is an array of all components (matrices are row-major, array elements are consecutive)
+- bool/int values are passed as floats too
+- the code is only valid for the version of the library that generated it
+- returns false for code that is not a preshader or if a result is undefined
+  (division by zero, pow(-1, 0.5), normalize(0), etc.), the outputs are incomplete in that case */
+HOC_APIFUNC HOC_BoolU8 HOC_RunPreshader(const uint32_t* code, size_t codeSize,
+	const float* const* inputs, float* const* outputs);
 
 HOC_APIFUNC const char* HOC_ShaderVarTypeToString(int svType);
 HOC_APIFUNC const char* HOC_ShaderDataTypeToString(int dataType);
+HOC_APIFUNC const char* HOC_CompileStageToString(int stage);
 HOC_APIFUNC void HOC_DumpShaderInterfaceOutput(HOC_InterfaceOutput* ifo, HOC_TextOutput* to);
 
+
+
+/* shader packages
+- one little-endian file with the code and interface tables of many compiled shaders
+  (all formats, stages and permutations), found by (name, stage, output format, permutation hash)
+- all references are byte offsets from the beginning of the package, there are no pointers,
+  so the package can be used in place (e.g. memory-mapped) if it's 4-byte aligned
+- layout: header, hash buckets, shader table, data (4-byte aligned arrays, zero-terminated strings)
+- reading requires a little-endian host (HOC_OpenPackage fails otherwise) */
+
+#define HOC_PACKAGE_MAGIC   0x50434F48 /* "HOCP" */
+#define HOC_PACKAGE_VERSION 2
+
+struct HOC_PackageHeader /* 32 bytes */
+{
+	uint32_t magic;        /* HOC_PACKAGE_MAGIC */
+	uint32_t version;      /* HOC_PACKAGE_VERSION */
+	uint32_t totalSize;    /* in bytes, including the header */
+	uint32_t numShaders;
+	uint32_t numBuckets;   /* power of two */
+	uint32_t bucketOffset; /* uint32_t[numBuckets]: index of the first shader to check or 0xffffffff */
+	uint32_t shaderOffset; /* HOC_PackageShader[numShaders] */
+	uint32_t reserved;
+};
+
+struct HOC_PackageShader /* 84 bytes */
+{
+	uint32_t keyHash[2];         /* HOC_HashPackageKey, low/high 32 bits */
+	uint32_t permutationHash[2]; /* low/high 32 bits */
+	uint32_t name;               /* offset of the zero-terminated name */
+	uint32_t nameSize;
+	uint8_t  stage;              /* HOC_ShaderStage */
+	uint8_t  outputFmt;          /* HOC_OutputShaderFormat */
+	uint8_t  reserved[2];
+	uint32_t code;               /* offset of the zero-terminated code */
+	uint32_t codeSize;           /* in bytes, without the terminator */
+	/* interface output, sizes are the same as in HOC_InterfaceOutput (0 if not available) */
+	uint32_t vars;               /* HOC_ShaderVariable[numVars] */
+	uint32_t numVars;
+	uint32_t varStr;             /* string buffer for vars */
+	uint32_t varStrSize;
+	uint32_t preshader;          /* uint32_t[preshaderSize] */
+	uint32_t preshaderSize;
+	uint32_t usageMask;          /* uint32_t[usageMaskSize] */
+	uint32_t usageMaskSize;
+	uint32_t layout;             /* HOC_ShaderVariableLayout[layoutSize] */
+	uint32_t layoutSize;
+	uint32_t location;           /* int32_t[locationSize] */
+	uint32_t locationSize;
+};
+
+/* hash of a permutation, 0 for no/empty defines, terminated by an entry with name=NULL
+- order-dependent, use the same order when adding and looking up shaders */
+HOC_APIFUNC uint64_t HOC_HashPermutation(const HOC_ShaderMacro* defines);
+/* hash of the lookup key, used to pick a bucket (hash & (numBuckets - 1)) and stored in the shader table */
+HOC_APIFUNC uint64_t HOC_HashPackageKey(const char* name, uint8_t stage, uint8_t outputFmt, uint64_t permutationHash);
+
+struct HOC_PackageBuilder;
+HOC_APIFUNC HOC_PackageBuilder* HOC_CreatePackageBuilder();
+HOC_APIFUNC void HOC_DestroyPackageBuilder(HOC_PackageBuilder* pb);
+/* copies the code and the interface output (if not null) of a compiled shader
+- returns false if a shader with the same key has already been added */
+HOC_APIFUNC HOC_BoolU8 HOC_PackageAddShader(HOC_PackageBuilder* pb,
+	const char* name, uint8_t stage, uint8_t outputFmt, uint64_t permutationHash,
+	const char* code, size_t codeSize, const HOC_InterfaceOutput* ifo);
+/* writes the package, returns false if it exceeds 4 GB */
+HOC_APIFUNC HOC_BoolU8 HOC_WritePackage(HOC_PackageBuilder* pb, HOC_TextOutput* out);
+
+/* validates the header, the tables and the offsets/sizes of all shaders (not the code),
+   returns NULL if the package cannot be used */
+HOC_APIFUNC const HOC_PackageHeader* HOC_OpenPackage(const void* data, size_t size);
+/* returns NULL if the shader is not found */
+HOC_APIFUNC const HOC_PackageShader* HOC_FindPackageShader(const HOC_PackageHeader* pkg,
+	const char* name, uint8_t stage, uint8_t outputFmt, uint64_t permutationHash);
+/* points the buffers of the interface output to the package data (nothing is copied or allocated) */
+HOC_APIFUNC void HOC_GetPackageInterfaceOutput(const HOC_PackageHeader* pkg,
+	const HOC_PackageShader* ps, HOC_InterfaceOutput* ifo);
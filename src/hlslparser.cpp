@@ -11,7 +11,7 @@ using namespace HOC;
 
 static inline bool isStr(const char* begin, const char* end, const char* str, size_t sz)
 {
-	return end - begin == sz && memcmp(begin, str, sz) == 0;
+	return size_t(end - begin) == sz && memcmp(begin, str, sz) == 0;
 }
 template<size_t N> static inline bool isStr(const char* begin, const char* end, const char(&str)[N])
 {
@@ -226,21 +226,36 @@ static const OperatorInfo g_allOperatorsResolveOrder[] =
 
 bool Parser::ParseCode(const char* text, const char** featureDefs)
 {
+	StageTimer timer(config->compileStats);
+
 	if (!ParseTokens(text, 0))
 		return false;
+	timer.EndStage(CS_Tokenize);
 
-	auto oneMacro = RequestIntBoolMacro(true);
-	while (*featureDefs)
-		macros.insert({ *featureDefs++, oneMacro });
-
+	DefineFeatureMacros(featureDefs);
 	if (!PreprocessTokens(0))
 		return false;
+	timer.EndStage(CS_Preprocess);
 
 //	FILEStream err(stderr);
 //	for (size_t i = 0; i < tokens.size(); ++i)
 //		err << " " << TokenToString(i);
 //	err << "\n";
 
+	bool ret = ParseDecls();
+	timer.EndStage(CS_Parse);
+	return ret;
+}
+
+void Parser::DefineFeatureMacros(const char** featureDefs)
+{
+	auto oneMacro = RequestIntBoolMacro(true);
+	while (*featureDefs)
+		macros.insert({ *featureDefs++, oneMacro });
+}
+
+bool Parser::ParseDecls()
+{
 	ast.InitBasicTypes();
 	while (curToken < tokens.size() && ParseDecl()) ;
 	if (diag.hasErrors || diag.hasFatalErrors)
@@ -261,7 +276,7 @@ bool Parser::ParseCode(const char* text, const char** featureDefs)
 	return true;
 }
 
-bool Parser::ParseTokens(const char* text, uint32_t source)
+bool Parser::ParseTokens(const char* text, uint32_t)
 {
 	uint32_t line = 1;
 	uint32_t logLine = 1;
@@ -301,7 +316,7 @@ bool Parser::ParseTokens(const char* text, uint32_t source)
 		{
 			text += 2;
 			while (*text && *text != '\r' && *text != '\n')
-				*text++;
+				text++;
 			if (*text)
 			{
 				logLine = ++line;
@@ -675,7 +690,13 @@ notfound:
 					}
 				}
 				if (isArg == false)
+				{
 					out.push_back(M.tokens[tid]);
+					// mark identifiers named same as macro unreplaceable
+					// (only in macro body, arguments can contain nested invocations)
+					if (out.back().type == STT_Ident && TokenStringData(out.back()) == range.it->first)
+						out.back().type = STT_IdentPPNoReplace;
+				}
 			}
 
 #if 0
@@ -690,13 +711,14 @@ notfound:
 		}
 		else
 		{
+			size_t start = out.size();
 			out.append(M.tokens.begin(), M.tokens.end());
-		}
 
-		// mark identifiers named same as macro unreplaceable
-		for (auto& t : out)
-			if (t.type == STT_Ident && TokenStringData(t) == range.it->first)
-				t.type = STT_IdentPPNoReplace;
+			// mark identifiers named same as macro unreplaceable
+			for (size_t i = start; i < out.size(); ++i)
+				if (out[i].type == STT_Ident && TokenStringData(out[i]) == range.it->first)
+					out[i].type = STT_IdentPPNoReplace;
+		}
 		return true;
 	};
 	auto EvaluateCondition = [this, &tokensToReplace, &replacedTokens,
@@ -1024,8 +1046,19 @@ notfound:
 						std::swap(tmpCurToken, curToken);
 
 						uint32_t subsrc = diag.GetSourceID(file);
-						if (!ParseTokens(buf, subsrc))
-							return false;
+						{
+							// move tokenization time out of the (outer) preprocessing stage
+							auto* stats = config->compileStats;
+							double tm1 = stats ? GetTime() : 0;
+							if (!ParseTokens(buf, subsrc))
+								return false;
+							if (stats)
+							{
+								double dt = GetTime() - tm1;
+								stats->stageTime[CS_Tokenize] += dt;
+								stats->stageTime[CS_Preprocess] -= dt;
+							}
+						}
 						if (!PreprocessTokens(subsrc))
 							return false;
 
@@ -1558,9 +1591,11 @@ static ASTType* ScalableSymmetricIntrin(Parser* parser, OpExpr* fcall,
 		rt0 = parser->Promote(rt0, arg->next->ToExpr()->GetReturnType());
 	if (rt0 && args >= 3)
 		rt0 = parser->Promote(rt0, arg->next->next->ToExpr()->GetReturnType());
+	ASTType* reqty;
+	bool notMatch;
 	if (!rt0)
 		goto mismatch;
-	ASTType* reqty = rt0;
+	reqty = rt0;
 	if (alsoInt)
 	{
 		if (rt0->IsBoolBased())
@@ -1573,7 +1608,7 @@ static ASTType* ScalableSymmetricIntrin(Parser* parser, OpExpr* fcall,
 		reqty = parser->ast.CastToFloat(rt0);
 	}
 
-	bool notMatch = rt0->IsNumericBased() == false;
+	notMatch = rt0->IsNumericBased() == false;
 
 	for (ASTNode* arg = fcall->GetFirstArg()->next; arg; arg = arg->next)
 	{
@@ -1623,9 +1658,11 @@ static ASTType* VectorIntrin(Parser* parser, OpExpr* fcall,
 	}
 	if (!rt0)
 		rt0 = parser->ast.CastToVector(fcall->GetFirstArg()->ToExpr()->GetReturnType());
+	ASTType* reqty;
+	bool notMatch;
 	if (!rt0)
 		goto unmatched;
-	ASTType* reqty = rt0;
+	reqty = rt0;
 	if (alsoInt)
 	{
 		if (rt0->IsBoolBased())
@@ -1638,7 +1675,7 @@ static ASTType* VectorIntrin(Parser* parser, OpExpr* fcall,
 		reqty = parser->ast.CastToFloat(rt0);
 	}
 
-	bool notMatch = rt0->IsNumericBased() == false;
+	notMatch = rt0->IsNumericBased() == false;
 	for (ASTNode* arg = fcall->GetFirstArg()->next; arg; arg = arg->next)
 	{
 		if (arg->ToExpr()->GetReturnType()->kind == ASTType::Matrix ||
@@ -1741,15 +1778,17 @@ static ASTType* TexSampleCmpIntrin(Parser* parser, OpExpr* fcall, OpKind opKind,
 	if (arg->ToExpr()->GetReturnType()->IsNumericOrVM1() == false)
 		goto mismatch;
 
-	// cast arg 2
-	auto* arg2 = fcall->GetFirstArg()->next->ToExpr();
-	ASTType* reqty = parser->ast.CastToFloat(arg2->GetReturnType());
-	if (vecSize > 1)
-		reqty = parser->ast.CastToVector(reqty, vecSize);
-	CastExprTo(arg2, reqty);
-	// cast arg 3
-	auto* arg3 = fcall->GetFirstArg()->next->next->ToExpr();
-	CastExprTo(arg3, parser->ast.CastToFloat(arg3->GetReturnType()));
+	{
+		// cast arg 2
+		auto* arg2 = fcall->GetFirstArg()->next->ToExpr();
+		ASTType* reqty = parser->ast.CastToFloat(arg2->GetReturnType());
+		if (vecSize > 1)
+			reqty = parser->ast.CastToVector(reqty, vecSize);
+		CastExprTo(arg2, reqty);
+		// cast arg 3
+		auto* arg3 = fcall->GetFirstArg()->next->next->ToExpr();
+		CastExprTo(arg3, parser->ast.CastToFloat(arg3->GetReturnType()));
+	}
 
 	fcall->opKind = opKind;
 	return parser->ast.GetFloat32Type();
@@ -2051,11 +2090,13 @@ std::unordered_map<const char*, IntrinsicValidatorFP, ConstCharHash, ConstCharEq
 			rt0 = arg->next->ToExpr()->GetReturnType();
 		if (!rt0)
 			rt0 = parser->ast.CastToVector(fcall->GetFirstArg()->ToExpr()->GetReturnType());
+		ASTType* reqty;
+		bool notMatch;
 		if (!rt0)
 			goto unmatched;
-		ASTType* reqty = parser->ast.CastToFloat(rt0);
+		reqty = parser->ast.CastToFloat(rt0);
 
-		bool notMatch = rt0->IsNumericBased() == false;
+		notMatch = rt0->IsNumericBased() == false;
 		arg = fcall->GetFirstArg();
 		if (arg->ToExpr()->GetReturnType()->kind == ASTType::Matrix ||
 			parser->CanCast(arg->ToExpr()->GetReturnType(), reqty, false) == false ||
@@ -2257,7 +2298,6 @@ void Parser::FindFunction(OpExpr* fcall, const String& name, const Location& loc
 		// adjust arguments
 		if (auto* fn = fcall->resolvedFunc)
 		{
-			int i = 0;
 			for (ASTNode *arg = fcall->GetFirstArg(), *argdecl = fn->GetFirstArg();
 				arg && argdecl;
 				arg = arg->next, argdecl = argdecl->next)
@@ -2333,6 +2373,16 @@ bool Parser::FindBestSplit(const Array<SLToken>& tokenArr, bool preProcSplit,
 	return true;
 }
 
+static bool IsFloatLiteral(Expr* expr)
+{
+	if (auto* unop = dyn_cast<UnaryOpExpr>(expr))
+	{
+		if (unop->opType == STT_OP_Sub || unop->opType == STT_OP_Add)
+			expr = unop->GetSource();
+	}
+	return dyn_cast<Float32Expr>(expr) && expr->GetReturnType()->kind == ASTType::Float32;
+}
+
 Expr* Parser::ParseExpr(SLTokenType endTokenType, size_t endPos)
 {
 	if (endPos == SIZE_MAX)
@@ -2548,7 +2598,11 @@ Expr* Parser::ParseExpr(SLTokenType endTokenType, size_t endPos)
 				: ast.GetInt32Type(),
 			"index"))
 		{
-			idx->SetReturnType(idx->GetSource()->GetReturnType()->subType);
+			// matrices are indexed by row
+			ASTType* srcType = idx->GetSource()->GetReturnType();
+			idx->SetReturnType(srcType->kind == ASTType::Matrix
+				? ast.GetVectorType(srcType->subType, srcType->sizeY)
+				: srcType->subType);
 
 			// TODO validate constant indices
 		}
@@ -2592,11 +2646,20 @@ Expr* Parser::ParseExpr(SLTokenType endTokenType, size_t endPos)
 
 		TryCastExprTo(tnop->GetCond(), ast.GetBoolType(), "ternary operator condition");
 
-		ASTType* rt = Promote(tnop->GetTrueExpr()->GetReturnType(), tnop->GetFalseExpr()->GetReturnType());
+		ASTType* rtt = tnop->GetTrueExpr()->GetReturnType();
+		ASTType* rtf = tnop->GetFalseExpr()->GetReturnType();
+		if (config->outputFlags & HOC_OF_NATIVE_HALF)
+		{
+			if (rtt->IsFloat16Based() && IsFloatLiteral(tnop->GetFalseExpr()))
+				rtf = ast.GetFloat16Type();
+			else if (rtf->IsFloat16Based() && IsFloatLiteral(tnop->GetTrueExpr()))
+				rtt = ast.GetFloat16Type();
+		}
+		ASTType* rt = Promote(rtt, rtf);
 		if (rt)
 		{
 			if (TryCastExprTo(tnop->GetTrueExpr(), rt, "ternary operator first choice") &&
-				TryCastExprTo(tnop->GetTrueExpr(), rt, "ternary operator second choice"))
+				TryCastExprTo(tnop->GetFalseExpr(), rt, "ternary operator second choice"))
 			{
 				tnop->SetReturnType(rt);
 			}
@@ -2781,6 +2844,14 @@ Expr* Parser::ParseExpr(SLTokenType endTokenType, size_t endPos)
 
 			ASTType* rt0 = binop->GetLft()->GetReturnType();
 			ASTType* rt1 = binop->GetRgt()->GetReturnType();
+			// with native half, float literals take the precision of the other operand (`h * 0.5` stays half)
+			if (config->outputFlags & HOC_OF_NATIVE_HALF)
+			{
+				if (rt0->IsFloat16Based() && IsFloatLiteral(binop->GetRgt()))
+					rt1 = ast.GetFloat16Type();
+				else if (rt1->IsFloat16Based() && IsFloatLiteral(binop->GetLft()))
+					rt0 = ast.GetFloat16Type();
+			}
 			ASTType* commonType = nullptr;
 			if (ttSplit == STT_OP_Assign)
 			{
@@ -2838,6 +2909,7 @@ ASTType* Parser::Promote(ASTType* a, ASTType* b)
 {
 	// bool -> int -> float32
 	//        half -> float32
+	// (bool -> int -> half -> float32 with HOC_OF_NATIVE_HALF)
 	// scalar -> vector/matrix
 
 	// can't promote types that do not resemble numbers
@@ -2866,9 +2938,10 @@ ASTType* Parser::Promote(ASTType* a, ASTType* b)
 		no = ast.GetInt32Type();
 	else if (na == nb)
 		no = na;
-	else if (na->kind == ASTType::Float32 || nb->kind == ASTType::Float32 ||
-		na->kind == ASTType::Float16 || nb->kind == ASTType::Float16)
+	else if (na->kind == ASTType::Float32 || nb->kind == ASTType::Float32)
 		no = ast.GetFloat32Type();
+	else if (na->kind == ASTType::Float16 || nb->kind == ASTType::Float16)
+		no = config->outputFlags & HOC_OF_NATIVE_HALF ? ast.GetFloat16Type() : ast.GetFloat32Type();
 	else if (na->kind == ASTType::Int32 || nb->kind == ASTType::Int32)
 		no = ast.GetInt32Type();
 	else if (na->kind == ASTType::UInt32 || nb->kind == ASTType::UInt32)
@@ -3318,7 +3391,7 @@ Stmt* Parser::ParseExprDeclStatement()
 		{
 			flags |= VarDecl::ATTR_Const;
 			if (!FWD())
-				return false;
+				return nullptr;
 		}
 
 		auto* varDecl = new VarDeclStmt;
@@ -3949,7 +4022,7 @@ bool Parser::TokenStringDataEquals(const SLToken& t, const char* comp, size_t co
 		return false;
 	int32_t	len = 0;
 	memcpy(&len, &tokenData[t.dataOff], 4);
-	return len == compsz && memcmp((const char*) &tokenData[t.dataOff + 4], comp, compsz) == 0;
+	return size_t(len) == compsz && memcmp((const char*) &tokenData[t.dataOff + 4], comp, compsz) == 0;
 }
 
 const char* Parser::TokenStringC(const SLToken& t) const
@@ -35,9 +35,12 @@ struct Parser
 		int32_t i01[2] = { 0, 1 };
 		tokenData.append((char*)i01, sizeof(i01));
 	}
+	// ParseCode = ParseTokens + DefineFeatureMacros + PreprocessTokens + ParseDecls
 	bool ParseCode(const char* text, const char** featureDefs);
 	bool ParseTokens(const char* text, uint32_t source);
+	void DefineFeatureMacros(const char** featureDefs);
 	bool PreprocessTokens(uint32_t source);
+	bool ParseDecls();
 
 	SLToken RequestIntBoolToken(bool v);
 	PreprocMacro RequestIntBoolMacro(bool v);
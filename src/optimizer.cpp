@@ -6,207 +6,4491 @@
 using namespace HOC;
 
 
+/* constant evaluation
+- values of scalars, vectors and matrices (matrix elements in row-major order, like in init lists)
+- floats are evaluated in double precision and rounded to float32 after each operation,
+  operations that produce non-finite values or depend on undefined behavior are not folded
+- constant vectors/matrices are represented as InitListExpr with constant scalar arguments
+  or casts of constant scalars (splat)
+*/
+static ASTType::Kind GetEvalKind(const ASTType* t, bool matrices)
+{
+	if (t->kind == ASTType::Vector || (t->kind == ASTType::Matrix && matrices))
+		t = t->subType;
+	switch (t->kind)
+	{
+	case ASTType::Bool: return ASTType::Bool;
+	case ASTType::Int32: return ASTType::Int32;
+	case ASTType::Float16:
+	case ASTType::Float32: return ASTType::Float32;
+	default: return ASTType::Void;
+	}
+}
+
+static int GetEvalCount(const ASTType* t)
+{
+	switch (t->kind)
+	{
+	case ASTType::Vector: return t->sizeX;
+	case ASTType::Matrix: return t->sizeX * t->sizeY;
+	default: return 1;
+	}
+}
+
+static bool ConvertConstValue(double& v, ASTType::Kind to)
+{
+	switch (to)
+	{
+	case ASTType::Bool:
+		v = v != 0 ? 1 : 0;
+		return true;
+	case ASTType::Int32:
+		if (!(v > -2147483649.0 && v < 2147483648.0))
+			return false;
+		v = double(int32_t(v));
+		return true;
+	case ASTType::Float32:
+		v = double(float(v));
+		return v - v == 0; // finite
+	default:
+		return false;
+	}
+}
+
+// converts src (of type st) to t, out.kind/count must already be set for t
+static bool CastConst(const ConstValue& src, const ASTType* st, const ASTType* t, ConstValue& out)
+{
+	if (src.count == 1)
+	{
+		for (int i = 0; i < out.count; ++i)
+			out.v[i] = src.v[0];
+	}
+	else if (t->kind == ASTType::Matrix && st->kind == ASTType::Matrix)
+	{
+		// truncation keeps the upper left part
+		if (t->sizeX > st->sizeX || t->sizeY > st->sizeY)
+			return false;
+		for (int y = 0; y < t->sizeX; ++y)
+			for (int x = 0; x < t->sizeY; ++x)
+				out.v[y * t->sizeY + x] = src.v[y * st->sizeY + x];
+	}
+	else if (out.count <= src.count &&
+		(t->kind != ASTType::Matrix || out.count == src.count))
+	{
+		for (int i = 0; i < out.count; ++i)
+			out.v[i] = src.v[i];
+	}
+	else
+		return false;
+	for (int i = 0; i < out.count; ++i)
+		if (!ConvertConstValue(out.v[i], out.kind))
+			return false;
+	return true;
+}
+
+// reads constants in their canonical form (after folding the children)
+static bool ReadConst(const Expr* e, bool matrices, ConstValue& out)
+{
+	const ASTType* t = e->GetReturnType();
+	out.kind = GetEvalKind(t, matrices);
+	if (out.kind == ASTType::Void)
+		return false;
+	out.count = GetEvalCount(t);
+
+	if (auto* bexpr = dyn_cast<const BoolExpr>(e))
+	{
+		if (out.count != 1)
+			return false;
+		out.v[0] = bexpr->value ? 1 : 0;
+		return true;
+	}
+	if (auto* i32expr = dyn_cast<const Int32Expr>(e))
+	{
+		if (out.count != 1)
+			return false;
+		out.v[0] = i32expr->value;
+		return ConvertConstValue(out.v[0], out.kind);
+	}
+	if (auto* f32expr = dyn_cast<const Float32Expr>(e))
+	{
+		if (out.count != 1)
+			return false;
+		out.v[0] = f32expr->value;
+		return ConvertConstValue(out.v[0], out.kind);
+	}
+	if (auto* ile = dyn_cast<const InitListExpr>(e))
+	{
+		int n = 0;
+		for (ASTNode* ch = ile->firstChild; ch; ch = ch->next)
+		{
+			ConstValue sub;
+			if (!ReadConst(ch->ToExpr(), matrices, sub) || n + sub.count > out.count)
+				return false;
+			for (int i = 0; i < sub.count; ++i)
+			{
+				out.v[n] = sub.v[i];
+				if (!ConvertConstValue(out.v[n++], out.kind))
+					return false;
+			}
+		}
+		return n == out.count;
+	}
+	if (auto* cast = dyn_cast<const CastExpr>(e))
+	{
+		ConstValue src;
+		if (!ReadConst(cast->GetSource(), matrices, src))
+			return false;
+		return CastConst(src, cast->GetSource()->GetReturnType(), t, out);
+	}
+	return false;
+}
+
+static Expr* CreateScalarConst(double v, ASTType::Kind kind, ASTType* t)
+{
+	switch (kind)
+	{
+	case ASTType::Bool: return new BoolExpr(v != 0, t);
+	case ASTType::Int32: return new Int32Expr(int32_t(v), t);
+	default: return new Float32Expr(v, t);
+	}
+}
+
+static Expr* CreateConst(const ConstValue& cv, ASTType* t)
+{
+	if (t->kind != ASTType::Vector && t->kind != ASTType::Matrix)
+		return CreateScalarConst(cv.v[0], cv.kind, t);
+
+	bool splat = t->kind == ASTType::Vector;
+	for (int i = 1; i < cv.count && splat; ++i)
+		splat = cv.v[i] == cv.v[0];
+	if (splat)
+	{
+		auto* cast = new CastExpr;
+		cast->SetReturnType(t);
+		cast->SetSource(CreateScalarConst(cv.v[0], cv.kind, t->subType));
+		return cast;
+	}
+
+	auto* ile = new InitListExpr;
+	ile->SetReturnType(t);
+	for (int i = 0; i < cv.count; ++i)
+		ile->AppendChild(CreateScalarConst(cv.v[i], cv.kind, t->subType));
+	return ile;
+}
+
+// converts the computed values to the result type, fails on non-finite values
+static bool FinishConst(ConstValue& cv, const ASTType* t, bool matrices)
+{
+	cv.kind = GetEvalKind(t, matrices);
+	if (cv.kind == ASTType::Void || GetEvalCount(t) != cv.count)
+		return false;
+	for (int i = 0; i < cv.count; ++i)
+	{
+		if (cv.v[i] - cv.v[i] != 0)
+			return false;
+		if (!ConvertConstValue(cv.v[i], cv.kind))
+			return false;
+	}
+	return true;
+}
+
+static FINLINE double Arg(const ConstValue& cv, int i) { return cv.v[cv.count == 1 ? 0 : i]; }
+
+static FINLINE int32_t WrapInt32(int64_t v) { return int32_t(uint32_t(uint64_t(v))); }
+
+static double Dot(const ConstValue& a, const ConstValue& b)
+{
+	double sum = 0;
+	for (int i = 0; i < a.count; ++i)
+		sum += a.v[i] * b.v[i];
+	return sum;
+}
+
+static double Determinant(const double* m, int n)
+{
+	if (n == 1)
+		return m[0];
+	if (n == 2)
+		return m[0] * m[3] - m[1] * m[2];
+	// cofactor expansion along the first row
+	double sum = 0;
+	double sub[9];
+	for (int c = 0; c < n; ++c)
+	{
+		int k = 0;
+		for (int y = 1; y < n; ++y)
+			for (int x = 0; x < n; ++x)
+				if (x != c)
+					sub[k++] = m[y * n + x];
+		double d = m[c] * Determinant(sub, n - 1);
+		sum += c % 2 ? -d : d;
+	}
+	return sum;
+}
+
+static bool EvalBinaryOp(SLTokenType op, const ConstValue& a, const ConstValue& b, ASTType::Kind kind, ConstValue& out)
+{
+	out.count = a.count > b.count ? a.count : b.count;
+	if ((a.count != 1 && a.count != out.count) || (b.count != 1 && b.count != out.count))
+		return false;
+	for (int i = 0; i < out.count; ++i)
+	{
+		double x = Arg(a, i);
+		double y = Arg(b, i);
+		double& r = out.v[i];
+		switch (op)
+		{
+		case STT_OP_Eq:         r = x == y; break;
+		case STT_OP_NEq:        r = x != y; break;
+		case STT_OP_Less:       r = x < y; break;
+		case STT_OP_LEq:        r = x <= y; break;
+		case STT_OP_Greater:    r = x > y; break;
+		case STT_OP_GEq:        r = x >= y; break;
+		case STT_OP_LogicalAnd: r = x != 0 && y != 0; break;
+		case STT_OP_LogicalOr:  r = x != 0 || y != 0; break;
+		default:
+			if (kind == ASTType::Int32)
+			{
+				int32_t ix = int32_t(x), iy = int32_t(y);
+				switch (op)
+				{
+				case STT_OP_Add: r = WrapInt32(int64_t(ix) + iy); break;
+				case STT_OP_Sub: r = WrapInt32(int64_t(ix) - iy); break;
+				case STT_OP_Mul: r = WrapInt32(int64_t(ix) * iy); break;
+				case STT_OP_Div:
+				case STT_OP_Mod:
+					// division by zero and overflow are undefined
+					if (iy == 0 || (ix == INT32_MIN && iy == -1))
+						return false;
+					r = op == STT_OP_Div ? ix / iy : ix % iy;
+					break;
+				case STT_OP_And: r = ix & iy; break;
+				case STT_OP_Or:  r = ix | iy; break;
+				case STT_OP_Xor: r = ix ^ iy; break;
+				case STT_OP_Lsh: r = WrapInt32(int64_t(uint32_t(ix) << (iy & 31))); break;
+				case STT_OP_Rsh: r = ix >> (iy & 31); break;
+				default: return false;
+				}
+			}
+			else if (kind == ASTType::Float32)
+			{
+				switch (op)
+				{
+				case STT_OP_Add: r = x + y; break;
+				case STT_OP_Sub: r = x - y; break;
+				case STT_OP_Mul: r = x * y; break;
+				case STT_OP_Div: r = x / y; break;
+				case STT_OP_Mod: r = fmod(x, y); break;
+				default: return false;
+				}
+			}
+			else
+				return false;
+		}
+	}
+	return true;
+}
+
+static SLTokenType OpKindToBinaryOp(OpKind op)
+{
+	switch (op)
+	{
+	case Op_Add:      return STT_OP_Add;
+	case Op_Subtract: return STT_OP_Sub;
+	case Op_Multiply: return STT_OP_Mul;
+	case Op_Divide:   return STT_OP_Div;
+	case Op_Modulus:  return STT_OP_Mod;
+	default:          return STT_NULL;
+	}
+}
+
+// intrinsics, argument types are already matched by the parser
+static bool EvalOp(OpKind op, const ConstValue* args, int numArgs,
+	const ASTType* const* argTypes, const ASTType* rt, bool matrices, ConstValue& out)
+{
+	ASTType::Kind kind = GetEvalKind(rt, matrices);
+	out.count = GetEvalCount(rt);
+	for (int i = 0; i < numArgs; ++i)
+		if (args[i].count != 1 && args[i].count != out.count)
+			goto not_componentwise;
+
+	if (SLTokenType binop = OpKindToBinaryOp(op))
+	{
+		if (numArgs != 2)
+			return false;
+		return EvalBinaryOp(binop, args[0], args[1], kind, out);
+	}
+
+	if (kind == ASTType::Int32)
+	{
+		// integer versions of component-wise intrinsics
+		for (int i = 0; i < out.count; ++i)
+		{
+			double x = Arg(args[0], i);
+			double& r = out.v[i];
+			switch (op)
+			{
+			case Op_Abs:   r = fabs(x); break;
+			case Op_Sign:  r = x > 0 ? 1 : x < 0 ? -1 : 0; break;
+			case Op_Max:   r = fmax(x, Arg(args[1], i)); break;
+			case Op_Min:   r = fmin(x, Arg(args[1], i)); break;
+			case Op_Clamp: r = fmin(fmax(x, Arg(args[1], i)), Arg(args[2], i)); break;
+			default: goto not_componentwise;
+			}
+		}
+		return true;
+	}
+
+	for (int i = 0; i < out.count; ++i)
+	{
+		double x = numArgs >= 1 ? Arg(args[0], i) : 0;
+		double y = numArgs >= 2 ? Arg(args[1], i) : 0;
+		double z = numArgs >= 3 ? Arg(args[2], i) : 0;
+		double& r = out.v[i];
+		switch (op)
+		{
+		case Op_Abs:      r = fabs(x); break;
+		case Op_ACos:     r = acos(x); break;
+		case Op_ASin:     r = asin(x); break;
+		case Op_ATan:     r = atan(x); break;
+		case Op_ATan2:    r = atan2(x, y); break;
+		case Op_Ceil:     r = ceil(x); break;
+		case Op_Clamp:    r = fmin(fmax(x, y), z); break;
+		case Op_Cos:      r = cos(x); break;
+		case Op_CosH:     r = cosh(x); break;
+		case Op_Degrees:  r = x * (180.0 / M_PI); break;
+		case Op_Exp:      r = exp(x); break;
+		case Op_Exp2:     r = exp2(x); break;
+		case Op_Floor:    r = floor(x); break;
+		case Op_FMod:     r = fmod(x, y); break;
+		case Op_Frac:     r = x - floor(x); break;
+		case Op_IsFinite: r = x - x == 0; break;
+		case Op_IsInf:    r = x - x != 0 && x == x; break;
+		case Op_IsNaN:    r = x != x; break;
+		case Op_LdExp:    r = x * exp2(y); break;
+		case Op_Lerp:     r = x + (y - x) * z; break;
+		case Op_Log:      r = log(x); break;
+		case Op_Log10:    r = log10(x); break;
+		case Op_Log2:     r = log2(x); break;
+		case Op_Max:      r = fmax(x, y); break;
+		case Op_Min:      r = fmin(x, y); break;
+		case Op_ModGLSL:  r = x - y * floor(x / y); break;
+		case Op_Pow:
+			// GPUs compute pow as exp2(log2(x) * y)
+			if (x < 0 || (x == 0 && y <= 0))
+				return false;
+			r = pow(x, y);
+			break;
+		case Op_Radians:  r = x * (M_PI / 180.0); break;
+		case Op_Round:    r = nearbyint(x); break;
+		case Op_RSqrt:    r = 1.0 / sqrt(x); break;
+		case Op_Saturate: r = fmin(fmax(x, 0.0), 1.0); break;
+		case Op_Sign:     r = x > 0 ? 1 : x < 0 ? -1 : 0; break;
+		case Op_Sin:      r = sin(x); break;
+		case Op_SinH:     r = sinh(x); break;
+		case Op_SmoothStep:
+			if (x == y)
+				return false;
+			r = fmin(fmax((z - x) / (y - x), 0.0), 1.0);
+			r = r * r * (3 - 2 * r);
+			break;
+		case Op_Sqrt:     r = sqrt(x); break;
+		case Op_Step:     r = y >= x ? 1 : 0; break;
+		case Op_Tan:      r = tan(x); break;
+		case Op_TanH:     r = tanh(x); break;
+		case Op_Trunc:    r = trunc(x); break;
+		default: goto not_componentwise;
+		}
+	}
+	return true;
+
+not_componentwise:
+	switch (op)
+	{
+	case Op_All:
+	case Op_Any:
+	{
+		bool all = true, any = false;
+		for (int i = 0; i < args[0].count; ++i)
+		{
+			all = all && args[0].v[i] != 0;
+			any = any || args[0].v[i] != 0;
+		}
+		out.count = 1;
+		out.v[0] = op == Op_All ? all : any;
+		return true;
+	}
+	case Op_Dot:
+		if (args[0].count != args[1].count)
+			return false;
+		out.count = 1;
+		out.v[0] = Dot(args[0], args[1]);
+		if (kind == ASTType::Int32)
+		{
+			int64_t sum = 0;
+			for (int i = 0; i < args[0].count; ++i)
+				sum += int64_t(int32_t(args[0].v[i])) * int32_t(args[1].v[i]);
+			out.v[0] = WrapInt32(sum);
+		}
+		return true;
+	case Op_Length:
+		out.count = 1;
+		out.v[0] = sqrt(Dot(args[0], args[0]));
+		return kind == ASTType::Float32;
+	case Op_Distance:
+	{
+		if (args[0].count != args[1].count)
+			return false;
+		double sum = 0;
+		for (int i = 0; i < args[0].count; ++i)
+			sum += (args[0].v[i] - args[1].v[i]) * (args[0].v[i] - args[1].v[i]);
+		out.count = 1;
+		out.v[0] = sqrt(sum);
+		return kind == ASTType::Float32;
+	}
+	case Op_Normalize:
+	{
+		double len = sqrt(Dot(args[0], args[0]));
+		if (len == 0 || kind != ASTType::Float32)
+			return false;
+		out.count = args[0].count;
+		for (int i = 0; i < out.count; ++i)
+			out.v[i] = args[0].v[i] / len;
+		return true;
+	}
+	case Op_Cross:
+		if (args[0].count != 3 || args[1].count != 3)
+			return false;
+		out.count = 3;
+		out.v[0] = args[0].v[1] * args[1].v[2] - args[0].v[2] * args[1].v[1];
+		out.v[1] = args[0].v[2] * args[1].v[0] - args[0].v[0] * args[1].v[2];
+		out.v[2] = args[0].v[0] * args[1].v[1] - args[0].v[1] * args[1].v[0];
+		return kind == ASTType::Float32;
+	case Op_FaceForward:
+	{
+		// faceforward(n, i, ng) = dot(ng, i) < 0 ? n : -n
+		if (args[1].count != args[2].count)
+			return false;
+		double d = Dot(args[2], args[1]);
+		out.count = args[0].count;
+		for (int i = 0; i < out.count; ++i)
+			out.v[i] = d < 0 ? args[0].v[i] : -args[0].v[i];
+		return true;
+	}
+	case Op_Reflect:
+	{
+		// reflect(i, n) = i - 2 * dot(n, i) * n
+		if (args[0].count != args[1].count)
+			return false;
+		double d = Dot(args[1], args[0]);
+		out.count = args[0].count;
+		for (int i = 0; i < out.count; ++i)
+			out.v[i] = args[0].v[i] - 2 * d * args[1].v[i];
+		return true;
+	}
+	case Op_Refract:
+	{
+		if (args[0].count != args[1].count || args[2].count != 1)
+			return false;
+		double d = Dot(args[1], args[0]);
+		double eta = args[2].v[0];
+		double k = 1 - eta * eta * (1 - d * d);
+		out.count = args[0].count;
+		for (int i = 0; i < out.count; ++i)
+			out.v[i] = k < 0 ? 0 : eta * args[0].v[i] - (eta * d + sqrt(k)) * args[1].v[i];
+		return true;
+	}
+	case Op_Determinant:
+		if (argTypes[0]->kind != ASTType::Matrix || argTypes[0]->sizeX != argTypes[0]->sizeY)
+			return false;
+		out.count = 1;
+		out.v[0] = Determinant(args[0].v, argTypes[0]->sizeX);
+		return true;
+	case Op_Transpose:
+	{
+		const ASTType* mt = argTypes[0];
+		if (mt->kind != ASTType::Matrix)
+			return false;
+		out.count = args[0].count;
+		for (int y = 0; y < mt->sizeX; ++y)
+			for (int x = 0; x < mt->sizeY; ++x)
+				out.v[x * mt->sizeX + y] = args[0].v[y * mt->sizeY + x];
+		return true;
+	}
+	case Op_MulMM:
+	case Op_MulMV:
+	case Op_MulVM:
+	{
+		// rows x inner * inner x cols, vectors are a single row or column
+		int rows = op == Op_MulVM ? 1 : argTypes[0]->sizeX;
+		int inner = op == Op_MulVM ? args[0].count : argTypes[0]->sizeY;
+		int cols = op == Op_MulMV ? 1 : argTypes[1]->sizeY;
+		if (op != Op_MulVM && argTypes[0]->kind != ASTType::Matrix)
+			return false;
+		if (op != Op_MulMV && (argTypes[1]->kind != ASTType::Matrix || argTypes[1]->sizeX != inner))
+			return false;
+		if (op == Op_MulMV && args[1].count != inner)
+			return false;
+		out.count = rows * cols;
+		for (int y = 0; y < rows; ++y)
+		{
+			for (int x = 0; x < cols; ++x)
+			{
+				double sum = 0;
+				for (int i = 0; i < inner; ++i)
+					sum += args[0].v[y * inner + i] * args[1].v[i * cols + x];
+				out.v[y * cols + x] = sum;
+			}
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+static bool EvalUnaryOp(SLTokenType op, const ConstValue& src, ConstValue& out)
+{
+	out.count = src.count;
+	for (int i = 0; i < src.count; ++i)
+	{
+		double x = src.v[i];
+		switch (op)
+		{
+		case STT_OP_Add: out.v[i] = x; break;
+		case STT_OP_Sub: out.v[i] = src.kind == ASTType::Int32 ? WrapInt32(-int64_t(x)) : -x; break;
+		case STT_OP_Not: out.v[i] = x == 0; break;
+		case STT_OP_Inv:
+			if (src.kind != ASTType::Int32)
+				return false;
+			out.v[i] = ~int32_t(x);
+			break;
+		default: return false;
+		}
+	}
+	return true;
+}
+
+// st - type of the swizzled value (4 bits per component for matrices, 2 bits for vectors/scalars)
+static void EvalSwizzle(uint32_t memberID, int numComp, const ASTType* st, const ConstValue& src, ConstValue& out)
+{
+	out.count = numComp;
+	for (int i = 0; i < numComp; ++i)
+	{
+		if (st->kind == ASTType::Matrix)
+		{
+			unsigned off = (memberID >> (i * 4)) & 0xf;
+			out.v[i] = src.v[(off % st->sizeX) * st->sizeY + off / st->sizeX];
+		}
+		else
+			out.v[i] = Arg(src, (memberID >> (i * 2)) & 0x3);
+	}
+}
+
+// vector component or matrix row
+static bool EvalIndex(const ConstValue& src, const ConstValue& index, const ASTType* st, ConstValue& out)
+{
+	int width = st->kind == ASTType::Matrix ? st->sizeY : 1;
+	int count = st->kind == ASTType::Matrix ? st->sizeX : src.count;
+	if (index.count != 1 || index.v[0] < 0 || index.v[0] >= count || src.count != count * width)
+		return false;
+	out.count = width;
+	for (int i = 0; i < width; ++i)
+		out.v[i] = src.v[int(index.v[0]) * width + i];
+	return true;
+}
+
+static bool EvalSelect(const ConstValue& cond, const ConstValue& tv, const ConstValue& fv, int count, ConstValue& out)
+{
+	out.count = count;
+	if ((cond.count != 1 && cond.count != count) ||
+		(tv.count != 1 && tv.count != count) ||
+		(fv.count != 1 && fv.count != count))
+		return false;
+	for (int i = 0; i < count; ++i)
+		out.v[i] = Arg(cond, i) != 0 ? Arg(tv, i) : Arg(fv, i);
+	return true;
+}
+
+static bool HasSideEffects(const ASTNode* node)
+{
+	if (auto* op = dyn_cast<const OpExpr>(node))
+	{
+		if (op->opKind == Op_FCall || op->opKind == Op_Clip)
+			return true;
+	}
+	else if (auto* binop = dyn_cast<const BinaryOpExpr>(node))
+	{
+		if (binop->opType == STT_OP_Assign || TokenIsOpAssign(binop->opType))
+			return true;
+	}
+	else if (dyn_cast<const IncDecOpExpr>(node))
+		return true;
+	for (const ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		if (HasSideEffects(ch))
+			return true;
+	return false;
+}
+
+// whether the variable referenced by the expression is written to (assignment, inc/dec, out argument)
+static bool IsWrittenRef(const DeclRefExpr* dre)
+{
+	const Expr* e = dre;
+	while (dyn_cast<SubValExpr>(e->parent) && e->parent->firstChild == e)
+		e = e->parent->ToExpr();
+	if (dyn_cast<IncDecOpExpr>(e->parent))
+		return true;
+	if (auto* binop = dyn_cast<BinaryOpExpr>(e->parent))
+		return TokenIsOpAssign(binop->opType) && binop->GetLft() == e;
+	if (auto* op = dyn_cast<OpExpr>(e->parent))
+	{
+		if (auto* rf = op->resolvedFunc)
+		{
+			for (ASTNode *arg = op->GetFirstArg(), *argdecl = rf->GetFirstArg();
+				arg && argdecl;
+				arg = arg->next, argdecl = argdecl->next)
+			{
+				if (arg == e && (argdecl->ToVarDecl()->flags & VarDecl::ATTR_Out))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool UniformSpecialization::AddValue(AST& ast, const UniformValue& uv)
+{
+	VarDecl* vd = nullptr;
+	for (ASTNode* g = ast.globalVars.firstChild; g && !vd; g = g->next)
+	{
+		if (auto* cbuf = dyn_cast<CBufferDecl>(g))
+		{
+			for (ASTNode* cbv = cbuf->firstChild; cbv && !vd; cbv = cbv->next)
+				if (cbv->ToVarDecl()->name == uv.name)
+					vd = cbv->ToVarDecl();
+		}
+		else if (g->ToVarDecl()->name == uv.name)
+			vd = g->ToVarDecl();
+	}
+	// a misspelled name would silently produce an unspecialized shader
+	if (!vd || !(vd->flags & VarDecl::ATTR_Uniform))
+	{
+		diag.EmitError(Twine("cannot specialize uniform '") + uv.name + "' - not found", Location::BAD());
+		return false;
+	}
+
+	const ASTType* t = vd->GetType();
+	ConstValue cv;
+	cv.kind = GetEvalKind(t, true);
+	cv.count = GetEvalCount(t);
+	if (cv.kind == ASTType::Void || (t->kind != ASTType::Vector && t->kind != ASTType::Matrix && !t->IsNumeric()))
+	{
+		diag.EmitError("cannot specialize uniform '" + vd->name + "' - unsupported type", vd->loc);
+		return false;
+	}
+	if (vd->optSlot >= 0)
+	{
+		diag.EmitError("uniform '" + vd->name + "' is specialized more than once", vd->loc);
+		return false;
+	}
+	if (!uv.values || (uv.numValues != 1 && uv.numValues != uint32_t(cv.count)))
+	{
+		diag.EmitError("cannot specialize uniform '" + vd->name + "' - expected 1 or " +
+			StdToString(cv.count) + " values", vd->loc);
+		return false;
+	}
+	for (int i = 0; i < cv.count; ++i)
+	{
+		cv.v[i] = uv.values[uv.numValues == 1 ? 0 : i];
+		if (!ConvertConstValue(cv.v[i], cv.kind))
+		{
+			diag.EmitError("cannot specialize uniform '" + vd->name + "' - value out of range", vd->loc);
+			return false;
+		}
+	}
+
+	vd->optSlot = int(vars.size());
+	vars.push_back(vd);
+	values.push_back(cv);
+	return true;
+}
+
+void UniformSpecialization::PostVisit(ASTNode* node)
+{
+	auto* dre = dyn_cast<DeclRefExpr>(node);
+	if (!dre || !dre->decl || dre->decl->optSlot < 0 || !(dre->decl->flags & VarDecl::ATTR_Uniform))
+		return;
+
+	// uniforms can be written to like other globals, those cannot be replaced
+	if (IsWrittenRef(dre))
+	{
+		diag.EmitError("cannot specialize uniform '" + dre->decl->name + "' - it is modified", dre->loc);
+		return;
+	}
+
+	delete dre->ReplaceWith(CreateConst(values[dre->decl->optSlot], dre->GetReturnType()));
+}
+
+void UniformSpecialization::VisitGlobal(VarDecl* vd)
+{
+	if (vd->GetInitExpr())
+		WalkNode(vd->GetInitExpr());
+}
+
+bool UniformSpecialization::RunOnAST(AST& ast, const UniformValue* uvs)
+{
+	bool ok = true;
+	for (const UniformValue* uv = uvs; uv->name && ok; ++uv)
+		ok = AddValue(ast, *uv);
+	if (ok && vars.size())
+		VisitAST(ast);
+
+	for (VarDecl* vd : vars)
+	{
+		vd->optSlot = -1;
+		if (ok && !diag.hasErrors && !dyn_cast<CBufferDecl>(vd->parent))
+			ast.removedUniforms.AppendChild(vd);
+	}
+	vars.clear();
+	values.clear();
+	return ok && !diag.hasErrors;
+}
+
+bool PreshaderExtraction::IsInputVar(const VarDecl* vd) const
+{
+	if (!vd || (vd->flags & (VarDecl::ATTR_Uniform | VarDecl::ATTR_Static)) != VarDecl::ATTR_Uniform ||
+		(vd->parent != &ast->globalVars && !dyn_cast<CBufferDecl>(vd->parent)))
+		return false;
+	for (const VarDecl* wvd : writtenVars)
+		if (wvd == vd)
+			return false;
+	return true;
+}
+
+// element of a uniform array with a constant index
+bool PreshaderExtraction::IsArrayInput(const IndexExpr* idx, int& offset) const
+{
+	auto* dre = dyn_cast<const DeclRefExpr>(idx->GetSource());
+	ConstValue index;
+	if (!dre || !IsInputVar(dre->decl))
+		return false;
+	const ASTType* t = dre->decl->GetType();
+	if (t->kind != ASTType::Array || GetEvalKind(t->subType, true) == ASTType::Void ||
+		!ReadConst(idx->GetIndex(), true, index) || index.count != 1 ||
+		index.v[0] < 0 || index.v[0] >= t->elementCount)
+		return false;
+	offset = int(index.v[0]) * GetEvalCount(t->subType);
+	return true;
+}
+
+PreshaderExtraction::ExprInfo PreshaderExtraction::Classify(Expr* expr)
+{
+	ExprInfo info;
+	if (GetEvalKind(expr->GetReturnType(), true) == ASTType::Void)
+	{
+		ProcessChildren(expr);
+		return info;
+	}
+
+	int offset;
+	if (auto* dre = dyn_cast<const DeclRefExpr>(expr))
+	{
+		info.uniformOnly = info.hasInput = IsInputVar(dre->decl);
+		return info;
+	}
+	if (dyn_cast<const ConstExpr>(expr))
+	{
+		ConstValue cv;
+		info.uniformOnly = ReadConst(expr, true, cv);
+		return info;
+	}
+	if (auto* idx = dyn_cast<const IndexExpr>(expr))
+	{
+		if (IsArrayInput(idx, offset))
+		{
+			info.uniformOnly = info.hasInput = true;
+			return info;
+		}
+	}
+
+	bool supported = false;
+	if (auto* unop = dyn_cast<const UnaryOpExpr>(expr))
+	{
+		supported = unop->opType == STT_OP_Add || unop->opType == STT_OP_Sub ||
+			unop->opType == STT_OP_Not || unop->opType == STT_OP_Inv;
+		info.numOps++;
+	}
+	else if (auto* binop = dyn_cast<const BinaryOpExpr>(expr))
+	{
+		supported = TokenIsOpCompare(binop->opType) ||
+			(binop->opType >= STT_OP_LogicalAnd && binop->opType <= STT_OP_Rsh);
+		info.numOps++;
+	}
+	else if (auto* op = dyn_cast<const OpExpr>(expr))
+	{
+		// no side effects, derivatives or texture sampling
+		supported = op->opKind != Op_FCall && op->opKind != Op_Clip &&
+			op->opKind != Op_DDX && op->opKind != Op_DDY && op->opKind != Op_FWidth &&
+			op->opKind < Op_Tex1D && op->GetArgCount() >= 1 && op->GetArgCount() <= 3;
+		info.numOps++;
+	}
+	else if (auto* mmb = dyn_cast<const MemberExpr>(expr))
+		supported = mmb->swizzleComp != 0;
+	else if (auto* idx = dyn_cast<const IndexExpr>(expr))
+	{
+		ASTType::Kind sk = idx->GetSource()->GetReturnType()->kind;
+		supported = sk == ASTType::Vector || sk == ASTType::Matrix;
+	}
+	else if (dyn_cast<const TernaryOpExpr>(expr))
+	{
+		supported = true;
+		info.numOps++;
+	}
+	else
+		supported = dyn_cast<const CastExpr>(expr) || dyn_cast<const InitListExpr>(expr);
+
+	// children are classified first, the ones that cannot be merged with their parent are extracted
+	size_t first = childInfos.size();
+	for (ASTNode* ch = expr->firstChild; ch; ch = ch->next)
+		childInfos.push_back(Classify(ch->ToExpr()));
+	info.uniformOnly = supported;
+	for (size_t i = first; i < childInfos.size(); ++i)
+	{
+		info.uniformOnly = info.uniformOnly && childInfos[i].uniformOnly;
+		info.hasInput = info.hasInput || childInfos[i].hasInput;
+		info.numOps += childInfos[i].numOps;
+	}
+	if (!info.uniformOnly)
+	{
+		size_t i = first;
+		for (ASTNode* ch = expr->firstChild; ch; ++i)
+		{
+			ASTNode* cch = ch;
+			ch = ch->next;
+			if (IsExtractable(childInfos[i]))
+				Extract(cch->ToExpr());
+		}
+	}
+	childInfos.resize(first);
+	return info;
+}
+
+void PreshaderExtraction::ProcessChildren(ASTNode* node)
+{
+	for (ASTNode* ch = node->firstChild; ch; )
+	{
+		ASTNode* cch = ch;
+		ch = ch->next;
+		if (auto* expr = cch->ToExpr())
+		{
+			if (IsExtractable(Classify(expr)))
+				Extract(expr);
+		}
+		else
+			ProcessChildren(cch);
+	}
+}
+
+static bool SameExpr(const Expr* a, const Expr* b)
+{
+	if (a->kind != b->kind || a->GetReturnType() != b->GetReturnType() || a->childCount != b->childCount)
+		return false;
+	switch (a->kind)
+	{
+	case ASTNode::Kind_DeclRefExpr:
+		if (static_cast<const DeclRefExpr*>(a)->decl != static_cast<const DeclRefExpr*>(b)->decl)
+			return false;
+		break;
+	case ASTNode::Kind_BoolExpr:
+	case ASTNode::Kind_Int32Expr:
+	case ASTNode::Kind_Float32Expr:
+	{
+		ConstValue ca, cb;
+		if (!ReadConst(a, true, ca) || !ReadConst(b, true, cb) || memcmp(ca.v, cb.v, sizeof(double)))
+			return false;
+		break;
+	}
+	case ASTNode::Kind_UnaryOpExpr:
+		if (static_cast<const UnaryOpExpr*>(a)->opType != static_cast<const UnaryOpExpr*>(b)->opType)
+			return false;
+		break;
+	case ASTNode::Kind_BinaryOpExpr:
+		if (static_cast<const BinaryOpExpr*>(a)->opType != static_cast<const BinaryOpExpr*>(b)->opType)
+			return false;
+		break;
+	case ASTNode::Kind_OpExpr:
+		if (static_cast<const OpExpr*>(a)->opKind != static_cast<const OpExpr*>(b)->opKind)
+			return false;
+		break;
+	case ASTNode::Kind_MemberExpr:
+		if (static_cast<const MemberExpr*>(a)->memberID != static_cast<const MemberExpr*>(b)->memberID ||
+			static_cast<const MemberExpr*>(a)->swizzleComp != static_cast<const MemberExpr*>(b)->swizzleComp)
+			return false;
+		break;
+	default:
+		break;
+	}
+	for (const ASTNode *cha = a->firstChild, *chb = b->firstChild; cha; cha = cha->next, chb = chb->next)
+		if (!SameExpr(static_cast<const Expr*>(cha), static_cast<const Expr*>(chb)))
+			return false;
+	return true;
+}
+
+void PreshaderExtraction::Extract(Expr* expr)
+{
+	// splatting is free on the GPU, the new uniform only needs the scalar
+	while (auto* cast = dyn_cast<CastExpr>(expr))
+	{
+		ASTType::Kind kind = cast->GetReturnType()->kind;
+		if ((kind != ASTType::Vector && kind != ASTType::Matrix) || !cast->GetSource()->GetReturnType()->IsNumeric())
+			break;
+		expr = cast->GetSource();
+	}
+
+	VarDecl* vd = nullptr;
+	for (size_t i = 0; i < extracted.size() && !vd; ++i)
+		if (SameExpr(extracted[i], expr))
+			vd = outputs[i];
+
+	if (!vd)
+	{
+		vd = ast->CreateGlobalVar();
+		vd->name = "_preshader" + StdToString(int(outputs.size()));
+		vd->flags = VarDecl::ATTR_Global | VarDecl::ATTR_Uniform;
+		vd->SetType(expr->GetReturnType());
+
+		EmitExpr(expr);
+		Emit(PSO_Output, 0, expr->GetReturnType(), 1, 0);
+		ast->preshaderCode.push_back(uint32_t(outputs.size()));
+		outputs.push_back(vd);
+		extracted.push_back(expr);
+	}
+
+	auto* dre = new DeclRefExpr;
+	dre->decl = vd;
+	dre->SetReturnType(vd->GetType());
+	expr->ReplaceWith(dre);
+	if (extracted.back() != expr)
+		delete expr;
+	numExtracted++;
+}
+
+int PreshaderExtraction::GetInputIndex(VarDecl* vd)
+{
+	if (vd->optSlot < 0)
+	{
+		vd->optSlot = int(inputs.size());
+		inputs.push_back(vd);
+	}
+	return vd->optSlot;
+}
+
+// instruction word: opcode (8 bits), argc (8 bits), result type (kind: 2 bits, class: 2 bits, sizeX/Y: 3 bits each)
+void PreshaderExtraction::Emit(uint32_t opcode, uint32_t argc, const ASTType* t, int numPops, int numPushes)
+{
+	uint32_t type = 0;
+	switch (GetEvalKind(t, true))
+	{
+	case ASTType::Bool: type = 0; break;
+	case ASTType::Int32: type = 1; break;
+	default: type = 2; break;
+	}
+	if (t->kind == ASTType::Vector)
+		type |= (1 << 2) | (t->sizeX << 4);
+	else if (t->kind == ASTType::Matrix)
+		type |= (2 << 2) | (t->sizeX << 4) | (t->sizeY << 7);
+	ast->preshaderCode.push_back(opcode | (argc << 8) | (type << 16));
+
+	stackSize += numPushes - numPops;
+	if (stackSize > maxStackSize)
+		maxStackSize = stackSize;
+}
+
+void PreshaderExtraction::EmitExpr(const Expr* expr)
+{
+	const ASTType* rt = expr->GetReturnType();
+	int offset = 0;
+	auto* idx = dyn_cast<const IndexExpr>(expr);
+	if (dyn_cast<const DeclRefExpr>(expr) || (idx && IsArrayInput(idx, offset)))
+	{
+		auto* dre = static_cast<const DeclRefExpr*>(idx ? idx->GetSource() : expr);
+		Emit(PSO_Input, 0, rt, 0, 1);
+		ast->preshaderCode.push_back(uint32_t(GetInputIndex(dre->decl)));
+		ast->preshaderCode.push_back(uint32_t(offset));
+		return;
+	}
+	if (dyn_cast<const ConstExpr>(expr))
+	{
+		ConstValue cv;
+		ReadConst(expr, true, cv);
+		Emit(PSO_Const, 0, rt, 0, 1);
+		for (int i = 0; i < cv.count; ++i)
+		{
+			uint32_t bits;
+			if (cv.kind == ASTType::Float32)
+			{
+				float f = float(cv.v[i]);
+				memcpy(&bits, &f, sizeof(bits));
+			}
+			else
+				bits = uint32_t(int32_t(cv.v[i]));
+			ast->preshaderCode.push_back(bits);
+		}
+		return;
+	}
+
+	for (const ASTNode* ch = expr->firstChild; ch; ch = ch->next)
+		EmitExpr(static_cast<const Expr*>(ch));
+	int n = expr->childCount;
+	if (auto* unop = dyn_cast<const UnaryOpExpr>(expr))
+	{
+		Emit(PSO_Unary, 0, rt, n, 1);
+		ast->preshaderCode.push_back(uint32_t(unop->opType));
+	}
+	else if (auto* binop = dyn_cast<const BinaryOpExpr>(expr))
+	{
+		Emit(PSO_Binary, 0, rt, n, 1);
+		ast->preshaderCode.push_back(uint32_t(binop->opType));
+	}
+	else if (auto* op = dyn_cast<const OpExpr>(expr))
+	{
+		Emit(PSO_Op, n, rt, n, 1);
+		ast->preshaderCode.push_back(uint32_t(op->opKind));
+	}
+	else if (auto* mmb = dyn_cast<const MemberExpr>(expr))
+	{
+		Emit(PSO_Swizzle, 0, rt, n, 1);
+		ast->preshaderCode.push_back(mmb->memberID);
+	}
+	else if (dyn_cast<const IndexExpr>(expr))
+		Emit(PSO_Index, 0, rt, n, 1);
+	else if (dyn_cast<const CastExpr>(expr))
+		Emit(PSO_Cast, 0, rt, n, 1);
+	else if (dyn_cast<const InitListExpr>(expr))
+		Emit(PSO_List, n, rt, n, 1);
+	else if (dyn_cast<const TernaryOpExpr>(expr))
+		Emit(PSO_Select, 0, rt, n, 1);
+}
+
+void PreshaderExtraction::FindWrittenVars(ASTNode* node)
+{
+	if (auto* dre = dyn_cast<DeclRefExpr>(node))
+	{
+		if (dre->decl && (dre->decl->flags & VarDecl::ATTR_Uniform) && IsWrittenRef(dre))
+			writtenVars.push_back(dre->decl);
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		FindWrittenVars(ch);
+}
+
+void PreshaderExtraction::RunOnAST(AST& a)
+{
+	ast = &a;
+	for (ASTNode* fn = ast->functionList.firstChild; fn; fn = fn->next)
+		if (Stmt* code = fn->ToFunction()->GetCode())
+			FindWrittenVars(code);
+
+	for (int i = 0; i < HeaderSize; ++i)
+		ast->preshaderCode.push_back(0);
+	for (ASTNode* fn = ast->functionList.firstChild; fn; fn = fn->next)
+		if (Stmt* code = fn->ToFunction()->GetCode())
+			ProcessChildren(code);
+
+	if (outputs.empty())
+	{
+		ast->preshaderCode.clear();
+	}
+	else
+	{
+		ast->preshaderCode[0] = Magic;
+		ast->preshaderCode[1] = uint32_t(inputs.size());
+		ast->preshaderCode[2] = uint32_t(outputs.size());
+		ast->preshaderCode[3] = uint32_t(maxStackSize);
+	}
+	for (VarDecl* vd : inputs)
+	{
+		vd->optSlot = -1;
+		ast->preshaderInputs.push_back(*vd);
+	}
+	for (VarDecl* vd : outputs)
+		ast->preshaderOutputs.push_back(*vd);
+	for (Expr* expr : extracted)
+		delete expr;
+	extracted.clear();
+}
+
+
+struct PreshaderValue
+{
+	ConstValue value;
+	uint32_t type;
+};
+
+// type from the instruction word, `scalar` and `vm` are the storage
+static const ASTType* DecodePreshaderType(uint32_t type, ASTType& scalar, ASTType& vm)
+{
+	static const ASTType::Kind kinds[4] = { ASTType::Bool, ASTType::Int32, ASTType::Float32, ASTType::Void };
+	scalar.kind = kinds[type & 0x3];
+	uint32_t cls = (type >> 2) & 0x3;
+	vm.sizeX = (type >> 4) & 0x7;
+	vm.sizeY = (type >> 7) & 0x7;
+	if (scalar.kind == ASTType::Void || (type >> 10) || cls > 2 ||
+		(cls >= 1 && (vm.sizeX < 1 || vm.sizeX > 4)) ||
+		(cls == 2 && (vm.sizeY < 1 || vm.sizeY > 4)))
+		return nullptr;
+	if (cls == 0)
+		return &scalar;
+	vm.kind = cls == 1 ? ASTType::Vector : ASTType::Matrix;
+	vm.subType = &scalar;
+	return &vm;
+}
+
+bool HOC::RunPreshader(const uint32_t* code, size_t codeSize, const float* const* inputs, float* const* outputs)
+{
+	typedef PreshaderExtraction PE;
+	if (!code || codeSize < PE::HeaderSize || code[0] != PE::Magic || code[3] > 1024)
+		return false;
+	uint32_t numInputs = code[1];
+	uint32_t numOutputs = code[2];
+	Array<PreshaderValue> stack;
+	stack.resize(code[3]);
+	size_t sp = 0;
+
+	for (size_t pc = PE::HeaderSize; pc < codeSize; )
+	{
+		uint32_t instr = code[pc++];
+		uint32_t opcode = instr & 0xff;
+		uint32_t argc = (instr >> 8) & 0xff;
+		ASTType scalar, vm;
+		const ASTType* rt = DecodePreshaderType(instr >> 16, scalar, vm);
+		if (!rt)
+			return false;
+		ConstValue out;
+		out.kind = GetEvalKind(rt, true);
+		out.count = GetEvalCount(rt);
+
+		// operand words and stack values
+		static const uint8_t numOperands[PE::PSO_COUNT] = { 2, 0, 1, 1, 1, 1, 0, 0, 0, 0, 1 };
+		static const uint8_t numPops[PE::PSO_COUNT] = { 0, 0, 1, 2, 0, 1, 2, 1, 0, 3, 1 };
+		if (opcode >= PE::PSO_COUNT)
+			return false;
+		uint32_t nops = opcode == PE::PSO_Const ? uint32_t(out.count) : numOperands[opcode];
+		uint32_t npop = opcode == PE::PSO_Op || opcode == PE::PSO_List ? argc : numPops[opcode];
+		if (codeSize - pc < nops || sp < npop)
+			return false;
+		const uint32_t* operands = &code[pc];
+		pc += nops;
+		sp -= npop;
+		PreshaderValue* args = stack.data() + sp;
+
+		ASTType argScalars[3], argVMs[3];
+		const ASTType* argTypes[3] = {};
+		for (uint32_t i = 0; i < npop && i < 3; ++i)
+			if (!(argTypes[i] = DecodePreshaderType(args[i].type, argScalars[i], argVMs[i])))
+				return false;
+
+		bool ok = true;
+		switch (opcode)
+		{
+		case PE::PSO_Input:
+			if (operands[0] >= numInputs || !inputs[operands[0]])
+				return false;
+			for (int i = 0; i < out.count; ++i)
+				out.v[i] = inputs[operands[0]][operands[1] + i];
+			break;
+		case PE::PSO_Const:
+			for (int i = 0; i < out.count; ++i)
+			{
+				if (out.kind == ASTType::Float32)
+				{
+					float f;
+					memcpy(&f, &operands[i], sizeof(f));
+					out.v[i] = f;
+				}
+				else
+					out.v[i] = int32_t(operands[i]);
+			}
+			break;
+		case PE::PSO_Unary:
+			ok = EvalUnaryOp(SLTokenType(operands[0]), args[0].value, out);
+			break;
+		case PE::PSO_Binary:
+		{
+			// arithmetic is done in the type of the result
+			SLTokenType op = SLTokenType(operands[0]);
+			ASTType::Kind kind = TokenIsOpCompare(op) ? args[0].value.kind : out.kind;
+			ok = EvalBinaryOp(op, args[0].value, args[1].value, kind, out);
+			break;
+		}
+		case PE::PSO_Op:
+		{
+			ConstValue opArgs[3];
+			if (argc < 1 || argc > 3 || operands[0] >= Op_COUNT)
+				return false;
+			for (uint32_t i = 0; i < argc; ++i)
+				opArgs[i] = args[i].value;
+			ok = EvalOp(OpKind(operands[0]), opArgs, int(argc), argTypes, rt, true, out);
+			break;
+		}
+		case PE::PSO_Swizzle:
+			EvalSwizzle(operands[0], out.count, argTypes[0], args[0].value, out);
+			break;
+		case PE::PSO_Index:
+			ok = EvalIndex(args[0].value, args[1].value, argTypes[0], out);
+			break;
+		case PE::PSO_Cast:
+			ok = CastConst(args[0].value, argTypes[0], rt, out);
+			break;
+		case PE::PSO_List:
+		{
+			int n = 0;
+			for (uint32_t i = 0; i < argc && ok; ++i)
+			{
+				const ConstValue& sub = args[i].value;
+				ok = n + sub.count <= out.count;
+				for (int j = 0; j < sub.count && ok; ++j)
+				{
+					out.v[n] = sub.v[j];
+					ok = ConvertConstValue(out.v[n++], out.kind);
+				}
+			}
+			ok = ok && n == out.count;
+			break;
+		}
+		case PE::PSO_Select:
+			ok = EvalSelect(args[0].value, args[1].value, args[2].value, out.count, out);
+			break;
+		case PE::PSO_Output:
+			if (operands[0] >= numOutputs || !outputs[operands[0]] || args[0].value.count != out.count)
+				return false;
+			for (int i = 0; i < out.count; ++i)
+				outputs[operands[0]][i] = float(args[0].value.v[i]);
+			continue;
+		}
+		if (!ok || !FinishConst(out, rt, true) || sp >= stack.size())
+			return false;
+		stack[sp].value = out;
+		stack[sp].type = instr >> 16;
+		sp++;
+	}
+	return true;
+}
+
+bool ConstantPropagation::Evaluate(Expr* expr, ConstValue& out)
+{
+	ASTType* rt = expr->GetReturnType();
+	if (GetEvalKind(rt, foldMatrices) == ASTType::Void)
+		return false;
+
+	if (auto* unop = dyn_cast<const UnaryOpExpr>(expr))
+	{
+		ConstValue src;
+		if (!ReadConst(unop->GetSource(), foldMatrices, src) ||
+			!EvalUnaryOp(unop->opType, src, out))
+			return false;
+	}
+	else if (auto* binop = dyn_cast<const BinaryOpExpr>(expr))
+	{
+		ConstValue lft, rgt;
+		if (!ReadConst(binop->GetLft(), foldMatrices, lft) ||
+			!ReadConst(binop->GetRgt(), foldMatrices, rgt))
+			return false;
+		// arithmetic is done in the type of the result
+		ASTType::Kind kind = GetEvalKind(rt, foldMatrices);
+		if (TokenIsOpCompare(binop->opType))
+			kind = lft.kind;
+		if (!EvalBinaryOp(binop->opType, lft, rgt, kind, out))
+			return false;
+	}
+	else if (auto* op = dyn_cast<const OpExpr>(expr))
+	{
+		ConstValue args[3];
+		const ASTType* argTypes[3];
+		if (op->opKind == Op_FCall || op->GetArgCount() > 3 || op->GetArgCount() < 1)
+			return false;
+		int n = 0;
+		for (ASTNode* ch = op->GetFirstArg(); ch; ch = ch->next, ++n)
+		{
+			argTypes[n] = ch->ToExpr()->GetReturnType();
+			if (!ReadConst(ch->ToExpr(), foldMatrices, args[n]))
+				return false;
+		}
+		if (!EvalOp(op->opKind, args, n, argTypes, rt, foldMatrices, out))
+			return false;
+	}
+	else if (auto* mmb = dyn_cast<const MemberExpr>(expr))
+	{
+		const ASTType* st = mmb->GetSource()->GetReturnType();
+		ConstValue src;
+		if (mmb->swizzleComp == 0 || !ReadConst(mmb->GetSource(), foldMatrices, src))
+			return false;
+		EvalSwizzle(mmb->memberID, mmb->swizzleComp, st, src, out);
+	}
+	else if (auto* idx = dyn_cast<const IndexExpr>(expr))
+	{
+		const ASTType* st = idx->GetSource()->GetReturnType();
+		ConstValue src, index;
+		if (st->kind != ASTType::Vector ||
+			!ReadConst(idx->GetSource(), foldMatrices, src) ||
+			!ReadConst(idx->GetIndex(), foldMatrices, index) ||
+			!EvalIndex(src, index, st, out))
+			return false;
+	}
+	else if (auto* cast = dyn_cast<const CastExpr>(expr))
+	{
+		// scalar constants cast to vectors are already in their shortest form
+		if (dyn_cast<const ConstExpr>(cast->GetSource()) && rt->kind == ASTType::Vector)
+			return false;
+		if (!ReadConst(cast, foldMatrices, out))
+			return false;
+	}
+	else if (auto* ile = dyn_cast<const InitListExpr>(expr))
+	{
+		// flatten nested constants, lists of scalar constants are already in their final form
+		bool flat = true;
+		for (ASTNode* ch = ile->firstChild; ch && flat; ch = ch->next)
+			flat = dyn_cast<const ConstExpr>(ch) != nullptr;
+		if (flat || !ReadConst(ile, foldMatrices, out))
+			return false;
+	}
+	else if (auto* tern = dyn_cast<const TernaryOpExpr>(expr))
+	{
+		ConstValue cond, tv, fv;
+		if (!ReadConst(tern->GetCond(), foldMatrices, cond) ||
+			!ReadConst(tern->GetTrueExpr(), foldMatrices, tv) ||
+			!ReadConst(tern->GetFalseExpr(), foldMatrices, fv))
+			return false;
+		if (!EvalSelect(cond, tv, fv, GetEvalCount(rt), out))
+			return false;
+	}
+	else
+		return false;
+
+	return FinishConst(out, rt, foldMatrices);
+}
+
 void ConstantPropagation::PostVisit(ASTNode* node)
 {
-	if (auto* unop = dyn_cast<const UnaryOpExpr>(node))
+	if (auto* expr = node->ToExpr())
+	{
+		ConstValue cv;
+		if (Evaluate(expr, cv))
+		{
+			delete node->ReplaceWith(CreateConst(cv, expr->GetReturnType()));
+			return;
+		}
+		if (auto* tern = dyn_cast<TernaryOpExpr>(node))
+		{
+			// both operands are evaluated, the unused one can only be removed without side effects
+			auto* cond = dyn_cast<const BoolExpr>(tern->GetCond());
+			if (cond && tern->GetReturnType() == tern->GetTrueExpr()->GetReturnType() &&
+				tern->GetReturnType() == tern->GetFalseExpr()->GetReturnType() &&
+				!HasSideEffects(cond->value ? tern->GetFalseExpr() : tern->GetTrueExpr()))
+			{
+				delete node->ReplaceWith(cond->value ? tern->GetTrueExpr() : tern->GetFalseExpr());
+			}
+		}
+		return;
+	}
+
+	if (auto* ifelse = dyn_cast<IfElseStmt>(node))
+	{
+		if (auto* cond = dyn_cast<const BoolExpr>(ifelse->GetCond()))
+		{
+			if (cond->value)
+			{
+				delete node->ReplaceWith(ifelse->GetTrueBr());
+			}
+			else
+			{
+				// TODO clean up
+				delete node->ReplaceWith(ifelse->GetFalseBr() ? ifelse->GetFalseBr() : new BlockStmt);
+			}
+			return;
+		}
+	}
+}
+
+void ConstantPropagation::VisitGlobal(VarDecl* vd)
+{
+	if (vd->GetInitExpr())
+		WalkNode(vd->GetInitExpr());
+}
+
+
+// converts a value to the type of the variable it is stored in (scalars are splatted)
+static bool ConvertToVarType(ConstValue& cv, const ASTType* t, bool matrices)
+{
+	ASTType::Kind kind = GetEvalKind(t, matrices);
+	int count = GetEvalCount(t);
+	if (kind == ASTType::Void || (cv.count != 1 && cv.count != count))
+		return false;
+	for (int i = 0; i < count; ++i)
+	{
+		cv.v[i] = Arg(cv, i);
+		if (!ConvertConstValue(cv.v[i], kind))
+			return false;
+	}
+	cv.kind = kind;
+	cv.count = count;
+	return true;
+}
+
+static bool SameConst(const ConstValue& a, const ConstValue& b)
+{
+	// bitwise to tell 0 and -0 apart
+	return a.kind == b.kind && a.count == b.count &&
+		memcmp(a.v, b.v, sizeof(a.v[0]) * a.count) == 0;
+}
+
+// variable written by an l-value expression (through swizzles/indexing)
+static VarDecl* GetWrittenVar(Expr* e)
+{
+	while (auto* sve = dyn_cast<SubValExpr>(e))
+		e = sve->GetSource();
+	auto* dre = dyn_cast<DeclRefExpr>(e);
+	return dre ? dre->decl : nullptr;
+}
+
+void VariableConstantPropagation::AssignSlots(ASTNode* node)
+{
+	if (auto* vds = dyn_cast<VarDeclStmt>(node))
+	{
+		for (ASTNode* ch = vds->firstChild; ch; ch = ch->next)
+		{
+			VarDecl* vd = ch->ToVarDecl();
+			// static locals keep their values between calls
+			if (!(vd->flags & VarDecl::ATTR_Static) &&
+				GetEvalKind(vd->GetType(), folder.foldMatrices) != ASTType::Void)
+			{
+				vd->optSlot = int(values.size());
+				values.push_back(ConstValue());
+				slotVars.push_back(vd);
+			}
+			else
+				vd->optSlot = -1;
+		}
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		AssignSlots(ch);
+}
+
+void VariableConstantPropagation::CollectWrites(ASTNode* node, bool conditional)
+{
+	if (auto* binop = dyn_cast<BinaryOpExpr>(node))
+	{
+		if (TokenIsOpAssign(binop->opType))
+		{
+			VarDecl* vd = GetWrittenVar(binop->GetLft());
+			if (vd && vd->optSlot >= 0)
+				writes.push_back({ vd->optSlot, binop, conditional });
+		}
+		else if (binop->opType == STT_OP_LogicalAnd || binop->opType == STT_OP_LogicalOr)
+		{
+			CollectWrites(binop->GetLft(), conditional);
+			CollectWrites(binop->GetRgt(), true);
+			return;
+		}
+	}
+	else if (auto* incdec = dyn_cast<IncDecOpExpr>(node))
+	{
+		VarDecl* vd = GetWrittenVar(incdec->GetSource());
+		if (vd && vd->optSlot >= 0)
+			writes.push_back({ vd->optSlot, incdec, conditional });
+	}
+	else if (auto* op = dyn_cast<OpExpr>(node))
+	{
+		if (auto* rf = op->resolvedFunc)
+		{
+			for (ASTNode *arg = op->GetFirstArg(), *argdecl = rf->GetFirstArg();
+				arg && argdecl;
+				arg = arg->next, argdecl = argdecl->next)
+			{
+				if (argdecl->ToVarDecl()->flags & VarDecl::ATTR_Out)
+				{
+					VarDecl* vd = GetWrittenVar(arg->ToExpr());
+					if (vd && vd->optSlot >= 0)
+						writes.push_back({ vd->optSlot, op, conditional });
+				}
+			}
+		}
+	}
+	else if (auto* tern = dyn_cast<TernaryOpExpr>(node))
+	{
+		CollectWrites(tern->GetCond(), conditional);
+		CollectWrites(tern->GetTrueExpr(), true);
+		CollectWrites(tern->GetFalseExpr(), true);
+		return;
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		CollectWrites(ch, conditional);
+}
+
+// rootSlot - variable assigned by the root expression, read before the assignment
+void VariableConstantPropagation::SubstituteReads(ASTNode* node, int rootSlot)
+{
+	if (auto* dre = dyn_cast<DeclRefExpr>(node))
+	{
+		int slot = dre->decl ? dre->decl->optSlot : -1;
+		if (slot < 0 || !values[slot].count ||
+			GetEvalCount(dre->GetReturnType()) != values[slot].count)
+			return;
+		if (slot != rootSlot)
+		{
+			for (const VarWrite& w : writes)
+				if (w.slot == slot)
+					return;
+		}
+		delete dre->ReplaceWith(CreateConst(values[slot], dre->GetReturnType()));
+		return;
+	}
+	for (ASTNode* ch = node->firstChild; ch; )
+	{
+		ASTNode* cch = ch;
+		ch = ch->next;
+		SubstituteReads(cch, rootSlot);
+	}
+}
+
+bool VariableConstantPropagation::EvaluateWrite(const VarWrite& w, ConstValue& out)
+{
+	const ConstValue& prev = values[w.slot];
+	const ASTType* vt = slotVars[w.slot]->GetType();
+	ASTType::Kind kind = GetEvalKind(vt, folder.foldMatrices);
+	if (auto* binop = dyn_cast<const BinaryOpExpr>(w.node))
+	{
+		ConstValue rgt;
+		if (!dyn_cast<const DeclRefExpr>(binop->GetLft()) ||
+			!ReadConst(binop->GetRgt(), folder.foldMatrices, rgt))
+			return false;
+		if (binop->opType == STT_OP_Assign)
+		{
+			out = rgt;
+			return ConvertToVarType(out, vt, folder.foldMatrices);
+		}
+		// compound assignment operators are in the same order as the binary operators
+		SLTokenType op = SLTokenType(binop->opType - STT_OP_AddEq + STT_OP_Add);
+		return prev.count &&
+			EvalBinaryOp(op, prev, rgt, kind, out) &&
+			FinishConst(out, vt, folder.foldMatrices);
+	}
+	if (auto* incdec = dyn_cast<const IncDecOpExpr>(w.node))
+	{
+		ConstValue one;
+		one.kind = kind;
+		one.count = 1;
+		one.v[0] = 1;
+		return dyn_cast<const DeclRefExpr>(incdec->GetSource()) && prev.count &&
+			EvalBinaryOp(incdec->dec ? STT_OP_Sub : STT_OP_Add, prev, one, kind, out) &&
+			FinishConst(out, vt, folder.foldMatrices);
+	}
+	return false;
+}
+
+Expr* VariableConstantPropagation::ProcessExpr(Expr* expr)
+{
+	if (!expr || unreachable)
+		return expr;
+
+	// the expression itself may be replaced
+	ASTNode* parent = expr->parent;
+	ASTNode* prev = expr->prev;
+
+	writes.clear();
+	CollectWrites(expr, false);
+	int rootSlot = -1;
+	if (auto* binop = dyn_cast<BinaryOpExpr>(expr))
+	{
+		if (writes.size() == 1 && writes[0].node == binop && dyn_cast<DeclRefExpr>(binop->GetLft()))
+			rootSlot = writes[0].slot;
+		// the assigned variable itself is not read
+		if (TokenIsOpAssign(binop->opType))
+			SubstituteReads(binop->GetRgt(), rootSlot);
+		else
+			SubstituteReads(binop, rootSlot);
+	}
+	else
+		SubstituteReads(expr, rootSlot);
+
+	expr = (prev ? prev->next : parent->firstChild)->ToExpr();
+	folder.WalkNode(expr);
+	expr = (prev ? prev->next : parent->firstChild)->ToExpr();
+
+	writes.clear();
+	CollectWrites(expr, false);
+	for (size_t i = 0; i < writes.size(); ++i)
+	{
+		const VarWrite& w = writes[i];
+		bool single = !w.conditional;
+		for (size_t j = 0; j < writes.size() && single; ++j)
+			single = j == i || writes[j].slot != w.slot;
+		ConstValue cv;
+		if (!single || !EvaluateWrite(w, cv))
+			cv = ConstValue();
+		values[w.slot] = cv;
+	}
+	return expr;
+}
+
+void VariableConstantPropagation::ProcessLoop(Stmt* loop)
+{
+	// the loop may run any number of times, everything it writes is unknown at the start of each iteration
+	writes.clear();
+	CollectWrites(loop, false);
+	for (const VarWrite& w : writes)
+		values[w.slot] = ConstValue();
+	Array<ConstValue> entryValues = values;
+
+	if (auto* whilestmt = dyn_cast<WhileStmt>(loop))
+	{
+		ProcessExpr(whilestmt->GetCond());
+		ProcessStmt(whilestmt->GetBody());
+	}
+	else if (auto* dowhile = dyn_cast<DoWhileStmt>(loop))
+	{
+		ProcessStmt(dowhile->GetBody());
+		values = entryValues;
+		unreachable = false;
+		ProcessExpr(dowhile->GetCond());
+	}
+	else if (auto* forstmt = dyn_cast<ForStmt>(loop))
+	{
+		ProcessExpr(forstmt->GetCond());
+		ProcessStmt(forstmt->GetBody());
+		// also reached from `continue`
+		values = entryValues;
+		unreachable = false;
+		ProcessExpr(forstmt->GetIncr());
+	}
+
+	// also reached from `break`
+	values = std::move(entryValues);
+	unreachable = false;
+}
+
+void VariableConstantPropagation::ProcessStmt(Stmt* stmt)
+{
+	// code after return/discard/break/continue is left as is
+	if (!stmt || unreachable)
+		return;
+
+	if (auto* blk = dyn_cast<BlockStmt>(stmt))
+	{
+		for (ASTNode* ch = blk->firstChild; ch; )
+		{
+			ASTNode* cch = ch;
+			ch = ch->next;
+			ProcessStmt(cch->ToStmt());
+		}
+	}
+	else if (auto* exprstmt = dyn_cast<ExprStmt>(stmt))
+	{
+		ProcessExpr(exprstmt->GetExpr());
+	}
+	else if (auto* vds = dyn_cast<VarDeclStmt>(stmt))
+	{
+		for (ASTNode* ch = vds->firstChild; ch; ch = ch->next)
+		{
+			VarDecl* vd = ch->ToVarDecl();
+			Expr* init = ProcessExpr(vd->GetInitExpr());
+			if (vd->optSlot < 0)
+				continue;
+			ConstValue cv;
+			if (!init ||
+				!ReadConst(init, folder.foldMatrices, cv) ||
+				!ConvertToVarType(cv, vd->GetType(), folder.foldMatrices))
+				cv = ConstValue();
+			values[vd->optSlot] = cv;
+		}
+	}
+	else if (auto* ifelse = dyn_cast<IfElseStmt>(stmt))
+	{
+		if (dyn_cast<BoolExpr>(ProcessExpr(ifelse->GetCond())))
+		{
+			// only the taken branch remains
+			ASTNode* parent = ifelse->parent;
+			ASTNode* prev = ifelse->prev;
+			folder.PostVisit(ifelse);
+			ProcessStmt((prev ? prev->next : parent->firstChild)->ToStmt());
+			return;
+		}
+
+		Array<ConstValue> entryValues = values;
+		ProcessStmt(ifelse->GetTrueBr());
+		Array<ConstValue> trueValues = std::move(values);
+		bool trueUnreachable = unreachable;
+
+		values = std::move(entryValues);
+		unreachable = false;
+		ProcessStmt(ifelse->GetFalseBr());
+
+		if (trueUnreachable)
+			return;
+		if (unreachable)
+		{
+			values = std::move(trueValues);
+			unreachable = false;
+			return;
+		}
+		for (size_t i = 0; i < values.size(); ++i)
+			if (!SameConst(values[i], trueValues[i]))
+				values[i] = ConstValue();
+	}
+	else if (dyn_cast<WhileStmt>(stmt) || dyn_cast<DoWhileStmt>(stmt))
+	{
+		ProcessLoop(stmt);
+	}
+	else if (auto* forstmt = dyn_cast<ForStmt>(stmt))
+	{
+		ProcessStmt(forstmt->GetInit());
+		ProcessLoop(stmt);
+	}
+	else if (auto* ret = dyn_cast<ReturnStmt>(stmt))
+	{
+		ProcessExpr(ret->GetExpr());
+		unreachable = true;
+	}
+	else if (dyn_cast<DiscardStmt>(stmt) || dyn_cast<BreakStmt>(stmt) || dyn_cast<ContinueStmt>(stmt))
+	{
+		unreachable = true;
+	}
+}
+
+void VariableConstantPropagation::ProcessFunction(ASTFunction* fn)
+{
+	values = globalValues;
+	slotVars.resize(globalValues.size());
+	AssignSlots(fn->GetCode());
+
+	unreachable = false;
+	ProcessStmt(fn->GetCode());
+
+	for (size_t i = globalValues.size(); i < slotVars.size(); ++i)
+		slotVars[i]->optSlot = -1;
+}
+
+void VariableConstantPropagation::RunOnAST(AST& ast)
+{
+	// static const globals cannot be modified, their (folded) initial values are used everywhere
+	writes.clear();
+	for (ASTNode* g = ast.globalVars.firstChild; g; g = g->next)
+	{
+		VarDecl* vd = g->ToVarDecl();
+		if (!vd || !vd->GetInitExpr())
+			continue;
+		// initializers may refer to previous constants
+		SubstituteReads(vd->GetInitExpr(), -1);
+		folder.WalkNode(vd->GetInitExpr());
+		ConstValue cv;
+		if ((vd->flags & (VarDecl::ATTR_Static | VarDecl::ATTR_Const)) ==
+			(VarDecl::ATTR_Static | VarDecl::ATTR_Const) &&
+			ReadConst(vd->GetInitExpr(), folder.foldMatrices, cv) &&
+			ConvertToVarType(cv, vd->GetType(), folder.foldMatrices))
+		{
+			vd->optSlot = int(values.size());
+			values.push_back(cv);
+			slotVars.push_back(vd);
+		}
+	}
+	globalValues = values;
+
+	for (ASTNode* ch = ast.functionList.firstChild; ch; ch = ch->next)
+		ProcessFunction(ch->ToFunction());
+
+	for (VarDecl* vd : slotVars)
+		vd->optSlot = -1;
+	slotVars.clear();
+}
+
+
+// component kind of scalars and vectors, Void for other types
+static ASTType::Kind GetScalarKind(const ASTType* t)
+{
+	if (t->kind == ASTType::Vector)
+		t = t->subType;
+	return t->IsNumeric() ? t->kind : ASTType::Void;
+}
+
+// whether all components of the scalar/vector constant are `v` (bitwise unless anySign is set)
+static bool IsConstSplat(const Expr* e, double v, bool anySign = false)
+{
+	ConstValue cv;
+	if (!ReadConst(e, false, cv))
+		return false;
+	for (int i = 0; i < cv.count; ++i)
+	{
+		if (anySign ? cv.v[i] != v : memcmp(&cv.v[i], &v, sizeof(v)) != 0)
+			return false;
+	}
+	return true;
+}
+
+// without side effects and cheap enough to evaluate twice
+static bool IsRepeatable(const Expr* e)
+{
+	while (auto* mmb = dyn_cast<const MemberExpr>(e))
+		e = mmb->GetSource();
+	return dyn_cast<const DeclRefExpr>(e) || dyn_cast<const ConstExpr>(e);
+}
+
+static Expr* CreateUnaryOp(SLTokenType opType, Expr* src, ASTType* t)
+{
+	auto* unop = new UnaryOpExpr;
+	unop->opType = opType;
+	unop->SetReturnType(t);
+	unop->SetSource(src);
+	return unop;
+}
+
+static Expr* CreateOp(OpKind opKind, Expr* a, Expr* b, ASTType* t)
+{
+	auto* op = new OpExpr;
+	op->opKind = opKind;
+	op->SetReturnType(t);
+	op->AppendChild(a);
+	if (b)
+		op->AppendChild(b);
+	return op;
+}
+
+// returns the replacement, the expression itself if it was modified in place or nullptr if nothing changed
+Expr* AlgebraicSimplification::Simplify(Expr* expr)
+{
+	ASTType* rt = expr->GetReturnType();
+
+	if (auto* mmb = dyn_cast<MemberExpr>(expr))
+	{
+		if (!mmb->swizzleComp)
+			return nullptr;
+		Expr* src = mmb->GetSource();
+		if (auto* inner = dyn_cast<MemberExpr>(src))
+		{
+			// swizzle of a swizzle, the components are picked from the inner source directly
+			if (!inner->swizzleComp)
+				return nullptr;
+			int bits = inner->GetSource()->GetReturnType()->kind == ASTType::Matrix ? 4 : 2;
+			uint32_t mask = (1u << bits) - 1;
+			uint32_t id = 0;
+			for (int i = 0; i < mmb->swizzleComp; ++i)
+			{
+				uint32_t comp = (mmb->memberID >> (i * 2)) & 0x3;
+				id |= ((inner->memberID >> (comp * bits)) & mask) << (i * bits);
+			}
+			inner->memberID = id;
+			inner->swizzleComp = mmb->swizzleComp;
+			inner->SetReturnType(rt);
+			return inner;
+		}
+		const ASTType* st = src->GetReturnType();
+		if (st != rt || st->kind != ASTType::Vector || mmb->swizzleComp != st->sizeX)
+			return nullptr;
+		for (int i = 0; i < mmb->swizzleComp; ++i)
+			if (((mmb->memberID >> (i * 2)) & 0x3) != uint32_t(i))
+				return nullptr;
+		return src; // .xyzw
+	}
+
+	if (auto* cast = dyn_cast<CastExpr>(expr))
+	{
+		Expr* src = cast->GetSource();
+		if (src->GetReturnType() == rt)
+			return src;
+		auto* inner = dyn_cast<CastExpr>(src);
+		if (!inner)
+			return nullptr;
+		// the inner cast can be skipped if it doesn't change the values used by the outer one
+		const ASTType* it = inner->GetReturnType();
+		const ASTType* st = inner->GetSource()->GetReturnType();
+		ASTType::Kind sk = GetScalarKind(st);
+		ASTType::Kind ik = GetScalarKind(it);
+		if (sk == ASTType::Void || ik == ASTType::Void || GetScalarKind(rt) == ASTType::Void)
+			return nullptr;
+		if (sk != ik && sk != ASTType::Bool && !(sk == ASTType::Float16 && ik == ASTType::Float32))
+			return nullptr; // conversion is not exact
+		if (GetEvalCount(st) != 1 && GetEvalCount(it) < GetEvalCount(rt))
+			return nullptr; // components are dropped
+		delete inner->ReplaceWith(inner->GetSource());
+		return cast;
+	}
+
+	ASTType::Kind kind = GetEvalKind(rt, false);
+	if (kind == ASTType::Void)
+		return nullptr;
+
+	if (auto* unop = dyn_cast<UnaryOpExpr>(expr))
+	{
+		Expr* src = unop->GetSource();
+		if (unop->opType == STT_OP_Add && src->GetReturnType() == rt)
+			return src;
+		// -(-x), !(!x) of bools, ~(~x)
+		auto* inner = dyn_cast<UnaryOpExpr>(src);
+		if (inner && inner->opType == unop->opType &&
+			(unop->opType == STT_OP_Sub || unop->opType == STT_OP_Not || unop->opType == STT_OP_Inv) &&
+			inner->GetSource()->GetReturnType() == rt)
+			return inner->GetSource();
+		return nullptr;
+	}
+
+	if (kind != ASTType::Int32 && kind != ASTType::Float32)
+		return nullptr;
+	bool isInt = kind == ASTType::Int32;
+	// zero that leaves the other operand of an addition unchanged
+	double addZero = isInt ? 0.0 : -0.0;
+
+	if (auto* binop = dyn_cast<BinaryOpExpr>(expr))
+	{
+		Expr* lft = binop->GetLft();
+		Expr* rgt = binop->GetRgt();
+		if (lft->GetReturnType() != rt || rgt->GetReturnType() != rt)
+			return nullptr;
+		switch (binop->opType)
+		{
+		case STT_OP_Add:
+			if (IsConstSplat(rgt, addZero, fastMath))
+				return lft;
+			if (IsConstSplat(lft, addZero, fastMath))
+				return rgt;
+			break;
+		case STT_OP_Sub:
+			if (IsConstSplat(rgt, 0.0, fastMath))
+				return lft;
+			if (IsConstSplat(lft, addZero, fastMath))
+				return CreateUnaryOp(STT_OP_Sub, rgt, rt);
+			break;
+		case STT_OP_Div:
+			if (IsConstSplat(rgt, 1.0))
+				return lft;
+			if (!isInt)
+			{
+				// the reciprocal of a power of two is exact, the results are the same
+				ConstValue cv;
+				if (!ReadConst(rgt, false, cv))
+					break;
+				for (int i = 0; i < cv.count; ++i)
+				{
+					int exp;
+					double r = 1.0 / cv.v[i];
+					if (!fastMath && (fabs(frexp(cv.v[i], &exp)) != 0.5 || !(fabs(r) >= ldexp(1.0, -126))))
+						return nullptr;
+					cv.v[i] = r;
+				}
+				if (!FinishConst(cv, rt, false))
+					break;
+				return CreateOp(Op_Multiply, lft, CreateConst(cv, rt), rt);
+			}
+			break;
+		default:
+			break;
+		}
+		return nullptr;
+	}
+
+	if (auto* op = dyn_cast<OpExpr>(expr))
+	{
+		switch (op->opKind)
+		{
+		case Op_Multiply:
+			// either side can be a scalar
+			for (int i = 0; i < 2; ++i)
+			{
+				Expr* x = i ? op->GetRgt() : op->GetLft();
+				Expr* c = i ? op->GetLft() : op->GetRgt();
+				if ((isInt || fastMath) && IsConstSplat(c, 0.0, true) && !HasSideEffects(x))
+				{
+					ConstValue zero;
+					zero.kind = kind;
+					zero.count = GetEvalCount(rt);
+					for (int j = 0; j < zero.count; ++j)
+						zero.v[j] = 0;
+					return CreateConst(zero, rt);
+				}
+				if (x->GetReturnType() != rt)
+					continue;
+				if (IsConstSplat(c, 1.0))
+					return x;
+				if (IsConstSplat(c, -1.0))
+					return CreateUnaryOp(STT_OP_Sub, x, rt);
+			}
+			break;
+		case Op_Pow:
+		{
+			Expr* x = op->GetLft();
+			Expr* y = op->GetRgt();
+			if (x->GetReturnType() != rt)
+				break;
+			if (IsConstSplat(y, 1.0))
+				return x;
+			if (IsConstSplat(y, 2.0) && IsRepeatable(x))
+				return CreateOp(Op_Multiply, x, x->DeepClone()->ToExpr(), rt);
+			// differs for -0 and -inf
+			if (fastMath && IsConstSplat(y, 0.5))
+				return CreateOp(Op_Sqrt, x, nullptr, rt);
+			break;
+		}
+		case Op_Abs:
+			if (auto* neg = dyn_cast<UnaryOpExpr>(op->GetSource()))
+			{
+				if (neg->opType == STT_OP_Sub && neg->GetSource()->GetReturnType() == rt)
+				{
+					delete neg->ReplaceWith(neg->GetSource());
+					return op;
+				}
+			}
+			// fallthrough
+		case Op_Ceil:
+		case Op_Floor:
+		case Op_Normalize:
+		case Op_Round:
+		case Op_Saturate:
+		case Op_Trunc:
+			// idempotent
+			if (auto* inner = dyn_cast<OpExpr>(op->GetSource()))
+			{
+				if (inner->opKind == op->opKind && inner->GetReturnType() == rt)
+					return inner;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return nullptr;
+}
+
+void AlgebraicSimplification::PostVisit(ASTNode* node)
+{
+	if (auto* expr = node->ToExpr())
+	{
+		// the results may simplify further
+		while (Expr* repl = Simplify(expr))
+		{
+			if (repl != expr)
+				delete expr->ReplaceWith(repl);
+			expr = repl;
+			numSimplified++;
+		}
+		node = expr;
+	}
+	folder.PostVisit(node);
+}
+
+void AlgebraicSimplification::VisitGlobal(VarDecl* vd)
+{
+	if (vd->GetInitExpr())
+		WalkNode(vd->GetInitExpr());
+}
+
+
+static uint32_t HashCombine(uint32_t h, uint32_t v)
+{
+	return (h ^ v) * 16777619u;
+}
+
+static bool IsTrivialExpr(const ASTNode* node)
+{
+	return dyn_cast<const DeclRefExpr>(node) || dyn_cast<const ConstExpr>(node);
+}
+
+// whether it's worth replacing repeated occurrences of the expression with a variable
+static bool IsCSECandidate(const Expr* expr)
+{
+	switch (expr->GetReturnType()->kind)
+	{
+	case ASTType::Bool:
+	case ASTType::Int32:
+	case ASTType::UInt32:
+	case ASTType::Float16:
+	case ASTType::Float32:
+	case ASTType::Vector:
+	case ASTType::Matrix:
+		break;
+	default:
+		return false;
+	}
+	switch (expr->kind)
+	{
+	case ASTNode::Kind_OpExpr:
+	case ASTNode::Kind_UnaryOpExpr:
+	case ASTNode::Kind_BinaryOpExpr:
+	case ASTNode::Kind_TernaryOpExpr:
+		return true;
+	case ASTNode::Kind_CastExpr:
+	case ASTNode::Kind_MemberExpr:
+	case ASTNode::Kind_IndexExpr:
+		// swizzles/casts of variables are as cheap as the variables themselves
+		for (const ASTNode* ch = expr->firstChild; ch; ch = ch->next)
+			if (!IsTrivialExpr(ch))
+				return true;
+		return false;
+	default:
+		return false;
+	}
+}
+
+int CommonSubexpressionElimination::GetVarValue(VarDecl* vd)
+{
+	if (vd->optSlot < 0)
+	{
+		vd->optSlot = int(slotVars.size());
+		slotVars.push_back(vd);
+		varValues.push_back(NewValue());
+		if ((vd->flags & (VarDecl::ATTR_Global | VarDecl::ATTR_Static | VarDecl::ATTR_Const)) ==
+			(VarDecl::ATTR_Global | VarDecl::ATTR_Static))
+			writableGlobals.push_back(vd);
+	}
+	return varValues[vd->optSlot];
+}
+
+void CommonSubexpressionElimination::SetVarValue(VarDecl* vd, int vn)
+{
+	GetVarValue(vd);
+	varValues[vd->optSlot] = vn;
+}
+
+// gives new values to all variables possibly written by the node
+void CommonSubexpressionElimination::ApplyWrites(ASTNode* node)
+{
+	if (auto* binop = dyn_cast<BinaryOpExpr>(node))
+	{
+		if (TokenIsOpAssign(binop->opType))
+		{
+			if (VarDecl* vd = GetWrittenVar(binop->GetLft()))
+				SetVarValue(vd, NewValue());
+		}
+	}
+	else if (auto* incdec = dyn_cast<IncDecOpExpr>(node))
+	{
+		if (VarDecl* vd = GetWrittenVar(incdec->GetSource()))
+			SetVarValue(vd, NewValue());
+	}
+	else if (auto* op = dyn_cast<OpExpr>(node))
+	{
+		if (auto* rf = op->resolvedFunc)
+		{
+			for (ASTNode *arg = op->GetFirstArg(), *argdecl = rf->GetFirstArg();
+				arg && argdecl;
+				arg = arg->next, argdecl = argdecl->next)
+			{
+				if (argdecl->ToVarDecl()->flags & VarDecl::ATTR_Out)
+				{
+					if (VarDecl* vd = GetWrittenVar(arg->ToExpr()))
+						SetVarValue(vd, NewValue());
+				}
+			}
+			// the called function may modify any static global
+			for (VarDecl* vd : writableGlobals)
+				SetVarValue(vd, NewValue());
+		}
+	}
+	else if (auto* vd = dyn_cast<VarDecl>(node))
+	{
+		SetVarValue(vd, NewValue());
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		ApplyWrites(ch);
+}
+
+int CommonSubexpressionElimination::FindOrAddValue(
+	Expr* expr, uint32_t op, double constVal, const int* args, int numArgs)
+{
+	ASTType* type = expr->GetReturnType();
+	uint32_t hash = HashCombine(2166136261u, expr->kind);
+	hash = HashCombine(hash, op);
+	hash = HashCombine(hash, uint32_t(uintptr_t(type)));
+	uint64_t cbits;
+	memcpy(&cbits, &constVal, sizeof(cbits));
+	hash = HashCombine(hash, uint32_t(cbits));
+	hash = HashCombine(hash, uint32_t(cbits >> 32));
+	for (int i = 0; i < numArgs; ++i)
+		hash = HashCombine(hash, uint32_t(args[i]));
+
+	bool candidate = IsCSECandidate(expr);
+	for (int i = buckets[hash & (buckets.size() - 1)]; i >= 0; i = values[i].next)
+	{
+		Value& v = values[i];
+		if (v.hash != hash ||
+			v.kind != expr->kind ||
+			v.op != op ||
+			v.type != type ||
+			memcmp(&v.constVal, &constVal, sizeof(constVal)) != 0 ||
+			v.numArgs != numArgs ||
+			memcmp(valueArgs.data() + v.firstArg, args, sizeof(int) * numArgs) != 0)
+			continue;
+
+		if (candidate && v.node)
+		{
+			VarDecl* src = v.temp;
+			if (!src && v.holder &&
+				!(v.holder->flags & (VarDecl::ATTR_Out | VarDecl::ATTR_Global | VarDecl::ATTR_StageIO | VarDecl::ATTR_Hidden)) &&
+				varValues[v.holder->optSlot] == v.vn &&
+				v.holder->GetType() == type)
+				src = v.holder;
+			if (!src)
+			{
+				// move the first occurrence into a new temporary, declared right before the statement
+				// that contains it now (it may have been moved into another temporary already)
+				ASTNode* marker = v.node;
+				while (!dyn_cast<BlockStmt>(marker->parent))
+					marker = marker->parent;
+				auto* vds = new VarDeclStmt;
+				auto* vd = new VarDecl;
+				auto* dre = new DeclRefExpr;
+				vd->name = "";
+				vd->SetType(type);
+				dre->decl = vd;
+				dre->SetReturnType(type);
+				v.node->ReplaceWith(dre);
+				vd->SetInitExpr(v.node);
+				vds->AppendChild(vd);
+				marker->InsertBeforeMe(vds);
+				curFunction->tmpVars.push_back(vd);
+				temps.push_back(vd);
+				SetVarValue(vd, v.vn);
+				v.temp = vd;
+				v.node = vd->GetInitExpr();
+				src = vd;
+			}
+			auto* dre = new DeclRefExpr;
+			dre->decl = src;
+			dre->SetReturnType(type);
+			delete expr->ReplaceWith(dre);
+		}
+		return v.vn;
+	}
+
+	Value v;
+	v.hash = hash;
+	v.next = buckets[hash & (buckets.size() - 1)];
+	v.vn = NewValue();
+	v.kind = expr->kind;
+	v.op = op;
+	v.type = type;
+	v.constVal = constVal;
+	v.firstArg = int(valueArgs.size());
+	v.numArgs = numArgs;
+	for (int i = 0; i < numArgs; ++i)
+		valueArgs.push_back(args[i]);
+	v.node = candidate ? expr : nullptr;
+	v.temp = nullptr;
+	v.holder = nullptr;
+	buckets[hash & (buckets.size() - 1)] = int(values.size());
+	values.push_back(v);
+	return v.vn;
+}
+
+// removes the values added in a nested block (temporaries are only visible in their scope)
+void CommonSubexpressionElimination::PopValues(size_t count)
+{
+	while (values.size() > count)
+	{
+		const Value& v = values.back();
+		buckets[v.hash & (buckets.size() - 1)] = v.next;
+		valueArgs.resize(v.firstArg);
+		values.pop_back();
+	}
+}
+
+int CommonSubexpressionElimination::NumberExpr(Expr* expr)
+{
+	if (auto* dre = dyn_cast<DeclRefExpr>(expr))
+		return dre->decl ? GetVarValue(dre->decl) : NewValue();
+
+	uint32_t op = 0;
+	double constVal = 0;
+	switch (expr->kind)
+	{
+	case ASTNode::Kind_BoolExpr: constVal = static_cast<BoolExpr*>(expr)->value; break;
+	case ASTNode::Kind_Int32Expr: constVal = static_cast<Int32Expr*>(expr)->value; break;
+	case ASTNode::Kind_Float32Expr: constVal = static_cast<Float32Expr*>(expr)->value; break;
+	case ASTNode::Kind_CastExpr:
+	case ASTNode::Kind_InitListExpr:
+	case ASTNode::Kind_TernaryOpExpr:
+	case ASTNode::Kind_IndexExpr:
+		break;
+	case ASTNode::Kind_OpExpr:
+		op = static_cast<OpExpr*>(expr)->opKind;
+		if (op == Op_FCall || op == Op_Clip)
+			return NewValue();
+		break;
+	case ASTNode::Kind_UnaryOpExpr: op = static_cast<UnaryOpExpr*>(expr)->opType; break;
+	case ASTNode::Kind_BinaryOpExpr:
+		op = static_cast<BinaryOpExpr*>(expr)->opType;
+		if (TokenIsOpAssign(SLTokenType(op)))
+			return NewValue();
+		break;
+	case ASTNode::Kind_MemberExpr:
+		op = static_cast<MemberExpr*>(expr)->memberID;
+		constVal = static_cast<MemberExpr*>(expr)->swizzleComp;
+		break;
+	default:
+		return NewValue();
+	}
+
+	// small fixed buffer, the expressions with more arguments are rare
+	int args[16];
+	int numArgs = 0;
+	for (ASTNode* ch = expr->firstChild; ch; )
+	{
+		ASTNode* next = ch->next; // the child may be replaced
+		int vn = NumberExpr(ch->ToExpr());
+		if (numArgs == 16)
+			return NewValue();
+		args[numArgs++] = vn;
+		ch = next;
+	}
+	return FindOrAddValue(expr, op, constVal, args, numArgs);
+}
+
+void CommonSubexpressionElimination::NumberAssignment(Expr* expr)
+{
+	auto* binop = dyn_cast<BinaryOpExpr>(expr);
+	if (binop && TokenIsOpAssign(binop->opType))
+	{
+		if (HasSideEffects(binop->GetLft()) || HasSideEffects(binop->GetRgt()))
+		{
+			ApplyWrites(binop);
+			return;
+		}
+		int vn = NumberExpr(binop->GetRgt());
+		for (Expr* e = binop->GetLft(); auto* sve = dyn_cast<SubValExpr>(e); e = sve->GetSource())
+			if (auto* idx = dyn_cast<IndexExpr>(sve))
+				NumberExpr(idx->GetIndex());
+
+		Expr* rgt = binop->GetRgt();
+		auto* dre = dyn_cast<DeclRefExpr>(binop->GetLft());
+		if (binop->opType == STT_OP_Assign && dre && dre->decl &&
+			rgt->GetReturnType() == dre->decl->GetType())
+		{
+			SetVarValue(dre->decl, vn);
+			// the variable can be used instead of later occurrences while it holds the value
+			if (values.size() && values.back().vn == vn && values.back().node == rgt && !values.back().holder)
+				values.back().holder = dre->decl;
+		}
+		else
+			ApplyWrites(binop);
+	}
+	else if (HasSideEffects(expr))
+		ApplyWrites(expr);
+	else
+		NumberExpr(expr);
+}
+
+void CommonSubexpressionElimination::ProcessStmt(Stmt* stmt)
+{
+	if (auto* exprstmt = dyn_cast<ExprStmt>(stmt))
+	{
+		NumberAssignment(exprstmt->GetExpr());
+	}
+	else if (auto* vds = dyn_cast<VarDeclStmt>(stmt))
+	{
+		// a temporary declared before the statement could not use the variables declared in it
+		if (vds->childCount > 1)
+		{
+			ApplyWrites(vds);
+			return;
+		}
+		for (ASTNode* ch = vds->firstChild; ch; ch = ch->next)
+		{
+			VarDecl* vd = ch->ToVarDecl();
+			Expr* init = vd->GetInitExpr();
+			if (!init || HasSideEffects(init) || (vd->flags & VarDecl::ATTR_Static))
+			{
+				ApplyWrites(vd);
+				continue;
+			}
+			int vn = NumberExpr(init);
+			init = vd->GetInitExpr();
+			if (init->GetReturnType() != vd->GetType())
+			{
+				SetVarValue(vd, NewValue());
+				continue;
+			}
+			SetVarValue(vd, vn);
+			if (values.size() && values.back().vn == vn && values.back().node == init && !values.back().holder)
+				values.back().holder = vd;
+		}
+	}
+	else if (auto* retstmt = dyn_cast<ReturnStmt>(stmt))
+	{
+		if (Expr* e = retstmt->GetExpr())
+			NumberAssignment(e);
+	}
+	else if (auto* ifelse = dyn_cast<IfElseStmt>(stmt))
+	{
+		NumberAssignment(ifelse->GetCond());
+		ProcessBlock(ifelse->GetTrueBr());
+		if (Stmt* f = ifelse->GetFalseBr())
+			ProcessBlock(f);
+		ApplyWrites(ifelse);
+	}
+	else if (dyn_cast<BlockStmt>(stmt))
+	{
+		ProcessBlock(stmt);
+	}
+	else if (dyn_cast<WhileStmt>(stmt) || dyn_cast<DoWhileStmt>(stmt) || dyn_cast<ForStmt>(stmt))
+	{
+		// values at the start of the body differ between iterations
+		ApplyWrites(stmt);
+		Stmt* body = nullptr;
+		if (auto* whilestmt = dyn_cast<WhileStmt>(stmt))
+			body = whilestmt->GetBody();
+		else if (auto* dowhilestmt = dyn_cast<DoWhileStmt>(stmt))
+			body = dowhilestmt->GetBody();
+		else
+			body = static_cast<ForStmt*>(stmt)->GetBody();
+		ProcessBlock(body);
+		ApplyWrites(stmt);
+	}
+}
+
+// values computed before the block are still available in it
+void CommonSubexpressionElimination::ProcessBlock(Stmt* stmt)
+{
+	auto* blk = dyn_cast<BlockStmt>(stmt);
+	if (!blk)
+	{
+		// a single statement has no place for temporaries
+		ApplyWrites(stmt);
+		return;
+	}
+	size_t numValues = values.size();
+	for (ASTNode* ch = blk->firstChild; ch; ch = ch->next)
+		ProcessStmt(ch->ToStmt());
+	PopValues(numValues);
+}
+
+void CommonSubexpressionElimination::CountTempUses(ASTNode* node)
+{
+	if (auto* dre = dyn_cast<DeclRefExpr>(node))
+	{
+		if (dre->decl && dre->decl->optSlot >= 0)
+		{
+			tempUses[dre->decl->optSlot]++;
+			tempLastUse[dre->decl->optSlot] = dre;
+		}
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		CountTempUses(ch);
+}
+
+// a temporary whose first occurrence was later moved into another temporary keeps only that use,
+// the expression is evaluated the same number of times without it
+void CommonSubexpressionElimination::InlineSingleUseTemps()
+{
+	if (temps.empty())
+		return;
+	tempUses.clear();
+	tempUses.resize(slotVars.size(), 0);
+	tempLastUse.clear();
+	tempLastUse.resize(slotVars.size(), nullptr);
+	CountTempUses(curFunction->GetCode());
+
+	for (VarDecl* vd : temps)
+	{
+		if (tempUses[vd->optSlot] != 1)
+			continue;
+		// the use may have been moved into the initializer of a temporary inlined before this one
+		delete tempLastUse[vd->optSlot]->ReplaceWith(vd->GetInitExpr());
+		for (size_t i = 0; i < curFunction->tmpVars.size(); ++i)
+		{
+			if (curFunction->tmpVars[i] == vd)
+			{
+				curFunction->tmpVars[i] = curFunction->tmpVars.back();
+				curFunction->tmpVars.pop_back();
+				break;
+			}
+		}
+		slotVars[vd->optSlot] = nullptr;
+		delete vd->parent; // the VarDeclStmt only contains the temporary
+	}
+	temps.clear();
+}
+
+void CommonSubexpressionElimination::ProcessFunction(ASTFunction* fn)
+{
+	curFunction = fn;
+	values.clear();
+	valueArgs.clear();
+	buckets.clear();
+	buckets.resize(256, -1);
+	ProcessBlock(fn->GetCode());
+	InlineSingleUseTemps();
+
+	for (VarDecl* vd : slotVars)
+		if (vd) // inlined temporaries are deleted
+			vd->optSlot = -1;
+	slotVars.clear();
+	varValues.clear();
+	writableGlobals.clear();
+}
+
+void CommonSubexpressionElimination::RunOnAST(AST& ast)
+{
+	for (ASTNode* ch = ast.functionList.firstChild; ch; ch = ch->next)
+		ProcessFunction(ch->ToFunction());
+}
+
+
+static void UnionLive(DeadStoreElimination::LiveSet& dst, const DeadStoreElimination::LiveSet& src)
+{
+	for (size_t i = 0; i < dst.size(); ++i)
+		dst[i] |= src[i];
+}
+
+static bool EqualLive(const DeadStoreElimination::LiveSet& a, const DeadStoreElimination::LiveSet& b)
+{
+	return memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+void DeadStoreElimination::AssignSlots(ASTNode* node)
+{
+	if (auto* vds = dyn_cast<VarDeclStmt>(node))
+	{
+		for (ASTNode* ch = vds->firstChild; ch; ch = ch->next)
+		{
+			VarDecl* vd = ch->ToVarDecl();
+			if (!(vd->flags & VarDecl::ATTR_Static))
+			{
+				vd->optSlot = int(slotVars.size());
+				slotVars.push_back(vd);
+			}
+			else
+				vd->optSlot = -1;
+		}
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		AssignSlots(ch);
+}
+
+void DeadStoreElimination::AddReads(ASTNode* node)
+{
+	if (auto* dre = dyn_cast<DeclRefExpr>(node))
+	{
+		if (dre->decl && dre->decl->optSlot >= 0)
+			live[dre->decl->optSlot] = 1;
+		return;
+	}
+	if (auto* binop = dyn_cast<BinaryOpExpr>(node))
+	{
+		if (binop->opType == STT_OP_Assign)
+		{
+			AddLValueReads(binop->GetLft());
+			AddReads(binop->GetRgt());
+			return;
+		}
+	}
+	else if (auto* op = dyn_cast<OpExpr>(node))
+	{
+		if (auto* rf = op->resolvedFunc)
+		{
+			for (ASTNode *arg = op->GetFirstArg(), *argdecl = rf->GetFirstArg();
+				arg && argdecl;
+				arg = arg->next, argdecl = argdecl->next)
+			{
+				if (argdecl->ToVarDecl()->flags & VarDecl::ATTR_In)
+					AddReads(arg);
+				else
+					AddLValueReads(arg->ToExpr());
+			}
+			return;
+		}
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		AddReads(ch);
+}
+
+// a written variable is not read, only the indices used to access it are
+void DeadStoreElimination::AddLValueReads(Expr* expr)
+{
+	while (auto* sve = dyn_cast<SubValExpr>(expr))
+	{
+		if (auto* idx = dyn_cast<IndexExpr>(sve))
+			AddReads(idx->GetIndex());
+		expr = sve->GetSource();
+	}
+	if (!dyn_cast<DeclRefExpr>(expr))
+		AddReads(expr);
+}
+
+static bool IsEmptyStmt(const ASTNode* node)
+{
+	return dyn_cast<const EmptyStmt>(node) || (dyn_cast<const BlockStmt>(node) && !node->firstChild);
+}
+
+void DeadStoreElimination::RemoveStmt(Stmt* stmt)
+{
+	// if/loop bodies must not be left empty
+	if (dyn_cast<BlockStmt>(stmt->parent))
+		delete stmt;
+	else
+		delete stmt->ReplaceWith(new EmptyStmt);
+}
+
+// returns true if the statement was a dead store (and has been removed or reduced)
+bool DeadStoreElimination::ProcessStore(ExprStmt* stmt)
+{
+	Expr* expr = stmt->GetExpr();
+	Expr* target = nullptr;
+	Expr* value = nullptr;
+	if (auto* binop = dyn_cast<BinaryOpExpr>(expr))
+	{
+		if (!TokenIsOpAssign(binop->opType))
+			return false;
+		target = binop->GetLft();
+		value = binop->GetRgt();
+	}
+	else if (auto* incdec = dyn_cast<IncDecOpExpr>(expr))
+		target = incdec->GetSource();
+	else
+		return false;
+
+	VarDecl* vd = GetWrittenVar(target);
+	if (!vd || vd->optSlot < 0 || live[vd->optSlot] || HasSideEffects(target))
+		return false;
+
+	if (value && HasSideEffects(value))
+	{
+		// keep the side effects
+		if (apply)
+		{
+			value->Unlink();
+			delete expr->ReplaceWith(value);
+		}
+		AddReads(value);
+	}
+	else if (apply)
+		RemoveStmt(stmt);
+	return true;
+}
+
+// on entry `live` contains the variables live after the statement, on exit - before it
+void DeadStoreElimination::ProcessStmt(Stmt* stmt)
+{
+	if (auto* blk = dyn_cast<BlockStmt>(stmt))
+	{
+		for (ASTNode* ch = blk->lastChild; ch; )
+		{
+			ASTNode* cch = ch;
+			ASTNode* after = ch->next;
+			ch = ch->prev;
+			ProcessStmt(cch->ToStmt());
+			// the statement may have been removed or replaced
+			cch = ch ? ch->next : blk->firstChild;
+			if (apply && cch != after && IsEmptyStmt(cch))
+				delete cch;
+		}
+	}
+	else if (auto* exprstmt = dyn_cast<ExprStmt>(stmt))
+	{
+		if (ProcessStore(exprstmt))
+			return;
+		// whole variables overwritten
+		Expr* expr = exprstmt->GetExpr();
+		if (auto* binop = dyn_cast<BinaryOpExpr>(expr))
+		{
+			auto* dre = dyn_cast<DeclRefExpr>(binop->GetLft());
+			if (binop->opType == STT_OP_Assign && dre && dre->decl && dre->decl->optSlot >= 0)
+				live[dre->decl->optSlot] = 0;
+		}
+		else if (auto* op = dyn_cast<OpExpr>(expr))
+		{
+			if (auto* rf = op->resolvedFunc)
+			{
+				for (ASTNode *arg = op->GetFirstArg(), *argdecl = rf->GetFirstArg();
+					arg && argdecl;
+					arg = arg->next, argdecl = argdecl->next)
+				{
+					auto* dre = dyn_cast<DeclRefExpr>(arg);
+					if ((argdecl->ToVarDecl()->flags & (VarDecl::ATTR_In | VarDecl::ATTR_Out)) == VarDecl::ATTR_Out &&
+						dre && dre->decl && dre->decl->optSlot >= 0)
+						live[dre->decl->optSlot] = 0;
+				}
+			}
+		}
+		AddReads(expr);
+	}
+	else if (auto* vds = dyn_cast<VarDeclStmt>(stmt))
+	{
+		for (ASTNode* ch = vds->lastChild; ch; ch = ch->prev)
+		{
+			VarDecl* vd = ch->ToVarDecl();
+			Expr* init = vd->GetInitExpr();
+			if (vd->optSlot >= 0)
+			{
+				// const variables require an initializer, they are removed entirely if unused
+				if (init && apply && !live[vd->optSlot] &&
+					!(vd->flags & VarDecl::ATTR_Const) && !HasSideEffects(init))
+				{
+					delete init;
+					init = nullptr;
+				}
+				live[vd->optSlot] = 0;
+			}
+			if (init)
+				AddReads(init);
+		}
+	}
+	else if (auto* ifelse = dyn_cast<IfElseStmt>(stmt))
+	{
+		LiveSet outLive = live;
+		ProcessStmt(ifelse->GetTrueBr());
+		if (Stmt* falseBr = ifelse->GetFalseBr())
+		{
+			LiveSet trueLive = std::move(live);
+			live = std::move(outLive);
+			ProcessStmt(falseBr);
+			UnionLive(live, trueLive);
+		}
+		else
+			UnionLive(live, outLive);
+
+		if (apply && IsEmptyStmt(ifelse->GetTrueBr()) &&
+			(!ifelse->GetFalseBr() || IsEmptyStmt(ifelse->GetFalseBr())) &&
+			!HasSideEffects(ifelse->GetCond()))
+		{
+			RemoveStmt(ifelse);
+			return;
+		}
+		AddReads(ifelse->GetCond());
+	}
+	else if (dyn_cast<WhileStmt>(stmt) || dyn_cast<DoWhileStmt>(stmt) || dyn_cast<ForStmt>(stmt))
+	{
+		ProcessLoop(stmt);
+	}
+	else if (auto* ret = dyn_cast<ReturnStmt>(stmt))
+	{
+		// locals are not used after returning
+		memset(live.data(), 0, live.size());
+		if (ret->GetExpr())
+			AddReads(ret->GetExpr());
+	}
+	else if (dyn_cast<DiscardStmt>(stmt))
+	{
+		memset(live.data(), 0, live.size());
+	}
+	else if (dyn_cast<BreakStmt>(stmt))
+	{
+		live = *curLoop->breakLive;
+	}
+	else if (dyn_cast<ContinueStmt>(stmt))
+	{
+		live = *curLoop->continueLive;
+	}
+}
+
+void DeadStoreElimination::ProcessLoop(Stmt* loop)
+{
+	Expr* cond = nullptr;
+	Expr* incr = nullptr;
+	Stmt* body = nullptr;
+	if (auto* whilestmt = dyn_cast<WhileStmt>(loop))
+	{
+		cond = whilestmt->GetCond();
+		body = whilestmt->GetBody();
+	}
+	else if (auto* dowhile = dyn_cast<DoWhileStmt>(loop))
+	{
+		cond = dowhile->GetCond();
+		body = dowhile->GetBody();
+	}
+	else if (auto* forstmt = dyn_cast<ForStmt>(loop))
+	{
+		cond = forstmt->GetCond();
+		incr = forstmt->GetIncr();
+		body = forstmt->GetBody();
+	}
+
+	// iterate to a fixed point: cond <- body, exit; body <- continue (increment) <- cond
+	LiveSet exitLive = live;
+	LiveSet condLive;
+	LiveSet contLive;
+	LoopTargets targets = { &exitLive, &contLive };
+	const LoopTargets* prevLoop = curLoop;
+	curLoop = &targets;
+	bool prevApply = apply;
+	apply = false;
+	for (bool first = true;; first = false)
+	{
+		// `live` contains the variables live before the body (none initially) and after the loop
+		if (cond)
+			AddReads(cond);
+		if (!first && EqualLive(live, condLive))
+			break;
+		condLive = live;
+		if (incr)
+			AddReads(incr);
+		contLive = live;
+		ProcessStmt(body);
+		UnionLive(live, exitLive);
+	}
+	apply = prevApply;
+
+	live = contLive;
+	ProcessStmt(body);
+	curLoop = prevLoop;
+
+	// do/while loops are entered through the body
+	if (!dyn_cast<DoWhileStmt>(loop))
+	{
+		live = std::move(condLive);
+		if (auto* forstmt = dyn_cast<ForStmt>(loop))
+			ProcessStmt(forstmt->GetInit());
+	}
+}
+
+void DeadStoreElimination::ProcessFunction(ASTFunction* fn)
+{
+	slotVars.clear();
+	AssignSlots(fn->GetCode());
+	live.clear();
+	live.resize(slotVars.size(), 0);
+
+	ProcessStmt(fn->GetCode());
+
+	for (VarDecl* vd : slotVars)
+		vd->optSlot = -1;
+}
+
+void DeadStoreElimination::RunOnAST(AST& ast)
+{
+	for (ASTNode* ch = ast.functionList.firstChild; ch; ch = ch->next)
+		ProcessFunction(ch->ToFunction());
+}
+
+
+static uint32_t MemberBit(uint32_t memberID)
+{
+	return memberID < 32 ? 1u << memberID : ~0u;
+}
+
+// returns the struct member written to by an assignment target, or null if it's not a member
+static MemberExpr* GetWrittenMember(Expr* target)
+{
+	MemberExpr* mmb = nullptr;
+	for (Expr* e = target; auto* sve = dyn_cast<SubValExpr>(e); e = sve->GetSource())
+	{
+		mmb = nullptr;
+		auto* me = dyn_cast<MemberExpr>(sve);
+		if (me && me->swizzleComp == 0)
+			mmb = me;
+	}
+	return mmb && dyn_cast<DeclRefExpr>(mmb->GetSource()) ? mmb : nullptr;
+}
+
+void DeadMemberStoreElimination::AssignSlots(ASTNode* node)
+{
+	if (auto* vds = dyn_cast<VarDeclStmt>(node))
+	{
+		for (ASTNode* ch = vds->firstChild; ch; ch = ch->next)
+		{
+			VarDecl* vd = ch->ToVarDecl();
+			if (!(vd->flags & VarDecl::ATTR_Static) && vd->GetType()->kind == ASTType::Structure)
+			{
+				vd->optSlot = int(slotVars.size());
+				slotVars.push_back(vd);
+			}
+			else
+				vd->optSlot = -1;
+		}
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		AssignSlots(ch);
+}
+
+void DeadMemberStoreElimination::FindReads(ASTNode* node)
+{
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		FindReads(ch);
+
+	auto* dre = dyn_cast<DeclRefExpr>(node);
+	if (!dre || !dre->decl || dre->decl->optSlot < 0)
+		return;
+	int slot = dre->decl->optSlot;
+
+	auto* mmb = dyn_cast<MemberExpr>(dre->parent);
+	if (mmb && mmb->swizzleComp == 0)
+	{
+		// stores to the member are not reads
+		Expr* e = mmb;
+		while (dyn_cast<SubValExpr>(e->parent) && e->parent->firstChild == e)
+			e = e->parent->ToExpr();
+		auto* binop = dyn_cast<BinaryOpExpr>(e->parent);
+		if (!binop || binop->opType != STT_OP_Assign || binop->GetLft() != e)
+			readMasks[slot] |= MemberBit(mmb->memberID);
+		return;
+	}
+	if (auto* binop = dyn_cast<BinaryOpExpr>(dre->parent))
+	{
+		if (binop->opType == STT_OP_Assign)
+		{
+			// whole struct overwritten
+			if (binop->GetLft() == dre)
+				return;
+			// whole struct copied
+			auto* dst = dyn_cast<DeclRefExpr>(binop->GetLft());
+			if (dst && dst->decl && dst->decl->optSlot >= 0)
+			{
+				copies.push_back({ dst->decl->optSlot, slot });
+				return;
+			}
+		}
+	}
+	else if (auto* vd = dyn_cast<VarDecl>(dre->parent))
+	{
+		if (vd->optSlot >= 0)
+		{
+			copies.push_back({ vd->optSlot, slot });
+			return;
+		}
+	}
+	readMasks[slot] = ~0u;
+}
+
+void DeadMemberStoreElimination::FindStores(ASTNode* node, Array<ExprStmt*>& out)
+{
+	if (auto* exprstmt = dyn_cast<ExprStmt>(node))
+	{
+		auto* binop = dyn_cast<BinaryOpExpr>(exprstmt->GetExpr());
+		if (binop && binop->opType == STT_OP_Assign)
+		{
+			MemberExpr* mmb = GetWrittenMember(binop->GetLft());
+			VarDecl* vd = mmb ? static_cast<DeclRefExpr*>(mmb->GetSource())->decl : nullptr;
+			if (vd && vd->optSlot >= 0 &&
+				!(readMasks[vd->optSlot] & MemberBit(mmb->memberID)) &&
+				!HasSideEffects(binop->GetLft()))
+				out.push_back(exprstmt);
+		}
+		return;
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		FindStores(ch, out);
+}
+
+void DeadMemberStoreElimination::ProcessFunction(ASTFunction* fn)
+{
+	slotVars.clear();
+	AssignSlots(fn->GetCode());
+	if (slotVars.size())
+	{
+		readMasks.clear();
+		readMasks.resize(slotVars.size(), 0);
+		copies.clear();
+		FindReads(fn->GetCode());
+		for (bool changed = true; changed; )
+		{
+			changed = false;
+			for (const Copy& c : copies)
+			{
+				uint32_t mask = readMasks[c.src] | readMasks[c.dst];
+				if (mask != readMasks[c.src])
+				{
+					readMasks[c.src] = mask;
+					changed = true;
+				}
+			}
+		}
+
+		Array<ExprStmt*> stores;
+		FindStores(fn->GetCode(), stores);
+		for (ExprStmt* stmt : stores)
+		{
+			Expr* value = static_cast<BinaryOpExpr*>(stmt->GetExpr())->GetRgt();
+			if (HasSideEffects(value))
+			{
+				// keep the side effects
+				value->Unlink();
+				delete stmt->GetExpr()->ReplaceWith(value);
+			}
+			else if (dyn_cast<BlockStmt>(stmt->parent))
+				delete stmt;
+			else
+				delete stmt->ReplaceWith(new EmptyStmt);
+		}
+		numRemoved += int(stores.size());
+	}
+
+	for (VarDecl* vd : slotVars)
+		vd->optSlot = -1;
+}
+
+void DeadMemberStoreElimination::RunOnAST(AST& ast)
+{
+	for (ASTNode* ch = ast.functionList.firstChild; ch; ch = ch->next)
+		ProcessFunction(ch->ToFunction());
+}
+
+
+static int CountNodes(const ASTNode* node)
+{
+	int n = 1;
+	for (const ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		n += CountNodes(ch);
+	return n;
+}
+
+static bool ContainsReturn(const ASTNode* node)
+{
+	if (dyn_cast<const ReturnStmt>(node))
+		return true;
+	for (const ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		if (dyn_cast<const Stmt>(ch) && ContainsReturn(ch))
+			return true;
+	return false;
+}
+
+static bool AlwaysReturns(const Stmt* stmt)
+{
+	if (dyn_cast<const ReturnStmt>(stmt))
+		return true;
+	if (auto* blk = dyn_cast<const BlockStmt>(stmt))
+	{
+		for (const ASTNode* ch = blk->firstChild; ch; ch = ch->next)
+			if (AlwaysReturns(static_cast<const Stmt*>(ch)))
+				return true;
+		return false;
+	}
+	if (auto* ifelse = dyn_cast<const IfElseStmt>(stmt))
+		return ifelse->GetFalseBr() && AlwaysReturns(ifelse->GetTrueBr()) && AlwaysReturns(ifelse->GetFalseBr());
+	return false;
+}
+
+// returns in loops cannot be restructured, static variables would be duplicated
+static bool CanInlineBody(const ASTNode* node, bool inLoop)
+{
+	if (dyn_cast<const ReturnStmt>(node) && inLoop)
+		return false;
+	if (auto* vd = dyn_cast<const VarDecl>(node))
+		if (vd->flags & VarDecl::ATTR_Static)
+			return false;
+	if (dyn_cast<const WhileStmt>(node) || dyn_cast<const DoWhileStmt>(node) || dyn_cast<const ForStmt>(node))
+		inLoop = true;
+	for (const ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		if (!CanInlineBody(ch, inLoop))
+			return false;
+	return true;
+}
+
+static BlockStmt* WrapInBlock(Stmt* stmt)
+{
+	if (auto* blk = dyn_cast<BlockStmt>(stmt))
+		return blk;
+	auto* blk = new BlockStmt;
+	stmt->ReplaceWith(blk);
+	blk->AppendChild(stmt);
+	return blk;
+}
+
+// moves statements into branches until no statement follows a return
+// (safe because all copied variables get unique names)
+static bool RestructureReturns(BlockStmt* blk)
+{
+	for (ASTNode* ch = blk->firstChild; ch; ch = ch->next)
+	{
+		if (!ContainsReturn(ch))
+			continue;
+		Stmt* stmt = ch->ToStmt();
+		if (AlwaysReturns(stmt))
+		{
+			// the rest is unreachable
+			while (ch->next)
+				delete ch->next;
+		}
+		if (dyn_cast<ReturnStmt>(stmt))
+			return true;
+
+		if (auto* inner = dyn_cast<BlockStmt>(stmt))
+		{
+			while (inner->next)
+				inner->AppendChild(inner->next);
+			return RestructureReturns(inner);
+		}
+
+		auto* ifelse = dyn_cast<IfElseStmt>(stmt);
+		if (!ifelse)
+			return false;
+		if (ifelse->next)
+		{
+			BlockStmt* target;
+			if (AlwaysReturns(ifelse->GetTrueBr()))
+			{
+				if (!ifelse->GetFalseBr())
+					ifelse->AppendChild(new BlockStmt);
+				target = WrapInBlock(ifelse->GetFalseBr());
+			}
+			else if (ifelse->GetFalseBr() && AlwaysReturns(ifelse->GetFalseBr()))
+				target = WrapInBlock(ifelse->GetTrueBr());
+			else
+				return false;
+			while (ifelse->next)
+				target->AppendChild(ifelse->next);
+		}
+		for (Stmt* br = ifelse->GetTrueBr(); br; br = br == ifelse->GetTrueBr() ? ifelse->GetFalseBr() : nullptr)
+		{
+			if (!dyn_cast<ReturnStmt>(br) && ContainsReturn(br) && !RestructureReturns(WrapInBlock(br)))
+				return false;
+		}
+		return true;
+	}
+	return true;
+}
+
+static bool IsInlineSideEffect(const Expr* expr)
+{
+	if (auto* op = dyn_cast<const OpExpr>(expr))
+		return op->opKind == Op_FCall || op->opKind == Op_Clip;
+	if (auto* binop = dyn_cast<const BinaryOpExpr>(expr))
+		return TokenIsOpAssign(binop->opType);
+	return dyn_cast<const IncDecOpExpr>(expr) != nullptr;
+}
+
+// first node with side effects in evaluation order
+static Expr* FirstSideEffect(Expr* expr)
+{
+	for (ASTNode* ch = expr->firstChild; ch; ch = ch->next)
+		if (Expr* e = FirstSideEffect(ch->ToExpr()))
+			return e;
+	return IsInlineSideEffect(expr) ? expr : nullptr;
+}
+
+// whether the expression is only evaluated depending on a condition in the same statement
+static bool IsConditionallyEvaluated(const Expr* expr)
+{
+	for (const ASTNode* n = expr; n->parent && dyn_cast<const Expr>(n->parent); n = n->parent)
+	{
+		if (auto* binop = dyn_cast<const BinaryOpExpr>(n->parent))
+		{
+			if ((binop->opType == STT_OP_LogicalAnd || binop->opType == STT_OP_LogicalOr) &&
+				n != binop->firstChild)
+				return true;
+		}
+		else if (dyn_cast<const TernaryOpExpr>(n->parent) && n != n->parent->firstChild)
+			return true;
+	}
+	return false;
+}
+
+// expressions that the inlined function cannot change and that are cheap to repeat
+static bool IsStableArg(const Expr* expr)
+{
+	if (dyn_cast<const ConstExpr>(expr))
+		return true;
+	if (auto* dre = dyn_cast<const DeclRefExpr>(expr))
+	{
+		// static globals could be written by the function
+		return dre->decl && (dre->decl->flags & (VarDecl::ATTR_Global | VarDecl::ATTR_Static | VarDecl::ATTR_Const)) !=
+			(VarDecl::ATTR_Global | VarDecl::ATTR_Static);
+	}
+	return false;
+}
+
+// variables of these types cannot be copied in all outputs
+static bool NeedsArgReplacement(const ASTType* t)
+{
+	return t->kind == ASTType::Array || t->kind >= ASTType::Sampler1D;
+}
+
+static DeclRefExpr* CreateVarRef(VarDecl* vd)
+{
+	auto* dre = new DeclRefExpr;
+	dre->decl = vd;
+	dre->SetReturnType(vd->GetType());
+	return dre;
+}
+
+static ExprStmt* CreateAssignment(Expr* dst, Expr* src)
+{
+	auto* exprst = new ExprStmt;
+	auto* assign = new BinaryOpExpr;
+	assign->opType = STT_OP_Assign;
+	assign->SetReturnType(dst->GetReturnType());
+	assign->AppendChild(dst);
+	assign->AppendChild(src);
+	exprst->AppendChild(assign);
+	return exprst;
+}
+
+static VarDeclStmt* CreateVarDeclStmt(VarDecl* vd, Expr* init)
+{
+	auto* vds = new VarDeclStmt;
+	if (init)
+		vd->SetInitExpr(init);
+	vds->AppendChild(vd);
+	return vds;
+}
+
+// a removed single-statement branch/body must be replaced
+static void ReplaceStmt(Stmt* stmt, Stmt* with)
+{
+	if (!with && !dyn_cast<BlockStmt>(stmt->parent))
+		with = new EmptyStmt;
+	delete stmt->ReplaceWith(with);
+}
+
+static void PairDecls(const ASTNode* orig, ASTNode* copy, Array<VarDecl*>& vars)
+{
+	if (auto* ovd = dyn_cast<const VarDecl>(orig))
+	{
+		VarDecl* vd = copy->ToVarDecl();
+		vd->name = ovd->name;
+		vd->flags = ovd->flags;
+		vd->loc = ovd->loc;
+		ovd->optSlot = int(vars.size());
+		vars.push_back(vd);
+	}
+	for (const ASTNode *och = orig->firstChild, *ch = copy->firstChild; och; och = och->next, ch = ch->next)
+		PairDecls(och, const_cast<ASTNode*>(ch), vars);
+}
+
+// a moved body keeps its variables, the replacements only rename them
+static void CollectDecls(ASTNode* node, Array<VarDecl*>& vars)
+{
+	if (auto* vd = dyn_cast<VarDecl>(node))
+	{
+		vd->optSlot = int(vars.size());
+		vars.push_back(vd);
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		CollectDecls(ch, vars);
+}
+
+static void ResetDeclSlots(const ASTNode* node)
+{
+	if (auto* vd = dyn_cast<const VarDecl>(node))
+		vd->optSlot = -1;
+	for (const ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		ResetDeclSlots(ch);
+}
+
+static void CollectReturns(ASTNode* node, Array<ReturnStmt*>& out)
+{
+	if (auto* ret = dyn_cast<ReturnStmt>(node))
+	{
+		out.push_back(ret);
+		return;
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		if (dyn_cast<Stmt>(ch))
+			CollectReturns(ch, out);
+}
+
+// parameters must have their index in optSlot
+static void CollectWrittenParams(const ASTNode* node, uint32_t& mask)
+{
+	auto AddWrite = [&mask](Expr* e)
+	{
+		VarDecl* vd = GetWrittenVar(e);
+		if (vd && vd->optSlot >= 0)
+			mask |= 1U << (vd->optSlot < 32 ? vd->optSlot : 31);
+	};
+	if (auto* binop = dyn_cast<const BinaryOpExpr>(node))
+	{
+		if (TokenIsOpAssign(binop->opType))
+			AddWrite(binop->GetLft());
+	}
+	else if (auto* incdec = dyn_cast<const IncDecOpExpr>(node))
+		AddWrite(incdec->GetSource());
+	else if (auto* op = dyn_cast<const OpExpr>(node))
+	{
+		if (auto* rf = op->resolvedFunc)
+		{
+			for (ASTNode *arg = op->GetFirstArg(), *argdecl = rf->GetFirstArg();
+				arg && argdecl;
+				arg = arg->next, argdecl = argdecl->next)
+			{
+				if (argdecl->ToVarDecl()->flags & VarDecl::ATTR_Out)
+					AddWrite(arg->ToExpr());
+			}
+		}
+	}
+	for (const ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		CollectWrittenParams(ch, mask);
+}
+
+// unique names for the copied variables
+static void SetInlinedName(VarDecl* vd, const char* origName, int id)
+{
+	char bfr[32];
+	snprintf(bfr, sizeof(bfr), "_inl%d_", id);
+	// avoid "__" (reserved in GLSL)
+	while (*origName == '_')
+		origName++;
+	vd->name = bfr;
+	vd->name += *origName ? origName : "v";
+}
+
+FunctionInliner::FuncInfo& FunctionInliner::GetInfo(ASTFunction* fn)
+{
+	if (fn->optSlot < 0)
+	{
+		fn->optSlot = int(funcInfos.size());
+		funcInfos.push_back(FuncInfo());
+		slotFuncs.push_back(fn);
+	}
+	return funcInfos[fn->optSlot];
+}
+
+// copies the statement, local variables declared in it are copied too and the references in
+// the copy are redirected to them, with `replacements` indexed by the slots of the original variables
+Stmt* FunctionInliner::CloneWithLocals(const Stmt* stmt)
+{
+	Stmt* copy = stmt->DeepClone()->ToStmt();
+	clonedVars.clear();
+	PairDecls(stmt, copy, clonedVars);
+	replacements.clear();
+	for (VarDecl* vd : clonedVars)
+		replacements.push_back({ vd, nullptr });
+	return copy;
+}
+
+void FunctionInliner::ApplyReplacements(ASTNode* node)
+{
+	if (auto* dre = dyn_cast<DeclRefExpr>(node))
+	{
+		if (dre->decl && dre->decl->optSlot >= 0)
+		{
+			const Replacement& r = replacements[dre->decl->optSlot];
+			if (r.var)
+				dre->decl = r.var;
+			else
+				delete dre->ReplaceWith(r.expr->DeepClone());
+		}
+		return;
+	}
+	for (ASTNode* ch = node->firstChild; ch; )
+	{
+		ASTNode* next = ch->next;
+		ApplyReplacements(ch);
+		ch = next;
+	}
+}
+
+bool FunctionInliner::PrepareFunction(ASTFunction* fn, FuncInfo& fi)
+{
+	auto* code = dyn_cast<BlockStmt>(fn->GetCode());
+	if (!code || fn == entryPoint || !CanInlineBody(code, false))
+		return false;
+
+	// done in place, the function does the same if it is not inlined everywhere
+	if (!RestructureReturns(code))
+		return false;
+
+	fi.size = CountNodes(code);
+	int i = 0;
+	for (ASTNode* arg = fn->GetFirstArg(); arg; arg = arg->next)
+		arg->ToVarDecl()->optSlot = i++;
+	CollectWrittenParams(code, fi.writtenParams);
+	for (ASTNode* arg = fn->GetFirstArg(); arg; arg = arg->next)
+		arg->ToVarDecl()->optSlot = -1;
+	return true;
+}
+
+// smaller than the call with argument copies, copies cannot lead to more copies
+static bool IsTinyLeaf(const FunctionInliner::FuncInfo& fi)
+{
+	const int ALWAYS_INLINE_SIZE = 16;
+	return fi.size <= ALWAYS_INLINE_SIZE && !fi.makesCalls;
+}
+
+bool FunctionInliner::ShouldInline(ASTFunction* fn)
+{
+	FuncInfo& fi = GetInfo(fn);
+	if (fi.state == 0)
+		fi.state = PrepareFunction(fn, fi) ? 1 : -1;
+	if (fi.state < 0)
+		return false;
+	// the last call gets the body without copying it
+	return fi.numCalls <= 1 ||
+		IsTinyLeaf(fi) ||
+		curGrowth + fi.size <= maxGrowth;
+}
+
+bool FunctionInliner::InlineCall(OpExpr* call, Stmt* stmt, bool& stmtRemoved)
+{
+	ASTFunction* fn = call->resolvedFunc;
+	FuncInfo& fi = GetInfo(fn);
+	ASTType* rt = fn->GetReturnType();
+	auto* exprstmt = dyn_cast<ExprStmt>(stmt);
+	bool resultUnused = exprstmt && exprstmt->GetExpr() == call;
+	// a void call in a loop initialization
+	if (rt->IsVoid() && !resultUnused)
+		return false;
+
+	// check whether the arguments can be passed
+	int i = 0;
+	for (ASTNode *arg = call->GetFirstArg(), *argdecl = fn->GetFirstArg();
+		arg && argdecl;
+		arg = arg->next, argdecl = argdecl->next, ++i)
+	{
+		VarDecl* pvd = argdecl->ToVarDecl();
+		Expr* argexpr = arg->ToExpr();
+		if (argexpr->GetReturnType() != pvd->GetType())
+			return false;
+		if (pvd->flags & VarDecl::ATTR_Out)
+		{
+			if (NeedsArgReplacement(pvd->GetType()) || !GetWrittenVar(argexpr))
+				return false;
+			// the copy back must write to the same location
+			for (Expr* e = argexpr; auto* sve = dyn_cast<SubValExpr>(e); e = sve->GetSource())
+				if (auto* idx = dyn_cast<IndexExpr>(sve))
+					if (!dyn_cast<ConstExpr>(idx->GetIndex()))
+						return false;
+		}
+		else if (NeedsArgReplacement(pvd->GetType()) &&
+			((fi.writtenParams & (1U << (i < 32 ? i : 31))) || !IsStableArg(argexpr)))
+			return false;
+	}
+
+	int id = numInlined++;
+	auto* code = static_cast<BlockStmt*>(fn->GetCode());
+	bool moveBody = fi.numCalls <= 1;
+	BlockStmt* body;
+	if (moveBody)
+	{
+		body = static_cast<BlockStmt*>(code->ReplaceWith(new BlockStmt));
+		clonedVars.clear();
+		CollectDecls(body, clonedVars);
+		replacements.clear();
+		for (VarDecl* vd : clonedVars)
+			replacements.push_back({ vd, nullptr });
+	}
+	else
+	{
+		body = static_cast<BlockStmt*>(CloneWithLocals(code));
+		CountCalls(body);
+		if (!IsTinyLeaf(fi))
+			curGrowth += fi.size;
+	}
+	for (VarDecl* vd : clonedVars)
+	{
+		String name = vd->name;
+		SetInlinedName(vd, name.c_str(), id);
+		curFunction->tmpVars.push_back(vd);
+	}
+	auto MakeVar = [&](const char* origName, ASTType* type)
+	{
+		auto* vd = new VarDecl;
+		SetInlinedName(vd, origName, id);
+		vd->SetType(type);
+		curFunction->tmpVars.push_back(vd);
+		return vd;
+	};
+
+	// parameters
+	auto* seq = new BlockStmt; // statements inserted before the call
+	auto* copyBack = new BlockStmt;
+	bool hasOutParams = false;
+	i = 0;
+	for (ASTNode *arg = call->GetFirstArg(), *argdecl = fn->GetFirstArg();
+		arg && argdecl;
+		++i)
+	{
+		VarDecl* pvd = argdecl->ToVarDecl();
+		Expr* argexpr = arg->ToExpr();
+		arg = arg->next;
+		argdecl = argdecl->next;
+		pvd->optSlot = int(replacements.size());
+		if (!(pvd->flags & VarDecl::ATTR_Out) &&
+			!(fi.writtenParams & (1U << (i < 32 ? i : 31))) &&
+			IsStableArg(argexpr))
+		{
+			replacements.push_back({ nullptr, argexpr });
+			continue;
+		}
+		VarDecl* vd = MakeVar(pvd->name.c_str(), pvd->GetType());
+		replacements.push_back({ vd, nullptr });
+		if (pvd->flags & VarDecl::ATTR_Out)
+		{
+			hasOutParams = true;
+			seq->AppendChild(CreateVarDeclStmt(vd,
+				pvd->flags & VarDecl::ATTR_In ? argexpr->DeepClone()->ToExpr() : nullptr));
+			copyBack->AppendChild(CreateAssignment(argexpr, CreateVarRef(vd)));
+		}
+		else
+			seq->AppendChild(CreateVarDeclStmt(vd, argexpr));
+	}
+	ApplyReplacements(body);
+	ResetDeclSlots(code);
+	for (ASTNode* argdecl = fn->GetFirstArg(); argdecl; argdecl = argdecl->next)
+		argdecl->ToVarDecl()->optSlot = -1;
+
+	// find out where the returned value goes
+	Array<ReturnStmt*> returns;
+	CollectReturns(body, returns);
+	bool tailReturn = returns.size() == 1 && body->lastChild == returns[0];
+
+	VarDecl* target = nullptr;
+	bool declTarget = false;
+	bool assignTarget = false;
+	auto* vds = dyn_cast<VarDeclStmt>(stmt);
+	VarDecl* vd = vds && vds->childCount == 1 ? vds->firstChild->ToVarDecl() : nullptr;
+	auto* assign = exprstmt ? dyn_cast<BinaryOpExpr>(exprstmt->GetExpr()) : nullptr;
+	auto* assignDst = assign && assign->opType == STT_OP_Assign && assign->GetRgt() == call
+		? dyn_cast<DeclRefExpr>(assign->GetLft()) : nullptr;
+	if (vd && vd->GetInitExpr() == call && vd->GetType() == rt &&
+		(tailReturn || !(vd->flags & (VarDecl::ATTR_Const | VarDecl::ATTR_Static))))
+	{
+		// float x = f(); -> the returned value initializes/is assigned to x
+		target = vd;
+		declTarget = true;
+	}
+	else if (assignDst && assignDst->decl && assignDst->GetReturnType() == rt && !hasOutParams &&
+		!(assignDst->decl->flags & (VarDecl::ATTR_Global | VarDecl::ATTR_StageIO | VarDecl::ATTR_Hidden)))
+	{
+		// x = f(); -> the returned value is assigned to x
+		target = assignDst->decl;
+		assignTarget = true;
+	}
+	else if (!resultUnused)
+	{
+		target = MakeVar("ret", rt);
+		if (!tailReturn)
+			seq->AppendChild(CreateVarDeclStmt(target, nullptr));
+	}
+
+	for (ReturnStmt* ret : returns)
+	{
+		Expr* e = ret->GetExpr();
+		Stmt* with = nullptr;
+		if (!e)
+			;
+		else if (!target)
+		{
+			if (HasSideEffects(e))
+			{
+				with = new ExprStmt;
+				with->AppendChild(e);
+			}
+		}
+		else if (tailReturn && declTarget)
+		{
+			delete call->ReplaceWith(e);
+			call = nullptr;
+		}
+		else if (tailReturn && !assignTarget)
+			with = CreateVarDeclStmt(target, e);
+		else
+			with = CreateAssignment(CreateVarRef(target), e);
+		ReplaceStmt(ret, with);
+	}
+
+	while (body->firstChild)
+		seq->AppendChild(body->firstChild);
+	delete body;
+	while (copyBack->firstChild)
+		seq->AppendChild(copyBack->firstChild);
+	delete copyBack;
+
+	ASTNode* insertBefore = stmt;
+	if (declTarget && call)
+	{
+		// the variable is assigned in the body, it must be declared before it
+		delete call;
+		call = nullptr;
+		insertBefore = stmt->next;
+	}
+	while (seq->firstChild)
+	{
+		pending.push_back(seq->firstChild->ToStmt());
+		stmt->parent->InsertBefore(seq->firstChild, insertBefore);
+	}
+	delete seq;
+
+	stmtRemoved = resultUnused || assignTarget;
+	if (stmtRemoved)
+		ReplaceStmt(stmt, nullptr);
+	else if (call)
+		delete call->ReplaceWith(CreateVarRef(target));
+
+	fi.numCalls--;
+	if (moveBody)
+	{
+		// nothing calls it anymore
+		slotFuncs[fn->optSlot] = nullptr;
+		delete fn;
+	}
+	return true;
+}
+
+bool FunctionInliner::ProcessExpr(ASTNode* holder, Stmt* stmt)
+{
+	while (holder->firstChild)
+	{
+		Expr* first = FirstSideEffect(holder->firstChild->ToExpr());
+		auto* call = first ? dyn_cast<OpExpr>(first) : nullptr;
+		if (!call || !call->resolvedFunc || IsConditionallyEvaluated(call) || !ShouldInline(call->resolvedFunc))
+			break;
+		bool removed;
+		if (!InlineCall(call, stmt, removed))
+			break;
+		if (removed)
+			return false;
+	}
+	return true;
+}
+
+static bool ContainsFCall(const ASTNode* node)
+{
+	if (auto* op = dyn_cast<const OpExpr>(node))
+		if (op->opKind == Op_FCall)
+			return true;
+	for (const ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		if (ContainsFCall(ch))
+			return true;
+	return false;
+}
+
+void FunctionInliner::ProcessStmt(Stmt* stmt)
+{
+	if (auto* blk = dyn_cast<BlockStmt>(stmt))
+	{
+		for (ASTNode* ch = blk->firstChild; ch; )
+		{
+			ASTNode* next = ch->next;
+			ProcessStmt(ch->ToStmt());
+			ch = next;
+		}
+		return;
+	}
+	if (!ContainsFCall(stmt))
+		return;
+	// calls are inlined into the closest block
+	if (!dyn_cast<BlockStmt>(stmt->parent))
+		stmt = WrapInBlock(stmt)->firstChild->ToStmt();
+
+	if (dyn_cast<ExprStmt>(stmt) || dyn_cast<ReturnStmt>(stmt))
+	{
+		ProcessExpr(stmt, stmt);
+	}
+	else if (auto* vds = dyn_cast<VarDeclStmt>(stmt))
+	{
+		// later initializers could use the previous variables
+		if (vds->childCount == 1)
+			ProcessExpr(vds->firstChild, stmt);
+	}
+	else if (auto* ifelse = dyn_cast<IfElseStmt>(stmt))
+	{
+		ProcessExpr(ifelse, stmt);
+		ProcessStmt(ifelse->GetTrueBr());
+		if (Stmt* f = ifelse->GetFalseBr())
+			ProcessStmt(f);
+	}
+	else if (auto* whilestmt = dyn_cast<WhileStmt>(stmt))
+		ProcessStmt(whilestmt->GetBody());
+	else if (auto* dowhilestmt = dyn_cast<DoWhileStmt>(stmt))
+		ProcessStmt(dowhilestmt->GetBody());
+	else if (auto* forstmt = dyn_cast<ForStmt>(stmt))
+	{
+		// the initialization is done once, before the loop
+		Stmt* init = forstmt->GetInit();
+		if (dyn_cast<ExprStmt>(init))
+			ProcessExpr(init, stmt);
+		else if (dyn_cast<VarDeclStmt>(init) && init->childCount == 1)
+			ProcessExpr(init->firstChild, stmt);
+		ProcessStmt(forstmt->GetBody());
+	}
+}
+
+// calls in copied bodies, the called functions were found by SortFunctions
+void FunctionInliner::CountCalls(ASTNode* node)
+{
+	if (auto* op = dyn_cast<OpExpr>(node))
+		if (op->opKind == Op_FCall && op->resolvedFunc && op->resolvedFunc->optSlot >= 0)
+			funcInfos[op->resolvedFunc->optSlot].numCalls++;
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		CountCalls(ch);
+}
+
+// slots of the functions reachable from the entry point, callees before their callers
+// (there is no recursion), also counts the calls
+void FunctionInliner::SortFunctions(Array<int>& order)
+{
+	Array<ASTFunction*> stack;
+	GetInfo(entryPoint).visit = 1;
+	stack.push_back(entryPoint);
+	while (!stack.empty())
+	{
+		ASTFunction* fn = stack.back();
+		int visit = GetInfo(fn).visit;
+		if (visit != 1)
+		{
+			// callees done or a function that was pushed again by a later caller
+			stack.pop_back();
+			if (visit == 2)
+			{
+				GetInfo(fn).visit = 3;
+				order.push_back(fn->optSlot);
+			}
+			continue;
+		}
+		GetInfo(fn).visit = 2;
+		bool makesCalls = false;
+		ASTNode* root = fn->GetCode();
+		for (ASTNode* ch = root; ch; )
+		{
+			auto* op = dyn_cast<OpExpr>(ch);
+			if (op && op->opKind == Op_FCall && op->resolvedFunc)
+			{
+				makesCalls = true;
+				FuncInfo& ci = GetInfo(op->resolvedFunc);
+				ci.numCalls++;
+				// pushed again so that it is done before this function
+				if (ci.visit <= 1)
+				{
+					ci.visit = 1;
+					stack.push_back(op->resolvedFunc);
+				}
+			}
+			if (ch->firstChild)
+				ch = ch->firstChild;
+			else
+			{
+				while (ch != root && !ch->next)
+					ch = ch->parent;
+				ch = ch != root ? ch->next : nullptr;
+			}
+		}
+		GetInfo(fn).makesCalls = makesCalls;
+	}
+}
+
+void FunctionInliner::MarkUsed(ASTFunction* fn)
+{
+	if (fn->used)
+		return;
+	fn->used = true;
+	Array<ASTFunction*> stack;
+	stack.push_back(fn);
+	while (!stack.empty())
+	{
+		ASTNode* root = stack.back()->GetCode();
+		stack.pop_back();
+		for (ASTNode* ch = root; ch; )
+		{
+			auto* op = dyn_cast<OpExpr>(ch);
+			if (op && op->opKind == Op_FCall && op->resolvedFunc && !op->resolvedFunc->used)
+			{
+				op->resolvedFunc->used = true;
+				stack.push_back(op->resolvedFunc);
+			}
+			if (ch->firstChild)
+				ch = ch->firstChild;
+			else
+			{
+				while (ch != root && !ch->next)
+					ch = ch->parent;
+				ch = ch != root ? ch->next : nullptr;
+			}
+		}
+	}
+}
+
+void FunctionInliner::RunOnAST(AST& ast)
+{
+	entryPoint = ast.entryPoint;
+	Array<int> order;
+	SortFunctions(order);
+	// callers first, a function is removed when its last call is inlined
+	for (size_t i = order.size(); i-- > 0; )
+	{
+		curFunction = slotFuncs[order[i]];
+		if (!curFunction || !curFunction->GetCode())
+			continue;
+		curGrowth = 0;
+		ProcessStmt(curFunction->GetCode());
+		while (!pending.empty())
+		{
+			Stmt* stmt = pending.back();
+			pending.pop_back();
+			ProcessStmt(stmt);
+		}
+	}
+
+	funcInfos.clear();
+	for (ASTFunction* fn : slotFuncs)
+		if (fn)
+			fn->optSlot = -1;
+	slotFuncs.clear();
+
+	if (numInlined)
+	{
+		for (ASTNode* ch = ast.functionList.firstChild; ch; ch = ch->next)
+			ch->ToFunction()->used = false;
+		MarkUsed(entryPoint);
+		RemoveUnusedFunctions().RunOnAST(ast);
+	}
+}
+
+
+
+static bool IsIntScalar(const ASTType* t)
+{
+	return t->kind == ASTType::Int32 || t->kind == ASTType::UInt32;
+}
+
+// constant through casts between int types
+static bool GetIntConst(const Expr* e, int64_t& out)
+{
+	while (auto* cast = dyn_cast<const CastExpr>(e))
+	{
+		if (!IsIntScalar(cast->GetReturnType()))
+			return false;
+		e = cast->GetSource();
+	}
+	auto* ie = dyn_cast<const Int32Expr>(e);
+	if (!ie)
+		return false;
+	out = ie->GetReturnType()->kind == ASTType::UInt32 ? int64_t(uint32_t(ie->value)) : int64_t(ie->value);
+	return true;
+}
+
+// reference to the variable through casts between int types
+static bool IsIntVarRef(const Expr* e, const VarDecl* vd, bool& casted)
+{
+	while (auto* cast = dyn_cast<const CastExpr>(e))
+	{
+		if (!IsIntScalar(cast->GetReturnType()))
+			return false;
+		casted = true;
+		e = cast->GetSource();
+	}
+	auto* dre = dyn_cast<const DeclRefExpr>(e);
+	return dre && dre->decl == vd;
+}
+
+static bool CompareIndex(int64_t v, SLTokenType op, int64_t limit)
+{
+	switch (op)
+	{
+	case STT_OP_Eq: return v == limit;
+	case STT_OP_NEq: return v != limit;
+	case STT_OP_LEq: return v <= limit;
+	case STT_OP_GEq: return v >= limit;
+	case STT_OP_Less: return v < limit;
+	case STT_OP_Greater: return v > limit;
+	default: return false;
+	}
+}
+
+static SLTokenType MirrorComparison(SLTokenType op)
+{
+	switch (op)
+	{
+	case STT_OP_LEq: return STT_OP_GEq;
+	case STT_OP_GEq: return STT_OP_LEq;
+	case STT_OP_Less: return STT_OP_Greater;
+	case STT_OP_Greater: return STT_OP_Less;
+	default: return op;
+	}
+}
+
+// no break/continue of the loop itself, no static variables and no writes to the index
+static bool CanUnrollBody(ASTNode* node, const VarDecl* index, bool inLoop)
+{
+	if ((dyn_cast<BreakStmt>(node) || dyn_cast<ContinueStmt>(node)) && !inLoop)
+		return false;
+	if (auto* vd = dyn_cast<VarDecl>(node))
+		if (vd->flags & VarDecl::ATTR_Static)
+			return false;
+	if (dyn_cast<WhileStmt>(node) || dyn_cast<DoWhileStmt>(node) || dyn_cast<ForStmt>(node))
+		inLoop = true;
+
+	if (auto* binop = dyn_cast<BinaryOpExpr>(node))
+	{
+		if (TokenIsOpAssign(binop->opType) && GetWrittenVar(binop->GetLft()) == index)
+			return false;
+	}
+	else if (auto* incdec = dyn_cast<IncDecOpExpr>(node))
 	{
-		if (auto* src = dyn_cast<const ConstExpr>(unop->GetSource()))
+		if (GetWrittenVar(incdec->GetSource()) == index)
+			return false;
+	}
+	else if (auto* op = dyn_cast<OpExpr>(node))
+	{
+		if (auto* rf = op->resolvedFunc)
 		{
-			switch (src->GetReturnType()->kind)
-			{
-			case ASTType::Bool:
-			{
-				bool sv = dyn_cast<const BoolExpr>(src)->value;
-				bool out = false;
-				switch (unop->opType)
-				{
-				case STT_OP_Not: out = sv ? 0 : 1; goto unop_replbool;
-				default: break;
-				unop_replbool:
-					delete node->ReplaceWith(new BoolExpr(out, unop->GetReturnType()));
-					return;
-				}
-				break;
-			}
-			case ASTType::Int32:
-			{
-				int32_t sv = dyn_cast<const Int32Expr>(src)->value;
-				int32_t out = 0;
-				switch (unop->opType)
-				{
-				case STT_OP_Sub: out = -sv; goto unop_replint;
-				case STT_OP_Inv: out = ~sv; goto unop_replint;
-				default: break;
-				unop_replint:
-					delete node->ReplaceWith(new Int32Expr(out, unop->GetReturnType()));
-					return;
-				}
-				break;
-			}
-			case ASTType::Float16:
-			case ASTType::Float32:
+			for (ASTNode *arg = op->GetFirstArg(), *argdecl = rf->GetFirstArg();
+				arg && argdecl;
+				arg = arg->next, argdecl = argdecl->next)
 			{
-				double sv = dyn_cast<const Float32Expr>(src)->value;
-				double out = 0;
-				switch (unop->opType)
-				{
-				case STT_OP_Sub: out = -sv; goto unop_replfloat;
-				default: break;
-				unop_replfloat:
-					delete node->ReplaceWith(new Float32Expr(out, unop->GetReturnType()));
-					return;
-				}
-				break;
-			}
+				if ((argdecl->ToVarDecl()->flags & VarDecl::ATTR_Out) && GetWrittenVar(arg->ToExpr()) == index)
+					return false;
 			}
 		}
 	}
-	else if (auto* binop = dyn_cast<const BinaryOpExpr>(node))
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		if (!CanUnrollBody(ch, index, inLoop))
+			return false;
+	return true;
+}
+
+static bool ReferencesVar(const ASTNode* node, const VarDecl* vd, const ASTNode* skip)
+{
+	if (node == skip)
+		return false;
+	if (auto* dre = dyn_cast<const DeclRefExpr>(node))
+		return dre->decl == vd;
+	for (const ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		if (ReferencesVar(ch, vd, skip))
+			return true;
+	return false;
+}
+
+// `for` initialization - `T i = C0` or `i = C0`, with a local int/uint variable
+static VarDecl* GetLoopIndex(ForStmt* loop, int64_t& start)
+{
+	VarDecl* index = nullptr;
+	Stmt* init = loop->GetInit();
+	if (auto* vds = dyn_cast<VarDeclStmt>(init))
+	{
+		if (vds->childCount != 1)
+			return nullptr;
+		VarDecl* vd = vds->firstChild->ToVarDecl();
+		if (!vd->GetInitExpr() || !GetIntConst(vd->GetInitExpr(), start))
+			return nullptr;
+		index = vd;
+	}
+	else if (auto* exprst = dyn_cast<ExprStmt>(init))
+	{
+		auto* assign = dyn_cast<BinaryOpExpr>(exprst->GetExpr());
+		if (!assign || assign->opType != STT_OP_Assign || !GetIntConst(assign->GetRgt(), start))
+			return nullptr;
+		auto* dre = dyn_cast<DeclRefExpr>(assign->GetLft());
+		if (!dre || !dre->decl)
+			return nullptr;
+		index = dre->decl;
+	}
+	else
+		return nullptr;
+	if (!IsIntScalar(index->GetType()) ||
+		(index->flags & (VarDecl::ATTR_Global | VarDecl::ATTR_Static | VarDecl::ATTR_Out)))
+		return nullptr;
+	return index;
+}
+
+// `for` condition - `i <cmp> C1` or `C1 <cmp> i`
+static bool GetLoopCondition(ForStmt* loop, const VarDecl* index, SLTokenType& cmp, int64_t& limit, bool& casted)
+{
+	auto* cond = dyn_cast<BinaryOpExpr>(loop->GetCond());
+	if (!cond)
+		return false;
+	cmp = cond->opType;
+	if (IsIntVarRef(cond->GetLft(), index, casted) && GetIntConst(cond->GetRgt(), limit))
+		;
+	else if (GetIntConst(cond->GetLft(), limit) && IsIntVarRef(cond->GetRgt(), index, casted))
+		cmp = MirrorComparison(cmp);
+	else
+		return false;
+	return cmp == STT_OP_Eq || cmp == STT_OP_NEq || cmp == STT_OP_LEq ||
+		cmp == STT_OP_GEq || cmp == STT_OP_Less || cmp == STT_OP_Greater;
+}
+
+bool LoopUnroller::MatchLoop(ForStmt* loop, int64_t& start, int64_t& step, int& tripCount)
+{
+	indexVar = GetLoopIndex(loop, start);
+	if (!indexVar)
+		return false;
+
+	bool casted = false;
+	SLTokenType cmp;
+	int64_t limit;
+	if (!GetLoopCondition(loop, indexVar, cmp, limit, casted))
+		return false;
+
+	// increment - `++i`, `i++`, `--i`, `i--`, `i += C2`, `i -= C2`, `i = i + C2`, `i = C2 + i`, `i = i - C2`
+	Expr* incr = loop->GetIncr();
+	if (auto* incdec = dyn_cast<IncDecOpExpr>(incr))
+	{
+		auto* dre = dyn_cast<DeclRefExpr>(incdec->GetSource());
+		if (!dre || dre->decl != indexVar)
+			return false;
+		step = incdec->dec ? -1 : 1;
+	}
+	else if (auto* binop = dyn_cast<BinaryOpExpr>(incr))
 	{
-		auto* lft = dyn_cast<const ConstExpr>(binop->GetLft());
-		auto* rgt = dyn_cast<const ConstExpr>(binop->GetRgt());
-		if (lft && rgt &&
-			binop->GetReturnType() == lft->GetReturnType() &&
-			binop->GetReturnType() == rgt->GetReturnType())
+		auto* dre = dyn_cast<DeclRefExpr>(binop->GetLft());
+		if (!dre || dre->decl != indexVar)
+			return false;
+		if (binop->opType == STT_OP_AddEq || binop->opType == STT_OP_SubEq)
 		{
-			switch (binop->GetReturnType()->kind)
-			{
-			case ASTType::Int32:
-			{
-				int32_t lv = dyn_cast<const Int32Expr>(lft)->value;
-				int32_t rv = dyn_cast<const Int32Expr>(rgt)->value;
-				int32_t out = 0;
-				switch (binop->opType)
-				{
-				case STT_OP_Add: out = lv + rv; goto binop_replint;
-				case STT_OP_Sub: out = lv - rv; goto binop_replint;
-				case STT_OP_Mul: out = lv * rv; goto binop_replint;
-				case STT_OP_Div: out = rv ? lv / rv : 0; goto binop_replint;
-				case STT_OP_Mod: out = rv ? lv % rv : 0; goto binop_replint;
-				default: break;
-				binop_replint:
-					delete node->ReplaceWith(new Int32Expr(out, binop->GetReturnType()));
-					return;
-				}
-				break;
-			}
-			case ASTType::Float16:
-			case ASTType::Float32:
+			if (!GetIntConst(binop->GetRgt(), step))
+				return false;
+			if (binop->opType == STT_OP_SubEq)
+				step = -step;
+		}
+		else if (binop->opType == STT_OP_Assign)
+		{
+			Expr* src = binop->GetRgt();
+			while (auto* cast = dyn_cast<CastExpr>(src))
 			{
-				double lv = dyn_cast<const Float32Expr>(lft)->value;
-				double rv = dyn_cast<const Float32Expr>(rgt)->value;
-				double out = 0;
-				switch (binop->opType)
-				{
-				case STT_OP_Add: out = lv + rv; goto binop_replfloat;
-				case STT_OP_Sub: out = lv - rv; goto binop_replfloat;
-				case STT_OP_Mul: out = lv * rv; goto binop_replfloat;
-				case STT_OP_Div: out = rv ? lv / rv : 0; goto binop_replfloat;
-				case STT_OP_Mod: out = rv ? fmod(lv, rv) : 0; goto binop_replfloat;
-				default: break;
-				binop_replfloat:
-					delete node->ReplaceWith(new Float32Expr(out, binop->GetReturnType()));
-					return;
-				}
-				break;
-			}
+				if (!IsIntScalar(cast->GetReturnType()))
+					return false;
+				src = cast->GetSource();
 			}
+			auto* arith = dyn_cast<BinaryOpExpr>(src);
+			if (!arith || (arith->opType != STT_OP_Add && arith->opType != STT_OP_Sub))
+				return false;
+			if (IsIntVarRef(arith->GetLft(), indexVar, casted) && GetIntConst(arith->GetRgt(), step))
+				;
+			else if (arith->opType == STT_OP_Add &&
+				GetIntConst(arith->GetLft(), step) && IsIntVarRef(arith->GetRgt(), indexVar, casted))
+				;
+			else
+				return false;
+			if (arith->opType == STT_OP_Sub)
+				step = -step;
+		}
+		else
+			return false;
+	}
+	else
+		return false;
+
+	Stmt* body = loop->GetBody();
+	if (!CanUnrollBody(body, indexVar, false))
+		return false;
+
+	// the values must stay in the range where the int/uint casts do not change them
+	int64_t minValue = casted || indexVar->GetType()->kind == ASTType::UInt32 ? 0 : INT32_MIN;
+	if (start < minValue || start > INT32_MAX)
+		return false;
+	int maxTrips = maxSize / CountNodes(body);
+	tripCount = 0;
+	for (int64_t v = start; CompareIndex(v, cmp, limit); v += step)
+	{
+		if (tripCount++ >= maxTrips || v + step < minValue || v + step > INT32_MAX)
+			return false;
+	}
+	return true;
+}
+
+Expr* LoopUnroller::CreateIndexConst(int64_t value)
+{
+	auto* cnst = new Int32Expr(int32_t(value), ast->GetInt32Type());
+	if (indexVar->GetType()->kind == ASTType::Int32)
+		return cnst;
+	auto* cast = new CastExpr;
+	cast->SetReturnType(indexVar->GetType());
+	cast->AppendChild(cnst);
+	return cast;
+}
+
+// variables declared in the copy have their index in the optSlot of the original
+void LoopUnroller::ApplyIndex(ASTNode* node, int64_t value)
+{
+	if (auto* dre = dyn_cast<DeclRefExpr>(node))
+	{
+		if (dre->decl == indexVar)
+			delete dre->ReplaceWith(CreateIndexConst(value));
+		else if (dre->decl && dre->decl->optSlot >= 0)
+			dre->decl = clonedVars[dre->decl->optSlot];
+		return;
+	}
+	if (auto* ret = dyn_cast<ReturnStmt>(node))
+		ret->AddToFunction(curFunction);
+	for (ASTNode* ch = node->firstChild; ch; )
+	{
+		ASTNode* next = ch->next;
+		ApplyIndex(ch, value);
+		ch = next;
+	}
+}
+
+void LoopUnroller::UnrollLoop(ForStmt* loop, int64_t start, int64_t step, int tripCount)
+{
+	Stmt* body = loop->GetBody();
+	// bodies without declarations can be merged into the enclosing block
+	bool merge = true;
+	if (auto* blk = dyn_cast<BlockStmt>(body))
+	{
+		for (ASTNode* ch = blk->firstChild; ch; ch = ch->next)
+			if (dyn_cast<VarDeclStmt>(ch))
+				merge = false;
+	}
+
+	auto* result = new BlockStmt;
+	for (int i = 0; i < tripCount; ++i)
+	{
+		Stmt* copy = body->DeepClone()->ToStmt();
+		clonedVars.clear();
+		PairDecls(body, copy, clonedVars);
+		ApplyIndex(copy, start + step * i);
+		ResetDeclSlots(body);
+		if (merge && dyn_cast<BlockStmt>(copy))
+		{
+			while (copy->firstChild)
+				result->AppendChild(copy->firstChild);
+			delete copy;
 		}
+		else
+			result->AppendChild(copy);
 	}
-	else if (auto* cast = dyn_cast<const CastExpr>(node))
+
+	// the index keeps its final value if it is used after the loop
+	int64_t end = start + step * tripCount;
+	Stmt* init = loop->GetInit();
+	if (dyn_cast<VarDeclStmt>(init))
 	{
-		if (auto* src = dyn_cast<const ConstExpr>(cast->GetSource()))
+		if (ReferencesVar(curFunction->GetCode(), indexVar, loop))
 		{
-			if (cast->GetReturnType()->kind == ASTType::Bool)
-			{
-				bool out = false;
-				switch (src->GetReturnType()->kind)
-				{
-				case ASTType::Bool:
-					out = static_cast<const BoolExpr*>(src)->value;
-					goto cast_replbool;
-				case ASTType::Int32:
-					out = static_cast<const Int32Expr*>(src)->value != 0;
-					goto cast_replbool;
-				case ASTType::Float16:
-				case ASTType::Float32:
-					out = static_cast<const Float32Expr*>(src)->value != 0;
-					goto cast_replbool;
-				default: break;
-				cast_replbool:
-					delete node->ReplaceWith(new BoolExpr(out, cast->GetReturnType()));
-					return;
-				}
-			}
-			else if (cast->GetReturnType()->kind == ASTType::Int32)
+			delete indexVar->GetInitExpr()->ReplaceWith(CreateIndexConst(end));
+			result->AppendChild(init);
+		}
+	}
+	else
+	{
+		auto* assign = static_cast<BinaryOpExpr*>(static_cast<ExprStmt*>(init)->GetExpr());
+		delete assign->GetRgt()->ReplaceWith(CreateIndexConst(end));
+		result->AppendChild(init);
+	}
+
+	if (!result->firstChild)
+	{
+		delete result;
+		ReplaceStmt(loop, nullptr);
+	}
+	else if (dyn_cast<BlockStmt>(loop->parent))
+	{
+		while (result->firstChild)
+			loop->InsertBeforeMe(result->firstChild);
+		delete result;
+		delete loop;
+	}
+	else
+		delete loop->ReplaceWith(result);
+	numUnrolled++;
+}
+
+void LoopUnroller::ProcessStmt(Stmt* stmt)
+{
+	// inner loops first
+	for (ASTNode* ch = stmt->firstChild; ch; )
+	{
+		ASTNode* next = ch->next;
+		if (auto* chstmt = dyn_cast<Stmt>(ch))
+			ProcessStmt(chstmt);
+		ch = next;
+	}
+	if (auto* loop = dyn_cast<ForStmt>(stmt))
+	{
+		int64_t start, step;
+		int tripCount;
+		if (MatchLoop(loop, start, step, tripCount))
+			UnrollLoop(loop, start, step, tripCount);
+	}
+}
+
+void LoopUnroller::RunOnAST(AST& a)
+{
+	ast = &a;
+	for (ASTNode* ch = a.functionList.firstChild; ch; ch = ch->next)
+	{
+		curFunction = ch->ToFunction();
+		if (curFunction->used && curFunction->GetCode())
+			ProcessStmt(curFunction->GetCode());
+	}
+}
+
+
+static bool IsFirstIterationTaken(Stmt* loop)
+{
+	if (dyn_cast<DoWhileStmt>(loop))
+		return true;
+	Expr* cond;
+	if (auto* whilestmt = dyn_cast<WhileStmt>(loop))
+		cond = whilestmt->GetCond();
+	else
+	{
+		auto* forstmt = static_cast<ForStmt*>(loop);
+		cond = forstmt->GetCond();
+		if (dyn_cast<VoidExpr>(cond))
+			return true;
+		int64_t start, limit;
+		bool casted = false;
+		SLTokenType cmp;
+		if (VarDecl* index = GetLoopIndex(forstmt, start))
+			if (GetLoopCondition(forstmt, index, cmp, limit, casted))
+				return (!casted || start >= 0) && CompareIndex(start, cmp, limit);
+	}
+	auto* bexpr = dyn_cast<BoolExpr>(cond);
+	return bexpr && bexpr->value;
+}
+
+void LoopInvariantCodeMotion::MarkLoopVars(ASTNode* node)
+{
+	auto Mark = [this](VarDecl* vd)
+	{
+		if (vd && vd->optSlot < 0)
+		{
+			vd->optSlot = 0;
+			loopVars.push_back(vd);
+		}
+	};
+	if (auto* vd = dyn_cast<VarDecl>(node))
+		Mark(vd);
+	else if (auto* binop = dyn_cast<BinaryOpExpr>(node))
+	{
+		if (TokenIsOpAssign(binop->opType))
+			Mark(GetWrittenVar(binop->GetLft()));
+	}
+	else if (auto* incdec = dyn_cast<IncDecOpExpr>(node))
+		Mark(GetWrittenVar(incdec->GetSource()));
+	else if (auto* op = dyn_cast<OpExpr>(node))
+	{
+		if (auto* rf = op->resolvedFunc)
+		{
+			for (ASTNode *arg = op->GetFirstArg(), *argdecl = rf->GetFirstArg();
+				arg && argdecl;
+				arg = arg->next, argdecl = argdecl->next)
 			{
-				int32_t out = 0;
-				switch (src->GetReturnType()->kind)
-				{
-				case ASTType::Bool:
-					out = static_cast<const BoolExpr*>(src)->value ? 1 : 0;
-					goto cast_replint;
-				case ASTType::Int32:
-					out = static_cast<const Int32Expr*>(src)->value;
-					goto cast_replint;
-				case ASTType::Float16:
-				case ASTType::Float32:
-					out = int32_t(static_cast<const Float32Expr*>(src)->value);
-					goto cast_replint;
-				default: break;
-				cast_replint:
-					delete node->ReplaceWith(new Int32Expr(out, cast->GetReturnType()));
-					return;
-				}
+				if (argdecl->ToVarDecl()->flags & VarDecl::ATTR_Out)
+					Mark(GetWrittenVar(arg->ToExpr()));
 			}
-			else if (cast->GetReturnType()->IsFloat())
+		}
+	}
+	for (ASTNode* ch = node->firstChild; ch; ch = ch->next)
+		MarkLoopVars(ch);
+}
+
+void LoopInvariantCodeMotion::UnmarkLoopVars()
+{
+	for (VarDecl* vd : loopVars)
+		vd->optSlot = -1;
+	loopVars.clear();
+}
+
+bool LoopInvariantCodeMotion::IsInvariantVar(const VarDecl* vd) const
+{
+	if (vd->optSlot >= 0)
+		return false;
+	// static globals could be written by the called functions
+	if ((vd->flags & (VarDecl::ATTR_Global | VarDecl::ATTR_Static)) == (VarDecl::ATTR_Global | VarDecl::ATTR_Static))
+		return (vd->flags & VarDecl::ATTR_Const) != 0;
+	return true;
+}
+
+void LoopInvariantCodeMotion::Hoist(Expr* expr)
+{
+	if (!IsCSECandidate(expr) || NeedsArgReplacement(expr->GetReturnType()))
+		return;
+
+	// temporaries (e.g. from an inner loop) are moved with the declaration
+	auto* vd = dyn_cast<VarDecl>(expr->parent);
+	Stmt* stmt = FindParentStatement(expr);
+	Stmt* body = nullptr;
+	if (auto* whilestmt = dyn_cast<WhileStmt>(curLoop))
+		body = whilestmt->GetBody();
+	else if (auto* dowhilestmt = dyn_cast<DoWhileStmt>(curLoop))
+		body = dowhilestmt->GetBody();
+	else
+		body = static_cast<ForStmt*>(curLoop)->GetBody();
+	if (vd && vd->name.empty() && stmt->childCount == 1 && stmt->parent == body && dyn_cast<BlockStmt>(body))
+	{
+		if (!dyn_cast<BlockStmt>(curLoop->parent))
+			WrapInBlock(curLoop);
+		curLoop->InsertBeforeMe(stmt);
+		vd->optSlot = -1;
+	}
+	else
+		FoldOutBefore(expr, curLoop);
+	numHoisted++;
+}
+
+bool LoopInvariantCodeMotion::ProcessExpr(Expr* expr)
+{
+	if (auto* dre = dyn_cast<DeclRefExpr>(expr))
+		return dre->decl && IsInvariantVar(dre->decl);
+	if (dyn_cast<ConstExpr>(expr))
+		return true;
+
+	bool pure = true;
+	switch (expr->kind)
+	{
+	case ASTNode::Kind_CastExpr:
+	case ASTNode::Kind_InitListExpr:
+	case ASTNode::Kind_UnaryOpExpr:
+	case ASTNode::Kind_TernaryOpExpr:
+	case ASTNode::Kind_MemberExpr:
+	case ASTNode::Kind_IndexExpr:
+		break;
+	case ASTNode::Kind_BinaryOpExpr:
+		if (TokenIsOpAssign(static_cast<BinaryOpExpr*>(expr)->opType))
+		{
+			auto* binop = static_cast<BinaryOpExpr*>(expr);
+			ProcessLValue(binop->GetLft());
+			if (ProcessExpr(binop->GetRgt()))
+				Hoist(binop->GetRgt());
+			return false;
+		}
+		break;
+	case ASTNode::Kind_IncDecOpExpr:
+		ProcessLValue(static_cast<IncDecOpExpr*>(expr)->GetSource());
+		return false;
+	case ASTNode::Kind_OpExpr:
+		{
+			auto* op = static_cast<OpExpr*>(expr);
+			if (op->opKind == Op_FCall)
 			{
-				double out = 0;
-				switch (src->GetReturnType()->kind)
+				for (ASTNode *arg = op->GetFirstArg(), *argdecl = op->resolvedFunc ? op->resolvedFunc->GetFirstArg() : nullptr;
+					arg; )
 				{
-				case ASTType::Bool:
-					out = static_cast<const BoolExpr*>(src)->value ? 1 : 0;
-					goto cast_replfloat;
-				case ASTType::Int32:
-					out = static_cast<const Int32Expr*>(src)->value;
-					goto cast_replfloat;
-				case ASTType::Float16:
-				case ASTType::Float32:
-					out = static_cast<const Float32Expr*>(src)->value;
-					goto cast_replfloat;
-				default: break;
-				cast_replfloat:
-					delete node->ReplaceWith(new Float32Expr(out, cast->GetReturnType()));
-					return;
+					ASTNode* next = arg->next;
+					if (argdecl && (argdecl->ToVarDecl()->flags & VarDecl::ATTR_Out))
+						ProcessLValue(arg->ToExpr());
+					else if (ProcessExpr(arg->ToExpr()))
+						Hoist(arg->ToExpr());
+					arg = next;
+					argdecl = argdecl ? argdecl->next : nullptr;
 				}
+				return false;
 			}
+			// no side effects and no dependencies on the control flow
+			pure = op->opKind != Op_Clip && op->opKind != Op_DDX && op->opKind != Op_DDY &&
+				op->opKind != Op_FWidth && op->opKind < Op_Tex1D;
 		}
+		break;
+	default:
+		pure = false;
+		break;
 	}
 
-	else if (auto* ifelse = dyn_cast<IfElseStmt>(node))
+	// the invariance of the first children, expressions with more are rare
+	bool childInv[16];
+	bool allInv = pure && expr->childCount <= 16;
+	int i = 0;
+	for (ASTNode* ch = expr->firstChild; ch; ch = ch->next, ++i)
 	{
-		if (auto* cond = dyn_cast<const BoolExpr>(ifelse->GetCond()))
+		bool inv = ProcessExpr(ch->ToExpr());
+		if (i < 16)
+			childInv[i] = inv;
+		allInv &= inv;
+	}
+	if (allInv)
+		return true;
+
+	i = 0;
+	for (ASTNode* ch = expr->firstChild; ch; ++i)
+	{
+		ASTNode* next = ch->next;
+		if (i < 16 && childInv[i])
+			Hoist(ch->ToExpr());
+		ch = next;
+	}
+	return false;
+}
+
+// only the indices of written variables can be moved
+void LoopInvariantCodeMotion::ProcessLValue(Expr* expr)
+{
+	while (auto* sve = dyn_cast<SubValExpr>(expr))
+	{
+		if (auto* idx = dyn_cast<IndexExpr>(sve))
+			if (ProcessExpr(idx->GetIndex()))
+				Hoist(idx->GetIndex());
+		expr = sve->GetSource();
+	}
+}
+
+void LoopInvariantCodeMotion::ProcessStmt(Stmt* stmt)
+{
+	if (auto* blk = dyn_cast<BlockStmt>(stmt))
+	{
+		for (ASTNode* ch = blk->firstChild; ch; )
 		{
-			if (cond->value)
-			{
-				delete node->ReplaceWith(ifelse->GetTrueBr());
-			}
-			else
-			{
-				// TODO clean up
-				delete node->ReplaceWith(ifelse->GetFalseBr() ? ifelse->GetFalseBr() : new BlockStmt);
-			}
-			return;
+			ASTNode* next = ch->next;
+			ProcessStmt(ch->ToStmt());
+			ch = next;
+		}
+	}
+	else if (auto* exprst = dyn_cast<ExprStmt>(stmt))
+	{
+		// the value of the statement itself is not used
+		if (Expr* e = exprst->GetExpr())
+			ProcessExpr(e);
+	}
+	else if (auto* ret = dyn_cast<ReturnStmt>(stmt))
+	{
+		if (Expr* e = ret->GetExpr())
+			if (ProcessExpr(e))
+				Hoist(e);
+	}
+	else if (auto* vds = dyn_cast<VarDeclStmt>(stmt))
+	{
+		for (ASTNode* ch = vds->firstChild; ch; )
+		{
+			ASTNode* next = ch->next;
+			if (Expr* init = ch->ToVarDecl()->GetInitExpr())
+				if (ProcessExpr(init))
+					Hoist(init);
+			ch = next;
 		}
 	}
+	else if (auto* ifelse = dyn_cast<IfElseStmt>(stmt))
+	{
+		if (ProcessExpr(ifelse->GetCond()))
+			Hoist(ifelse->GetCond());
+		ProcessStmt(ifelse->GetTrueBr());
+		if (Stmt* f = ifelse->GetFalseBr())
+			ProcessStmt(f);
+	}
+	// inner loops are already processed
 }
 
-void ConstantPropagation::VisitGlobal(VarDecl* vd)
+void LoopInvariantCodeMotion::ProcessLoop(Stmt* loop)
 {
-	if (vd->GetInitExpr())
-		WalkNode(vd->GetInitExpr());
+	curLoop = loop;
+	MarkLoopVars(loop);
+	bool entered = IsFirstIterationTaken(loop);
+	if (auto* whilestmt = dyn_cast<WhileStmt>(loop))
+	{
+		if (ProcessExpr(whilestmt->GetCond()))
+			Hoist(whilestmt->GetCond());
+		if (entered)
+			ProcessStmt(whilestmt->GetBody());
+	}
+	else if (auto* dowhilestmt = dyn_cast<DoWhileStmt>(loop))
+	{
+		ProcessStmt(dowhilestmt->GetBody());
+		if (ProcessExpr(dowhilestmt->GetCond()))
+			Hoist(dowhilestmt->GetCond());
+	}
+	else
+	{
+		auto* forstmt = static_cast<ForStmt*>(loop);
+		if (ProcessExpr(forstmt->GetCond()))
+			Hoist(forstmt->GetCond());
+		if (entered)
+		{
+			ProcessExpr(forstmt->GetIncr());
+			ProcessStmt(forstmt->GetBody());
+		}
+	}
+	UnmarkLoopVars();
+	curLoop = nullptr;
+}
+
+void LoopInvariantCodeMotion::FindLoops(Stmt* stmt)
+{
+	// inner loops first
+	for (ASTNode* ch = stmt->firstChild; ch; )
+	{
+		ASTNode* next = ch->next;
+		if (auto* chstmt = dyn_cast<Stmt>(ch))
+			FindLoops(chstmt);
+		ch = next;
+	}
+	if (dyn_cast<WhileStmt>(stmt) || dyn_cast<DoWhileStmt>(stmt) || dyn_cast<ForStmt>(stmt))
+		ProcessLoop(stmt);
 }
 
+void LoopInvariantCodeMotion::RunOnAST(AST& ast)
+{
+	for (ASTNode* ch = ast.functionList.firstChild; ch; ch = ch->next)
+	{
+		auto* fn = ch->ToFunction();
+		if (fn->used && fn->GetCode())
+			FindLoops(fn->GetCode());
+	}
+}
 
 void RemoveUnusedFunctions::RunOnAST(AST& ast)
 {
@@ -229,11 +4513,19 @@ void MarkUnusedVariables::PreVisit(ASTNode* node)
 	}
 	else if (auto* vds = dyn_cast<VarDeclStmt>(node))
 	{
+		// locals are declared before they are referenced
 		for (ASTNode* ch = vds->firstChild; ch; ch = ch->next)
-			ch->ToVarDecl()->used = true;
+			ch->ToVarDecl()->used = false;
 	}
 }
 
+void MarkUnusedVariables::VisitGlobal(VarDecl* vd)
+{
+	// initializers may refer to other globals
+	if (vd->GetInitExpr())
+		WalkNode(vd->GetInitExpr());
+}
+
 void MarkUnusedVariables::VisitFunction(ASTFunction* fn)
 {
 	for (ASTNode* arg = fn->GetFirstArg(); arg; arg = arg->next)
@@ -261,7 +4553,7 @@ void RemoveUnusedVariables::RunOnAST(AST& ast)
 {
 	for (ASTNode* g = ast.globalVars.firstChild; g; )
 	{
-		if (auto* cbuf = dyn_cast<CBufferDecl>(g))
+		if (dyn_cast<CBufferDecl>(g))
 		{
 			g = g->next;
 #if 0
@@ -287,3 +4579,47 @@ void RemoveUnusedVariables::RunOnAST(AST& ast)
 	VisitAST(ast);
 }
 
+void RemoveUnusedVariables::PostVisit(ASTNode* node)
+{
+	auto* vds = dyn_cast<VarDeclStmt>(node);
+	if (!vds)
+		return;
+	for (ASTNode* ch = vds->firstChild; ch; )
+	{
+		VarDecl* vd = ch->ToVarDecl();
+		ch = ch->next;
+		if (vd->used || (vd->GetInitExpr() && HasSideEffects(vd->GetInitExpr())))
+			continue;
+		vd->Unlink();
+		vd->optSlot = int(removedVars.size());
+		removedVars.push_back(vd);
+	}
+	if (vds->childCount == 0)
+	{
+		if (dyn_cast<BlockStmt>(vds->parent))
+			delete vds;
+		else
+			delete vds->ReplaceWith(new EmptyStmt);
+	}
+}
+
+void RemoveUnusedVariables::VisitFunction(ASTFunction* fn)
+{
+	curFunction = fn;
+	ASTWalker::VisitFunction(fn);
+
+	// one pass over tmpVars, it can contain the variables of all inlined functions
+	if (removedVars.empty())
+		return;
+	size_t n = 0;
+	for (VarDecl* vd : fn->tmpVars)
+	{
+		if (vd->optSlot < 0 || size_t(vd->optSlot) >= removedVars.size() || removedVars[vd->optSlot] != vd)
+			fn->tmpVars[n++] = vd;
+	}
+	fn->tmpVars.resize(n);
+	for (VarDecl* vd : removedVars)
+		delete vd;
+	removedVars.clear();
+}
+
@@ -0,0 +1,414 @@
+
+
+#include "common.hpp"
+
+
+using namespace HOC;
+
+
+static uint64_t FNV1a64(uint64_t hash, const void* data, size_t size)
+{
+	auto* p = (const uint8_t*) data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static uint64_t FNV1a64U64(uint64_t hash, uint64_t v)
+{
+	// little-endian bytes, independent of the host
+	uint8_t bytes[8];
+	for (int i = 0; i < 8; ++i)
+		bytes[i] = uint8_t(v >> (i * 8));
+	return FNV1a64(hash, bytes, 8);
+}
+
+static const uint64_t FNV1A64_BASIS = 0xcbf29ce484222325ULL;
+
+uint64_t HOC_HashPermutation(const HOC_ShaderMacro* defines)
+{
+	if (!defines || !defines->name)
+		return 0;
+	uint64_t hash = FNV1A64_BASIS;
+	for (auto* d = defines; d->name; ++d)
+	{
+		// name and value are separated/terminated by zero bytes, "A" and "A=" differ
+		hash = FNV1a64(hash, d->name, strlen(d->name) + 1);
+		if (d->value)
+			hash = FNV1a64(hash, d->value, strlen(d->value) + 1);
+		else
+			hash = FNV1a64(hash, "\xff", 1);
+	}
+	return hash;
+}
+
+uint64_t HOC_HashPackageKey(const char* name, uint8_t stage, uint8_t outputFmt, uint64_t permutationHash)
+{
+	uint64_t hash = FNV1a64(FNV1A64_BASIS, name, strlen(name) + 1);
+	uint8_t sf[2] = { stage, outputFmt };
+	hash = FNV1a64(hash, sf, 2);
+	return FNV1a64U64(hash, permutationHash);
+}
+
+
+static const uint32_t PACKAGE_HEADER_SIZE = 32;
+static const uint32_t PACKAGE_SHADER_SIZE = 84;
+static const uint32_t PACKAGE_VAR_SIZE = 20;
+static const uint32_t PACKAGE_LAYOUT_SIZE = 16;
+
+// serializes values in little-endian byte order, independent of the host
+struct PackageWriter
+{
+	Array<uint8_t> data;
+
+	void Align4()
+	{
+		while (data.size() % 4)
+			data.push_back(0);
+	}
+	uint32_t AddBytes(const void* bytes, size_t size)
+	{
+		uint32_t off = uint32_t(data.size());
+		data.append((const uint8_t*) bytes, size);
+		return off;
+	}
+	uint32_t AddString(const char* str, size_t size)
+	{
+		uint32_t off = AddBytes(str, size);
+		data.push_back(0);
+		return off;
+	}
+	void AddU32(uint32_t v)
+	{
+		for (int i = 0; i < 4; ++i)
+			data.push_back(uint8_t(v >> (i * 8)));
+	}
+	uint32_t AddU32Array(const uint32_t* arr, size_t size)
+	{
+		Align4();
+		uint32_t off = uint32_t(data.size());
+		for (size_t i = 0; i < size; ++i)
+			AddU32(arr[i]);
+		return off;
+	}
+	uint32_t AddVars(const ShaderVariable* vars, size_t count)
+	{
+		Align4();
+		uint32_t off = uint32_t(data.size());
+		for (size_t i = 0; i < count; ++i)
+		{
+			const ShaderVariable& sv = vars[i];
+			AddU32(sv.name);
+			AddU32(sv.semantic);
+			AddU32(uint32_t(sv.regSemIdx));
+			AddU32(sv.arraySize);
+			data.push_back(sv.svType);
+			data.push_back(sv.dataType);
+			data.push_back(sv.sizeX);
+			data.push_back(sv.sizeY);
+		}
+		return off;
+	}
+	uint32_t AddI32Array(const int32_t* arr, size_t size)
+	{
+		Align4();
+		uint32_t off = uint32_t(data.size());
+		for (size_t i = 0; i < size; ++i)
+			AddU32(uint32_t(arr[i]));
+		return off;
+	}
+	uint32_t AddLayouts(const ShaderVariableLayout* layouts, size_t count)
+	{
+		Align4();
+		uint32_t off = uint32_t(data.size());
+		for (size_t i = 0; i < count; ++i)
+		{
+			AddU32(layouts[i].offset);
+			AddU32(layouts[i].size);
+			AddU32(layouts[i].arrayStride);
+			AddU32(layouts[i].matrixStride);
+		}
+		return off;
+	}
+};
+
+struct HOC_PackageBuilder
+{
+	HOC_CLASS_USE_ALLOC()
+
+	// offsets in data until the package is written
+	Array<HOC_PackageShader> shaders;
+	Array<uint64_t> keyHashes;
+	PackageWriter data;
+
+	bool HasShader(uint64_t keyHash, const char* name, uint8_t stage, uint8_t outputFmt, uint64_t permutationHash) const
+	{
+		for (size_t i = 0; i < shaders.size(); ++i)
+		{
+			const auto& ps = shaders[i];
+			if (keyHashes[i] == keyHash &&
+				ps.stage == stage &&
+				ps.outputFmt == outputFmt &&
+				(ps.permutationHash[0] | (uint64_t(ps.permutationHash[1]) << 32)) == permutationHash &&
+				!strcmp((const char*) &data.data[ps.name], name))
+				return true;
+		}
+		return false;
+	}
+};
+
+HOC_PackageBuilder* HOC_CreatePackageBuilder()
+{
+	return new HOC_PackageBuilder;
+}
+
+void HOC_DestroyPackageBuilder(HOC_PackageBuilder* pb)
+{
+	delete pb;
+}
+
+HOC_BoolU8 HOC_PackageAddShader(HOC_PackageBuilder* pb,
+	const char* name, uint8_t stage, uint8_t outputFmt, uint64_t permutationHash,
+	const char* code, size_t codeSize, const HOC_InterfaceOutput* ifo)
+{
+	uint64_t keyHash = HOC_HashPackageKey(name, stage, outputFmt, permutationHash);
+	if (pb->HasShader(keyHash, name, stage, outputFmt, permutationHash))
+		return false;
+
+	HOC_PackageShader ps;
+	memset(&ps, 0, sizeof(ps));
+	ps.keyHash[0] = uint32_t(keyHash);
+	ps.keyHash[1] = uint32_t(keyHash >> 32);
+	ps.permutationHash[0] = uint32_t(permutationHash);
+	ps.permutationHash[1] = uint32_t(permutationHash >> 32);
+	ps.nameSize = uint32_t(strlen(name));
+	ps.name = pb->data.AddString(name, ps.nameSize);
+	ps.stage = stage;
+	ps.outputFmt = outputFmt;
+	ps.codeSize = uint32_t(codeSize);
+	if (outputFmt == OSF_SPIRV)
+		pb->data.Align4(); // SPIR-V words can be passed to the driver in place
+	ps.code = pb->data.AddString(code, codeSize);
+	if (ifo)
+	{
+		ps.numVars = uint32_t(ifo->outVarBufSize);
+		ps.vars = pb->data.AddVars(ifo->outVarBuf, ifo->outVarBufSize);
+		ps.varStrSize = uint32_t(ifo->outVarStrBufSize);
+		ps.varStr = pb->data.AddBytes(ifo->outVarStrBuf, ifo->outVarStrBufSize);
+		ps.preshaderSize = uint32_t(ifo->outPreshaderBufSize);
+		ps.preshader = pb->data.AddU32Array(ifo->outPreshaderBuf, ifo->outPreshaderBufSize);
+		ps.usageMaskSize = uint32_t(ifo->outUsageMaskBufSize);
+		ps.usageMask = pb->data.AddU32Array(ifo->outUsageMaskBuf, ifo->outUsageMaskBufSize);
+		ps.layoutSize = uint32_t(ifo->outLayoutBufSize);
+		ps.layout = pb->data.AddLayouts(ifo->outLayoutBuf, ifo->outLayoutBufSize);
+		ps.locationSize = uint32_t(ifo->outLocationBufSize);
+		ps.location = pb->data.AddI32Array(ifo->outLocationBuf, ifo->outLocationBufSize);
+	}
+	pb->shaders.push_back(ps);
+	pb->keyHashes.push_back(keyHash);
+	return true;
+}
+
+HOC_BoolU8 HOC_WritePackage(HOC_PackageBuilder* pb, HOC_TextOutput* out)
+{
+	uint32_t numShaders = uint32_t(pb->shaders.size());
+	uint32_t numBuckets = 1;
+	while (numBuckets < numShaders * 2)
+		numBuckets *= 2;
+
+	uint32_t bucketOffset = PACKAGE_HEADER_SIZE;
+	uint32_t shaderOffset = bucketOffset + numBuckets * 4;
+	uint32_t dataOffset = shaderOffset + numShaders * PACKAGE_SHADER_SIZE;
+	uint64_t totalSize = uint64_t(dataOffset) + pb->data.data.size();
+	if (totalSize > 0xffffffff)
+		return false;
+
+	// shaders are sorted by bucket, each bucket points to its first shader
+	Array<uint32_t> order;
+	Array<uint32_t> bucketCounts;
+	bucketCounts.resize(numBuckets + 1, 0);
+	for (uint32_t i = 0; i < numShaders; ++i)
+		bucketCounts[(pb->keyHashes[i] & (numBuckets - 1)) + 1]++;
+	for (uint32_t b = 0; b < numBuckets; ++b)
+		bucketCounts[b + 1] += bucketCounts[b];
+	Array<uint32_t> buckets;
+	buckets.resize(numBuckets, 0xffffffff);
+	for (uint32_t b = 0; b < numBuckets; ++b)
+		if (bucketCounts[b] != bucketCounts[b + 1])
+			buckets[b] = bucketCounts[b];
+	order.resize(numShaders, 0);
+	for (uint32_t i = 0; i < numShaders; ++i)
+		order[bucketCounts[pb->keyHashes[i] & (numBuckets - 1)]++] = i;
+
+	PackageWriter hdr;
+	hdr.AddU32(HOC_PACKAGE_MAGIC);
+	hdr.AddU32(HOC_PACKAGE_VERSION);
+	hdr.AddU32(uint32_t(totalSize));
+	hdr.AddU32(numShaders);
+	hdr.AddU32(numBuckets);
+	hdr.AddU32(bucketOffset);
+	hdr.AddU32(shaderOffset);
+	hdr.AddU32(0);
+	for (auto b : buckets)
+		hdr.AddU32(b);
+	for (auto i : order)
+	{
+		const auto& ps = pb->shaders[i];
+		auto Rebase = [dataOffset](uint32_t off) { return off + dataOffset; };
+		hdr.AddU32(ps.keyHash[0]);
+		hdr.AddU32(ps.keyHash[1]);
+		hdr.AddU32(ps.permutationHash[0]);
+		hdr.AddU32(ps.permutationHash[1]);
+		hdr.AddU32(Rebase(ps.name));
+		hdr.AddU32(ps.nameSize);
+		hdr.data.push_back(ps.stage);
+		hdr.data.push_back(ps.outputFmt);
+		hdr.data.push_back(0);
+		hdr.data.push_back(0);
+		hdr.AddU32(Rebase(ps.code));
+		hdr.AddU32(ps.codeSize);
+		hdr.AddU32(Rebase(ps.vars));
+		hdr.AddU32(ps.numVars);
+		hdr.AddU32(Rebase(ps.varStr));
+		hdr.AddU32(ps.varStrSize);
+		hdr.AddU32(Rebase(ps.preshader));
+		hdr.AddU32(ps.preshaderSize);
+		hdr.AddU32(Rebase(ps.usageMask));
+		hdr.AddU32(ps.usageMaskSize);
+		hdr.AddU32(Rebase(ps.layout));
+		hdr.AddU32(ps.layoutSize);
+		hdr.AddU32(Rebase(ps.location));
+		hdr.AddU32(ps.locationSize);
+	}
+	assert(hdr.data.size() == dataOffset);
+
+	out->func((const char*) hdr.data.data(), hdr.data.size(), out->userData);
+	if (pb->data.data.size())
+		out->func((const char*) pb->data.data.data(), pb->data.data.size(), out->userData);
+	return true;
+}
+
+
+static bool IsLittleEndianHost()
+{
+	uint32_t v = 1;
+	return *(const uint8_t*) &v == 1;
+}
+
+static bool IsPackageArray(const HOC_PackageHeader* pkg, uint32_t off, uint32_t count, uint32_t elemSize, uint32_t align)
+{
+	return off % align == 0 && uint64_t(off) + uint64_t(count) * elemSize <= pkg->totalSize;
+}
+
+static bool IsPackageString(const HOC_PackageHeader* pkg, uint32_t off, uint32_t size)
+{
+	return uint64_t(off) + size < pkg->totalSize && ((const char*) pkg)[off + size] == 0;
+}
+
+// all offsets must be checked once when the package is opened, lookups trust them
+static bool IsValidPackageShader(const HOC_PackageHeader* pkg, const HOC_PackageShader& ps)
+{
+	if (!IsPackageString(pkg, ps.name, ps.nameSize) ||
+		!IsPackageString(pkg, ps.code, ps.codeSize) ||
+		!IsPackageArray(pkg, ps.vars, ps.numVars, PACKAGE_VAR_SIZE, 4) ||
+		!IsPackageArray(pkg, ps.varStr, ps.varStrSize, 1, 1) ||
+		!IsPackageArray(pkg, ps.preshader, ps.preshaderSize, 4, 4) ||
+		!IsPackageArray(pkg, ps.usageMask, ps.usageMaskSize, 4, 4) ||
+		!IsPackageArray(pkg, ps.layout, ps.layoutSize, PACKAGE_LAYOUT_SIZE, 4) ||
+		!IsPackageArray(pkg, ps.location, ps.locationSize, 4, 4))
+		return false;
+	// variable names are read as zero-terminated strings from the string buffer
+	auto* varStr = (const char*) pkg + ps.varStr;
+	if (ps.varStrSize && varStr[ps.varStrSize - 1] != 0)
+		return false;
+	auto* vars = (const ShaderVariable*) ((const char*) pkg + ps.vars);
+	for (uint32_t i = 0; i < ps.numVars; ++i)
+		if (vars[i].name >= ps.varStrSize)
+			return false;
+	return true;
+}
+
+const HOC_PackageHeader* HOC_OpenPackage(const void* data, size_t size)
+{
+	static_assert(sizeof(HOC_PackageHeader) == PACKAGE_HEADER_SIZE, "package header size mismatch");
+	static_assert(sizeof(HOC_PackageShader) == PACKAGE_SHADER_SIZE, "package shader size mismatch");
+	static_assert(sizeof(ShaderVariable) == PACKAGE_VAR_SIZE, "shader variable size mismatch");
+	static_assert(sizeof(ShaderVariableLayout) == PACKAGE_LAYOUT_SIZE, "shader variable layout size mismatch");
+
+	if (!IsLittleEndianHost() || !data || uintptr_t(data) % 4 || size < PACKAGE_HEADER_SIZE)
+		return nullptr;
+	auto* pkg = (const HOC_PackageHeader*) data;
+	if (pkg->magic != HOC_PACKAGE_MAGIC ||
+		pkg->version != HOC_PACKAGE_VERSION ||
+		pkg->totalSize > size ||
+		!pkg->numBuckets ||
+		(pkg->numBuckets & (pkg->numBuckets - 1)) ||
+		pkg->bucketOffset % 4 ||
+		pkg->shaderOffset % 4 ||
+		uint64_t(pkg->bucketOffset) + uint64_t(pkg->numBuckets) * 4 > pkg->totalSize ||
+		uint64_t(pkg->shaderOffset) + uint64_t(pkg->numShaders) * PACKAGE_SHADER_SIZE > pkg->totalSize)
+		return nullptr;
+
+	auto* buckets = (const uint32_t*) ((const char*) data + pkg->bucketOffset);
+	for (uint32_t i = 0; i < pkg->numBuckets; ++i)
+		if (buckets[i] >= pkg->numShaders && buckets[i] != 0xffffffff)
+			return nullptr;
+	auto* shaders = (const HOC_PackageShader*) ((const char*) data + pkg->shaderOffset);
+	for (uint32_t i = 0; i < pkg->numShaders; ++i)
+		if (!IsValidPackageShader(pkg, shaders[i]))
+			return nullptr;
+	return pkg;
+}
+
+const HOC_PackageShader* HOC_FindPackageShader(const HOC_PackageHeader* pkg,
+	const char* name, uint8_t stage, uint8_t outputFmt, uint64_t permutationHash)
+{
+	uint64_t keyHash = HOC_HashPackageKey(name, stage, outputFmt, permutationHash);
+	uint32_t mask = pkg->numBuckets - 1;
+	uint32_t bucket = uint32_t(keyHash) & mask;
+	auto* base = (const char*) pkg;
+	uint32_t first = ((const uint32_t*) (base + pkg->bucketOffset))[bucket];
+	auto* shaders = (const HOC_PackageShader*) (base + pkg->shaderOffset);
+	for (uint32_t i = first; i < pkg->numShaders && (shaders[i].keyHash[0] & mask) == bucket; ++i)
+	{
+		const auto& ps = shaders[i];
+		if (ps.keyHash[0] == uint32_t(keyHash) &&
+			ps.keyHash[1] == uint32_t(keyHash >> 32) &&
+			ps.stage == stage &&
+			ps.outputFmt == outputFmt &&
+			ps.permutationHash[0] == uint32_t(permutationHash) &&
+			ps.permutationHash[1] == uint32_t(permutationHash >> 32) &&
+			!strcmp(base + ps.name, name))
+			return &ps;
+	}
+	return nullptr;
+}
+
+void HOC_GetPackageInterfaceOutput(const HOC_PackageHeader* pkg,
+	const HOC_PackageShader* ps, HOC_InterfaceOutput* ifo)
+{
+	auto* base = (char*) pkg;
+	ifo->outVarBuf = (ShaderVariable*) (base + ps->vars);
+	ifo->outVarBufSize = ps->numVars;
+	ifo->outVarStrBuf = base + ps->varStr;
+	ifo->outVarStrBufSize = ps->varStrSize;
+	ifo->outPreshaderBuf = (uint32_t*) (base + ps->preshader);
+	ifo->outPreshaderBufSize = ps->preshaderSize;
+	ifo->outUsageMaskBuf = (uint32_t*) (base + ps->usageMask);
+	ifo->outUsageMaskBufSize = ps->usageMaskSize;
+	ifo->outLayoutBuf = (ShaderVariableLayout*) (base + ps->layout);
+	ifo->outLayoutBufSize = ps->layoutSize;
+	ifo->outLocationBuf = (int32_t*) (base + ps->location);
+	ifo->outLocationBufSize = ps->locationSize;
+	// nothing to free
+	ifo->overflowAlloc = false;
+	ifo->didOverflowVar = false;
+	ifo->didOverflowStr = false;
+	ifo->didOverflowPreshader = false;
+	ifo->didOverflowUsageMask = false;
+	ifo->didOverflowLayout = false;
+	ifo->didOverflowLocation = false;
+}
@@ -0,0 +1,2291 @@
+
+
+#include "compiler.hpp"
+
+#include <initializer_list>
+#include <unordered_map>
+
+
+using namespace HOC;
+
+
+/* SPIR-V 1.0 binary generator
+- works on the AST after the GLSL transformations, so matrices follow the GLSL model
+  (sizeX columns of sizeY-component vectors, m[i] is a column) and mul() is the GLSL '*' operator
+- float matrices are OpTypeMatrix, other matrices (not supported by SPIR-V) are arrays of columns
+- uniform block types are separate from the ones used for values (they have explicit layout decorations,
+  bools are stored as uints), loaded values are converted to the value types
+- names are emitted for types, variables and functions, there is no other debug information */
+
+enum SpvOp
+{
+	SpvOpUndef                    = 1,
+	SpvOpName                     = 5,
+	SpvOpMemberName               = 6,
+	SpvOpExtInstImport            = 11,
+	SpvOpExtInst                  = 12,
+	SpvOpMemoryModel              = 14,
+	SpvOpEntryPoint               = 15,
+	SpvOpExecutionMode            = 16,
+	SpvOpCapability               = 17,
+	SpvOpTypeVoid                 = 19,
+	SpvOpTypeBool                 = 20,
+	SpvOpTypeInt                  = 21,
+	SpvOpTypeFloat                = 22,
+	SpvOpTypeVector               = 23,
+	SpvOpTypeMatrix               = 24,
+	SpvOpTypeImage                = 25,
+	SpvOpTypeSampledImage         = 27,
+	SpvOpTypeArray                = 28,
+	SpvOpTypeStruct               = 30,
+	SpvOpTypePointer              = 32,
+	SpvOpTypeFunction             = 33,
+	SpvOpConstantTrue             = 41,
+	SpvOpConstantFalse            = 42,
+	SpvOpConstant                 = 43,
+	SpvOpConstantComposite        = 44,
+	SpvOpConstantNull             = 46,
+	SpvOpFunction                 = 54,
+	SpvOpFunctionParameter        = 55,
+	SpvOpFunctionEnd              = 56,
+	SpvOpFunctionCall             = 57,
+	SpvOpVariable                 = 59,
+	SpvOpLoad                     = 61,
+	SpvOpStore                    = 62,
+	SpvOpAccessChain              = 65,
+	SpvOpDecorate                 = 71,
+	SpvOpMemberDecorate           = 72,
+	SpvOpVectorExtractDynamic     = 77,
+	SpvOpVectorShuffle            = 79,
+	SpvOpCompositeConstruct       = 80,
+	SpvOpCompositeExtract         = 81,
+	SpvOpCompositeInsert          = 82,
+	SpvOpTranspose                = 84,
+	SpvOpImageSampleImplicitLod   = 87,
+	SpvOpImageSampleExplicitLod   = 88,
+	SpvOpImageSampleDrefImplicitLod = 89,
+	SpvOpImageSampleDrefExplicitLod = 90,
+	SpvOpConvertFToU              = 109,
+	SpvOpConvertFToS              = 110,
+	SpvOpConvertSToF              = 111,
+	SpvOpConvertUToF              = 112,
+	SpvOpBitcast                  = 124,
+	SpvOpSNegate                  = 126,
+	SpvOpFNegate                  = 127,
+	SpvOpIAdd                     = 128,
+	SpvOpFAdd                     = 129,
+	SpvOpISub                     = 130,
+	SpvOpFSub                     = 131,
+	SpvOpIMul                     = 132,
+	SpvOpFMul                     = 133,
+	SpvOpUDiv                     = 134,
+	SpvOpSDiv                     = 135,
+	SpvOpFDiv                     = 136,
+	SpvOpUMod                     = 137,
+	SpvOpSRem                     = 138,
+	SpvOpFRem                     = 140,
+	SpvOpFMod                     = 141,
+	SpvOpVectorTimesMatrix        = 144,
+	SpvOpMatrixTimesVector        = 145,
+	SpvOpMatrixTimesMatrix        = 146,
+	SpvOpDot                      = 148,
+	SpvOpAny                      = 154,
+	SpvOpAll                      = 155,
+	SpvOpIsNan                    = 156,
+	SpvOpIsInf                    = 157,
+	SpvOpLogicalEqual             = 164,
+	SpvOpLogicalNotEqual          = 165,
+	SpvOpLogicalOr                = 166,
+	SpvOpLogicalAnd               = 167,
+	SpvOpLogicalNot               = 168,
+	SpvOpSelect                   = 169,
+	SpvOpIEqual                   = 170,
+	SpvOpINotEqual                = 171,
+	SpvOpUGreaterThan             = 172,
+	SpvOpSGreaterThan             = 173,
+	SpvOpUGreaterThanEqual        = 174,
+	SpvOpSGreaterThanEqual        = 175,
+	SpvOpULessThan                = 176,
+	SpvOpSLessThan                = 177,
+	SpvOpULessThanEqual           = 178,
+	SpvOpSLessThanEqual           = 179,
+	SpvOpFOrdEqual                = 180,
+	SpvOpFUnordNotEqual           = 183,
+	SpvOpFOrdLessThan             = 184,
+	SpvOpFOrdGreaterThan          = 186,
+	SpvOpFOrdLessThanEqual        = 188,
+	SpvOpFOrdGreaterThanEqual     = 190,
+	SpvOpShiftRightLogical        = 194,
+	SpvOpShiftRightArithmetic     = 195,
+	SpvOpShiftLeftLogical         = 196,
+	SpvOpBitwiseOr                = 197,
+	SpvOpBitwiseXor               = 198,
+	SpvOpBitwiseAnd               = 199,
+	SpvOpNot                      = 200,
+	SpvOpDPdx                     = 207,
+	SpvOpDPdy                     = 208,
+	SpvOpFwidth                   = 209,
+	SpvOpLoopMerge                = 246,
+	SpvOpSelectionMerge           = 247,
+	SpvOpLabel                    = 248,
+	SpvOpBranch                   = 249,
+	SpvOpBranchConditional        = 250,
+	SpvOpKill                     = 252,
+	SpvOpReturn                   = 253,
+	SpvOpReturnValue              = 254,
+	SpvOpUnreachable              = 255,
+};
+
+enum SpvEnum
+{
+	SpvMagicNumber                = 0x07230203,
+	SpvVersion10                  = 0x00010000,
+
+	SpvCapabilityShader           = 1,
+	SpvCapabilitySampled1D        = 43,
+
+	SpvAddressingModelLogical     = 0,
+	SpvMemoryModelGLSL450         = 1,
+
+	SpvExecutionModelVertex       = 0,
+	SpvExecutionModelFragment     = 4,
+	SpvExecutionModeOriginUpperLeft = 7,
+	SpvExecutionModeDepthReplacing  = 12,
+
+	SpvStorageClassUniformConstant = 0,
+	SpvStorageClassInput          = 1,
+	SpvStorageClassUniform        = 2,
+	SpvStorageClassOutput         = 3,
+	SpvStorageClassPrivate        = 6,
+	SpvStorageClassFunction       = 7,
+
+	SpvDecorationRelaxedPrecision = 0,
+	SpvDecorationBlock            = 2,
+	SpvDecorationColMajor         = 5,
+	SpvDecorationArrayStride      = 6,
+	SpvDecorationMatrixStride     = 7,
+	SpvDecorationBuiltIn          = 11,
+	SpvDecorationFlat             = 14,
+	SpvDecorationLocation         = 30,
+	SpvDecorationBinding          = 33,
+	SpvDecorationDescriptorSet    = 34,
+	SpvDecorationOffset           = 35,
+
+	SpvBuiltInPosition            = 0,
+	SpvBuiltInFragCoord           = 15,
+	SpvBuiltInFragDepth           = 22,
+
+	SpvDim1D                      = 0,
+	SpvDim2D                      = 1,
+	SpvDim3D                      = 2,
+	SpvDimCube                    = 3,
+
+	SpvImageOperandsBias          = 0x1,
+	SpvImageOperandsLod           = 0x2,
+	SpvImageOperandsGrad          = 0x4,
+
+	SpvSelectionControlNone       = 0,
+	SpvLoopControlNone            = 0,
+	SpvFunctionControlNone        = 0,
+};
+
+enum GLSLstd450
+{
+	GLSLstd450RoundEven   = 2,
+	GLSLstd450Trunc       = 3,
+	GLSLstd450FAbs        = 4,
+	GLSLstd450SAbs        = 5,
+	GLSLstd450FSign       = 6,
+	GLSLstd450SSign       = 7,
+	GLSLstd450Floor       = 8,
+	GLSLstd450Ceil        = 9,
+	GLSLstd450Fract       = 10,
+	GLSLstd450Radians     = 11,
+	GLSLstd450Degrees     = 12,
+	GLSLstd450Sin         = 13,
+	GLSLstd450Cos         = 14,
+	GLSLstd450Tan         = 15,
+	GLSLstd450Asin        = 16,
+	GLSLstd450Acos        = 17,
+	GLSLstd450Atan        = 18,
+	GLSLstd450Sinh        = 19,
+	GLSLstd450Cosh        = 20,
+	GLSLstd450Tanh        = 21,
+	GLSLstd450Atan2       = 25,
+	GLSLstd450Pow         = 26,
+	GLSLstd450Exp         = 27,
+	GLSLstd450Log         = 28,
+	GLSLstd450Exp2        = 29,
+	GLSLstd450Log2        = 30,
+	GLSLstd450Sqrt        = 31,
+	GLSLstd450InverseSqrt = 32,
+	GLSLstd450Determinant = 33,
+	GLSLstd450FMin        = 37,
+	GLSLstd450UMin        = 38,
+	GLSLstd450SMin        = 39,
+	GLSLstd450FMax        = 40,
+	GLSLstd450UMax        = 41,
+	GLSLstd450SMax        = 42,
+	GLSLstd450FClamp      = 43,
+	GLSLstd450UClamp      = 44,
+	GLSLstd450SClamp      = 45,
+	GLSLstd450FMix        = 46,
+	GLSLstd450Step        = 48,
+	GLSLstd450SmoothStep  = 49,
+	GLSLstd450Length      = 66,
+	GLSLstd450Distance    = 67,
+	GLSLstd450Cross       = 68,
+	GLSLstd450Normalize   = 69,
+	GLSLstd450FaceForward = 70,
+	GLSLstd450Reflect     = 71,
+	GLSLstd450Refract     = 72,
+};
+
+
+struct SPIRVGenerator
+{
+	typedef Array<uint32_t> Words;
+
+	enum BaseKind
+	{
+		BK_Bool,
+		BK_Int,
+		BK_UInt,
+		BK_Float,
+	};
+	enum ArithOp
+	{
+		AO_Add,
+		AO_Sub,
+		AO_Mul,
+		AO_Div,
+		AO_Mod,
+		AO_And,
+		AO_Or,
+		AO_Xor,
+		AO_Shl,
+		AO_Shr,
+	};
+
+	struct VarInfo
+	{
+		uint32_t id;          // pointer (0 for uniform block members)
+		uint32_t storage;
+		bool layout;          // stored with the uniform block layout types
+		uint32_t blockVar;    // uniform block members only
+		uint32_t blockMember;
+		const ASTType* type;  // type of the SPIR-V variable (built-ins may differ from the declaration)
+	};
+	struct Pointer
+	{
+		uint32_t id;
+		uint32_t storage;
+		bool layout;
+		const ASTType* type;
+	};
+	struct ScalarValue
+	{
+		uint32_t id;
+		const ASTType* type;
+	};
+	struct LoopInfo
+	{
+		uint32_t mergeLabel;
+		uint32_t continueLabel;
+		bool mergeUsed;
+	};
+	struct ShadowedVar
+	{
+		const VarDecl* vd;
+		VarInfo source;
+	};
+
+	SPIRVGenerator(const AST& a) : ast(a), types(const_cast<AST&>(a)) {}
+
+	// instruction encoding
+	uint32_t NewID() { return nextID++; }
+	static size_t BeginInst(Words& w, uint32_t op)
+	{
+		w.push_back(op);
+		return w.size() - 1;
+	}
+	static void EndInst(Words& w, size_t at)
+	{
+		w[at] |= uint32_t(w.size() - at) << 16;
+	}
+	static void Emit(Words& w, uint32_t op, std::initializer_list<uint32_t> operands)
+	{
+		size_t at = BeginInst(w, op);
+		for (uint32_t v : operands)
+			w.push_back(v);
+		EndInst(w, at);
+	}
+	static void AppendString(Words& w, const String& str)
+	{
+		// zero-terminated, padded with zeroes to a whole number of words
+		for (size_t i = 0; i <= str.size(); i += 4)
+		{
+			uint32_t word = 0;
+			for (size_t j = 0; j < 4 && i + j < str.size(); ++j)
+				word |= uint32_t(uint8_t(str[i + j])) << (j * 8);
+			w.push_back(word);
+		}
+	}
+	void EmitName(uint32_t id, const String& name)
+	{
+		if (name.empty())
+			return;
+		size_t at = BeginInst(debugNames, SpvOpName);
+		debugNames.push_back(id);
+		AppendString(debugNames, name);
+		EndInst(debugNames, at);
+	}
+	void EmitMemberName(uint32_t id, uint32_t member, const String& name)
+	{
+		size_t at = BeginInst(debugNames, SpvOpMemberName);
+		debugNames.push_back(id);
+		debugNames.push_back(member);
+		AppendString(debugNames, name);
+		EndInst(debugNames, at);
+	}
+	// function code, returns the result id
+	uint32_t Op(uint32_t op, uint32_t resultType, std::initializer_list<uint32_t> operands)
+	{
+		uint32_t id = NewID();
+		size_t at = BeginInst(fnCode, op);
+		fnCode.push_back(resultType);
+		fnCode.push_back(id);
+		for (uint32_t v : operands)
+			fnCode.push_back(v);
+		EndInst(fnCode, at);
+		return id;
+	}
+	uint32_t Op(uint32_t op, uint32_t resultType, const Words& operands)
+	{
+		uint32_t id = NewID();
+		size_t at = BeginInst(fnCode, op);
+		fnCode.push_back(resultType);
+		fnCode.push_back(id);
+		fnCode.append(operands.begin(), operands.end());
+		EndInst(fnCode, at);
+		return id;
+	}
+	uint32_t ExtInst(uint32_t inst, uint32_t resultType, std::initializer_list<uint32_t> operands)
+	{
+		Words ops;
+		ops.push_back(glslStdID);
+		ops.push_back(inst);
+		for (uint32_t v : operands)
+			ops.push_back(v);
+		return Op(SpvOpExtInst, resultType, ops);
+	}
+
+	// types and constants (emitted once, in the order of first use)
+	// key = opcode (+ result type for constants) + operands, small keys stay in the String buffer
+	static String CacheKey(uint32_t keyOp, uint32_t type, const uint32_t* operands, size_t count)
+	{
+		String key((const char*) &keyOp, sizeof(keyOp));
+		if (type)
+			key.append((const char*) &type, sizeof(type));
+		key.append((const char*) operands, count * sizeof(uint32_t));
+		return key;
+	}
+	uint32_t Cached(String&& key, uint32_t op, uint32_t type, const uint32_t* operands, size_t count)
+	{
+		auto it = cache.find(key);
+		if (it != cache.end())
+			return it->second;
+		uint32_t id = NewID();
+		size_t at = BeginInst(globals, op);
+		if (type)
+			globals.push_back(type);
+		globals.push_back(id);
+		globals.append(operands, operands + count);
+		EndInst(globals, at);
+		cache.insert(std::make_pair(std::move(key), id));
+		return id;
+	}
+	uint32_t Cached(uint32_t op, uint32_t type, const uint32_t* operands, size_t count)
+	{
+		return Cached(CacheKey(op, type, operands, count), op, type, operands, count);
+	}
+	uint32_t GetType(uint32_t op, const Words& operands)
+	{
+		return Cached(op, 0, operands.data(), operands.size());
+	}
+	uint32_t GetType(uint32_t op, std::initializer_list<uint32_t> operands)
+	{
+		return Cached(op, 0, operands.begin(), operands.size());
+	}
+	uint32_t GetConstant(uint32_t op, uint32_t type, const Words& values)
+	{
+		return Cached(op, type, values.data(), values.size());
+	}
+	uint32_t GetConstant(uint32_t op, uint32_t type, std::initializer_list<uint32_t> values)
+	{
+		return Cached(op, type, values.begin(), values.size());
+	}
+
+	uint32_t GetVoidType() { return GetType(SpvOpTypeVoid, {}); }
+	uint32_t GetBoolType() { return GetType(SpvOpTypeBool, {}); }
+	uint32_t GetIntType(bool sign) { return GetType(SpvOpTypeInt, { 32, sign ? 1u : 0u }); }
+	uint32_t GetFloatType() { return GetType(SpvOpTypeFloat, { 32 }); }
+	uint32_t GetVecType(uint32_t compType, int size)
+	{
+		return size == 1 ? compType : GetType(SpvOpTypeVector, { compType, uint32_t(size) });
+	}
+	uint32_t GetPointerType(uint32_t storage, uint32_t type)
+	{
+		return GetType(SpvOpTypePointer, { storage, type });
+	}
+	uint32_t GetArrayType(uint32_t elemType, uint32_t count, uint32_t stride)
+	{
+		uint32_t len = GetConstUInt(count);
+		if (!stride)
+			return GetType(SpvOpTypeArray, { elemType, len });
+
+		// arrays with different strides must be different types, the stride is a part of the key
+		// (in place of the result type, which types do not have)
+		uint32_t ops[2] = { elemType, len };
+		uint32_t prevID = nextID;
+		uint32_t id = Cached(CacheKey(0xffff0000u | SpvOpTypeArray, stride, ops, 2), SpvOpTypeArray, 0, ops, 2);
+		if (id >= prevID)
+			Emit(decorations, SpvOpDecorate, { id, SpvDecorationArrayStride, stride });
+		return id;
+	}
+	uint32_t GetSampledImageType(ASTType::Kind kind)
+	{
+		uint32_t dim = SpvDim2D;
+		uint32_t depth = 0;
+		switch (kind)
+		{
+		case ASTType::Sampler1DCmp: dim = SpvDim1D; depth = 1; break;
+		case ASTType::Sampler1D: dim = SpvDim1D; break;
+		case ASTType::Sampler2DCmp: dim = SpvDim2D; depth = 1; break;
+		case ASTType::Sampler2D: dim = SpvDim2D; break;
+		case ASTType::Sampler3D: dim = SpvDim3D; break;
+		case ASTType::SamplerCubeCmp: dim = SpvDimCube; depth = 1; break;
+		case ASTType::SamplerCube: dim = SpvDimCube; break;
+		default: break;
+		}
+		if (dim == SpvDim1D)
+			usesSampled1D = true;
+		uint32_t img = GetType(SpvOpTypeImage, { GetFloatType(), dim, depth, 0, 0, 1, 0 });
+		return GetType(SpvOpTypeSampledImage, { img });
+	}
+	static bool IsSpvMatrix(const ASTType* t)
+	{
+		return t->kind == ASTType::Matrix && t->subType->IsFloat() && t->sizeY > 1;
+	}
+	uint32_t GetTypeID(const ASTType* t, bool layout = false)
+	{
+		switch (t->kind)
+		{
+		case ASTType::Void:
+			return GetVoidType();
+		case ASTType::Bool:
+			return layout ? GetIntType(false) : GetBoolType();
+		case ASTType::Int32:
+			return GetIntType(true);
+		case ASTType::UInt32:
+			return GetIntType(false);
+		case ASTType::Float16:
+		case ASTType::Float32:
+			return GetFloatType();
+		case ASTType::Vector:
+			return GetVecType(GetTypeID(t->subType, layout), t->sizeX);
+		case ASTType::Matrix:
+			{
+				uint32_t colType = GetVecType(GetTypeID(t->subType, layout), t->sizeY);
+				if (IsSpvMatrix(t))
+					return GetType(SpvOpTypeMatrix, { colType, uint32_t(t->sizeX) });
+				return GetArrayType(colType, t->sizeX, layout ? 16 : 0);
+			}
+		case ASTType::Array:
+			return GetArrayType(GetTypeID(t->subType, layout), t->elementCount,
+				layout ? GetUniformTypeLayout(t, ULR_STD140, true).arrayStride : 0);
+		case ASTType::Structure:
+			return GetStructType(t->ToStructType(), layout);
+		case ASTType::Sampler1D:
+		case ASTType::Sampler2D:
+		case ASTType::Sampler3D:
+		case ASTType::SamplerCube:
+		case ASTType::Sampler1DCmp:
+		case ASTType::Sampler2DCmp:
+		case ASTType::SamplerCubeCmp:
+			return GetSampledImageType(t->kind);
+		default:
+			return GetVoidType();
+		}
+	}
+	bool HasLayoutType(const ASTType* t)
+	{
+		return GetTypeID(t, true) != GetTypeID(t, false);
+	}
+	void DecorateLayoutMembers(uint32_t structType, const Array<const AccessPointDecl*>& members)
+	{
+		uint32_t cursor = 0;
+		for (size_t i = 0; i < members.size(); ++i)
+		{
+			const ASTType* mt = members[i]->type;
+			auto tl = GetUniformTypeLayout(mt, ULR_STD140, true);
+			uint32_t offset = PlaceInUniformLayout(cursor, mt, tl, ULR_STD140);
+			cursor = EndOfUniformLayout(offset, mt, tl, ULR_STD140);
+			Emit(decorations, SpvOpMemberDecorate, { structType, uint32_t(i), SpvDecorationOffset, offset });
+			const ASTType* bt = mt;
+			while (bt->kind == ASTType::Array)
+				bt = bt->subType;
+			if (IsSpvMatrix(bt))
+			{
+				Emit(decorations, SpvOpMemberDecorate, { structType, uint32_t(i), SpvDecorationColMajor });
+				Emit(decorations, SpvOpMemberDecorate, { structType, uint32_t(i), SpvDecorationMatrixStride,
+					tl.matrixStride });
+			}
+		}
+	}
+	uint32_t EmitStructType(const String& name, const Array<const AccessPointDecl*>& members, bool layout)
+	{
+		Words memberTypes;
+		for (auto* m : members)
+			memberTypes.push_back(GetTypeID(m->type, layout));
+		uint32_t id = NewID();
+		size_t at = BeginInst(globals, SpvOpTypeStruct);
+		globals.push_back(id);
+		globals.append(memberTypes.begin(), memberTypes.end());
+		EndInst(globals, at);
+		EmitName(id, name);
+		for (size_t i = 0; i < members.size(); ++i)
+			EmitMemberName(id, uint32_t(i), members[i]->name);
+		if (layout)
+			DecorateLayoutMembers(id, members);
+		return id;
+	}
+	uint32_t GetStructType(const ASTStructType* st, bool layout)
+	{
+		auto it = structTypes[layout].find(st);
+		if (it != structTypes[layout].end())
+			return it->second;
+		Array<const AccessPointDecl*> members;
+		for (const auto& m : st->members)
+			members.push_back(&m);
+		uint32_t id = EmitStructType(st->name, members, layout);
+		structTypes[layout].insert(std::make_pair(st, id));
+		return id;
+	}
+
+	uint32_t GetConstBool(bool v)
+	{
+		return GetConstant(v ? SpvOpConstantTrue : SpvOpConstantFalse, GetBoolType(), {});
+	}
+	uint32_t GetConstInt(int32_t v) { return GetConstant(SpvOpConstant, GetIntType(true), { uint32_t(v) }); }
+	uint32_t GetConstUInt(uint32_t v) { return GetConstant(SpvOpConstant, GetIntType(false), { v }); }
+	uint32_t GetConstFloat(float v)
+	{
+		uint32_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		return GetConstant(SpvOpConstant, GetFloatType(), { bits });
+	}
+	uint32_t GetConstNull(uint32_t type) { return GetConstant(SpvOpConstantNull, type, {}); }
+	// scalar constant of the base type of t
+	uint32_t GetScalarConst(const ASTType* t, double v)
+	{
+		switch (GetBaseKind(t))
+		{
+		case BK_Bool: return GetConstBool(v != 0);
+		case BK_Int: return GetConstInt(int32_t(v));
+		case BK_UInt: return GetConstUInt(uint32_t(int64_t(v)));
+		default: return GetConstFloat(float(v));
+		}
+	}
+	// constant of type t with all components set to the scalar constant
+	uint32_t SplatConst(uint32_t scalar, const ASTType* t)
+	{
+		switch (t->kind)
+		{
+		case ASTType::Vector:
+			if (t->sizeX > 1)
+			{
+				Words comps;
+				comps.resize(t->sizeX, scalar);
+				return GetConstant(SpvOpConstantComposite, GetTypeID(t), comps);
+			}
+			return scalar;
+		case ASTType::Matrix:
+			{
+				uint32_t col = SplatConst(scalar, GetColumnType(t));
+				Words cols;
+				cols.resize(t->sizeX, col);
+				return GetConstant(SpvOpConstantComposite, GetTypeID(t), cols);
+			}
+		default:
+			return scalar;
+		}
+	}
+
+	// AST type helpers
+	static const ASTType* GetBaseType(const ASTType* t)
+	{
+		return t->kind == ASTType::Vector || t->kind == ASTType::Matrix ? t->subType : t;
+	}
+	static BaseKind GetBaseKind(const ASTType* t)
+	{
+		switch (GetBaseType(t)->kind)
+		{
+		case ASTType::Bool: return BK_Bool;
+		case ASTType::Int32: return BK_Int;
+		case ASTType::UInt32: return BK_UInt;
+		default: return BK_Float;
+		}
+	}
+	static bool IsScalarLike(const ASTType* t)
+	{
+		return t->IsNumeric() || (t->kind == ASTType::Vector && t->sizeX == 1) ||
+			(t->kind == ASTType::Matrix && t->sizeX * t->sizeY == 1);
+	}
+	ASTType* GetKindType(BaseKind bk)
+	{
+		switch (bk)
+		{
+		case BK_Bool: return types.GetBoolType();
+		case BK_Int: return types.GetInt32Type();
+		case BK_UInt: return types.GetUInt32Type();
+		default: return types.GetFloat32Type();
+		}
+	}
+	// same shape, different component type
+	const ASTType* WithBase(const ASTType* t, BaseKind bk)
+	{
+		ASTType* base = GetKindType(bk);
+		switch (t->kind)
+		{
+		case ASTType::Vector: return types.GetVectorType(base, t->sizeX);
+		case ASTType::Matrix: return types.GetMatrixType(base, t->sizeX, t->sizeY);
+		default: return base;
+		}
+	}
+	const ASTType* GetColumnType(const ASTType* t)
+	{
+		return types.GetVectorType(t->subType, t->sizeY);
+	}
+	const ASTType* GetElementType(const ASTType* t)
+	{
+		switch (t->kind)
+		{
+		case ASTType::Vector: return t->subType;
+		case ASTType::Matrix: return GetColumnType(t);
+		case ASTType::Array: return t->subType;
+		default: return t;
+		}
+	}
+
+	// value helpers
+	uint32_t Extract(uint32_t val, const ASTType* compType, uint32_t idx)
+	{
+		return Op(SpvOpCompositeExtract, GetTypeID(compType), { val, idx });
+	}
+	uint32_t Construct(const ASTType* t, const Words& comps)
+	{
+		return Op(SpvOpCompositeConstruct, GetTypeID(t), comps);
+	}
+	uint32_t Splat(uint32_t scalar, const ASTType* t)
+	{
+		switch (t->kind)
+		{
+		case ASTType::Vector:
+			if (t->sizeX > 1)
+			{
+				Words comps;
+				comps.resize(t->sizeX, scalar);
+				return Construct(t, comps);
+			}
+			return scalar;
+		case ASTType::Matrix:
+			{
+				uint32_t col = Splat(scalar, GetColumnType(t));
+				Words cols;
+				cols.resize(t->sizeX, col);
+				return Construct(t, cols);
+			}
+		default:
+			return scalar;
+		}
+	}
+	// scalar or vector types of the same size
+	uint32_t ConvertBase(uint32_t val, const ASTType* from, const ASTType* to)
+	{
+		BaseKind fk = GetBaseKind(from);
+		BaseKind tk = GetBaseKind(to);
+		if (fk == tk)
+			return val;
+		uint32_t rt = GetTypeID(to);
+		if (tk == BK_Bool)
+		{
+			uint32_t zero = SplatConst(GetScalarConst(from, 0), from);
+			return Op(fk == BK_Float ? SpvOpFUnordNotEqual : SpvOpINotEqual, rt, { val, zero });
+		}
+		if (fk == BK_Bool)
+		{
+			return Op(SpvOpSelect, rt, { val,
+				SplatConst(GetScalarConst(to, 1), to), SplatConst(GetScalarConst(to, 0), to) });
+		}
+		if (fk == BK_Float)
+			return Op(tk == BK_Int ? SpvOpConvertFToS : SpvOpConvertFToU, rt, { val });
+		if (tk == BK_Float)
+			return Op(fk == BK_Int ? SpvOpConvertSToF : SpvOpConvertUToF, rt, { val });
+		return Op(SpvOpBitcast, rt, { val });
+	}
+	uint32_t TruncateVector(uint32_t val, const ASTType* from, int size)
+	{
+		const ASTType* rt = types.GetVectorType(from->subType, size);
+		if (size == 1)
+			return Extract(val, from->subType, 0);
+		Words ops;
+		ops.push_back(val);
+		ops.push_back(val);
+		for (int i = 0; i < size; ++i)
+			ops.push_back(uint32_t(i));
+		return Op(SpvOpVectorShuffle, GetTypeID(rt), ops);
+	}
+	void Flatten(uint32_t val, const ASTType* t, Array<ScalarValue>& out)
+	{
+		switch (t->kind)
+		{
+		case ASTType::Vector:
+			if (t->sizeX == 1)
+			{
+				out.push_back({ val, t->subType });
+				break;
+			}
+			for (uint32_t i = 0; i < t->sizeX; ++i)
+				out.push_back({ Extract(val, t->subType, i), t->subType });
+			break;
+		case ASTType::Matrix:
+		case ASTType::Array:
+			{
+				const ASTType* et = GetElementType(t);
+				uint32_t count = t->kind == ASTType::Array ? t->elementCount : t->sizeX;
+				for (uint32_t i = 0; i < count; ++i)
+					Flatten(Extract(val, et, i), et, out);
+			}
+			break;
+		case ASTType::Structure:
+			{
+				const auto& members = t->ToStructType()->members;
+				for (size_t i = 0; i < members.size(); ++i)
+					Flatten(Extract(val, members[i].type, uint32_t(i)), members[i].type, out);
+			}
+			break;
+		default:
+			out.push_back({ val, t });
+			break;
+		}
+	}
+	// rebuilds a value from scalars (in column order), missing ones are zero
+	uint32_t Build(const Array<ScalarValue>& comps, size_t& at, const ASTType* t)
+	{
+		Words parts;
+		switch (t->kind)
+		{
+		case ASTType::Vector:
+			if (t->sizeX == 1)
+				return Build(comps, at, t->subType);
+			for (uint32_t i = 0; i < t->sizeX; ++i)
+				parts.push_back(Build(comps, at, t->subType));
+			return Construct(t, parts);
+		case ASTType::Matrix:
+		case ASTType::Array:
+			{
+				const ASTType* et = GetElementType(t);
+				uint32_t count = t->kind == ASTType::Array ? t->elementCount : t->sizeX;
+				for (uint32_t i = 0; i < count; ++i)
+					parts.push_back(Build(comps, at, et));
+			}
+			return Construct(t, parts);
+		case ASTType::Structure:
+			for (const auto& m : t->ToStructType()->members)
+				parts.push_back(Build(comps, at, m.type));
+			return Construct(t, parts);
+		default:
+			if (at < comps.size())
+			{
+				const ScalarValue& sv = comps[at++];
+				return ConvertBase(sv.id, sv.type, t);
+			}
+			return GetScalarConst(t, 0);
+		}
+	}
+	uint32_t Convert(uint32_t val, const ASTType* from, const ASTType* to)
+	{
+		if (from == to || GetTypeID(from) == GetTypeID(to))
+			return val;
+		if (!from->IsNumericBased() || !to->IsNumericBased())
+		{
+			if (from->kind == ASTType::Array && to->kind == ASTType::Array &&
+				from->elementCount == to->elementCount)
+			{
+				Words elems;
+				for (uint32_t i = 0; i < from->elementCount; ++i)
+					elems.push_back(Convert(Extract(val, from->subType, i), from->subType, to->subType));
+				return Construct(to, elems);
+			}
+			return val; // structures are converted member by member in the AST
+		}
+		if (IsScalarLike(from))
+		{
+			if (from->kind == ASTType::Matrix)
+			{
+				val = Extract(val, GetColumnType(from), 0);
+				from = GetColumnType(from);
+			}
+			return Splat(ConvertBase(val, GetBaseType(from), GetBaseType(to)), to);
+		}
+		if (IsScalarLike(to))
+		{
+			const ASTType* base = GetBaseType(from);
+			val = from->kind == ASTType::Matrix
+				? Op(SpvOpCompositeExtract, GetTypeID(base), { val, 0, 0 })
+				: Extract(val, base, 0);
+			val = ConvertBase(val, base, GetBaseType(to));
+			return to->kind == ASTType::Matrix ? Splat(val, to) : val;
+		}
+		if (from->kind == ASTType::Vector && to->kind == ASTType::Vector && to->sizeX <= from->sizeX)
+		{
+			if (to->sizeX < from->sizeX)
+				val = TruncateVector(val, from, to->sizeX);
+			return ConvertBase(val, types.GetVectorType(from->subType, to->sizeX), to);
+		}
+		if (from->kind == ASTType::Matrix && to->kind == ASTType::Matrix &&
+			to->sizeX <= from->sizeX && to->sizeY <= from->sizeY)
+		{
+			// upper left part, column by column
+			Words cols;
+			const ASTType* fromCol = GetColumnType(from);
+			const ASTType* toCol = GetColumnType(to);
+			for (uint32_t i = 0; i < to->sizeX; ++i)
+				cols.push_back(Convert(Extract(val, fromCol, i), fromCol, toCol));
+			return Construct(to, cols);
+		}
+		Array<ScalarValue> comps;
+		Flatten(val, from, comps);
+		size_t at = 0;
+		return Build(comps, at, to);
+	}
+	uint32_t FromLayout(uint32_t val, const ASTType* t)
+	{
+		if (!HasLayoutType(t))
+			return val;
+		Words parts;
+		switch (t->kind)
+		{
+		case ASTType::Bool:
+			return Op(SpvOpINotEqual, GetTypeID(t), { val, GetConstUInt(0) });
+		case ASTType::Vector:
+			return Op(SpvOpINotEqual, GetTypeID(t), { val,
+				SplatConst(GetConstUInt(0), types.GetVectorType(types.GetUInt32Type(), t->sizeX)) });
+		case ASTType::Matrix:
+		case ASTType::Array:
+			{
+				const ASTType* et = GetElementType(t);
+				uint32_t count = t->kind == ASTType::Array ? t->elementCount : t->sizeX;
+				for (uint32_t i = 0; i < count; ++i)
+					parts.push_back(FromLayout(Op(SpvOpCompositeExtract, GetTypeID(et, true), { val, i }), et));
+			}
+			return Construct(t, parts);
+		case ASTType::Structure:
+			{
+				const auto& members = t->ToStructType()->members;
+				for (size_t i = 0; i < members.size(); ++i)
+				{
+					parts.push_back(FromLayout(Op(SpvOpCompositeExtract, GetTypeID(members[i].type, true),
+						{ val, uint32_t(i) }), members[i].type));
+				}
+			}
+			return Construct(t, parts);
+		default:
+			return val;
+		}
+	}
+
+	// variables
+	bool HasRelaxedPrecision(const VarDecl* vd)
+	{
+		if (vd->precision != VarDecl::Prec_Default)
+			return true;
+		const ASTType* t = vd->GetType();
+		while (t->kind == ASTType::Array)
+			t = t->subType;
+		return ast.nativeHalf && t->IsFloat16Based();
+	}
+	uint32_t EmitGlobalVar(const VarDecl* vd, uint32_t storage, const ASTType* t, bool layout = false)
+	{
+		uint32_t id = NewID();
+		uint32_t ptrType = GetPointerType(storage, GetTypeID(t, layout));
+		if (storage == SpvStorageClassPrivate)
+			Emit(globals, SpvOpVariable, { ptrType, id, storage, GetConstNull(GetTypeID(t)) });
+		else
+			Emit(globals, SpvOpVariable, { ptrType, id, storage });
+		if (vd)
+		{
+			EmitName(id, vd->name);
+			if (HasRelaxedPrecision(vd))
+				Emit(decorations, SpvOpDecorate, { id, SpvDecorationRelaxedPrecision });
+		}
+		return id;
+	}
+	uint32_t EmitLocalVar(const VarDecl* vd, const ASTType* t)
+	{
+		uint32_t id = NewID();
+		Emit(fnVars, SpvOpVariable, { GetPointerType(SpvStorageClassFunction, GetTypeID(t)), id,
+			SpvStorageClassFunction });
+		if (vd)
+		{
+			EmitName(id, vd->name);
+			if (HasRelaxedPrecision(vd))
+				Emit(decorations, SpvOpDecorate, { id, SpvDecorationRelaxedPrecision });
+		}
+		return id;
+	}
+	const VarInfo& GetVar(const VarDecl* vd)
+	{
+		auto it = vars.find(vd);
+		if (it != vars.end())
+			return it->second;
+		// temporaries without a declaration statement
+		VarInfo vi = { 0, SpvStorageClassFunction, false, 0, 0, vd->GetType() };
+		if (curFunc)
+			vi.id = EmitLocalVar(vd, vd->GetType());
+		else
+		{
+			vi.storage = SpvStorageClassPrivate;
+			vi.id = EmitGlobalVar(vd, SpvStorageClassPrivate, vd->GetType());
+		}
+		return vars.insert(std::make_pair(vd, vi)).first->second;
+	}
+	void DeclareBlock(const CBufferDecl* cbuf)
+	{
+		Array<const AccessPointDecl*> members;
+		for (const ASTNode* ch = cbuf->firstChild; ch; ch = ch->next)
+			members.push_back(ch->ToVarDecl());
+		if (members.empty())
+			return;
+
+		uint32_t structType = EmitStructType(cbuf->name, members, true);
+		Emit(decorations, SpvOpDecorate, { structType, SpvDecorationBlock });
+		uint32_t id = NewID();
+		Emit(globals, SpvOpVariable, { GetPointerType(SpvStorageClassUniform, structType), id,
+			SpvStorageClassUniform });
+		EmitName(id, cbuf->name);
+		Emit(decorations, SpvOpDecorate, { id, SpvDecorationDescriptorSet, 0 });
+		if (cbuf->bufRegID >= 0)
+			Emit(decorations, SpvOpDecorate, { id, SpvDecorationBinding, uint32_t(cbuf->bufRegID) });
+
+		uint32_t idx = 0;
+		for (const ASTNode* ch = cbuf->firstChild; ch; ch = ch->next, ++idx)
+		{
+			const VarDecl* vd = ch->ToVarDecl();
+			VarInfo vi = { 0, SpvStorageClassUniform, true, id, idx, vd->GetType() };
+			AddReadOnlyVar(vd, vi);
+		}
+	}
+	void AddReadOnlyVar(const VarDecl* vd, const VarInfo& vi)
+	{
+		if (writtenReadOnlyVars.find(vd) == writtenReadOnlyVars.end())
+		{
+			vars.insert(std::make_pair(vd, vi));
+			return;
+		}
+		// HLSL allows modifying uniforms and inputs, such shaders use a private copy
+		VarInfo shadow = { EmitGlobalVar(vd, SpvStorageClassPrivate, vd->GetType()), SpvStorageClassPrivate,
+			false, 0, 0, vd->GetType() };
+		vars.insert(std::make_pair(vd, shadow));
+		shadowedVars.push_back({ vd, vi });
+	}
+	void DeclareStageIO(const VarDecl* vd)
+	{
+		uint32_t storage = (vd->flags & VarDecl::ATTR_In) ? SpvStorageClassInput : SpvStorageClassOutput;
+		const ASTType* t = vd->GetType();
+		uint32_t builtIn = 0xffffffff;
+		if (vd->flags & VarDecl::ATTR_Hidden)
+		{
+			if (vd->name == "gl_Position")
+			{
+				builtIn = SpvBuiltInPosition;
+				t = types.GetFloat32VecType(4);
+			}
+			else if (vd->name == "gl_FragCoord")
+			{
+				builtIn = SpvBuiltInFragCoord;
+				t = types.GetFloat32VecType(4);
+			}
+			else if (vd->name == "gl_FragDepth")
+			{
+				builtIn = SpvBuiltInFragDepth;
+				t = types.GetFloat32Type();
+				writesDepth = true;
+			}
+		}
+
+		uint32_t id = EmitGlobalVar(vd, storage, t);
+		if (builtIn != 0xffffffff)
+			Emit(decorations, SpvOpDecorate, { id, SpvDecorationBuiltIn, builtIn });
+		else if (vd->regID >= 0)
+			Emit(decorations, SpvOpDecorate, { id, SpvDecorationLocation, uint32_t(vd->regID) });
+		const ASTType* bt = t;
+		while (bt->kind == ASTType::Array)
+			bt = bt->subType;
+		if (storage == SpvStorageClassInput && ast.stage == ShaderStage_Pixel && bt->IsIntBased())
+			Emit(decorations, SpvOpDecorate, { id, SpvDecorationFlat });
+		interfaceVars.push_back(id);
+		AddReadOnlyVar(vd, VarInfo{ id, storage, false, 0, 0, t });
+	}
+	void DeclareGlobals()
+	{
+		for (const ASTNode* g = ast.globalVars.firstChild; g; g = g->next)
+		{
+			if (auto* cbuf = dyn_cast<const CBufferDecl>(g))
+			{
+				DeclareBlock(cbuf);
+				continue;
+			}
+			const VarDecl* vd = g->ToVarDecl();
+			const ASTType* t = vd->GetType();
+			const ASTType* bt = t;
+			while (bt->kind == ASTType::Array)
+				bt = bt->subType;
+			if (bt->IsSampler())
+			{
+				uint32_t id = EmitGlobalVar(vd, SpvStorageClassUniformConstant, t);
+				Emit(decorations, SpvOpDecorate, { id, SpvDecorationDescriptorSet, 1 });
+				if (vd->regID >= 0)
+					Emit(decorations, SpvOpDecorate, { id, SpvDecorationBinding, uint32_t(vd->regID) });
+				vars.insert(std::make_pair(vd, VarInfo{ id, SpvStorageClassUniformConstant, false, 0, 0, t }));
+			}
+			else if ((vd->flags & VarDecl::ATTR_StageIO) && (vd->flags & (VarDecl::ATTR_In | VarDecl::ATTR_Out)))
+			{
+				DeclareStageIO(vd);
+			}
+			else
+			{
+				// static variables (uniforms are in blocks at this point)
+				uint32_t id = EmitGlobalVar(vd, SpvStorageClassPrivate, t);
+				vars.insert(std::make_pair(vd, VarInfo{ id, SpvStorageClassPrivate, false, 0, 0, t }));
+				if (vd->GetInitExpr())
+					privateInits.push_back(vd);
+			}
+		}
+	}
+	void MarkWritten(const Expr* e)
+	{
+		while (auto* sve = dyn_cast<const SubValExpr>(e))
+			e = sve->GetSource();
+		if (auto* dre = dyn_cast<const DeclRefExpr>(e))
+		{
+			const VarDecl* vd = dre->decl;
+			if (vd && (((vd->flags & VarDecl::ATTR_Uniform) && !vd->GetType()->IsSampler()) ||
+				(vd->flags & (VarDecl::ATTR_StageIO | VarDecl::ATTR_In)) == (VarDecl::ATTR_StageIO | VarDecl::ATTR_In)))
+				writtenReadOnlyVars.insert(std::make_pair(vd, true));
+		}
+	}
+	// finds uniforms and inputs that are modified
+	void ScanNode(const ASTNode* node)
+	{
+		if (auto* binop = dyn_cast<const BinaryOpExpr>(node))
+		{
+			if (TokenIsOpAssign(binop->opType))
+				MarkWritten(binop->GetLft());
+		}
+		else if (auto* idop = dyn_cast<const IncDecOpExpr>(node))
+		{
+			MarkWritten(idop->GetSource());
+		}
+		else if (auto* op = dyn_cast<const OpExpr>(node))
+		{
+			if (op->opKind == Op_FCall)
+			{
+				const ASTNode* param = op->resolvedFunc->GetFirstArg();
+				for (const ASTNode* arg = op->GetFirstArg(); arg && param; arg = arg->next, param = param->next)
+					if (param->ToVarDecl()->flags & VarDecl::ATTR_Out)
+						MarkWritten(arg->ToExpr());
+			}
+		}
+		for (const ASTNode* ch = node->firstChild; ch; ch = ch->next)
+			ScanNode(ch);
+	}
+
+	// pointers (access chains) for variables and parts of them
+	bool IsAddressable(const Expr* e)
+	{
+		if (auto* dre = dyn_cast<const DeclRefExpr>(e))
+			return dre->decl != nullptr;
+		if (auto* mbe = dyn_cast<const MemberExpr>(e))
+		{
+			if (!mbe->swizzleComp)
+				return IsAddressable(mbe->GetSource());
+			if (mbe->swizzleComp != 1)
+				return false;
+			const ASTType* st = mbe->GetSource()->GetReturnType();
+			return (st->kind == ASTType::Vector && st->sizeX > 1 ? true : (mbe->memberID & 3) == 0) &&
+				IsAddressable(mbe->GetSource());
+		}
+		if (auto* ie = dyn_cast<const IndexExpr>(e))
+			return IsAddressable(ie->GetSource());
+		return false;
+	}
+	Pointer BuildChain(const Expr* e, Words& chain)
+	{
+		if (auto* dre = dyn_cast<const DeclRefExpr>(e))
+		{
+			const VarInfo& vi = GetVar(dre->decl);
+			if (vi.blockVar)
+			{
+				chain.push_back(GetConstInt(int32_t(vi.blockMember)));
+				return { vi.blockVar, vi.storage, vi.layout, vi.type };
+			}
+			return { vi.id, vi.storage, vi.layout, vi.type };
+		}
+		if (auto* mbe = dyn_cast<const MemberExpr>(e))
+		{
+			Pointer p = BuildChain(mbe->GetSource(), chain);
+			const ASTType* st = mbe->GetSource()->GetReturnType();
+			if (!mbe->swizzleComp)
+				chain.push_back(GetConstInt(int32_t(mbe->memberID)));
+			else if (st->kind == ASTType::Vector && st->sizeX > 1)
+				chain.push_back(GetConstInt(int32_t(mbe->memberID & 3)));
+			return p;
+		}
+		auto* ie = static_cast<const IndexExpr*>(e);
+		Pointer p = BuildChain(ie->GetSource(), chain);
+		const ASTType* st = ie->GetSource()->GetReturnType();
+		if (!(st->kind == ASTType::Vector && st->sizeX == 1))
+			chain.push_back(EvalIndex(ie->GetIndex()));
+		return p;
+	}
+	Pointer GetPointer(const Expr* e)
+	{
+		Words chain;
+		Pointer p = BuildChain(e, chain);
+		if (chain.empty())
+			return p;
+		Words ops;
+		ops.push_back(p.id);
+		ops.append(chain.begin(), chain.end());
+		uint32_t ptrType = GetPointerType(p.storage, GetTypeID(e->GetReturnType(), p.layout));
+		return { Op(SpvOpAccessChain, ptrType, ops), p.storage, p.layout, e->GetReturnType() };
+	}
+	uint32_t Load(const Pointer& p)
+	{
+		uint32_t val = Op(SpvOpLoad, GetTypeID(p.type, p.layout), { p.id });
+		return p.layout ? FromLayout(val, p.type) : val;
+	}
+	void Store(uint32_t ptr, uint32_t val)
+	{
+		Emit(fnCode, SpvOpStore, { ptr, val });
+	}
+	// val has the type of the expression
+	void StoreTo(const Expr* lhs, uint32_t val)
+	{
+		if (IsAddressable(lhs))
+		{
+			Pointer p = GetPointer(lhs);
+			Store(p.id, Convert(val, lhs->GetReturnType(), p.type));
+			return;
+		}
+		if (auto* mbe = dyn_cast<const MemberExpr>(lhs))
+		{
+			if (mbe->swizzleComp)
+			{
+				const Expr* src = mbe->GetSource();
+				const ASTType* st = src->GetReturnType();
+				if (st->kind != ASTType::Vector || st->sizeX == 1)
+				{
+					StoreTo(src, Convert(val, lhs->GetReturnType(), st));
+					return;
+				}
+				uint32_t cur = Eval(src);
+				uint32_t merged;
+				if (mbe->swizzleComp == 1)
+				{
+					merged = Op(SpvOpCompositeInsert, GetTypeID(st), { val, cur, mbe->memberID & 3 });
+				}
+				else
+				{
+					uint32_t comps[4] = { 0, 1, 2, 3 };
+					for (int i = 0; i < mbe->swizzleComp; ++i)
+						comps[(mbe->memberID >> (i * 2)) & 3] = st->sizeX + i;
+					Words ops;
+					ops.push_back(cur);
+					ops.push_back(val);
+					for (uint32_t i = 0; i < st->sizeX; ++i)
+						ops.push_back(comps[i]);
+					merged = Op(SpvOpVectorShuffle, GetTypeID(st), ops);
+				}
+				StoreTo(src, merged);
+				return;
+			}
+		}
+		// not an l-value (rejected by the parser)
+	}
+
+	// expressions
+	uint32_t EvalIndex(const Expr* e)
+	{
+		if (auto* i32e = dyn_cast<const Int32Expr>(e))
+			return GetConstInt(i32e->value);
+		return Convert(Eval(e), e->GetReturnType(), types.GetInt32Type());
+	}
+	uint32_t EvalAs(const Expr* e, const ASTType* t)
+	{
+		return Convert(Eval(e), e->GetReturnType(), t);
+	}
+	uint32_t EvalConst(const Expr* e, double v)
+	{
+		return SplatConst(GetScalarConst(e->GetReturnType(), v), e->GetReturnType());
+	}
+	uint32_t EvalSubValue(const Expr* e)
+	{
+		if (auto* mbe = dyn_cast<const MemberExpr>(e))
+		{
+			const Expr* src = mbe->GetSource();
+			const ASTType* st = src->GetReturnType();
+			uint32_t sv = Eval(src);
+			if (!mbe->swizzleComp)
+				return Extract(sv, mbe->GetReturnType(), mbe->memberID);
+			if (st->kind != ASTType::Vector || st->sizeX == 1)
+				return Splat(sv, mbe->GetReturnType());
+			if (mbe->swizzleComp == 1)
+				return Extract(sv, st->subType, mbe->memberID & 3);
+			Words ops;
+			ops.push_back(sv);
+			ops.push_back(sv);
+			for (int i = 0; i < mbe->swizzleComp; ++i)
+				ops.push_back((mbe->memberID >> (i * 2)) & 3);
+			return Op(SpvOpVectorShuffle, GetTypeID(mbe->GetReturnType()), ops);
+		}
+		auto* ie = static_cast<const IndexExpr*>(e);
+		const Expr* src = ie->GetSource();
+		const ASTType* st = src->GetReturnType();
+		uint32_t sv = Eval(src);
+		if (st->kind == ASTType::Vector && st->sizeX == 1)
+			return sv;
+		if (auto* i32e = dyn_cast<const Int32Expr>(ie->GetIndex()))
+			return Extract(sv, ie->GetReturnType(), uint32_t(i32e->value));
+		uint32_t idx = EvalIndex(ie->GetIndex());
+		if (st->kind == ASTType::Vector)
+			return Op(SpvOpVectorExtractDynamic, GetTypeID(ie->GetReturnType()), { sv, idx });
+		// dynamic indexing of values requires a variable
+		uint32_t tmp = EmitLocalVar(nullptr, st);
+		Store(tmp, sv);
+		uint32_t ptr = Op(SpvOpAccessChain,
+			GetPointerType(SpvStorageClassFunction, GetTypeID(ie->GetReturnType())), { tmp, idx });
+		return Op(SpvOpLoad, GetTypeID(ie->GetReturnType()), { ptr });
+	}
+	uint32_t EvalInitList(const InitListExpr* ile)
+	{
+		const ASTType* t = ile->GetReturnType();
+		if (t->kind == ASTType::Vector && t->sizeX > 1)
+		{
+			// vectors can be constructed from scalars and vectors directly
+			Words parts;
+			uint32_t numComps = 0;
+			bool direct = true;
+			for (const ASTNode* ch = ile->firstChild; ch; ch = ch->next)
+			{
+				const ASTType* ct = ch->ToExpr()->GetReturnType();
+				if (!ct->IsNumeric() && ct->kind != ASTType::Vector)
+				{
+					direct = false;
+					break;
+				}
+				numComps += ct->kind == ASTType::Vector ? ct->sizeX : 1;
+			}
+			if (direct && numComps == t->sizeX)
+			{
+				for (const ASTNode* ch = ile->firstChild; ch; ch = ch->next)
+				{
+					const ASTType* ct = ch->ToExpr()->GetReturnType();
+					parts.push_back(ConvertBase(Eval(ch->ToExpr()), ct, WithBase(ct, GetBaseKind(t))));
+				}
+				return Construct(t, parts);
+			}
+		}
+		Array<ScalarValue> comps;
+		for (const ASTNode* ch = ile->firstChild; ch; ch = ch->next)
+			Flatten(Eval(ch->ToExpr()), ch->ToExpr()->GetReturnType(), comps);
+		size_t at = 0;
+		return Build(comps, at, t);
+	}
+	uint32_t Arith(ArithOp aop, uint32_t a, uint32_t b, const ASTType* t)
+	{
+		if (t->kind == ASTType::Matrix)
+		{
+			const ASTType* ct = GetColumnType(t);
+			Words cols;
+			for (uint32_t i = 0; i < t->sizeX; ++i)
+				cols.push_back(Arith(aop, Extract(a, ct, i), Extract(b, ct, i), ct));
+			return Construct(t, cols);
+		}
+		BaseKind bk = GetBaseKind(t);
+		if (bk == BK_Bool)
+		{
+			switch (aop)
+			{
+			case AO_And: return Op(SpvOpLogicalAnd, GetTypeID(t), { a, b });
+			case AO_Or: return Op(SpvOpLogicalOr, GetTypeID(t), { a, b });
+			case AO_Xor: return Op(SpvOpLogicalNotEqual, GetTypeID(t), { a, b });
+			default:
+				{
+					const ASTType* it = WithBase(t, BK_Int);
+					uint32_t r = Arith(aop, ConvertBase(a, t, it), ConvertBase(b, t, it), it);
+					return ConvertBase(r, it, t);
+				}
+			}
+		}
+		uint32_t op = 0;
+		bool flt = bk == BK_Float;
+		switch (aop)
+		{
+		case AO_Add: op = flt ? SpvOpFAdd : SpvOpIAdd; break;
+		case AO_Sub: op = flt ? SpvOpFSub : SpvOpISub; break;
+		case AO_Mul: op = flt ? SpvOpFMul : SpvOpIMul; break;
+		case AO_Div: op = flt ? SpvOpFDiv : bk == BK_Int ? SpvOpSDiv : SpvOpUDiv; break;
+		// HLSL '%' and fmod() keep the sign of the dividend
+		case AO_Mod: op = flt ? SpvOpFRem : bk == BK_Int ? SpvOpSRem : SpvOpUMod; break;
+		case AO_And: op = SpvOpBitwiseAnd; break;
+		case AO_Or: op = SpvOpBitwiseOr; break;
+		case AO_Xor: op = SpvOpBitwiseXor; break;
+		case AO_Shl: op = SpvOpShiftLeftLogical; break;
+		case AO_Shr: op = bk == BK_Int ? SpvOpShiftRightArithmetic : SpvOpShiftRightLogical; break;
+		}
+		return Op(op, GetTypeID(t), { a, b });
+	}
+	static bool GetArithOp(SLTokenType tt, ArithOp& aop)
+	{
+		switch (tt)
+		{
+		case STT_OP_Add: case STT_OP_AddEq: aop = AO_Add; return true;
+		case STT_OP_Sub: case STT_OP_SubEq: aop = AO_Sub; return true;
+		case STT_OP_Mul: case STT_OP_MulEq: aop = AO_Mul; return true;
+		case STT_OP_Div: case STT_OP_DivEq: aop = AO_Div; return true;
+		case STT_OP_Mod: case STT_OP_ModEq: aop = AO_Mod; return true;
+		case STT_OP_And: case STT_OP_AndEq: aop = AO_And; return true;
+		case STT_OP_Or: case STT_OP_OrEq: aop = AO_Or; return true;
+		case STT_OP_Xor: case STT_OP_XorEq: aop = AO_Xor; return true;
+		case STT_OP_Lsh: case STT_OP_LshEq: aop = AO_Shl; return true;
+		case STT_OP_Rsh: case STT_OP_RshEq: aop = AO_Shr; return true;
+		default: return false;
+		}
+	}
+	// a and b have the type t, the result is a bool of the same shape
+	uint32_t Compare(SLTokenType tt, uint32_t a, uint32_t b, const ASTType* t)
+	{
+		const ASTType* rt = WithBase(t, BK_Bool);
+		if (t->kind == ASTType::Matrix)
+		{
+			const ASTType* ct = GetColumnType(t);
+			Words cols;
+			for (uint32_t i = 0; i < t->sizeX; ++i)
+				cols.push_back(Compare(tt, Extract(a, ct, i), Extract(b, ct, i), ct));
+			return Construct(rt, cols);
+		}
+		BaseKind bk = GetBaseKind(t);
+		if (bk == BK_Bool)
+		{
+			if (tt == STT_OP_Eq || tt == STT_OP_NEq)
+				return Op(tt == STT_OP_Eq ? SpvOpLogicalEqual : SpvOpLogicalNotEqual, GetTypeID(rt), { a, b });
+			const ASTType* it = WithBase(t, BK_Int);
+			return Compare(tt, ConvertBase(a, t, it), ConvertBase(b, t, it), it);
+		}
+		uint32_t op = 0;
+		switch (tt)
+		{
+		case STT_OP_Eq: op = bk == BK_Float ? SpvOpFOrdEqual : SpvOpIEqual; break;
+		case STT_OP_NEq: op = bk == BK_Float ? SpvOpFUnordNotEqual : SpvOpINotEqual; break;
+		case STT_OP_Less:
+			op = bk == BK_Float ? SpvOpFOrdLessThan : bk == BK_Int ? SpvOpSLessThan : SpvOpULessThan; break;
+		case STT_OP_LEq:
+			op = bk == BK_Float ? SpvOpFOrdLessThanEqual : bk == BK_Int ? SpvOpSLessThanEqual : SpvOpULessThanEqual;
+			break;
+		case STT_OP_Greater:
+			op = bk == BK_Float ? SpvOpFOrdGreaterThan : bk == BK_Int ? SpvOpSGreaterThan : SpvOpUGreaterThan;
+			break;
+		case STT_OP_GEq:
+			op = bk == BK_Float ? SpvOpFOrdGreaterThanEqual
+				: bk == BK_Int ? SpvOpSGreaterThanEqual : SpvOpUGreaterThanEqual;
+			break;
+		default: break;
+		}
+		return Op(op, GetTypeID(rt), { a, b });
+	}
+	// applies a unary instruction to scalars/vectors and to each matrix column
+	uint32_t UnaryColumns(uint32_t op, uint32_t a, const ASTType* t)
+	{
+		if (t->kind == ASTType::Matrix)
+		{
+			const ASTType* ct = GetColumnType(t);
+			Words cols;
+			for (uint32_t i = 0; i < t->sizeX; ++i)
+				cols.push_back(UnaryColumns(op, Extract(a, ct, i), ct));
+			return Construct(t, cols);
+		}
+		return Op(op, GetTypeID(t), { a });
+	}
+	uint32_t SelectValue(uint32_t c, const ASTType* ct, uint32_t a, uint32_t b, const ASTType* t)
+	{
+		switch (t->kind)
+		{
+		case ASTType::Matrix:
+		case ASTType::Array:
+			{
+				const ASTType* et = GetElementType(t);
+				bool perElement = ct->kind == t->kind;
+				const ASTType* cet = perElement ? GetElementType(ct) : ct;
+				uint32_t count = t->kind == ASTType::Array ? t->elementCount : t->sizeX;
+				Words parts;
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					parts.push_back(SelectValue(perElement ? Extract(c, cet, i) : c, cet,
+						Extract(a, et, i), Extract(b, et, i), et));
+				}
+				return Construct(t, parts);
+			}
+		case ASTType::Structure:
+			{
+				const auto& members = t->ToStructType()->members;
+				Words parts;
+				for (size_t i = 0; i < members.size(); ++i)
+				{
+					const ASTType* mt = members[i].type;
+					parts.push_back(SelectValue(c, ct, Extract(a, mt, uint32_t(i)), Extract(b, mt, uint32_t(i)), mt));
+				}
+				return Construct(t, parts);
+			}
+		default:
+			// SPIR-V 1.0 requires a condition with the same number of components
+			if (t->kind == ASTType::Vector && t->sizeX > 1 && IsScalarLike(ct))
+				c = Splat(c, WithBase(t, BK_Bool));
+			return Op(SpvOpSelect, GetTypeID(t), { c, a, b });
+		}
+	}
+	uint32_t EvalUnaryOp(const UnaryOpExpr* unop)
+	{
+		const ASTType* t = unop->GetReturnType();
+		uint32_t v = EvalAs(unop->GetSource(), t);
+		switch (unop->opType)
+		{
+		case STT_OP_Sub:
+			switch (GetBaseKind(t))
+			{
+			case BK_Float:
+				return UnaryColumns(SpvOpFNegate, v, t);
+			case BK_Bool:
+				return v; // -true is still true
+			default:
+				return UnaryColumns(SpvOpSNegate, v, t);
+			}
+		case STT_OP_Not:
+			return UnaryColumns(SpvOpLogicalNot, v, t);
+		case STT_OP_Inv:
+			return UnaryColumns(SpvOpNot, v, t);
+		default:
+			return v;
+		}
+	}
+	uint32_t EvalBinaryOp(const BinaryOpExpr* binop)
+	{
+		const Expr* lft = binop->GetLft();
+		const Expr* rgt = binop->GetRgt();
+		const ASTType* lt = lft->GetReturnType();
+		ArithOp aop = AO_Add;
+		switch (binop->opType)
+		{
+		case STT_OP_Assign:
+			{
+				uint32_t v = EvalAs(rgt, lt);
+				StoreTo(lft, v);
+				return v;
+			}
+		case STT_OP_AddEq:
+		case STT_OP_SubEq:
+		case STT_OP_MulEq:
+		case STT_OP_DivEq:
+		case STT_OP_ModEq:
+		case STT_OP_AndEq:
+		case STT_OP_OrEq:
+		case STT_OP_XorEq:
+		case STT_OP_LshEq:
+		case STT_OP_RshEq:
+			{
+				GetArithOp(binop->opType, aop);
+				if (IsAddressable(lft))
+				{
+					// the location is computed once
+					Pointer p = GetPointer(lft);
+					uint32_t cur = Convert(Load(p), p.type, lt);
+					uint32_t v = Arith(aop, cur, EvalAs(rgt, lt), lt);
+					Store(p.id, Convert(v, lt, p.type));
+					return v;
+				}
+				uint32_t cur = Eval(lft);
+				uint32_t v = Arith(aop, cur, EvalAs(rgt, lt), lt);
+				StoreTo(lft, v);
+				return v;
+			}
+		case STT_OP_Eq:
+		case STT_OP_NEq:
+		case STT_OP_Less:
+		case STT_OP_LEq:
+		case STT_OP_Greater:
+		case STT_OP_GEq:
+			{
+				uint32_t a = Eval(lft);
+				uint32_t b = EvalAs(rgt, lt);
+				return Compare(binop->opType, a, b, lt);
+			}
+		case STT_OP_LogicalAnd:
+		case STT_OP_LogicalOr:
+			{
+				// HLSL evaluates both operands
+				const ASTType* t = binop->GetReturnType();
+				uint32_t a = EvalAs(lft, t);
+				uint32_t b = EvalAs(rgt, t);
+				return Arith(binop->opType == STT_OP_LogicalAnd ? AO_And : AO_Or, a, b, t);
+			}
+		default:
+			if (GetArithOp(binop->opType, aop))
+			{
+				const ASTType* t = binop->GetReturnType();
+				uint32_t a = EvalAs(lft, t);
+				uint32_t b = EvalAs(rgt, t);
+				return Arith(aop, a, b, t);
+			}
+			return Op(SpvOpUndef, GetTypeID(binop->GetReturnType()), {});
+		}
+	}
+	uint32_t EvalIncDec(const IncDecOpExpr* idop)
+	{
+		const Expr* src = idop->GetSource();
+		const ASTType* t = src->GetReturnType();
+		uint32_t one = SplatConst(GetScalarConst(t, 1), t);
+		ArithOp aop = idop->dec ? AO_Sub : AO_Add;
+		if (IsAddressable(src))
+		{
+			Pointer p = GetPointer(src);
+			uint32_t cur = Convert(Load(p), p.type, t);
+			uint32_t v = Arith(aop, cur, one, t);
+			Store(p.id, Convert(v, t, p.type));
+			return idop->post ? cur : v;
+		}
+		uint32_t cur = Eval(src);
+		uint32_t v = Arith(aop, cur, one, t);
+		StoreTo(src, v);
+		return idop->post ? cur : v;
+	}
+	uint32_t EvalCall(const OpExpr* op)
+	{
+		const ASTFunction* F = op->resolvedFunc;
+		Words args;
+		Array<const Expr*> outArgs;
+		Array<const VarDecl*> outParams;
+		Array<uint32_t> outVars;
+		const ASTNode* param = F->GetFirstArg();
+		for (const ASTNode* arg = op->GetFirstArg(); arg && param; arg = arg->next, param = param->next)
+		{
+			const VarDecl* pvd = param->ToVarDecl();
+			const Expr* ae = arg->ToExpr();
+			if (pvd->GetType()->IsSampler())
+			{
+				args.push_back(GetPointer(ae).id);
+				continue;
+			}
+			// arguments are passed by pointer to a copy (copy-in/copy-out)
+			uint32_t tmp = EmitLocalVar(nullptr, pvd->GetType());
+			if ((pvd->flags & VarDecl::ATTR_In) || !(pvd->flags & VarDecl::ATTR_Out))
+				Store(tmp, EvalAs(ae, pvd->GetType()));
+			if (pvd->flags & VarDecl::ATTR_Out)
+			{
+				outArgs.push_back(ae);
+				outParams.push_back(pvd);
+				outVars.push_back(tmp);
+			}
+			args.push_back(tmp);
+		}
+		Words ops;
+		ops.push_back(funcIDs[F]);
+		ops.append(args.begin(), args.end());
+		uint32_t ret = Op(SpvOpFunctionCall, GetTypeID(F->GetReturnType()), ops);
+		for (size_t i = 0; i < outArgs.size(); ++i)
+		{
+			const ASTType* pt = outParams[i]->GetType();
+			uint32_t v = Op(SpvOpLoad, GetTypeID(pt), { outVars[i] });
+			StoreTo(outArgs[i], Convert(v, pt, outArgs[i]->GetReturnType()));
+		}
+		return ret;
+	}
+	const ASTType* ToFloat(const ASTType* t)
+	{
+		return GetBaseKind(t) == BK_Float ? t : WithBase(t, BK_Float);
+	}
+	// GLSL.std.450 instruction with all arguments and the result converted to t
+	uint32_t EvalExtInst(uint32_t inst, const OpExpr* op, const ASTType* t)
+	{
+		Words ops;
+		ops.push_back(glslStdID);
+		ops.push_back(inst);
+		for (const ASTNode* arg = op->GetFirstArg(); arg; arg = arg->next)
+			ops.push_back(EvalAs(arg->ToExpr(), t));
+		return Convert(Op(SpvOpExtInst, GetTypeID(t), ops), t, op->GetReturnType());
+	}
+	uint32_t EvalTypedExtInst(uint32_t fInst, uint32_t sInst, uint32_t uInst, const OpExpr* op)
+	{
+		const ASTType* t = op->GetReturnType();
+		switch (GetBaseKind(t))
+		{
+		case BK_Float: return EvalExtInst(fInst, op, t);
+		case BK_UInt: return EvalExtInst(uInst, op, t);
+		case BK_Int: return EvalExtInst(sInst, op, t);
+		default: return EvalExtInst(sInst, op, WithBase(t, BK_Int));
+		}
+	}
+	uint32_t EvalTex(const OpExpr* op)
+	{
+		enum Mode { Plain, Bias, LOD, Grad, Cmp, LOD0Cmp };
+		int dims = 2;
+		Mode mode = Plain;
+		switch (op->opKind)
+		{
+		case Op_Tex1D: case Op_Tex1DProj: dims = 1; break;
+		case Op_Tex1DBias: dims = 1; mode = Bias; break;
+		case Op_Tex1DGrad: dims = 1; mode = Grad; break;
+		case Op_Tex1DLOD: dims = 1; mode = LOD; break;
+		case Op_Tex1DCmp: dims = 1; mode = Cmp; break;
+		case Op_Tex1DLOD0Cmp: dims = 1; mode = LOD0Cmp; break;
+		case Op_Tex2D: case Op_Tex2DProj: break;
+		case Op_Tex2DBias: mode = Bias; break;
+		case Op_Tex2DGrad: mode = Grad; break;
+		case Op_Tex2DLOD: mode = LOD; break;
+		case Op_Tex2DCmp: mode = Cmp; break;
+		case Op_Tex2DLOD0Cmp: mode = LOD0Cmp; break;
+		case Op_Tex3D: case Op_Tex3DProj: case Op_TexCube: case Op_TexCubeProj: dims = 3; break;
+		case Op_Tex3DBias: case Op_TexCubeBias: dims = 3; mode = Bias; break;
+		case Op_Tex3DGrad: case Op_TexCubeGrad: dims = 3; mode = Grad; break;
+		case Op_Tex3DLOD: case Op_TexCubeLOD: dims = 3; mode = LOD; break;
+		case Op_TexCubeCmp: dims = 3; mode = Cmp; break;
+		case Op_TexCubeLOD0Cmp: dims = 3; mode = LOD0Cmp; break;
+		default: break;
+		}
+		// implicit LOD is only available in pixel shaders
+		bool implicitLOD = ast.stage == ShaderStage_Pixel;
+
+		const ASTNode* arg = op->GetFirstArg();
+		uint32_t sampledImage = Eval(arg->ToExpr());
+		arg = arg->next;
+		const ASTType* coordType = types.GetFloat32VecType(dims);
+		uint32_t coord = EvalAs(arg->ToExpr(), coordType);
+		arg = arg->next;
+		const ASTType* floatType = types.GetFloat32Type();
+		const ASTType* resultType = mode == Cmp || mode == LOD0Cmp ? floatType : types.GetFloat32VecType(4);
+		uint32_t rt = GetTypeID(resultType);
+		uint32_t zero = GetConstFloat(0);
+		uint32_t result;
+		switch (mode)
+		{
+		case Bias:
+			{
+				uint32_t bias = EvalAs(arg->ToExpr(), floatType);
+				result = implicitLOD
+					? Op(SpvOpImageSampleImplicitLod, rt, { sampledImage, coord, SpvImageOperandsBias, bias })
+					: Op(SpvOpImageSampleExplicitLod, rt, { sampledImage, coord, SpvImageOperandsLod, bias });
+			}
+			break;
+		case LOD:
+			result = Op(SpvOpImageSampleExplicitLod, rt, { sampledImage, coord, SpvImageOperandsLod,
+				EvalAs(arg->ToExpr(), floatType) });
+			break;
+		case Grad:
+			{
+				uint32_t ddx = EvalAs(arg->ToExpr(), coordType);
+				uint32_t ddy = EvalAs(arg->next->ToExpr(), coordType);
+				result = Op(SpvOpImageSampleExplicitLod, rt, { sampledImage, coord, SpvImageOperandsGrad, ddx, ddy });
+			}
+			break;
+		case Cmp:
+		case LOD0Cmp:
+			{
+				uint32_t ref = EvalAs(arg->ToExpr(), floatType);
+				result = implicitLOD && mode == Cmp
+					? Op(SpvOpImageSampleDrefImplicitLod, rt, { sampledImage, coord, ref })
+					: Op(SpvOpImageSampleDrefExplicitLod, rt, { sampledImage, coord, ref, SpvImageOperandsLod, zero });
+			}
+			break;
+		default:
+			result = implicitLOD
+				? Op(SpvOpImageSampleImplicitLod, rt, { sampledImage, coord })
+				: Op(SpvOpImageSampleExplicitLod, rt, { sampledImage, coord, SpvImageOperandsLod, zero });
+			break;
+		}
+		return Convert(result, resultType, op->GetReturnType());
+	}
+	uint32_t EvalOp(const OpExpr* op)
+	{
+		const ASTType* rt = op->GetReturnType();
+		const Expr* arg0 = op->GetFirstArg() ? op->GetFirstArg()->ToExpr() : nullptr;
+		const Expr* arg1 = arg0 && arg0->next ? arg0->next->ToExpr() : nullptr;
+		switch (op->opKind)
+		{
+		case Op_FCall:
+			return EvalCall(op);
+		case Op_Add:
+		case Op_Subtract:
+		case Op_Multiply:
+		case Op_Divide:
+		case Op_Modulus:
+		case Op_FMod:
+			{
+				static const ArithOp aops[] = { AO_Add, AO_Sub, AO_Mul, AO_Div, AO_Mod };
+				ArithOp aop = op->opKind == Op_FMod ? AO_Mod : aops[op->opKind - Op_Add];
+				uint32_t a = EvalAs(arg0, rt);
+				uint32_t b = EvalAs(arg1, rt);
+				return Arith(aop, a, b, rt);
+			}
+		case Op_ModGLSL:
+			{
+				const ASTType* t = ToFloat(rt);
+				uint32_t a = EvalAs(arg0, t);
+				uint32_t b = EvalAs(arg1, t);
+				return Convert(Op(SpvOpFMod, GetTypeID(t), { a, b }), t, rt);
+			}
+		case Op_Abs:        return EvalTypedExtInst(GLSLstd450FAbs, GLSLstd450SAbs, GLSLstd450SAbs, op);
+		case Op_Clamp:      return EvalTypedExtInst(GLSLstd450FClamp, GLSLstd450SClamp, GLSLstd450UClamp, op);
+		case Op_Max:        return EvalTypedExtInst(GLSLstd450FMax, GLSLstd450SMax, GLSLstd450UMax, op);
+		case Op_Min:        return EvalTypedExtInst(GLSLstd450FMin, GLSLstd450SMin, GLSLstd450UMin, op);
+		case Op_Sign:       return EvalTypedExtInst(GLSLstd450FSign, GLSLstd450SSign, GLSLstd450SSign, op);
+		case Op_ACos:       return EvalExtInst(GLSLstd450Acos, op, ToFloat(rt));
+		case Op_ASin:       return EvalExtInst(GLSLstd450Asin, op, ToFloat(rt));
+		case Op_ATan:       return EvalExtInst(GLSLstd450Atan, op, ToFloat(rt));
+		case Op_ATan2:      return EvalExtInst(GLSLstd450Atan2, op, ToFloat(rt));
+		case Op_Ceil:       return EvalExtInst(GLSLstd450Ceil, op, ToFloat(rt));
+		case Op_Cos:        return EvalExtInst(GLSLstd450Cos, op, ToFloat(rt));
+		case Op_CosH:       return EvalExtInst(GLSLstd450Cosh, op, ToFloat(rt));
+		case Op_Cross:      return EvalExtInst(GLSLstd450Cross, op, ToFloat(rt));
+		case Op_Degrees:    return EvalExtInst(GLSLstd450Degrees, op, ToFloat(rt));
+		case Op_Exp:        return EvalExtInst(GLSLstd450Exp, op, ToFloat(rt));
+		case Op_Exp2:       return EvalExtInst(GLSLstd450Exp2, op, ToFloat(rt));
+		case Op_FaceForward:return EvalExtInst(GLSLstd450FaceForward, op, ToFloat(rt));
+		case Op_Floor:      return EvalExtInst(GLSLstd450Floor, op, ToFloat(rt));
+		case Op_Frac:       return EvalExtInst(GLSLstd450Fract, op, ToFloat(rt));
+		case Op_Lerp:       return EvalExtInst(GLSLstd450FMix, op, ToFloat(rt));
+		case Op_Log:        return EvalExtInst(GLSLstd450Log, op, ToFloat(rt));
+		case Op_Log2:       return EvalExtInst(GLSLstd450Log2, op, ToFloat(rt));
+		case Op_Normalize:  return EvalExtInst(GLSLstd450Normalize, op, ToFloat(rt));
+		case Op_Pow:        return EvalExtInst(GLSLstd450Pow, op, ToFloat(rt));
+		case Op_Radians:    return EvalExtInst(GLSLstd450Radians, op, ToFloat(rt));
+		case Op_Reflect:    return EvalExtInst(GLSLstd450Reflect, op, ToFloat(rt));
+		case Op_Round:      return EvalExtInst(GLSLstd450RoundEven, op, ToFloat(rt)); // D3D rounds to even
+		case Op_RSqrt:      return EvalExtInst(GLSLstd450InverseSqrt, op, ToFloat(rt));
+		case Op_Sin:        return EvalExtInst(GLSLstd450Sin, op, ToFloat(rt));
+		case Op_SinH:       return EvalExtInst(GLSLstd450Sinh, op, ToFloat(rt));
+		case Op_SmoothStep: return EvalExtInst(GLSLstd450SmoothStep, op, ToFloat(rt));
+		case Op_Sqrt:       return EvalExtInst(GLSLstd450Sqrt, op, ToFloat(rt));
+		case Op_Step:       return EvalExtInst(GLSLstd450Step, op, ToFloat(rt));
+		case Op_Tan:        return EvalExtInst(GLSLstd450Tan, op, ToFloat(rt));
+		case Op_TanH:       return EvalExtInst(GLSLstd450Tanh, op, ToFloat(rt));
+		case Op_Trunc:      return EvalExtInst(GLSLstd450Trunc, op, ToFloat(rt));
+		case Op_Length:
+		case Op_Distance:
+			{
+				const ASTType* t = ToFloat(arg0->GetReturnType());
+				uint32_t a = EvalAs(arg0, t);
+				uint32_t r = op->opKind == Op_Length
+					? ExtInst(GLSLstd450Length, GetFloatType(), { a })
+					: ExtInst(GLSLstd450Distance, GetFloatType(), { a, EvalAs(arg1, t) });
+				return Convert(r, types.GetFloat32Type(), rt);
+			}
+		case Op_Refract:
+			{
+				const ASTType* t = ToFloat(rt);
+				uint32_t i = EvalAs(arg0, t);
+				uint32_t n = EvalAs(arg1, t);
+				uint32_t eta = EvalAs(arg1->next->ToExpr(), types.GetFloat32Type());
+				return Convert(ExtInst(GLSLstd450Refract, GetTypeID(t), { i, n, eta }), t, rt);
+			}
+		case Op_Determinant:
+			{
+				const ASTType* t = ToFloat(arg0->GetReturnType());
+				uint32_t r = ExtInst(GLSLstd450Determinant, GetFloatType(), { EvalAs(arg0, t) });
+				return Convert(r, types.GetFloat32Type(), rt);
+			}
+		case Op_Dot:
+			{
+				const ASTType* t = ToFloat(arg0->GetReturnType());
+				uint32_t a = EvalAs(arg0, t);
+				uint32_t b = EvalAs(arg1, t);
+				uint32_t r = IsScalarLike(t)
+					? Op(SpvOpFMul, GetFloatType(), { a, b })
+					: Op(SpvOpDot, GetFloatType(), { a, b });
+				return Convert(r, types.GetFloat32Type(), rt);
+			}
+		case Op_MulMM:
+		case Op_MulMV:
+		case Op_MulVM:
+			{
+				// GLSL operator '*' (the arguments are in the GLSL matrix layout)
+				const ASTType* at = ToFloat(arg0->GetReturnType());
+				const ASTType* bt = ToFloat(arg1->GetReturnType());
+				uint32_t a = EvalAs(arg0, at);
+				uint32_t b = EvalAs(arg1, bt);
+				const ASTType* t;
+				uint32_t spvOp;
+				if (op->opKind == Op_MulVM)
+				{
+					t = types.GetFloat32VecType(bt->sizeX);
+					spvOp = SpvOpVectorTimesMatrix;
+				}
+				else if (op->opKind == Op_MulMV)
+				{
+					t = types.GetFloat32VecType(at->sizeY);
+					spvOp = SpvOpMatrixTimesVector;
+				}
+				else
+				{
+					t = types.GetFloat32MtxType(bt->sizeX, at->sizeY);
+					spvOp = SpvOpMatrixTimesMatrix;
+				}
+				return Convert(Op(spvOp, GetTypeID(t), { a, b }), t, rt);
+			}
+		case Op_Transpose:
+			{
+				const ASTType* t = ToFloat(rt);
+				const ASTType* st = ToFloat(arg0->GetReturnType());
+				return Convert(Op(SpvOpTranspose, GetTypeID(t), { EvalAs(arg0, st) }), t, rt);
+			}
+		case Op_Saturate:
+			{
+				const ASTType* t = ToFloat(rt);
+				uint32_t zero = SplatConst(GetConstFloat(0), t);
+				uint32_t one = SplatConst(GetConstFloat(1), t);
+				return Convert(ExtInst(GLSLstd450FClamp, GetTypeID(t), { EvalAs(arg0, t), zero, one }), t, rt);
+			}
+		case Op_LdExp:
+			{
+				const ASTType* t = ToFloat(rt);
+				uint32_t x = EvalAs(arg0, t);
+				uint32_t e = ExtInst(GLSLstd450Exp2, GetTypeID(t), { EvalAs(arg1, t) });
+				return Convert(Op(SpvOpFMul, GetTypeID(t), { x, e }), t, rt);
+			}
+		case Op_Log10:
+			{
+				const ASTType* t = ToFloat(rt);
+				uint32_t l = ExtInst(GLSLstd450Log, GetTypeID(t), { EvalAs(arg0, t) });
+				uint32_t invLn10 = SplatConst(GetConstFloat(float(1.0 / log(10.0))), t);
+				return Convert(Op(SpvOpFMul, GetTypeID(t), { l, invLn10 }), t, rt);
+			}
+		case Op_DDX:
+		case Op_DDY:
+		case Op_FWidth:
+			{
+				const ASTType* t = ToFloat(rt);
+				uint32_t spvOp = op->opKind == Op_DDX ? SpvOpDPdx : op->opKind == Op_DDY ? SpvOpDPdy : SpvOpFwidth;
+				return Convert(UnaryColumns(spvOp, EvalAs(arg0, t), t), t, rt);
+			}
+		case Op_IsNaN:
+		case Op_IsInf:
+		case Op_IsFinite:
+			{
+				const ASTType* t = ToFloat(arg0->GetReturnType());
+				const ASTType* bt = WithBase(t, BK_Bool);
+				uint32_t v = EvalAs(arg0, t);
+				uint32_t r;
+				if (op->opKind == Op_IsFinite)
+				{
+					uint32_t nonFinite = Op(SpvOpLogicalOr, GetTypeID(bt), {
+						UnaryColumns(SpvOpIsNan, v, bt == t ? t : t),
+						UnaryColumns(SpvOpIsInf, v, t) });
+					r = UnaryColumns(SpvOpLogicalNot, nonFinite, bt);
+				}
+				else
+					r = UnaryColumns(op->opKind == Op_IsNaN ? SpvOpIsNan : SpvOpIsInf, v, t);
+				return Convert(r, bt, rt);
+			}
+		case Op_All:
+		case Op_Any:
+			{
+				const ASTType* bt = WithBase(arg0->GetReturnType(), BK_Bool);
+				uint32_t v = EvalAs(arg0, bt);
+				uint32_t r = ReduceBool(op->opKind == Op_All, v, bt);
+				return Convert(r, types.GetBoolType(), rt);
+			}
+		case Op_Clip:
+			return 0; // replaced by the GLSL conversion
+		default:
+			if (op->opKind >= Op_Tex1D && op->opKind <= Op_TexCubeLOD0Cmp)
+				return EvalTex(op);
+			return Op(SpvOpUndef, GetTypeID(rt), {});
+		}
+	}
+	uint32_t ReduceBool(bool all, uint32_t v, const ASTType* t)
+	{
+		if (IsScalarLike(t))
+			return t->kind == ASTType::Matrix ? Op(SpvOpCompositeExtract, GetBoolType(), { v, 0, 0 }) : v;
+		if (t->kind == ASTType::Vector)
+			return Op(all ? SpvOpAll : SpvOpAny, GetBoolType(), { v });
+		const ASTType* ct = GetColumnType(t);
+		uint32_t r = 0;
+		for (uint32_t i = 0; i < t->sizeX; ++i)
+		{
+			uint32_t cr = ReduceBool(all, Extract(v, ct, i), ct);
+			r = i ? Op(all ? SpvOpLogicalAnd : SpvOpLogicalOr, GetBoolType(), { r, cr }) : cr;
+		}
+		return r;
+	}
+	uint32_t Eval(const Expr* e)
+	{
+		switch (e->kind)
+		{
+		case ASTNode::Kind_BoolExpr:
+			return EvalConst(e, static_cast<const BoolExpr*>(e)->value);
+		case ASTNode::Kind_Int32Expr:
+			return EvalConst(e, static_cast<const Int32Expr*>(e)->value);
+		case ASTNode::Kind_Float32Expr:
+			return EvalConst(e, static_cast<const Float32Expr*>(e)->value);
+		case ASTNode::Kind_DeclRefExpr:
+		case ASTNode::Kind_MemberExpr:
+		case ASTNode::Kind_IndexExpr:
+			if (IsAddressable(e))
+			{
+				Pointer p = GetPointer(e);
+				return Convert(Load(p), p.type, e->GetReturnType());
+			}
+			return EvalSubValue(e);
+		case ASTNode::Kind_CastExpr:
+			return EvalAs(static_cast<const CastExpr*>(e)->GetSource(), e->GetReturnType());
+		case ASTNode::Kind_InitListExpr:
+			return EvalInitList(static_cast<const InitListExpr*>(e));
+		case ASTNode::Kind_IncDecOpExpr:
+			return EvalIncDec(static_cast<const IncDecOpExpr*>(e));
+		case ASTNode::Kind_OpExpr:
+			return EvalOp(static_cast<const OpExpr*>(e));
+		case ASTNode::Kind_UnaryOpExpr:
+			return EvalUnaryOp(static_cast<const UnaryOpExpr*>(e));
+		case ASTNode::Kind_BinaryOpExpr:
+			return EvalBinaryOp(static_cast<const BinaryOpExpr*>(e));
+		case ASTNode::Kind_TernaryOpExpr:
+			{
+				auto* tnop = static_cast<const TernaryOpExpr*>(e);
+				const ASTType* ct = WithBase(tnop->GetCond()->GetReturnType(), BK_Bool);
+				uint32_t c = EvalAs(tnop->GetCond(), ct);
+				uint32_t a = EvalAs(tnop->GetTrueExpr(), e->GetReturnType());
+				uint32_t b = EvalAs(tnop->GetFalseExpr(), e->GetReturnType());
+				return SelectValue(c, ct, a, b, e->GetReturnType());
+			}
+		default:
+			return 0;
+		}
+	}
+
+	// statements, structured control flow
+	uint32_t BeginBlock(uint32_t label)
+	{
+		Emit(fnCode, SpvOpLabel, { label });
+		blockOpen = true;
+		return label;
+	}
+	void Terminate(uint32_t op, std::initializer_list<uint32_t> operands)
+	{
+		Emit(fnCode, op, operands);
+		blockOpen = false;
+	}
+	void EndMergeBlock(uint32_t label, bool used)
+	{
+		BeginBlock(label);
+		if (!used)
+			Terminate(SpvOpUnreachable, {});
+	}
+	bool HasExpr(const Expr* e)
+	{
+		return e && !dyn_cast<const VoidExpr>(e);
+	}
+	void GenLoop(const Stmt* init, const Expr* cond, const Expr* incr, const Stmt* body, bool condFirst)
+	{
+		if (init)
+			GenStmt(init);
+		if (!blockOpen)
+			return;
+		uint32_t header = NewID();
+		uint32_t merge = NewID();
+		uint32_t cont = NewID();
+		uint32_t bodyLabel = NewID();
+		Terminate(SpvOpBranch, { header });
+		BeginBlock(header);
+		Emit(fnCode, SpvOpLoopMerge, { merge, cont, SpvLoopControlNone });
+		loops.push_back({ merge, cont, false });
+		if (condFirst && HasExpr(cond))
+		{
+			uint32_t condLabel = NewID();
+			Terminate(SpvOpBranch, { condLabel });
+			BeginBlock(condLabel);
+			uint32_t c = EvalAs(cond, types.GetBoolType());
+			Terminate(SpvOpBranchConditional, { c, bodyLabel, merge });
+			loops.back().mergeUsed = true;
+		}
+		else
+			Terminate(SpvOpBranch, { bodyLabel });
+
+		BeginBlock(bodyLabel);
+		GenStmt(body);
+		if (blockOpen)
+			Terminate(SpvOpBranch, { cont });
+
+		BeginBlock(cont);
+		if (condFirst)
+		{
+			if (HasExpr(incr))
+				Eval(incr);
+			Terminate(SpvOpBranch, { header });
+		}
+		else
+		{
+			uint32_t c = EvalAs(cond, types.GetBoolType());
+			Terminate(SpvOpBranchConditional, { c, header, merge });
+			loops.back().mergeUsed = true;
+		}
+		bool mergeUsed = loops.back().mergeUsed;
+		loops.pop_back();
+		EndMergeBlock(merge, mergeUsed);
+	}
+	void GenStmt(const Stmt* node)
+	{
+		if (!blockOpen)
+			return; // unreachable code
+		switch (node->kind)
+		{
+		case ASTNode::Kind_BlockStmt:
+			for (const ASTNode* ch = node->firstChild; ch && blockOpen; ch = ch->next)
+				GenStmt(ch->ToStmt());
+			break;
+		case ASTNode::Kind_ExprStmt:
+			if (auto* e = static_cast<const ExprStmt*>(node)->GetExpr())
+				Eval(e);
+			break;
+		case ASTNode::Kind_VarDeclStmt:
+			for (const ASTNode* ch = node->firstChild; ch; ch = ch->next)
+			{
+				const VarDecl* vd = ch->ToVarDecl();
+				uint32_t id = GetVar(vd).id;
+				if (vd->GetInitExpr())
+					Store(id, EvalAs(vd->GetInitExpr(), vd->GetType()));
+			}
+			break;
+		case ASTNode::Kind_IfElseStmt:
+			{
+				auto* ifelse = static_cast<const IfElseStmt*>(node);
+				uint32_t c = EvalAs(ifelse->GetCond(), types.GetBoolType());
+				uint32_t trueLabel = NewID();
+				uint32_t falseLabel = ifelse->GetFalseBr() ? NewID() : 0;
+				uint32_t merge = NewID();
+				bool mergeUsed = !falseLabel;
+				Emit(fnCode, SpvOpSelectionMerge, { merge, SpvSelectionControlNone });
+				Terminate(SpvOpBranchConditional, { c, trueLabel, falseLabel ? falseLabel : merge });
+				BeginBlock(trueLabel);
+				GenStmt(ifelse->GetTrueBr());
+				if (blockOpen)
+				{
+					Terminate(SpvOpBranch, { merge });
+					mergeUsed = true;
+				}
+				if (falseLabel)
+				{
+					BeginBlock(falseLabel);
+					GenStmt(ifelse->GetFalseBr());
+					if (blockOpen)
+					{
+						Terminate(SpvOpBranch, { merge });
+						mergeUsed = true;
+					}
+				}
+				EndMergeBlock(merge, mergeUsed);
+			}
+			break;
+		case ASTNode::Kind_WhileStmt:
+			{
+				auto* whilestmt = static_cast<const WhileStmt*>(node);
+				GenLoop(nullptr, whilestmt->GetCond(), nullptr, whilestmt->GetBody(), true);
+			}
+			break;
+		case ASTNode::Kind_DoWhileStmt:
+			{
+				auto* dowhilestmt = static_cast<const DoWhileStmt*>(node);
+				GenLoop(nullptr, dowhilestmt->GetCond(), nullptr, dowhilestmt->GetBody(), false);
+			}
+			break;
+		case ASTNode::Kind_ForStmt:
+			{
+				auto* forstmt = static_cast<const ForStmt*>(node);
+				GenLoop(forstmt->GetInit(), forstmt->GetCond(), forstmt->GetIncr(), forstmt->GetBody(), true);
+			}
+			break;
+		case ASTNode::Kind_ReturnStmt:
+			{
+				const Expr* e = static_cast<const ReturnStmt*>(node)->GetExpr();
+				if (HasExpr(e) && !curFunc->GetReturnType()->IsVoid())
+					Terminate(SpvOpReturnValue, { EvalAs(e, curFunc->GetReturnType()) });
+				else
+					Terminate(SpvOpReturn, {});
+			}
+			break;
+		case ASTNode::Kind_DiscardStmt:
+			Terminate(SpvOpKill, {});
+			break;
+		case ASTNode::Kind_BreakStmt:
+			if (!loops.empty())
+			{
+				loops.back().mergeUsed = true;
+				Terminate(SpvOpBranch, { loops.back().mergeLabel });
+			}
+			break;
+		case ASTNode::Kind_ContinueStmt:
+			if (!loops.empty())
+				Terminate(SpvOpBranch, { loops.back().continueLabel });
+			break;
+		default:
+			break;
+		}
+	}
+
+	// functions
+	void GenEntryPointPrologue()
+	{
+		for (const auto& sv : shadowedVars)
+		{
+			Pointer src = { sv.source.id, sv.source.storage, sv.source.layout, sv.source.type };
+			if (sv.source.blockVar)
+			{
+				src.id = Op(SpvOpAccessChain, GetPointerType(src.storage, GetTypeID(src.type, true)),
+					{ sv.source.blockVar, GetConstInt(int32_t(sv.source.blockMember)) });
+			}
+			Store(vars[sv.vd].id, Convert(Load(src), src.type, sv.vd->GetType()));
+		}
+		for (const VarDecl* vd : privateInits)
+			Store(vars[vd].id, EvalAs(vd->GetInitExpr(), vd->GetType()));
+	}
+	void GenFunction(const ASTFunction* F)
+	{
+		curFunc = F;
+		fnVars.clear();
+		fnCode.clear();
+
+		uint32_t retType = GetTypeID(F->GetReturnType());
+		Words fnTypeOps;
+		fnTypeOps.push_back(retType);
+		Words paramTypes;
+		for (const ASTNode* arg = F->GetFirstArg(); arg; arg = arg->next)
+		{
+			const ASTType* t = arg->ToVarDecl()->GetType();
+			uint32_t storage = t->IsSampler() ? SpvStorageClassUniformConstant : SpvStorageClassFunction;
+			paramTypes.push_back(GetPointerType(storage, GetTypeID(t)));
+		}
+		fnTypeOps.append(paramTypes.begin(), paramTypes.end());
+		uint32_t fnType = GetType(SpvOpTypeFunction, fnTypeOps);
+
+		uint32_t id = funcIDs[F];
+		Emit(functions, SpvOpFunction, { retType, id, SpvFunctionControlNone, fnType });
+		EmitName(id, F->mangledName);
+		size_t i = 0;
+		for (const ASTNode* arg = F->GetFirstArg(); arg; arg = arg->next, ++i)
+		{
+			const VarDecl* vd = arg->ToVarDecl();
+			uint32_t pid = NewID();
+			Emit(functions, SpvOpFunctionParameter, { paramTypes[i], pid });
+			EmitName(pid, vd->name);
+			uint32_t storage = vd->GetType()->IsSampler() ? SpvStorageClassUniformConstant : SpvStorageClassFunction;
+			vars.insert(std::make_pair(vd, VarInfo{ pid, storage, false, 0, 0, vd->GetType() }));
+		}
+
+		blockOpen = true;
+		if (F == ast.entryPoint)
+			GenEntryPointPrologue();
+		GenStmt(F->GetCode());
+		if (blockOpen)
+			Terminate(F->GetReturnType()->IsVoid() ? SpvOpReturn : SpvOpUnreachable, {});
+
+		// variables must be at the beginning of the first block
+		Emit(functions, SpvOpLabel, { NewID() });
+		functions.append(fnVars.begin(), fnVars.end());
+		functions.append(fnCode.begin(), fnCode.end());
+		Emit(functions, SpvOpFunctionEnd, {});
+		curFunc = nullptr;
+	}
+
+	void Generate(OutStream& out)
+	{
+		glslStdID = NewID();
+
+		for (const ASTNode* fnn = ast.functionList.firstChild; fnn; fnn = fnn->next)
+		{
+			ScanNode(fnn->ToFunction()->GetCode());
+			funcIDs[fnn->ToFunction()] = NewID();
+		}
+		DeclareGlobals();
+		for (const ASTNode* fnn = ast.functionList.firstChild; fnn; fnn = fnn->next)
+			GenFunction(fnn->ToFunction());
+
+		Words header;
+		Emit(header, SpvOpCapability, { SpvCapabilityShader });
+		if (usesSampled1D)
+			Emit(header, SpvOpCapability, { SpvCapabilitySampled1D });
+		size_t at = BeginInst(header, SpvOpExtInstImport);
+		header.push_back(glslStdID);
+		AppendString(header, "GLSL.std.450");
+		EndInst(header, at);
+		Emit(header, SpvOpMemoryModel, { SpvAddressingModelLogical, SpvMemoryModelGLSL450 });
+		uint32_t entryID = funcIDs[ast.entryPoint];
+		at = BeginInst(header, SpvOpEntryPoint);
+		header.push_back(ast.stage == ShaderStage_Pixel ? SpvExecutionModelFragment : SpvExecutionModelVertex);
+		header.push_back(entryID);
+		AppendString(header, "main");
+		header.append(interfaceVars.begin(), interfaceVars.end());
+		EndInst(header, at);
+		if (ast.stage == ShaderStage_Pixel)
+		{
+			Emit(header, SpvOpExecutionMode, { entryID, SpvExecutionModeOriginUpperLeft });
+			if (writesDepth)
+				Emit(header, SpvOpExecutionMode, { entryID, SpvExecutionModeDepthReplacing });
+		}
+
+		uint32_t prefix[5] = { SpvMagicNumber, SpvVersion10, 0, nextID, 0 };
+		out.Write((const char*) prefix, sizeof(prefix));
+		const Words* sections[] = { &header, &debugNames, &decorations, &globals, &functions };
+		for (const Words* s : sections)
+			out.Write((const char*) s->data(), s->size() * sizeof(uint32_t));
+	}
+
+	const AST& ast;
+	AST& types; // type lookups only, they can add types to the AST
+	uint32_t nextID = 1;
+	uint32_t glslStdID = 0;
+	Words debugNames;
+	Words decorations;
+	Words globals; // types, constants and global variables
+	Words functions;
+	Words fnVars;
+	Words fnCode;
+	Words interfaceVars;
+	std::unordered_map<String, uint32_t> cache;
+	std::unordered_map<const ASTStructType*, uint32_t> structTypes[2]; // value types, layout types
+	std::unordered_map<const VarDecl*, VarInfo> vars;
+	std::unordered_map<const VarDecl*, bool> writtenReadOnlyVars;
+	std::unordered_map<const ASTFunction*, uint32_t> funcIDs;
+	Array<ShadowedVar> shadowedVars;
+	Array<const VarDecl*> privateInits;
+	Array<LoopInfo> loops;
+	const ASTFunction* curFunc = nullptr;
+	bool blockOpen = false;
+	bool usesSampled1D = false;
+	bool writesDepth = false;
+};
+
+
+void HOC::GenerateSPIRV(const AST& ast, OutStream& out)
+{
+	SPIRVGenerator gen(ast);
+	gen.Generate(out);
+}
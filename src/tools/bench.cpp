@@ -0,0 +1,917 @@
+
+
+#include "../compiler.hpp"
+#include "shadergen.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#  include "msvc_dirent.h"
+#else
+#  include <dirent.h>
+#endif
+
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+
+using namespace HOC;
+
+// only for compatibility with test.cpp, normally not needed
+extern "C" void* chkmalloc(size_t sz) { return malloc(sz); }
+extern "C" void chkfree(void* p) { free(p); }
+
+
+/* compiler throughput benchmark
+- inputs: sources from test scripts, runtests/html5-shader.hlsl, synthetic shaders
+- every input is compiled to every output format (pairs that fail to compile are skipped)
+- reports shaders/second, MB/second (of source code) and p50/p99 compile latency
+- results can be saved as JSON and compared against a previously saved baseline
+*/
+
+static const char* OUTPUT_FORMATS[] =
+{
+	"hlsl_sm3",
+	"hlsl_sm4",
+	"glsl_140",
+	"glsl_es_100",
+	"glsl_330",
+	"glsl_es_300",
+	"spirv",
+};
+#define NUM_OUTPUT_FORMATS (sizeof(OUTPUT_FORMATS)/sizeof(OUTPUT_FORMATS[0]))
+
+typedef std::unordered_map<std::string, std::string> IncludeMap;
+
+struct BenchShader
+{
+	std::string group;
+	std::string name;
+	std::string source;
+	ShaderStage stage;
+	std::vector<std::pair<std::string, std::string>> defines;
+	IncludeMap includes;
+};
+
+struct BenchResult
+{
+	std::string key; // <group>.<format>
+	size_t numShaders = 0;
+	size_t numSkipped = 0;
+	size_t numCompiles = 0;
+	double sourceBytes = 0;
+	double totalTime = 0;
+	std::vector<double> latencies;
+
+	double ShadersPerSec() const { return totalTime > 0 ? numCompiles / totalTime : 0; }
+	double MBPerSec() const { return totalTime > 0 ? sourceBytes / (1024.0 * 1024.0) / totalTime : 0; }
+	double Percentile(double q) const
+	{
+		if (latencies.empty())
+			return 0;
+		// nearest rank, latencies are sorted
+		size_t rank = size_t(ceil(q * latencies.size()));
+		if (rank < 1)
+			rank = 1;
+		return latencies[std::min(rank, latencies.size()) - 1];
+	}
+};
+
+
+static int LoadIncludeFileBench(const char* file, const char*, char** outbuf, void* userdata)
+{
+	if (file == NULL)
+	{
+		delete[] * outbuf;
+		return 1;
+	}
+
+	auto& includes = *static_cast<const IncludeMap*>(userdata);
+	auto it = includes.find(file);
+	if (it != includes.end())
+	{
+		*outbuf = new char[it->second.size() + 1];
+		memcpy(*outbuf, it->second.c_str(), it->second.size() + 1);
+		return 1;
+	}
+	return 0;
+}
+
+static void WriteStr_Count(const char*, size_t size, void* userData)
+{
+	*(size_t*) userData += size;
+}
+
+static bool CompileOnce(const BenchShader& sh, OutputShaderFormat fmt, std::string* errors,
+	HOC_CompileStats* stats = nullptr)
+{
+	std::vector<HOC_ShaderMacro> macros;
+	for (const auto& def : sh.defines)
+	{
+		HOC_ShaderMacro m = { def.first.c_str(), def.second.c_str() };
+		macros.push_back(m);
+	}
+	HOC_ShaderMacro nullMacro = { NULL, NULL };
+	macros.push_back(nullMacro);
+
+	size_t codeSize = 0, errSize = 0;
+	HOC_TextOutput toCode = { &WriteStr_Count, &codeSize };
+	HOC_TextOutput toErrorsCount = { &WriteStr_Count, &errSize };
+	HOC_TextOutput toErrorsStr = { &HOC_WriteStr_String<std::string>, errors };
+
+	HOC_Config cfg;
+	cfg.stage = sh.stage;
+	cfg.outputFmt = fmt;
+	cfg.defines = macros.data();
+	cfg.loadIncludeFileFunc = LoadIncludeFileBench;
+	cfg.loadIncludeFileUserData = const_cast<IncludeMap*>(&sh.includes);
+	cfg.codeOutputStream = &toCode;
+	cfg.errorOutputStream = errors ? &toErrorsStr : &toErrorsCount;
+	cfg.compileStats = stats;
+	return HOC_CompileShader(sh.name.c_str(), sh.source.c_str(), &cfg) != 0;
+}
+
+
+/* collects sources from test scripts (see test.cpp for the syntax)
+- only sources that are followed by a successful compilation command are used
+- the stage is deduced from the compilation command arguments */
+static void LoadTestSources(const char* fname, const char* nameonly, std::vector<BenchShader>& out)
+{
+	std::string testFile = GetFileContents<std::string>(fname);
+	IncludeMap includes;
+	std::string lastSource;
+	std::string testName = "<unknown>";
+	bool usedVS = false, usedPS = false;
+
+	const char* data = testFile.c_str();
+	while (*data)
+	{
+		while (*data == ' ' || *data == '\t' || *data == '\r' || *data == '\n') data++;
+		if (!*data)
+			break;
+
+		const char* ident_start = data;
+		while (*data == '_' || *data == '/' ||
+			(*data >= 'a' && *data <= 'z') ||
+			(*data >= 'A' && *data <= 'Z') ||
+			(*data >= '0' && *data <= '9')) data++;
+		if (ident_start == data)
+		{
+			fprintf(stderr, "%s - expected identifier, skipping rest of file\n", fname);
+			return;
+		}
+		std::string ident(ident_start, data - ident_start);
+
+		while (*data == ' ' || *data == '\t' || *data == '\r' || *data == '\n') data++;
+		if (*data != '`')
+		{
+			fprintf(stderr, "%s - expected start of value (`), skipping rest of file\n", fname);
+			return;
+		}
+		const char* value_start = ++data;
+		bool esc = false;
+		while (*data)
+		{
+			if (*data == '`' && !esc)
+				break;
+			if (*data == '\\' && !esc)
+				esc = true;
+			else esc = false;
+			data++;
+		}
+		if (*data != '`')
+		{
+			fprintf(stderr, "%s - expected end of value (`), skipping rest of file\n", fname);
+			return;
+		}
+		const char* value_end = data++;
+
+		std::string value;
+		for (const char* ip = value_start; ip < value_end; ++ip)
+		{
+			if (*ip == '\\' && (ip[1] == '\\' || ip[1] == '`'))
+				++ip;
+			value.push_back(*ip);
+		}
+
+		if (ident.size() > 2 && ident[0] == '/' && ident[1] == '/')
+		{
+			testName = value;
+		}
+		else if (ident == "source")
+		{
+			lastSource = value;
+			usedVS = false;
+			usedPS = false;
+		}
+		else if (ident == "source_replace")
+		{
+			size_t splitpos = value.find("=>");
+			if (splitpos != std::string::npos)
+			{
+				std::string strToFind = value.substr(0, splitpos);
+				std::string strReplacement = value.substr(splitpos + 2);
+				for (size_t i = 0; strToFind.size(); i += strReplacement.size())
+				{
+					i = lastSource.find(strToFind, i);
+					if (i == std::string::npos)
+						break;
+					lastSource.replace(i, strToFind.size(), strReplacement);
+				}
+				usedVS = false;
+				usedPS = false;
+			}
+		}
+		else if (ident == "addinc")
+		{
+			size_t pos = value.find("=");
+			if (pos != std::string::npos)
+				includes[value.substr(0, pos)] = value.substr(pos + 1);
+		}
+		else if (ident == "rminc")
+		{
+			includes.clear();
+		}
+		else if (ident.compare(0, 8, "compile_") == 0 &&
+			ident.compare(0, 12, "compile_fail") != 0)
+		{
+			bool ps = value.find("-S frag") != std::string::npos ||
+				value.find("/T ps_") != std::string::npos;
+			bool& used = ps ? usedPS : usedVS;
+			if (!used && lastSource.size())
+			{
+				used = true;
+				BenchShader sh;
+				sh.group = "tests";
+				sh.name = std::string(nameonly) + ":" + testName;
+				sh.source = lastSource;
+				sh.stage = ps ? ShaderStage_Pixel : ShaderStage_Vertex;
+				sh.includes = includes;
+				out.push_back(sh);
+			}
+		}
+	}
+}
+
+static bool LoadTestDir(const char* dir, std::vector<BenchShader>& out)
+{
+	DIR* d = opendir(dir);
+	if (!d)
+		return false;
+
+	std::vector<std::string> names;
+	while (struct dirent* e = readdir(d))
+	{
+		size_t len = strlen(e->d_name);
+		if (strncmp(e->d_name, "!_", 2) == 0)
+			continue;
+		if (len < 5 || strcmp(e->d_name + len - 5, ".hlsl") != 0)
+			continue;
+		names.push_back(e->d_name);
+	}
+	closedir(d);
+
+	std::sort(names.begin(), names.end());
+	for (const auto& name : names)
+	{
+		std::string path = std::string(dir) + "/" + name;
+		LoadTestSources(path.c_str(), name.c_str(), out);
+	}
+	return true;
+}
+
+static void AddHTML5Shaders(const char* path, std::vector<BenchShader>& out)
+{
+	std::string src = GetFileContents<std::string>(path);
+	if (src.empty())
+	{
+		fprintf(stderr, "warning: could not load '%s', skipping\n", path);
+		return;
+	}
+	for (int ps = 0; ps < 2; ++ps)
+	{
+		BenchShader sh;
+		sh.group = "html5";
+		sh.name = std::string(path) + (ps ? ":ps" : ":vs");
+		sh.source = src;
+		sh.stage = ps ? ShaderStage_Pixel : ShaderStage_Vertex;
+		sh.defines.push_back(std::make_pair(ps ? "PS" : "VS", "1"));
+		out.push_back(sh);
+	}
+}
+
+static BenchShader MakeSyntheticShader(const ShaderGenParams& params, const char* group, const char* name)
+{
+	ShaderGenerator gen(params);
+	BenchShader sh;
+	sh.group = group;
+	sh.name = name;
+	sh.source = gen.Generate();
+	sh.stage = params.pixelShader ? ShaderStage_Pixel : ShaderStage_Vertex;
+	for (const auto& inc : gen.includes)
+		sh.includes[inc.first] = inc.second;
+	return sh;
+}
+
+static void AddSyntheticShaders(int scale, std::vector<BenchShader>& out)
+{
+	static const int sizes[] = { 4, 16, 64 };
+	for (int size : sizes)
+	{
+		for (int ps = 0; ps < 2; ++ps)
+		{
+			ShaderGenParams params;
+			params.numFunctions = size * scale;
+			params.numStatements = 8;
+			params.exprLength = 8;
+			params.numUniforms = 16 + size;
+			params.pixelShader = ps != 0;
+			params.seed = uint32_t(size * 2 + ps + 1);
+
+			char name[64];
+			snprintf(name, sizeof(name), "synthetic-%d%s", size * scale, ps ? ":ps" : ":vs");
+
+			out.push_back(MakeSyntheticShader(params, "synthetic", name));
+		}
+	}
+}
+
+
+static void AddMeasurement(BenchResult& res, const BenchShader& sh, const std::vector<double>& times)
+{
+	for (double t : times)
+	{
+		res.latencies.push_back(t);
+		res.totalTime += t;
+		res.sourceBytes += sh.source.size();
+	}
+	res.numCompiles += times.size();
+	res.numShaders++;
+}
+
+static void PrintResults(const std::vector<BenchResult>& results)
+{
+	printf("\n%-24s %8s %8s %12s %10s %10s %10s\n",
+		"group.format", "shaders", "skipped", "shaders/s", "MB/s", "p50 ms", "p99 ms");
+	for (const auto& r : results)
+	{
+		printf("%-24s %8zu %8zu %12.1f %10.3f %10.4f %10.4f\n",
+			r.key.c_str(), r.numShaders, r.numSkipped, r.ShadersPerSec(), r.MBPerSec(),
+			r.Percentile(0.5) * 1000, r.Percentile(0.99) * 1000);
+	}
+}
+
+static bool WriteJSON(const char* path, const std::vector<BenchResult>& results, int iterations)
+{
+	FILE* fp = fopen(path, "w");
+	if (!fp)
+	{
+		fprintf(stderr, "error: failed to open '%s' for writing\n", path);
+		return false;
+	}
+	fprintf(fp, "{\n\t\"iterations\": %d,\n\t\"results\": {", iterations);
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const auto& r = results[i];
+		fprintf(fp, "%s\n\t\t\"%s\": {\"shaders\": %zu, \"skipped\": %zu, \"compiles\": %zu, "
+			"\"seconds\": %.6f, \"shaders_per_sec\": %.3f, \"mb_per_sec\": %.5f, "
+			"\"p50_ms\": %.5f, \"p99_ms\": %.5f}",
+			i ? "," : "", r.key.c_str(), r.numShaders, r.numSkipped, r.numCompiles,
+			r.totalTime, r.ShadersPerSec(), r.MBPerSec(),
+			r.Percentile(0.5) * 1000, r.Percentile(0.99) * 1000);
+	}
+	fprintf(fp, "\n\t}\n}\n");
+	fclose(fp);
+	return true;
+}
+
+
+/* minimal JSON reader for baseline files
+- flattens all numeric values to "<key>.<key>..." paths */
+struct JSONFlattener
+{
+	bool Parse(const char* text)
+	{
+		p = text;
+		return Value("") && (SkipSpace(), *p == '\0');
+	}
+	void SkipSpace()
+	{
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+	}
+	bool String(std::string& out)
+	{
+		if (*p != '"')
+			return false;
+		p++;
+		while (*p && *p != '"')
+		{
+			if (*p == '\\' && p[1])
+				p++;
+			out.push_back(*p++);
+		}
+		if (*p != '"')
+			return false;
+		p++;
+		return true;
+	}
+	bool Value(const std::string& path)
+	{
+		SkipSpace();
+		if (*p == '{')
+		{
+			p++;
+			SkipSpace();
+			if (*p == '}')
+				return p++, true;
+			for (;;)
+			{
+				std::string key;
+				SkipSpace();
+				if (!String(key))
+					return false;
+				SkipSpace();
+				if (*p++ != ':')
+					return false;
+				if (!Value(path.empty() ? key : path + "." + key))
+					return false;
+				SkipSpace();
+				if (*p == ',')
+				{
+					p++;
+					continue;
+				}
+				if (*p == '}')
+					return p++, true;
+				return false;
+			}
+		}
+		if (*p == '[')
+		{
+			p++;
+			for (int i = 0;; ++i)
+			{
+				SkipSpace();
+				if (*p == ']')
+					return p++, true;
+				if (!Value(path + "." + std::to_string(i)))
+					return false;
+				SkipSpace();
+				if (*p == ',')
+					p++;
+			}
+		}
+		if (*p == '"')
+		{
+			std::string tmp;
+			return String(tmp);
+		}
+		if (strncmp(p, "true", 4) == 0) return p += 4, true;
+		if (strncmp(p, "false", 5) == 0) return p += 5, true;
+		if (strncmp(p, "null", 4) == 0) return p += 4, true;
+
+		char* end = nullptr;
+		double v = strtod(p, &end);
+		if (end == p)
+			return false;
+		p = end;
+		values[path] = v;
+		return true;
+	}
+
+	const char* p = nullptr;
+	std::unordered_map<std::string, double> values;
+};
+
+/* returns the number of regressions
+- throughput (higher is better) and latency (lower is better) are compared separately */
+static int CompareWithBaseline(const char* path, const std::vector<BenchResult>& results, double thresholdPct)
+{
+	std::string text = GetFileContents<std::string>(path);
+	JSONFlattener json;
+	if (text.empty() || !json.Parse(text.c_str()))
+	{
+		fprintf(stderr, "error: failed to load baseline '%s'\n", path);
+		return -1;
+	}
+
+	int numRegressions = 0;
+	double limit = thresholdPct / 100.0;
+	printf("\ncomparison with baseline '%s' (threshold: %g%%):\n", path, thresholdPct);
+	for (const auto& r : results)
+	{
+		struct Metric { const char* name; double value; bool higherIsBetter; };
+		Metric metrics[] =
+		{
+			{ "shaders_per_sec", r.ShadersPerSec(), true },
+			{ "mb_per_sec", r.MBPerSec(), true },
+			{ "p50_ms", r.Percentile(0.5) * 1000, false },
+			{ "p99_ms", r.Percentile(0.99) * 1000, false },
+		};
+		for (const auto& m : metrics)
+		{
+			auto it = json.values.find("results." + r.key + "." + m.name);
+			if (it == json.values.end() || it->second <= 0)
+				continue;
+			double base = it->second;
+			double change = (m.value - base) / base;
+			bool regressed = m.higherIsBetter ? change < -limit : change > limit;
+			if (regressed)
+				numRegressions++;
+			printf("%-24s %-16s %12.4f -> %12.4f (%+7.2f%%)%s\n",
+				r.key.c_str(), m.name, base, m.value, change * 100,
+				regressed ? "  REGRESSION" : "");
+		}
+	}
+	printf("regressions: %d\n", numRegressions);
+	return numRegressions;
+}
+
+
+/* scaling report
+- each series doubles one generator parameter while keeping the rest small
+- per-stage times are fitted to t = c * n^k (log-log least squares) and to t / (n log n),
+  stages where the latter still grows (slope above tolerance) are flagged as superlinear
+- series with an exponent limit for the optimize stage fail if it is exceeded
+  (inlining must stay linear in the number of functions)
+*/
+struct ScalingSeries
+{
+	const char* name;
+	int ShaderGenParams::* param;
+	int first;
+	int numFunctions; // to have enough functions for call depth/include fan-out
+	double maxOptimizeExponent; // 0 - no limit
+};
+
+static const ScalingSeries SCALING_SERIES[] =
+{
+	{ "functions", &ShaderGenParams::numFunctions, 8, 0, 1.3 },
+	{ "call_depth", &ShaderGenParams::callDepth, 2, 256, 0 },
+	{ "expr_length", &ShaderGenParams::exprLength, 8, 0, 0 },
+	{ "expr_nesting", &ShaderGenParams::exprNesting, 4, 0, 0 },
+	{ "uniforms", &ShaderGenParams::numUniforms, 16, 0, 0 },
+	{ "cbuffers", &ShaderGenParams::numCBuffers, 4, 0, 0 },
+	{ "struct_members", &ShaderGenParams::structMembers, 4, 0, 0 },
+	{ "macro_nesting", &ShaderGenParams::macroNesting, 4, 0, 0 },
+	{ "include_fanout", &ShaderGenParams::includeFanOut, 4, 256, 0 },
+};
+#define NUM_SCALING_SERIES (sizeof(SCALING_SERIES)/sizeof(SCALING_SERIES[0]))
+
+#define SCALING_TOTAL HOC_NUM_COMPILE_STAGES // index of total time in sample arrays
+#define SCALING_MIN_TIME 20e-6 // shorter times are too noisy to fit
+
+struct LogLogFit
+{
+	double exponent = 0; // k in t = c * n^k
+	double nlognSlope = 0; // k in t / (n log n) = c * n^k
+	bool valid = false;
+};
+
+static LogLogFit FitGrowth(const std::vector<int>& ns, const std::vector<double>& ts)
+{
+	LogLogFit fit;
+	double sx = 0, sy = 0, sz = 0, sxx = 0, sxy = 0, sxz = 0;
+	int count = 0;
+	for (size_t i = 0; i < ns.size(); ++i)
+	{
+		if (ts[i] < SCALING_MIN_TIME || ns[i] < 1)
+			continue;
+		double n = ns[i];
+		double x = log(n);
+		double y = log(ts[i]);
+		double z = y - log(n * std::max(1.0, log2(n)));
+		sx += x;
+		sy += y;
+		sz += z;
+		sxx += x * x;
+		sxy += x * y;
+		sxz += x * z;
+		count++;
+	}
+	double den = count * sxx - sx * sx;
+	if (count < 3 || den <= 0)
+		return fit;
+	fit.exponent = (count * sxy - sx * sy) / den;
+	fit.nlognSlope = (count * sxz - sx * sz) / den;
+	fit.valid = true;
+	return fit;
+}
+
+static double Median(std::vector<double>& v)
+{
+	std::sort(v.begin(), v.end());
+	return v.empty() ? 0 : v[v.size() / 2];
+}
+
+static int RunScalingReport(OutputShaderFormat fmt, int steps, int repetitions, double tolerance)
+{
+	int numFlagged = 0;
+	int numOverLimit = 0;
+	std::string flagged;
+	std::string overLimit;
+	printf("scaling report (%s, %d steps, median of %d compilations, tolerance: %g)\n",
+		OUTPUT_FORMATS[fmt], steps, repetitions, tolerance);
+
+	for (size_t s = 0; s < NUM_SCALING_SERIES; ++s)
+	{
+		const ScalingSeries& series = SCALING_SERIES[s];
+		printf("\nseries: %s\n%8s %10s", series.name, "n", "bytes");
+		for (int st = 0; st < HOC_NUM_COMPILE_STAGES; ++st)
+			printf(" %11s", HOC_CompileStageToString(st));
+		printf(" %11s\n", "total");
+
+		std::vector<int> ns;
+		std::vector<double> times[SCALING_TOTAL + 1];
+		int n = series.first;
+		for (int step = 0; step < steps; ++step, n *= 2)
+		{
+			ShaderGenParams params;
+			params.numFunctions = 8;
+			params.numStatements = 8;
+			params.exprLength = 8;
+			params.numUniforms = 16;
+			if (series.numFunctions)
+				params.numFunctions = std::max(series.numFunctions, n);
+			params.*series.param = n;
+
+			BenchShader sh = MakeSyntheticShader(params, "scaling", series.name);
+			std::string errors;
+			if (!CompileOnce(sh, fmt, &errors))
+			{
+				printf("%8d  failed to compile, series stopped:\n%s\n", n, errors.c_str());
+				break;
+			}
+
+			std::vector<double> samples[SCALING_TOTAL + 1];
+			for (int r = 0; r < repetitions; ++r)
+			{
+				HOC_CompileStats stats;
+				double t0 = GetTime();
+				CompileOnce(sh, fmt, nullptr, &stats);
+				samples[SCALING_TOTAL].push_back(GetTime() - t0);
+				for (int st = 0; st < HOC_NUM_COMPILE_STAGES; ++st)
+					samples[st].push_back(stats.stageTime[st]);
+			}
+
+			size_t bytes = sh.source.size();
+			for (const auto& inc : sh.includes)
+				bytes += inc.second.size();
+			printf("%8d %10zu", n, bytes);
+			ns.push_back(n);
+			for (int st = 0; st <= SCALING_TOTAL; ++st)
+			{
+				times[st].push_back(Median(samples[st]));
+				printf(" %11.4f", times[st].back() * 1000);
+			}
+			printf("\n");
+		}
+
+		printf("%19s", "exponent");
+		LogLogFit fits[SCALING_TOTAL + 1];
+		for (int st = 0; st <= SCALING_TOTAL; ++st)
+		{
+			fits[st] = FitGrowth(ns, times[st]);
+			if (fits[st].valid)
+				printf(" %11.2f", fits[st].exponent);
+			else
+				printf(" %11s", "-");
+		}
+		printf("\n%19s", "vs n log n");
+		for (int st = 0; st <= SCALING_TOTAL; ++st)
+		{
+			if (!fits[st].valid)
+			{
+				printf(" %11s", "-");
+				continue;
+			}
+			bool superlinear = fits[st].nlognSlope > tolerance;
+			printf(" %10.2f%s", fits[st].nlognSlope, superlinear ? "!" : " ");
+			if (superlinear)
+			{
+				numFlagged++;
+				char bfr[128];
+				snprintf(bfr, sizeof(bfr), "  %s / %s: t ~ n^%.2f\n", series.name,
+					st == SCALING_TOTAL ? "total" : HOC_CompileStageToString(st), fits[st].exponent);
+				flagged += bfr;
+			}
+		}
+		printf("\n");
+
+		const LogLogFit& opt = fits[CS_Optimize];
+		if (series.maxOptimizeExponent > 0 && opt.valid && opt.exponent > series.maxOptimizeExponent)
+		{
+			numOverLimit++;
+			char bfr[128];
+			snprintf(bfr, sizeof(bfr), "  %s / optimize: t ~ n^%.2f (limit: n^%.2f)\n", series.name,
+				opt.exponent, series.maxOptimizeExponent);
+			overLimit += bfr;
+		}
+	}
+
+	printf("\nstages growing faster than n log n: %d\n%s", numFlagged, flagged.c_str());
+	printf("stages over their exponent limit: %d\n%s", numOverLimit, overLimit.c_str());
+	return numFlagged + numOverLimit;
+}
+
+
+static void PrintHelp()
+{
+	puts("HLSL optimizing converter - compiler throughput benchmark");
+	puts("usage: hlslbench [options]");
+	puts("options:");
+	puts("  -n, --iterations=<n>   timed compilations of each shader/format pair (default: 10)");
+	puts("  -w, --warmup=<n>       untimed compilations before measuring (default: 2)");
+	puts("  -d, --tests=<dir>      directory with test scripts (default: tests)");
+	puts("  --html5=<file>         html5 sample shader (default: runtests/html5-shader.hlsl)");
+	puts("  --scale=<n>            size multiplier for synthetic shaders (default: 1, 0 to disable)");
+	puts("  -f, --format=<fmt>     only benchmark one output format");
+	puts("  --json=<file>          save results as JSON");
+	puts("  --baseline=<file>      compare with results saved using --json, fail on regressions");
+	puts("  --threshold=<pct>      allowed regression in percent (default: 10)");
+	puts("  -v, --verbose          print skipped shaders with errors");
+	puts("  --scaling              run the scaling report instead (format: -f, default: hlsl_sm4)");
+	puts("  --scaling-steps=<n>    number of size doublings per series (default: 7)");
+	puts("  --tolerance=<k>        max. slope of t/(n log n) over n in log-log space (default: 0.25)");
+}
+
+struct ArgParser
+{
+	bool FlagArg(int& i, const char* shortArg, const char* longArg)
+	{
+		const char* curArg = argv[i];
+		if (curArg[0] != '-')
+			return false;
+		if (shortArg && strcmp(curArg + 1, shortArg) == 0)
+			return true;
+		return curArg[1] == '-' && strcmp(curArg + 2, longArg) == 0;
+	}
+	const char* ValueArg(int& i, const char* shortArg, const char* longArg)
+	{
+		const char* curArg = argv[i];
+		if (curArg[0] != '-')
+			return nullptr;
+		if (shortArg && i + 1 < argc && strcmp(curArg + 1, shortArg) == 0)
+			return argv[++i];
+		size_t len = strlen(longArg);
+		if (curArg[1] == '-' && strncmp(curArg + 2, longArg, len) == 0)
+		{
+			if (curArg[2 + len] == '=' && curArg[3 + len] != '\0')
+				return curArg + 3 + len;
+			if (curArg[2 + len] == '\0' && i + 1 < argc)
+				return argv[++i];
+		}
+		return nullptr;
+	}
+
+	int argc;
+	char** argv;
+};
+
+int main(int argc, char** argv)
+{
+	int iterations = 10;
+	int warmup = 2;
+	int scale = 1;
+	int onlyFormat = -1;
+	bool verbose = false;
+	bool scaling = false;
+	int scalingSteps = 7;
+	double tolerance = 0.25;
+	double thresholdPct = 10;
+	const char* testDir = "tests";
+	const char* html5File = "runtests/html5-shader.hlsl";
+	const char* jsonFile = nullptr;
+	const char* baselineFile = nullptr;
+
+	ArgParser ap = { argc, argv };
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* val;
+		if (ap.FlagArg(i, "h", "help"))
+		{
+			PrintHelp();
+			return 0;
+		}
+		else if (ap.FlagArg(i, "v", "verbose"))
+			verbose = true;
+		else if (ap.FlagArg(i, nullptr, "scaling"))
+			scaling = true;
+		else if ((val = ap.ValueArg(i, nullptr, "scaling-steps")))
+			scalingSteps = atoi(val);
+		else if ((val = ap.ValueArg(i, nullptr, "tolerance")))
+			tolerance = atof(val);
+		else if ((val = ap.ValueArg(i, "n", "iterations")))
+			iterations = atoi(val);
+		else if ((val = ap.ValueArg(i, "w", "warmup")))
+			warmup = atoi(val);
+		else if ((val = ap.ValueArg(i, "d", "tests")))
+			testDir = val;
+		else if ((val = ap.ValueArg(i, nullptr, "html5")))
+			html5File = val;
+		else if ((val = ap.ValueArg(i, nullptr, "scale")))
+			scale = atoi(val);
+		else if ((val = ap.ValueArg(i, nullptr, "json")))
+			jsonFile = val;
+		else if ((val = ap.ValueArg(i, nullptr, "baseline")))
+			baselineFile = val;
+		else if ((val = ap.ValueArg(i, nullptr, "threshold")))
+			thresholdPct = atof(val);
+		else if ((val = ap.ValueArg(i, "f", "format")))
+		{
+			for (size_t f = 0; f < NUM_OUTPUT_FORMATS; ++f)
+				if (strcmp(OUTPUT_FORMATS[f], val) == 0)
+					onlyFormat = int(f);
+			if (onlyFormat < 0)
+			{
+				fprintf(stderr, "error: output format string not recognized - '%s'\n", val);
+				return 1;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "error: unrecognized argument: %s\n", argv[i]);
+			PrintHelp();
+			return 1;
+		}
+	}
+	if (iterations < 1)
+		iterations = 1;
+
+	if (scaling)
+	{
+		OutputShaderFormat fmt = onlyFormat >= 0 ? OutputShaderFormat(onlyFormat) : OSF_HLSL_SM4;
+		return RunScalingReport(fmt, scalingSteps, iterations, tolerance) ? 1 : 0;
+	}
+
+	std::vector<BenchShader> shaders;
+	if (!LoadTestDir(testDir, shaders))
+		fprintf(stderr, "warning: could not open test directory '%s', skipping\n", testDir);
+	if (*html5File)
+		AddHTML5Shaders(html5File, shaders);
+	if (scale > 0)
+		AddSyntheticShaders(scale, shaders);
+	printf("benchmarking %zu shaders, %d iterations (+%d warm-up)\n", shaders.size(), iterations, warmup);
+
+	std::vector<BenchResult> results;
+	auto GetResult = [&results](const std::string& key) -> BenchResult&
+	{
+		for (auto& r : results)
+			if (r.key == key)
+				return r;
+		results.push_back(BenchResult());
+		results.back().key = key;
+		return results.back();
+	};
+
+	std::vector<double> times;
+	for (size_t f = 0; f < NUM_OUTPUT_FORMATS; ++f)
+	{
+		if (onlyFormat >= 0 && int(f) != onlyFormat)
+			continue;
+		OutputShaderFormat fmt = OutputShaderFormat(f);
+		std::string totalKey = std::string("all.") + OUTPUT_FORMATS[f];
+		for (const auto& sh : shaders)
+			GetResult(sh.group + "." + OUTPUT_FORMATS[f]);
+		GetResult(totalKey);
+		for (const auto& sh : shaders)
+		{
+			std::string key = sh.group + "." + OUTPUT_FORMATS[f];
+			std::string errors;
+			if (!CompileOnce(sh, fmt, &errors))
+			{
+				if (verbose)
+					fprintf(stderr, "skipped %s [%s]:\n%s\n", sh.name.c_str(), OUTPUT_FORMATS[f], errors.c_str());
+				GetResult(key).numSkipped++;
+				GetResult(totalKey).numSkipped++;
+				continue;
+			}
+			for (int i = 0; i < warmup; ++i)
+				CompileOnce(sh, fmt, nullptr);
+
+			times.clear();
+			for (int i = 0; i < iterations; ++i)
+			{
+				double t0 = GetTime();
+				CompileOnce(sh, fmt, nullptr);
+				times.push_back(GetTime() - t0);
+			}
+			AddMeasurement(GetResult(key), sh, times);
+			AddMeasurement(GetResult(totalKey), sh, times);
+		}
+	}
+	for (auto& r : results)
+		std::sort(r.latencies.begin(), r.latencies.end());
+
+	PrintResults(results);
+
+	if (jsonFile && !WriteJSON(jsonFile, results, iterations))
+		return 1;
+	if (baselineFile && CompareWithBaseline(baselineFile, results, thresholdPct) != 0)
+		return 1;
+	return 0;
+}
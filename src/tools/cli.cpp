@@ -58,6 +58,9 @@ static const char* OUTPUT_FORMATS[] =
 	"hlsl_sm4",
 	"glsl_140",
 	"glsl_es_100",
+	"glsl_330",
+	"glsl_es_300",
+	"spirv",
 };
 #define NUM_OUTPUT_FORMATS (sizeof(OUTPUT_FORMATS)/sizeof(OUTPUT_FORMATS[0]))
 static OutputShaderFormat StringToOutputFmt(const char* str)
@@ -106,6 +109,22 @@ static uint32_t FindOutputFlagByName(const char* str)
 		return HOC_OF_GLSL_RENAME_VSINPUT;
 	if (!strcmp(str, "glsl-rename-varyings"))
 		return HOC_OF_GLSL_RENAME_VARYINGS;
+	if (!strcmp(str, "glsl-auto-precision"))
+		return HOC_OF_GLSL_AUTO_PRECISION;
+	if (!strcmp(str, "native-half"))
+		return HOC_OF_NATIVE_HALF;
+	if (!strcmp(str, "export-varyings"))
+		return HOC_OF_EXPORT_VARYINGS;
+	if (!strcmp(str, "export-usage-masks"))
+		return HOC_OF_EXPORT_USAGE_MASKS;
+	if (!strcmp(str, "export-layout"))
+		return HOC_OF_EXPORT_LAYOUT;
+	if (!strcmp(str, "hlsl3-pack-uniforms"))
+		return HOC_OF_HLSL3_PACK_UNIFORMS;
+	if (!strcmp(str, "fast-math"))
+		return HOC_OF_FAST_MATH;
+	if (!strcmp(str, "preshader"))
+		return HOC_OF_PRESHADER;
 	return 0;
 }
 
@@ -119,13 +138,17 @@ static void PrintHelp()
 	fprintf(stderr, "    -o, --output      - name of output file (default='<input>.<fmt>.<fmt[4]>')\n");
 	fprintf(stderr, "    -P, --stdout      - write code to output\n");
 	fprintf(stderr, "    -D<name>[=<val>]  - add a preprocessor define\n");
+	fprintf(stderr, "    -U<name>=<val>[,<val>...] - replace a uniform with a constant value\n");
 	fprintf(stderr, "    -e, --entrypoint  - name of shader entry point function (default='main')\n");
 	fprintf(stderr, "    -f, --format      - output format (required, see options below)\n");
 	fprintf(stderr, "    -s, --stage       - shader stage (required, see options below)\n");
 	fprintf(stderr, "    -x, --transform   - apply code transformation (see options below)\n");
 	fprintf(stderr, "    -d, --dump        - dump AST before/after modifications\n");
+	fprintf(stderr, "    -O<level>         - optimization level (0 - folding only, 1 - default, 2 - aggressive)\n");
+	fprintf(stderr, "    --max-unroll=<n>  - max. size of a fully unrolled loop in AST nodes (0 - no unrolling, default=256)\n");
 	fprintf(stderr, "    -f<name>          - enable a build flag\n");
 	fprintf(stderr, "    -fno-<name>       - disable a build flag\n");
+	fprintf(stderr, "    --package=<file>  - compile all shaders listed in <source> into a package file\n");
 	fprintf(stderr, "\n");
 	fprintf(stderr, "  supported shader stages: vertex, pixel\n");
 	fprintf(stderr, "\n");
@@ -143,12 +166,32 @@ static void PrintHelp()
 	fprintf(stderr, "     pick and export the registers of unassigned I/O variables\n");
 	fprintf(stderr, "    - hlsl3-buffer-slots (default: off)\n");
 	fprintf(stderr, "     interpret buffer registers as slot offsets and apply them\n");
+	fprintf(stderr, "    - hlsl3-pack-uniforms (default: off)\n");
+	fprintf(stderr, "     share c# registers between scalar/float2/float3 uniforms\n");
 	fprintf(stderr, "    - glsl-rename-psoutput (default: on)\n");
 	fprintf(stderr, "     rename pixel shader outputs to PSCOLOR# for easier binding\n");
 	fprintf(stderr, "    - glsl-rename-samplers (default: on)\n");
 	fprintf(stderr, "     rename texture samplers to SAMPLER# for easier binding\n");
 	fprintf(stderr, "    - glsl-rename-cbuffers (default: on)\n");
 	fprintf(stderr, "     rename constant buffers to CBUF# for easier binding\n");
+	fprintf(stderr, "    - glsl-auto-precision (default: off)\n");
+	fprintf(stderr, "     declare GLSL ES variables as mediump where the value ranges allow it\n");
+	fprintf(stderr, "    - native-half (default: off)\n");
+	fprintf(stderr, "     emit half as min16float (HLSL SM4) or mediump (GLSL), uniforms stay 32-bit\n");
+	fprintf(stderr, "    - export-varyings (default: off)\n");
+	fprintf(stderr, "     list VS outputs and PS inputs in the interface output\n");
+	fprintf(stderr, "    - export-usage-masks (default: off)\n");
+	fprintf(stderr, "     export the components of uniforms that are read in the interface output\n");
+	fprintf(stderr, "    - export-layout (default: off)\n");
+	fprintf(stderr, "     export byte offsets, sizes and strides of uniforms in the interface output\n");
+	fprintf(stderr, "    - fast-math (default: off)\n");
+	fprintf(stderr, "     allow optimizations that change results for -0, infinities, NaNs or by rounding\n");
+	fprintf(stderr, "    - preshader (default: off)\n");
+	fprintf(stderr, "     replace uniform-only expressions with uniforms computed by a CPU program\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  package list format (one shader per line, '#' starts a comment):\n");
+	fprintf(stderr, "    <name> <stage> <format> <source> [-D<name>[=<val>]...] [-e<entrypoint>] [-O<level>] [-f[no-]<flag>...]\n");
+	fprintf(stderr, "    - other options apply to all shaders, permutation hash is computed from the -D options in the line\n");
 }
 
 static void Stringify(String& out, const String& in, bool jsconcat)
@@ -166,14 +209,138 @@ static void Stringify(String& out, const String& in, bool jsconcat)
 	out += "\"";
 }
 
+static void SplitArgs(Array<String>& out, const String& line)
+{
+	size_t i = 0;
+	while (i < line.size())
+	{
+		while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r'))
+			i++;
+		size_t start = i;
+		while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r')
+			i++;
+		if (i > start)
+			out.push_back(line.substr(start, i - start));
+	}
+}
+
+static int BuildPackage(const char* listFileName, const char* packageFileName, const HOC_Config& baseCfg, const Array<ShaderMacro>& baseMacros)
+{
+	String list = GetFileContents<String>(listFileName, true);
+	HOC_PackageBuilder* pb = HOC_CreatePackageBuilder();
+	int numErrors = 0;
+	size_t lineStart = 0;
+	for (int lineNum = 1; lineStart < list.size(); ++lineNum)
+	{
+		size_t lineEnd = list.find("\n", lineStart);
+		if (lineEnd == String::npos)
+			lineEnd = list.size();
+		String line = list.substr(lineStart, lineEnd - lineStart);
+		lineStart = lineEnd + 1;
+		size_t comment = line.find("#");
+		if (comment != String::npos)
+			line = line.substr(0, comment);
+
+		Array<String> args;
+		SplitArgs(args, line);
+		if (args.empty())
+			continue;
+		if (args.size() < 4)
+		{
+			fprintf(stderr, "%s:%d: error: expected <name> <stage> <format> <source>\n", listFileName, lineNum);
+			numErrors++;
+			continue;
+		}
+
+		HOC_Config cfg = baseCfg;
+		cfg.stage = StringToShaderStage(args[1].c_str());
+		cfg.outputFmt = StringToOutputFmt(args[2].c_str());
+		Array<ShaderMacro> macros = baseMacros;
+		// the permutation is identified by the defines of this line, split into name/value
+		Array<String> permNames;
+		Array<String> permValues;
+		Array<bool> permHasValue;
+		for (size_t i = 4; i < args.size(); ++i)
+		{
+			const char* arg = args[i].c_str();
+			if (strncmp(arg, "-D", 2) == 0 && arg[2])
+			{
+				const char* eq = strchr(arg + 2, '=');
+				permNames.push_back(eq ? String(arg + 2, eq - arg - 2) : String(arg + 2));
+				permValues.push_back(eq ? String(eq + 1) : String());
+				permHasValue.push_back(eq != nullptr);
+			}
+			else if (strncmp(arg, "-e", 2) == 0 && arg[2])
+				cfg.entryPoint = arg + 2;
+			else if (strncmp(arg, "-O", 2) == 0 && arg[2] >= '0' && arg[2] <= '2' && !arg[3])
+				cfg.optimizationLevel = uint8_t(arg[2] - '0');
+			else if (uint32_t flag = strncmp(arg, "-fno-", 5) == 0 ? FindOutputFlagByName(arg + 5) : 0)
+				cfg.outputFlags &= ~flag;
+			else if (uint32_t flag = strncmp(arg, "-f", 2) == 0 ? FindOutputFlagByName(arg + 2) : 0)
+				cfg.outputFlags |= flag;
+			else
+			{
+				fprintf(stderr, "%s:%d: error: option not recognized - '%s'\n", listFileName, lineNum, arg);
+				numErrors++;
+			}
+		}
+		Array<ShaderMacro> permMacros;
+		for (size_t i = 0; i < permNames.size(); ++i)
+			permMacros.push_back({ permNames[i].c_str(), permHasValue[i] ? permValues[i].c_str() : nullptr });
+		for (size_t i = 0; i < permMacros.size(); ++i)
+			macros.push_back(permMacros[i]);
+		permMacros.push_back({ nullptr, nullptr });
+		macros.push_back({ nullptr, nullptr });
+		cfg.defines = macros.data();
+
+		String code;
+		HOC_TextOutput toCode = { &HOC_WriteStr_String<String>, &code };
+		HOC_InterfaceOutput ifo;
+		cfg.codeOutputStream = &toCode;
+		cfg.codeOutput = nullptr;
+		cfg.interfaceOutput = &ifo;
+		String source = GetFileContents<String>(args[3].c_str(), true);
+		if (!HOC_CompileShader(args[3].c_str(), source.c_str(), &cfg))
+		{
+			fprintf(stderr, "%s:%d: error: failed to compile '%s'\n", listFileName, lineNum, args[0].c_str());
+			numErrors++;
+		}
+		else if (!HOC_PackageAddShader(pb, args[0].c_str(), cfg.stage, cfg.outputFmt,
+			HOC_HashPermutation(permMacros.data()), code.data(), code.size(), &ifo))
+		{
+			fprintf(stderr, "%s:%d: error: duplicate shader '%s'\n", listFileName, lineNum, args[0].c_str());
+			numErrors++;
+		}
+		HOC_FreeInterfaceOutputBuffers(&ifo);
+	}
+
+	String package;
+	HOC_TextOutput toPackage = { &HOC_WriteStr_String<String>, &package };
+	if (!numErrors && !HOC_WritePackage(pb, &toPackage))
+	{
+		fprintf(stderr, "error: package is too big\n");
+		numErrors++;
+	}
+	HOC_DestroyPackageBuilder(pb);
+	if (numErrors)
+	{
+		fprintf(stderr, "package build failed, no output generated\n");
+		return 1;
+	}
+	SetFileContents(packageFileName, package, false);
+	return 0;
+}
+
 int main(int argc, char** argv)
 {
 	ArgParser ap = { argc, argv };
 	HOC_Config cfg;
 	Array<ShaderMacro> macros;
+	Array<const char*> uniformArgs;
 	String genCode;
 	const char* inputFileName = nullptr;
 	const char* outputFileName = nullptr;
+	const char* packageFileName = nullptr;
 	const char* xform = "none";
 	const char* usedFmtString = nullptr;
 	bool hasStage = false;
@@ -202,6 +369,10 @@ int main(int argc, char** argv)
 		{
 			macros.push_back({ argv[i] + 2, nullptr });
 		}
+		else if (strncmp(argv[i], "-U", 2) == 0 && strchr(argv[i] + 2, '='))
+		{
+			uniformArgs.push_back(argv[i] + 2);
+		}
 		else if (const char* ep = ap.ValueArg(i, "e", "entrypoint"))
 		{
 			cfg.entryPoint = ep;
@@ -235,6 +406,18 @@ int main(int argc, char** argv)
 		{
 			cfg.ASTDumpStream = &toStdout;
 		}
+		else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' && argv[i][2] <= '2' && !argv[i][3])
+		{
+			cfg.optimizationLevel = uint8_t(argv[i][2] - '0');
+		}
+		else if (const char* mu = ap.ValueArg(i, "-max-unroll", "max-unroll"))
+		{
+			cfg.maxUnrollSize = uint32_t(strtoul(mu, nullptr, 10));
+		}
+		else if (const char* pkg = ap.ValueArg(i, "-package", "package"))
+		{
+			packageFileName = pkg;
+		}
 		else if (strncmp(argv[i], STRLIT_SIZE("-f")) == 0)
 		{
 			bool off = strncmp(argv[i], STRLIT_SIZE("-fno-")) == 0;
@@ -264,6 +447,11 @@ int main(int argc, char** argv)
 		PrintHelp();
 		return 1;
 	}
+	if (packageFileName)
+	{
+		// format/stage are specified for each shader
+		return BuildPackage(inputFileName, packageFileName, cfg, macros);
+	}
 	if (!usedFmtString)
 	{
 		fprintf(stderr, "error: output format (-f, --format) not specified\n\n");
@@ -277,12 +465,49 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	if (cfg.outputFmt == OSF_SPIRV && strcmp(xform, "none") != 0)
+	{
+		fprintf(stderr, "error: code transformations are not supported for binary output (spirv)\n");
+		return 1;
+	}
+
 	if (!macros.empty())
 	{
 		macros.push_back({ nullptr, nullptr });
 		cfg.defines = macros.data();
 	}
 
+	// <name>=<value>[,<value>...], pointers are taken after all values are parsed
+	Array<String> uniformNames;
+	Array<float> uniformData;
+	Array<uint32_t> uniformCounts;
+	Array<UniformValue> uniformValues;
+	for (const char* arg : uniformArgs)
+	{
+		const char* eq = strchr(arg, '=');
+		uniformNames.push_back(String(arg, eq - arg));
+		uniformCounts.push_back(0);
+		do
+		{
+			char* end;
+			uniformData.push_back(strtof(eq + 1, &end));
+			uniformCounts.back()++;
+			eq = end;
+		}
+		while (*eq == ',');
+	}
+	if (!uniformArgs.empty())
+	{
+		size_t off = 0;
+		for (size_t i = 0; i < uniformNames.size(); ++i)
+		{
+			uniformValues.push_back({ uniformNames[i].c_str(), &uniformData[off], uniformCounts[i] });
+			off += uniformCounts[i];
+		}
+		uniformValues.push_back({ nullptr, nullptr, 0 });
+		cfg.uniformValues = uniformValues.data();
+	}
+
 	String inCode = GetFileContents<String>(inputFileName, true);
 	if (!HOC_CompileShader(inputFileName, inCode.c_str(), &cfg))
 	{
@@ -304,9 +529,10 @@ int main(int argc, char** argv)
 		outCode = genCode;
 	}
 
+	bool text = cfg.outputFmt != OSF_SPIRV; // SPIR-V is a binary module
 	if (codeToStdout)
 	{
-		fprintf(stdout, "%s", outCode.c_str());
+		fwrite(outCode.data(), outCode.size(), 1, stdout);
 	}
 	if (!outputFileName && !codeToStdout)
 	{
@@ -314,11 +540,11 @@ int main(int argc, char** argv)
 		strncpy(path, inputFileName, 8192);
 		strcat(path, usedFmtString);
 		strncat(path, usedFmtString, 4);
-		SetFileContents(path, outCode, true);
+		SetFileContents(path, outCode, text);
 	}
 	if (outputFileName)
 	{
-		SetFileContents(outputFileName, outCode, true);
+		SetFileContents(outputFileName, outCode, text);
 	}
 	return 0;
 }
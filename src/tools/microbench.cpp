@@ -0,0 +1,470 @@
+
+
+#include "../hlslparser.hpp"
+#include "shadergen.hpp"
+
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+using namespace HOC;
+
+// only for compatibility with test.cpp, normally not needed
+extern "C" void* chkmalloc(size_t sz) { return malloc(sz); }
+extern "C" void chkfree(void* p) { free(p); }
+
+
+/* per-stage micro-benchmarks
+- each benchmark times one stage/pass/generator on an input prepared by running all the preceding steps
+- the input is rebuilt (untimed) before every repetition since most steps modify the AST
+- reports min/median/mean/stddev/max over the repetitions (after warm-up)
+*/
+
+static const char* OUTPUT_FORMATS[] =
+{
+	"hlsl_sm3",
+	"hlsl_sm4",
+	"glsl_140",
+	"glsl_es_100",
+	"glsl_330",
+	"glsl_es_300",
+	"spirv",
+};
+#define NUM_OUTPUT_FORMATS (sizeof(OUTPUT_FORMATS)/sizeof(OUTPUT_FORMATS[0]))
+
+static const char* GENERATOR_NAMES[] =
+{
+	"GenerateHLSL_SM3",
+	"GenerateHLSL_SM4",
+	"GenerateGLSL_140",
+	"GenerateGLSL_ES_100",
+	"GenerateGLSL_330",
+	"GenerateGLSL_ES_300",
+	"GenerateSPIRV",
+};
+
+struct BenchInput
+{
+	std::string name;
+	std::string source;
+	ShaderStage stage;
+};
+
+// all state of one compilation
+struct Fixture
+{
+	Fixture(const BenchInput& in, OutputShaderFormat fmt) :
+		config(MakeConfig(in.stage, fmt)),
+		diag(&errors, in.name.c_str()),
+		info(diag, in.stage, fmt, config.outputFlags, config.optimizationLevel),
+		parser(diag, &config),
+		input(in)
+	{
+		GetFeatureDefs(in.stage, fmt, featureDefs);
+	}
+	static HOC_Config MakeConfig(ShaderStage stage, OutputShaderFormat fmt)
+	{
+		HOC_Config cfg;
+		cfg.stage = stage;
+		cfg.outputFmt = fmt;
+		cfg.optimizationLevel = 2; // time all optimization passes
+		return cfg;
+	}
+
+	HOC_Config config;
+	StringStream errors;
+	Diagnostic diag;
+	Info info;
+	Parser parser;
+	const BenchInput& input;
+	const char* featureDefs[3];
+	StringStream code;
+};
+
+enum Step
+{
+	Step_ParseTokens,
+	Step_PreprocessTokens,
+	Step_ParseDecls,
+	Step_ValidateAST,
+	Step_TransformAST,
+	Step_FunctionInliner,
+	Step_ConstantPropagation,
+	Step_VariableConstantPropagation,
+	Step_AlgebraicSimplification,
+	Step_LoopUnroller,
+	Step_LoopInvariantCodeMotion,
+	Step_CommonSubexpressionElimination,
+	Step_DeadStoreElimination,
+	Step_MarkUnusedVariables,
+	Step_RemoveUnusedVariables,
+	Step_PrepareASTForOutput,
+	Step_Generate,
+
+	Step_COUNT,
+
+	// combined steps, not part of the sequence
+	Step_ParseCode = Step_COUNT,
+	Step_OptimizeAST,
+};
+
+static const char* STEP_NAMES[] =
+{
+	"Parser::ParseTokens",
+	"Parser::PreprocessTokens",
+	"Parser::ParseDecls",
+	"ValidateAST",
+	"TransformAST",
+	"FunctionInliner",
+	"ConstantPropagation",
+	"VariableConstantPropagation",
+	"AlgebraicSimplification",
+	"LoopUnroller",
+	"LoopInvariantCodeMotion",
+	"CommonSubexpressionElimination",
+	"DeadStoreElimination",
+	"MarkUnusedVariables",
+	"RemoveUnusedVariables",
+	"PrepareASTForOutput",
+	nullptr, // Generate* - name depends on format
+};
+
+// same as in OptimizeAST
+static bool FoldMatrices(const Fixture& f)
+{
+	return f.info.outputFmt == OSF_HLSL_SM3 || f.info.outputFmt == OSF_HLSL_SM4;
+}
+
+// must match the order in HOC_CompileShader
+static bool RunStep(Fixture& f, int step)
+{
+	AST& ast = f.parser.ast;
+	switch (step)
+	{
+	case Step_ParseTokens:
+		return f.parser.ParseTokens(f.input.source.c_str(), 0);
+	case Step_PreprocessTokens:
+		f.parser.DefineFeatureMacros(f.featureDefs);
+		return f.parser.PreprocessTokens(0);
+	case Step_ParseDecls:
+		if (!f.parser.ParseDecls())
+			return false;
+		ast.MarkUsed(f.diag);
+		return !f.diag.hasErrors;
+	case Step_ValidateAST:
+		return ValidateAST(ast, f.diag, f.info.outputFmt);
+	case Step_TransformAST:
+		return TransformAST(ast, f.info);
+	case Step_FunctionInliner:
+		FunctionInliner(f.info.optimizationLevel).RunOnAST(ast);
+		return true;
+	case Step_ConstantPropagation:
+		ConstantPropagation(FoldMatrices(f)).RunOnAST(ast);
+		return true;
+	case Step_VariableConstantPropagation:
+		VariableConstantPropagation(FoldMatrices(f)).RunOnAST(ast);
+		return true;
+	case Step_AlgebraicSimplification:
+		AlgebraicSimplification((f.info.outputFlags & HOC_OF_FAST_MATH) != 0, FoldMatrices(f)).RunOnAST(ast);
+		return true;
+	case Step_LoopUnroller:
+		LoopUnroller(f.info.maxUnrollSize).RunOnAST(ast);
+		return true;
+	case Step_LoopInvariantCodeMotion:
+		LoopInvariantCodeMotion().RunOnAST(ast);
+		return true;
+	case Step_CommonSubexpressionElimination:
+		CommonSubexpressionElimination().RunOnAST(ast);
+		return true;
+	case Step_DeadStoreElimination:
+		DeadStoreElimination().RunOnAST(ast);
+		return true;
+	case Step_MarkUnusedVariables:
+		MarkUnusedVariables().RunOnAST(ast);
+		return true;
+	case Step_RemoveUnusedVariables:
+		RemoveUnusedVariables().RunOnAST(ast);
+		return true;
+	case Step_PrepareASTForOutput:
+		PrepareASTForOutput(ast, f.info);
+		return true;
+	case Step_Generate:
+		GenerateCode(ast, f.info.outputFmt, f.code);
+		return true;
+	case Step_ParseCode:
+		return f.parser.ParseCode(f.input.source.c_str(), f.featureDefs);
+	case Step_OptimizeAST:
+		OptimizeAST(ast, f.info);
+		return true;
+	}
+	return false;
+}
+
+struct Benchmark
+{
+	const char* name;
+	int setupSteps; // steps to run before the timed one
+	int step;
+};
+
+static const Benchmark COMBINED_BENCHMARKS[] =
+{
+	{ "Parser::ParseCode", 0, Step_ParseCode },
+	{ "OptimizeAST", Step_ConstantPropagation, Step_OptimizeAST },
+};
+
+struct Stats
+{
+	double min, median, mean, stddev, max;
+
+	static Stats Calc(std::vector<double>& v)
+	{
+		Stats s = {};
+		if (v.empty())
+			return s;
+		std::sort(v.begin(), v.end());
+		s.min = v.front();
+		s.max = v.back();
+		s.median = v.size() % 2 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) * 0.5;
+		double sum = 0;
+		for (double t : v)
+			sum += t;
+		s.mean = sum / v.size();
+		double var = 0;
+		for (double t : v)
+			var += (t - s.mean) * (t - s.mean);
+		s.stddev = v.size() > 1 ? sqrt(var / (v.size() - 1)) : 0;
+		return s;
+	}
+};
+
+struct Result
+{
+	std::string input;
+	std::string format;
+	std::string bench;
+	Stats stats;
+};
+
+// returns false if the input cannot be prepared or the benchmarked steps fail
+static bool RunBenchmark(const BenchInput& in, OutputShaderFormat fmt,
+	int setupSteps, int step, int warmup, int repetitions, Stats& out)
+{
+	std::vector<double> samples;
+	for (int r = -warmup; r < repetitions; ++r)
+	{
+		Fixture* f = new Fixture(in, fmt);
+		for (int s = 0; s < setupSteps; ++s)
+		{
+			if (!RunStep(*f, s))
+			{
+				fprintf(stderr, "%s [%s]: setup failed at %s:\n%s\n", in.name.c_str(),
+					OUTPUT_FORMATS[fmt], STEP_NAMES[s] ? STEP_NAMES[s] : "", f->errors.str().c_str());
+				delete f;
+				return false;
+			}
+		}
+
+		double t0 = GetTime();
+		bool ok = RunStep(*f, step);
+		double t1 = GetTime();
+
+		delete f;
+		if (!ok)
+			return false;
+		if (r >= 0)
+			samples.push_back(t1 - t0);
+	}
+	out = Stats::Calc(samples);
+	return true;
+}
+
+
+static void AddSyntheticInput(std::vector<BenchInput>& inputs)
+{
+	ShaderGenParams params;
+	params.numFunctions = 64;
+	params.exprNesting = 4;
+	params.numCBuffers = 4;
+	params.structMembers = 4;
+	params.macroNesting = 4;
+
+	BenchInput in;
+	in.name = "synthetic";
+	in.source = ShaderGenerator(params).Generate();
+	in.stage = ShaderStage_Vertex;
+	inputs.push_back(in);
+}
+
+static bool WriteJSON(const char* path, const std::vector<Result>& results, int repetitions)
+{
+	FILE* fp = fopen(path, "w");
+	if (!fp)
+	{
+		fprintf(stderr, "error: failed to open '%s' for writing\n", path);
+		return false;
+	}
+	fprintf(fp, "{\n\t\"repetitions\": %d,\n\t\"results\": {", repetitions);
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const auto& r = results[i];
+		fprintf(fp, "%s\n\t\t\"%s.%s.%s\": {\"min_us\": %.3f, \"median_us\": %.3f, "
+			"\"mean_us\": %.3f, \"stddev_us\": %.3f, \"max_us\": %.3f}",
+			i ? "," : "", r.input.c_str(), r.format.c_str(), r.bench.c_str(),
+			r.stats.min * 1e6, r.stats.median * 1e6, r.stats.mean * 1e6,
+			r.stats.stddev * 1e6, r.stats.max * 1e6);
+	}
+	fprintf(fp, "\n\t}\n}\n");
+	fclose(fp);
+	return true;
+}
+
+static void PrintHelp()
+{
+	puts("HLSL optimizing converter - per-stage micro-benchmarks");
+	puts("usage: hlslmicrobench [options]");
+	puts("options:");
+	puts("  -n, --repetitions=<n>  timed repetitions of each benchmark (default: 50)");
+	puts("  -w, --warmup=<n>       untimed repetitions before measuring (default: 5)");
+	puts("  -f, --format=<fmt>     only benchmark one output format");
+	puts("  -b, --bench=<text>     only run benchmarks with names containing the text");
+	puts("  -i, --input=<file>     benchmark a shader file instead of the built-in inputs");
+	puts("  -s, --stage=<stage>    shader stage of the input file (vertex/pixel, default: vertex)");
+	puts("  --json=<file>          save results as JSON");
+}
+
+int main(int argc, char** argv)
+{
+	int repetitions = 50;
+	int warmup = 5;
+	int onlyFormat = -1;
+	const char* benchFilter = nullptr;
+	const char* inputFile = nullptr;
+	const char* jsonFile = nullptr;
+	ShaderStage inputStage = ShaderStage_Vertex;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		auto Value = [&](const char* shortArg, const char* longArg) -> const char*
+		{
+			if (shortArg && !strcmp(arg, shortArg) && i + 1 < argc)
+				return argv[++i];
+			size_t len = strlen(longArg);
+			if (!strncmp(arg, longArg, len) && arg[len] == '=')
+				return arg + len + 1;
+			return nullptr;
+		};
+		const char* val;
+		if (!strcmp(arg, "-h") || !strcmp(arg, "--help"))
+		{
+			PrintHelp();
+			return 0;
+		}
+		else if ((val = Value("-n", "--repetitions")))
+			repetitions = atoi(val);
+		else if ((val = Value("-w", "--warmup")))
+			warmup = atoi(val);
+		else if ((val = Value("-b", "--bench")))
+			benchFilter = val;
+		else if ((val = Value("-i", "--input")))
+			inputFile = val;
+		else if ((val = Value(nullptr, "--json")))
+			jsonFile = val;
+		else if ((val = Value("-s", "--stage")))
+		{
+			if (!strcmp(val, "vertex"))
+				inputStage = ShaderStage_Vertex;
+			else if (!strcmp(val, "pixel"))
+				inputStage = ShaderStage_Pixel;
+			else
+			{
+				fprintf(stderr, "error: unrecognized shader stage: %s\n", val);
+				return 1;
+			}
+		}
+		else if ((val = Value("-f", "--format")))
+		{
+			for (size_t f = 0; f < NUM_OUTPUT_FORMATS; ++f)
+				if (strcmp(OUTPUT_FORMATS[f], val) == 0)
+					onlyFormat = int(f);
+			if (onlyFormat < 0)
+			{
+				fprintf(stderr, "error: output format string not recognized - '%s'\n", val);
+				return 1;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "error: unrecognized argument: %s\n", arg);
+			PrintHelp();
+			return 1;
+		}
+	}
+	if (repetitions < 1)
+		repetitions = 1;
+	if (warmup < 0)
+		warmup = 0;
+
+	std::vector<BenchInput> inputs;
+	if (inputFile)
+	{
+		BenchInput in;
+		in.name = inputFile;
+		in.source = GetFileContents<std::string>(inputFile);
+		in.stage = inputStage;
+		inputs.push_back(in);
+	}
+	else
+	{
+		std::string html5 = GetFileContents<std::string>("runtests/html5-shader.hlsl");
+		BenchInput vs = { "html5-vs", html5, ShaderStage_Vertex };
+		BenchInput ps = { "html5-ps", html5, ShaderStage_Pixel };
+		inputs.push_back(vs);
+		inputs.push_back(ps);
+		AddSyntheticInput(inputs);
+	}
+
+	printf("%d repetitions (+%d warm-up), times in microseconds\n", repetitions, warmup);
+	printf("\n%-10s %-12s %-30s %10s %10s %10s %10s %10s\n",
+		"input", "format", "benchmark", "min", "median", "mean", "stddev", "max");
+
+	std::vector<Result> results;
+	for (const auto& in : inputs)
+	{
+		for (size_t f = 0; f < NUM_OUTPUT_FORMATS; ++f)
+		{
+			if (onlyFormat >= 0 && int(f) != onlyFormat)
+				continue;
+			OutputShaderFormat fmt = OutputShaderFormat(f);
+
+			auto Run = [&](const char* name, int setupSteps, int step)
+			{
+				if (benchFilter && !strstr(name, benchFilter))
+					return;
+				Result res = { in.name, OUTPUT_FORMATS[f], name, {} };
+				if (!RunBenchmark(in, fmt, setupSteps, step, warmup, repetitions, res.stats))
+				{
+					printf("%-10s %-12s %-30s failed\n", in.name.c_str(), OUTPUT_FORMATS[f], name);
+					return;
+				}
+				printf("%-10s %-12s %-30s %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+					in.name.c_str(), OUTPUT_FORMATS[f], name,
+					res.stats.min * 1e6, res.stats.median * 1e6, res.stats.mean * 1e6,
+					res.stats.stddev * 1e6, res.stats.max * 1e6);
+				results.push_back(res);
+			};
+
+			for (int s = 0; s < Step_COUNT; ++s)
+				Run(STEP_NAMES[s] ? STEP_NAMES[s] : GENERATOR_NAMES[f], s, s);
+			for (const auto& b : COMBINED_BENCHMARKS)
+				Run(b.name, b.setupSteps, b.step);
+		}
+	}
+
+	if (jsonFile && !WriteJSON(jsonFile, results, repetitions))
+		return 1;
+	return 0;
+}
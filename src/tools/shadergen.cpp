@@ -0,0 +1,142 @@
+
+
+#include "shadergen.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/* synthetic shader generator tool
+- writes the generated shader to a file or stdout
+- included files are written to the directory of the output file (or the current directory)
+*/
+
+struct IntParam
+{
+	const char* name;
+	int ShaderGenParams::* member;
+	const char* desc;
+};
+
+static const IntParam INT_PARAMS[] =
+{
+	{ "functions", &ShaderGenParams::numFunctions, "number of helper functions" },
+	{ "call-depth", &ShaderGenParams::callDepth, "max. call chain length (0 = number of functions)" },
+	{ "statements", &ShaderGenParams::numStatements, "local variable declarations per function" },
+	{ "expr-length", &ShaderGenParams::exprLength, "terms per expression" },
+	{ "expr-nesting", &ShaderGenParams::exprNesting, "max. depth of parenthesized subexpressions" },
+	{ "uniforms", &ShaderGenParams::numUniforms, "number of float4 uniforms" },
+	{ "cbuffers", &ShaderGenParams::numCBuffers, "number of cbuffers" },
+	{ "cbuffer-members", &ShaderGenParams::cbufferMembers, "float4 members in each cbuffer" },
+	{ "struct-members", &ShaderGenParams::structMembers, "members of the per-function local struct (0 = no struct)" },
+	{ "macro-nesting", &ShaderGenParams::macroNesting, "depth of nested function-like macros" },
+	{ "include-fanout", &ShaderGenParams::includeFanOut, "number of included files" },
+};
+#define NUM_INT_PARAMS (sizeof(INT_PARAMS)/sizeof(INT_PARAMS[0]))
+
+static void PrintHelp()
+{
+	puts("HLSL optimizing converter - synthetic shader generator");
+	puts("usage: hlslgen [options]");
+	puts("options:");
+	puts("  -o <file>              output file (default: stdout, included files are written to the current directory)");
+	puts("  --pixel                generate a pixel shader (default: vertex shader)");
+	puts("  --seed=<n>             random seed");
+	for (size_t i = 0; i < NUM_INT_PARAMS; ++i)
+		printf("  --%s=<n>%*s%s (default: %d)\n", INT_PARAMS[i].name,
+			int(16 - strlen(INT_PARAMS[i].name)), "", INT_PARAMS[i].desc,
+			ShaderGenParams().*INT_PARAMS[i].member);
+}
+
+static bool WriteFile(const std::string& path, const std::string& contents)
+{
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp)
+	{
+		fprintf(stderr, "error: failed to open '%s' for writing\n", path.c_str());
+		return false;
+	}
+	bool ok = contents.empty() || fwrite(contents.data(), contents.size(), 1, fp) == 1;
+	fclose(fp);
+	if (!ok)
+		fprintf(stderr, "error: failed to write to '%s'\n", path.c_str());
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	ShaderGenParams params;
+	const char* outFile = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		if (!strcmp(arg, "-h") || !strcmp(arg, "--help"))
+		{
+			PrintHelp();
+			return 0;
+		}
+		if (!strcmp(arg, "-o") && i + 1 < argc)
+		{
+			outFile = argv[++i];
+			continue;
+		}
+		if (!strcmp(arg, "--pixel"))
+		{
+			params.pixelShader = true;
+			continue;
+		}
+		if (!strncmp(arg, "--seed=", 7))
+		{
+			params.seed = uint32_t(strtoul(arg + 7, nullptr, 10));
+			continue;
+		}
+
+		bool found = false;
+		for (size_t p = 0; p < NUM_INT_PARAMS; ++p)
+		{
+			size_t len = strlen(INT_PARAMS[p].name);
+			if (arg[0] == '-' && arg[1] == '-' &&
+				!strncmp(arg + 2, INT_PARAMS[p].name, len) &&
+				arg[2 + len] == '=')
+			{
+				params.*INT_PARAMS[p].member = atoi(arg + 3 + len);
+				found = true;
+				break;
+			}
+		}
+		if (!found)
+		{
+			fprintf(stderr, "error: unrecognized argument: %s\n", arg);
+			PrintHelp();
+			return 1;
+		}
+	}
+
+	ShaderGenerator gen(params);
+	std::string code = gen.Generate();
+
+	std::string dir;
+	if (outFile)
+	{
+		const char* sep = strrchr(outFile, '/');
+#ifdef _WIN32
+		if (const char* bsep = strrchr(outFile, '\\'))
+			if (!sep || bsep > sep)
+				sep = bsep;
+#endif
+		if (sep)
+			dir.assign(outFile, sep + 1);
+		if (!WriteFile(outFile, code))
+			return 1;
+	}
+	else
+		fwrite(code.data(), 1, code.size(), stdout);
+
+	for (const auto& inc : gen.includes)
+	{
+		if (!WriteFile(dir + inc.first, inc.second))
+			return 1;
+	}
+	return 0;
+}
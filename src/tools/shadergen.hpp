@@ -0,0 +1,237 @@
+
+#pragma once
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+
+/* synthetic HLSL shader generator
+- generates valid shaders (for all output formats) of configurable size
+- the output only depends on the parameters (including the seed)
+- functions are split into chains (call graph depth), the entry point calls the last function of each chain
+- with include fan-out, functions are distributed between included files (gen0.hlsl, gen1.hlsl, ...)
+*/
+
+struct ShaderGenParams
+{
+	int numFunctions = 16;     // helper functions
+	int callDepth = 0;         // max. length of a call chain (0 = numFunctions)
+	int numStatements = 8;     // local variable declarations per function
+	int exprLength = 8;        // number of terms per expression
+	int exprNesting = 0;       // depth of parenthesized subexpressions in the first term of each expression
+	int numUniforms = 16;      // float4 uniforms
+	int numCBuffers = 0;       // cbuffers ..
+	int cbufferMembers = 4;    // .. and float4 members in each
+	int structMembers = 0;     // float4 members of a local struct variable in each function (0 = none)
+	int macroNesting = 0;      // depth of nested function-like macros (0 = none)
+	int includeFanOut = 0;     // number of included files (0 = none)
+	bool pixelShader = false;
+	uint32_t seed = 1;
+};
+
+struct ShaderGenerator
+{
+	typedef std::vector<std::pair<std::string, std::string>> FileList;
+
+	ShaderGenerator(const ShaderGenParams& p) : params(p), rngState(p.seed ? p.seed : 1) {}
+
+	uint32_t Rand()
+	{
+		// xorshift32
+		rngState ^= rngState << 13;
+		rngState ^= rngState >> 17;
+		rngState ^= rngState << 5;
+		return rngState;
+	}
+	int Rand(int n) { return n > 0 ? int(Rand() % uint32_t(n)) : 0; }
+
+	void Printf(const char* fmt, ...)
+#ifdef __GNUC__
+		__attribute__((format(printf, 2, 3)))
+#endif
+	{
+		char bfr[256];
+		va_list args;
+		va_start(args, fmt);
+		int len = vsnprintf(bfr, sizeof(bfr), fmt, args);
+		va_end(args);
+		if (len > 0)
+			out->append(bfr, size_t(len) < sizeof(bfr) ? size_t(len) : sizeof(bfr) - 1);
+	}
+	void Append(const char* str) { out->append(str); }
+
+	int NumFunctions() const { return params.numFunctions > 0 ? params.numFunctions : 1; }
+	int CallDepth() const { return params.callDepth > 0 ? params.callDepth : NumFunctions(); }
+
+	void Uniform()
+	{
+		int numCBufVars = params.numCBuffers * params.cbufferMembers;
+		int n = Rand(params.numUniforms + numCBufVars);
+		if (n < params.numUniforms)
+			Printf("u%d", n);
+		else if (numCBufVars > 0)
+			Printf("cb%d_m%d", (n - params.numUniforms) / params.cbufferMembers,
+				(n - params.numUniforms) % params.cbufferMembers);
+		else
+			Append("a");
+	}
+
+	// float4 term, numLocals = number of usable t# variables
+	void Term(int numLocals, int nesting)
+	{
+		if (nesting > 0)
+		{
+			// nest one side only to keep the size linear in depth
+			Append("(");
+			Term(numLocals, nesting - 1);
+			Append(Rand(2) ? " + " : " * ");
+			Term(numLocals, 0);
+			Append(")");
+			return;
+		}
+		if (params.macroNesting > 0 && Rand(4) == 0)
+		{
+			Printf("M%d(", params.macroNesting - 1);
+			Term(numLocals, 0);
+			Append(")");
+			return;
+		}
+		switch (Rand(9))
+		{
+		case 0: Append("a"); break;
+		case 1: Append("b"); break;
+		case 2:
+			if (numLocals)
+			{
+				Printf("t%d", Rand(numLocals));
+				break;
+			}
+			// fallthrough
+		case 3: Uniform(); break;
+		case 4: Printf("%d.%d", Rand(10), Rand(100)); break;
+		case 5: Append("sin("); Uniform(); Append(")"); break;
+		case 6: Append("saturate("); Uniform(); Append(" * a)"); break;
+		case 7: Append("dot(b, "); Uniform(); Append(")"); break;
+		case 8:
+			if (params.structMembers > 0)
+				Printf("s.m%d", Rand(params.structMembers));
+			else
+				Append("b.wzyx");
+			break;
+		}
+	}
+
+	void Expr(int numLocals)
+	{
+		static const char* ops[] = { " + ", " - ", " * " };
+		int len = params.exprLength > 0 ? params.exprLength : 1;
+		for (int i = 0; i < len; ++i)
+		{
+			if (i)
+				Append(ops[Rand(3)]);
+			Term(numLocals, i == 0 ? params.exprNesting : 0);
+		}
+	}
+
+	void Function(int id)
+	{
+		Printf("float4 f%d(float4 a, float4 b)\n{\n", id);
+		if (params.structMembers > 0)
+		{
+			Append("\tData s;\n");
+			for (int i = 0; i < params.structMembers; ++i)
+				Printf("\ts.m%d = %s * %d.5;\n", i, i % 2 ? "a" : "b", i);
+		}
+		int numStmts = params.numStatements > 0 ? params.numStatements : 1;
+		for (int i = 0; i < numStmts; ++i)
+		{
+			Printf("\tfloat4 t%d = ", i);
+			if (i == 0 && id % CallDepth() != 0)
+			{
+				Printf("f%d(a, b) + ", id - 1);
+			}
+			Expr(i);
+			Append(";\n");
+		}
+		Printf("\treturn t%d;\n}\n", numStmts - 1);
+	}
+
+	// returns the main file, included files are stored in `includes`
+	std::string Generate()
+	{
+		std::string mainFile;
+		includes.clear();
+		out = &mainFile;
+
+		for (int i = 0; i < params.numUniforms; ++i)
+			Printf("float4 u%d;\n", i);
+		for (int i = 0; i < params.numCBuffers; ++i)
+		{
+			Printf("cbuffer CB%d\n{\n", i);
+			for (int j = 0; j < params.cbufferMembers; ++j)
+				Printf("\tfloat4 cb%d_m%d;\n", i, j);
+			Append("};\n");
+		}
+		if (params.structMembers > 0)
+		{
+			Append("struct Data\n{\n");
+			for (int i = 0; i < params.structMembers; ++i)
+				Printf("\tfloat4 m%d;\n", i);
+			Append("};\n");
+		}
+		for (int i = 0; i < params.macroNesting; ++i)
+		{
+			if (i == 0)
+				Append("#define M0(x) (x)\n");
+			else
+				Printf("#define M%d(x) M%d((x) * 0.5)\n", i, i - 1);
+		}
+
+		int numFuncs = NumFunctions();
+		int numIncludes = params.includeFanOut;
+		if (numIncludes > numFuncs)
+			numIncludes = numFuncs;
+		if (numIncludes > 0)
+		{
+			// functions are split evenly and included in order
+			includes.resize(numIncludes);
+			for (int i = 0; i < numIncludes; ++i)
+			{
+				char name[32];
+				snprintf(name, sizeof(name), "gen%d.hlsl", i);
+				includes[i].first = name;
+				Printf("#include \"%s\"\n", name);
+
+				out = &includes[i].second;
+				for (int f = i * numFuncs / numIncludes; f < (i + 1) * numFuncs / numIncludes; ++f)
+					Function(f);
+				out = &mainFile;
+			}
+		}
+		else
+		{
+			for (int i = 0; i < numFuncs; ++i)
+				Function(i);
+		}
+
+		if (params.pixelShader)
+			Append("float4 main(float4 a : TEXCOORD0) : COLOR\n{\n\tfloat4 b = a.wzyx;\n");
+		else
+			Append("float4 main(float4 a : POSITION) : POSITION\n{\n\tfloat4 b = a.yxwz;\n");
+		Append("\treturn 0");
+		for (int i = CallDepth() - 1; i < numFuncs + CallDepth() - 1; i += CallDepth())
+			Printf(" + f%d(a, b)", i < numFuncs ? i : numFuncs - 1);
+		Append(";\n}\n");
+
+		out = nullptr;
+		return mainFile;
+	}
+
+	ShaderGenParams params;
+	uint32_t rngState;
+	std::string* out = nullptr;
+	FileList includes;
+};
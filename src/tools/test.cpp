@@ -1,7 +1,9 @@
 
 
 #include "../compiler.hpp"
+#include "../hlslparser.hpp"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <errno.h>
 #include <time.h>
@@ -20,9 +22,12 @@
 #else
 #  include <unistd.h>
 #  include <dirent.h>
+#  define mkdir(p) mkdir(p, 0777)
 #endif
 
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 
 using namespace HOC;
@@ -169,17 +174,6 @@ void free_testfiles(testfile* files, size_t count)
 int tests_executed = 0;
 int tests_failed = 0;
 
-int numallocs = 0;
-static void* ext_memfunc(void* ud, void* ptr, size_t size)
-{
-	if (ptr) numallocs--;
-	if (size) numallocs++;
-	else if (!ptr)
-		return NULL;
-	(void) ud;
-	return realloc(ptr, size);
-}
-
 /* check if equal, ignoring newline differences */
 static int memstreq_nnl(const char* mem, const char* str)
 {
@@ -209,7 +203,7 @@ static int memstreq_nnl(const char* mem, const char* str)
 
 typedef std::unordered_map<std::string, std::string> IncludeMap;
 
-static int LoadIncludeFileTest(const char* file, const char* requester, char** outbuf, void* userdata)
+static int LoadIncludeFileTest(const char* file, const char*, char** outbuf, void* userdata)
 {
 	if (file == NULL)
 	{
@@ -230,6 +224,7 @@ static int LoadIncludeFileTest(const char* file, const char* requester, char** o
 
 bool g_runFXC = true;
 bool g_runGLSLV = true;
+bool g_runSPIRVV = true;
 
 std::string longestMyBuildShader = "<none?";
 std::string longestFXCBuildShader = "<none?>";
@@ -245,12 +240,638 @@ size_t nextBuildVarStrBufSize = 0;
 bool nextBuildVarRequest = false;
 bool nextSlotAssignRequest = false;
 bool nextHLSLSM3BufferRegsAreSlots = false;
+bool nextFastMath = false;
+bool nextPreshader = false;
+bool nextNativeHalf = false;
+bool nextAutoPrecision = false;
+bool nextPackVaryings = false;
+bool nextPackUniforms = false;
+bool nextUsageMasks = false;
+bool nextLayout = false;
+bool nextPackageAdd = false;
+std::string nextPackageName;
+std::vector<std::string> nextPackageDefines; // name[=value]
+std::vector<std::string> nextUniformNames;
+std::vector<std::vector<float>> nextUniformValues;
+int nextOptimizationLevel = -1;
+int nextMaxUnrollSize = -1;
+bool nextCodeBufRequest = false;
+size_t nextCodeBufSize = 0;
+bool nextCodeBufAlloc = true;
+bool nextCodeBufUserAlloc = false;
+size_t numCodeBufUserAllocs = 0;
+
+static void* CodeBufUserAlloc(size_t size, void* userData)
+{
+	++*(size_t*) userData;
+	return new char[size];
+}
+
+// compiled shader kept for verify_package, copies of the interface output buffers
+struct PackageTestShader
+{
+	std::string name;
+	uint64_t permutationHash;
+	ShaderStage stage;
+	OutputShaderFormat outputFmt;
+	std::string code;
+	std::string varDump;
+	std::vector<ShaderVariable> vars;
+	std::string varStr;
+	std::vector<uint32_t> preshader;
+	std::vector<uint32_t> usageMask;
+	std::vector<HOC_ShaderVariableLayout> layout;
+	std::vector<int32_t> location;
+};
+
+static uint64_t PackageTestPermutationHash(const std::vector<std::string>& defines)
+{
+	std::vector<std::string> names, values;
+	std::vector<HOC_ShaderMacro> macros;
+	for (const auto& d : defines)
+	{
+		size_t eq = d.find('=');
+		names.push_back(d.substr(0, eq));
+		values.push_back(eq != std::string::npos ? d.substr(eq + 1) : std::string());
+	}
+	for (size_t i = 0; i < defines.size(); ++i)
+		macros.push_back({ names[i].c_str(), defines[i].find('=') != std::string::npos ? values[i].c_str() : nullptr });
+	macros.push_back({ nullptr, nullptr });
+	return HOC_HashPermutation(macros.data());
+}
+
+/* reference evaluator for 'verify_folding', independent of the optimizer's folder:
+	float32 math for floats (rounded after each operation), wrapping int32 math for ints */
+struct RefValue
+{
+	ASTType::Kind kind;
+	int count;
+	double v[16];
+};
+
+static bool RefScalarKind(const ASTType* t, ASTType::Kind& kind)
+{
+	if (t->kind == ASTType::Vector || t->kind == ASTType::Matrix)
+		t = t->subType;
+	kind = t->kind == ASTType::Float16 ? ASTType::Float32 : t->kind;
+	return kind == ASTType::Bool || kind == ASTType::Int32 || kind == ASTType::Float32;
+}
+
+static double RefConvert(double x, ASTType::Kind kind)
+{
+	switch (kind)
+	{
+	case ASTType::Bool:  return x != 0;
+	case ASTType::Int32: return int32_t(x);
+	default:             return float(x);
+	}
+}
+
+static double RefWrap(int64_t x)
+{
+	return int32_t(uint32_t(uint64_t(x)));
+}
+
+static double RefArg(const RefValue& rv, int i)
+{
+	return rv.v[rv.count == 1 ? 0 : i];
+}
+
+static float RefDot(const RefValue& a, const RefValue& b)
+{
+	float sum = 0;
+	for (int i = 0; i < a.count; ++i)
+		sum += float(a.v[i]) * float(b.v[i]);
+	return sum;
+}
+
+static bool RefEval(const Expr* expr, RefValue& out, std::string& err)
+{
+	const ASTType* rt = expr->GetReturnType();
+	if (!RefScalarKind(rt, out.kind) || rt->GetElementCount() > 16)
+	{
+		err = "unsupported type " + std::string(rt->GetName().c_str());
+		return false;
+	}
+	out.count = rt->GetElementCount();
+
+	if (auto* be = dyn_cast<const BoolExpr>(expr))
+		out.v[0] = be->value;
+	else if (auto* ie = dyn_cast<const Int32Expr>(expr))
+		out.v[0] = ie->value;
+	else if (auto* fe = dyn_cast<const Float32Expr>(expr))
+		out.v[0] = fe->value;
+	else if (auto* cast = dyn_cast<const CastExpr>(expr))
+	{
+		RefValue src;
+		if (!RefEval(cast->GetSource(), src, err))
+			return false;
+		const ASTType* st = cast->GetSource()->GetReturnType();
+		if (st->kind == ASTType::Matrix && rt->kind == ASTType::Matrix && st->sizeY != rt->sizeY)
+		{
+			err = "unsupported matrix truncation";
+			return false;
+		}
+		if (src.count != 1 && src.count < out.count)
+		{
+			err = "invalid cast";
+			return false;
+		}
+		for (int i = 0; i < out.count; ++i)
+			out.v[i] = RefArg(src, i);
+	}
+	else if (auto* ile = dyn_cast<const InitListExpr>(expr))
+	{
+		int n = 0;
+		for (const ASTNode* ch = ile->firstChild; ch; ch = ch->next)
+		{
+			RefValue src;
+			if (!RefEval(ch->ToExpr(), src, err))
+				return false;
+			for (int i = 0; i < src.count && n < 16; ++i)
+				out.v[n++] = src.v[i];
+		}
+		if (n != out.count)
+		{
+			err = "invalid initializer list";
+			return false;
+		}
+	}
+	else if (auto* mmb = dyn_cast<const MemberExpr>(expr))
+	{
+		RefValue src;
+		if (mmb->swizzleComp == 0 || mmb->GetSource()->GetReturnType()->kind == ASTType::Matrix)
+		{
+			err = "unsupported member access";
+			return false;
+		}
+		if (!RefEval(mmb->GetSource(), src, err))
+			return false;
+		for (int i = 0; i < out.count; ++i)
+			out.v[i] = src.v[(mmb->memberID >> (i * 2)) & 0x3];
+	}
+	else if (auto* idx = dyn_cast<const IndexExpr>(expr))
+	{
+		RefValue src, index;
+		if (!RefEval(idx->GetSource(), src, err) || !RefEval(idx->GetIndex(), index, err))
+			return false;
+		int width = out.count;
+		if (index.v[0] < 0 || (int(index.v[0]) + 1) * width > src.count)
+		{
+			err = "index out of range";
+			return false;
+		}
+		for (int i = 0; i < width; ++i)
+			out.v[i] = src.v[int(index.v[0]) * width + i];
+	}
+	else if (auto* unop = dyn_cast<const UnaryOpExpr>(expr))
+	{
+		RefValue src;
+		if (!RefEval(unop->GetSource(), src, err))
+			return false;
+		for (int i = 0; i < out.count; ++i)
+		{
+			double x = RefArg(src, i);
+			switch (unop->opType)
+			{
+			case STT_OP_Add: out.v[i] = x; break;
+			case STT_OP_Sub: out.v[i] = out.kind == ASTType::Int32 ? RefWrap(-int64_t(x)) : -x; break;
+			case STT_OP_Not: out.v[i] = x == 0; break;
+			case STT_OP_Inv: out.v[i] = ~int32_t(x); break;
+			default:
+				err = std::string("unsupported unary operator ") + TokenTypeToString(unop->opType);
+				return false;
+			}
+		}
+	}
+	else if (auto* binop = dyn_cast<const BinaryOpExpr>(expr))
+	{
+		RefValue a, b;
+		if (!RefEval(binop->GetLft(), a, err) || !RefEval(binop->GetRgt(), b, err))
+			return false;
+		for (int i = 0; i < out.count; ++i)
+		{
+			double x = RefArg(a, i), y = RefArg(b, i);
+			int32_t ix = int32_t(x), iy = int32_t(y);
+			float fx = float(x), fy = float(y);
+			bool isInt = out.kind == ASTType::Int32;
+			double& r = out.v[i];
+			switch (binop->opType)
+			{
+			case STT_OP_Eq:         r = x == y; break;
+			case STT_OP_NEq:        r = x != y; break;
+			case STT_OP_Less:       r = x < y; break;
+			case STT_OP_LEq:        r = x <= y; break;
+			case STT_OP_Greater:    r = x > y; break;
+			case STT_OP_GEq:        r = x >= y; break;
+			case STT_OP_LogicalAnd: r = x != 0 && y != 0; break;
+			case STT_OP_LogicalOr:  r = x != 0 || y != 0; break;
+			case STT_OP_Add: r = isInt ? RefWrap(int64_t(ix) + iy) : fx + fy; break;
+			case STT_OP_Sub: r = isInt ? RefWrap(int64_t(ix) - iy) : fx - fy; break;
+			case STT_OP_Mul: r = isInt ? RefWrap(int64_t(ix) * iy) : fx * fy; break;
+			case STT_OP_Div:
+			case STT_OP_Mod:
+				if (isInt && (iy == 0 || (ix == INT32_MIN && iy == -1)))
+				{
+					err = "undefined integer division";
+					return false;
+				}
+				if (binop->opType == STT_OP_Div)
+					r = isInt ? ix / iy : fx / fy;
+				else
+					r = isInt ? ix % iy : fmodf(fx, fy);
+				break;
+			case STT_OP_And: r = ix & iy; break;
+			case STT_OP_Or:  r = ix | iy; break;
+			case STT_OP_Xor: r = ix ^ iy; break;
+			case STT_OP_Lsh: r = int32_t(uint32_t(ix) << (iy & 31)); break;
+			case STT_OP_Rsh: r = ix >> (iy & 31); break;
+			default:
+				err = std::string("unsupported binary operator ") + TokenTypeToString(binop->opType);
+				return false;
+			}
+		}
+	}
+	else if (auto* tern = dyn_cast<const TernaryOpExpr>(expr))
+	{
+		RefValue cond, tv, fv;
+		if (!RefEval(tern->GetCond(), cond, err) ||
+			!RefEval(tern->GetTrueExpr(), tv, err) ||
+			!RefEval(tern->GetFalseExpr(), fv, err))
+			return false;
+		for (int i = 0; i < out.count; ++i)
+			out.v[i] = RefArg(cond, i) != 0 ? RefArg(tv, i) : RefArg(fv, i);
+	}
+	else if (auto* op = dyn_cast<const OpExpr>(expr))
+	{
+		RefValue args[3];
+		const ASTType* argTypes[3];
+		if (op->GetArgCount() > 3)
+		{
+			err = "too many arguments";
+			return false;
+		}
+		int n = 0;
+		for (const ASTNode* ch = op->GetFirstArg(); ch; ch = ch->next, ++n)
+		{
+			argTypes[n] = ch->ToExpr()->GetReturnType();
+			if (!RefEval(ch->ToExpr(), args[n], err))
+				return false;
+		}
+		const RefValue& a = args[0];
+		const RefValue& b = args[1];
+		switch (op->opKind)
+		{
+		case Op_All:
+		case Op_Any:
+		{
+			bool all = true, any = false;
+			for (int i = 0; i < a.count; ++i)
+			{
+				all = all && a.v[i] != 0;
+				any = any || a.v[i] != 0;
+			}
+			out.v[0] = op->opKind == Op_All ? all : any;
+			break;
+		}
+		case Op_Dot:
+			if (out.kind == ASTType::Int32)
+			{
+				int64_t sum = 0;
+				for (int i = 0; i < a.count; ++i)
+					sum += int64_t(int32_t(a.v[i])) * int32_t(b.v[i]);
+				out.v[0] = RefWrap(sum);
+			}
+			else
+				out.v[0] = RefDot(a, b);
+			break;
+		case Op_Length:
+			out.v[0] = sqrtf(RefDot(a, a));
+			break;
+		case Op_Distance:
+		{
+			float sum = 0;
+			for (int i = 0; i < a.count; ++i)
+				sum += (float(a.v[i]) - float(b.v[i])) * (float(a.v[i]) - float(b.v[i]));
+			out.v[0] = sqrtf(sum);
+			break;
+		}
+		case Op_Normalize:
+		{
+			float len = sqrtf(RefDot(a, a));
+			for (int i = 0; i < out.count; ++i)
+				out.v[i] = float(a.v[i]) / len;
+			break;
+		}
+		case Op_Cross:
+			out.v[0] = float(a.v[1] * b.v[2]) - float(a.v[2] * b.v[1]);
+			out.v[1] = float(a.v[2] * b.v[0]) - float(a.v[0] * b.v[2]);
+			out.v[2] = float(a.v[0] * b.v[1]) - float(a.v[1] * b.v[0]);
+			break;
+		case Op_Reflect:
+		{
+			float d = RefDot(b, a);
+			for (int i = 0; i < out.count; ++i)
+				out.v[i] = float(a.v[i]) - 2 * d * float(b.v[i]);
+			break;
+		}
+		case Op_Determinant:
+		{
+			const double* m = a.v;
+			if (argTypes[0]->sizeX == 2 && argTypes[0]->sizeY == 2)
+				out.v[0] = float(m[0] * m[3]) - float(m[1] * m[2]);
+			else if (argTypes[0]->sizeX == 3 && argTypes[0]->sizeY == 3)
+				out.v[0] = float(m[0] * (m[4] * m[8] - m[5] * m[7])
+					- m[1] * (m[3] * m[8] - m[5] * m[6])
+					+ m[2] * (m[3] * m[7] - m[4] * m[6]));
+			else
+			{
+				err = "unsupported determinant size";
+				return false;
+			}
+			break;
+		}
+		case Op_MulMM:
+		case Op_MulMV:
+		case Op_MulVM:
+		{
+			int inner = op->opKind == Op_MulVM ? a.count : argTypes[0]->sizeY;
+			int cols = op->opKind == Op_MulMV ? 1 : argTypes[1]->sizeY;
+			for (int i = 0; i < out.count; ++i)
+			{
+				float sum = 0;
+				for (int k = 0; k < inner; ++k)
+					sum += float(a.v[(i / cols) * inner + k]) * float(b.v[k * cols + i % cols]);
+				out.v[i] = sum;
+			}
+			break;
+		}
+		default:
+			// component-wise intrinsics
+			for (int i = 0; i < out.count; ++i)
+			{
+				double x = RefArg(a, i);
+				double y = n > 1 ? RefArg(b, i) : 0;
+				double z = n > 2 ? RefArg(args[2], i) : 0;
+				float fx = float(x), fy = float(y), fz = float(z);
+				double& r = out.v[i];
+				if (out.kind == ASTType::Int32)
+				{
+					int32_t ix = int32_t(x), iy = int32_t(y), iz = int32_t(z);
+					switch (op->opKind)
+					{
+					case Op_Abs:   r = ix < 0 ? RefWrap(-int64_t(ix)) : ix; break;
+					case Op_Sign:  r = x > 0 ? 1 : x < 0 ? -1 : 0; break;
+					case Op_Min:   r = ix < iy ? ix : iy; break;
+					case Op_Max:   r = ix > iy ? ix : iy; break;
+					case Op_Clamp: r = ix < iy ? iy : ix > iz ? iz : ix; break;
+					case Op_Add:      r = RefWrap(int64_t(ix) + iy); break;
+					case Op_Subtract: r = RefWrap(int64_t(ix) - iy); break;
+					case Op_Multiply: r = RefWrap(int64_t(ix) * iy); break;
+					case Op_Divide:
+					case Op_Modulus:
+						if (iy == 0 || (ix == INT32_MIN && iy == -1))
+						{
+							err = "undefined integer division";
+							return false;
+						}
+						r = op->opKind == Op_Divide ? ix / iy : ix % iy;
+						break;
+					default:
+						err = std::string("unsupported int intrinsic ") + OpKindToString(op->opKind);
+						return false;
+					}
+					continue;
+				}
+				switch (op->opKind)
+				{
+				case Op_Add:      r = fx + fy; break;
+				case Op_Subtract: r = fx - fy; break;
+				case Op_Multiply: r = fx * fy; break;
+				case Op_Divide:   r = fx / fy; break;
+				case Op_Modulus:  r = fmodf(fx, fy); break;
+				case Op_Abs:      r = fabsf(fx); break;
+				case Op_ACos:     r = acosf(fx); break;
+				case Op_ASin:     r = asinf(fx); break;
+				case Op_ATan:     r = atanf(fx); break;
+				case Op_ATan2:    r = atan2f(fx, fy); break;
+				case Op_Ceil:     r = ceilf(fx); break;
+				case Op_Clamp:    r = fminf(fmaxf(fx, fy), fz); break;
+				case Op_Cos:      r = cosf(fx); break;
+				case Op_CosH:     r = coshf(fx); break;
+				case Op_Degrees:  r = fx * 57.29577951f; break;
+				case Op_Exp:      r = expf(fx); break;
+				case Op_Exp2:     r = exp2f(fx); break;
+				case Op_Floor:    r = floorf(fx); break;
+				case Op_FMod:     r = fmodf(fx, fy); break;
+				case Op_Frac:     r = fx - floorf(fx); break;
+				case Op_LdExp:    r = ldexpf(fx, int(fy)); break;
+				case Op_Lerp:     r = fx + (fy - fx) * fz; break;
+				case Op_Log:      r = logf(fx); break;
+				case Op_Log10:    r = log10f(fx); break;
+				case Op_Log2:     r = log2f(fx); break;
+				case Op_Max:      r = fmaxf(fx, fy); break;
+				case Op_Min:      r = fminf(fx, fy); break;
+				case Op_Pow:      r = powf(fx, fy); break;
+				case Op_Radians:  r = fx * 0.01745329252f; break;
+				case Op_Round:    r = nearbyintf(fx); break;
+				case Op_RSqrt:    r = 1 / sqrtf(fx); break;
+				case Op_Saturate: r = fminf(fmaxf(fx, 0), 1); break;
+				case Op_Sign:     r = fx > 0 ? 1 : fx < 0 ? -1 : 0; break;
+				case Op_Sin:      r = sinf(fx); break;
+				case Op_SinH:     r = sinhf(fx); break;
+				case Op_SmoothStep:
+				{
+					float t = fminf(fmaxf((fz - fx) / (fy - fx), 0), 1);
+					r = t * t * (3 - 2 * t);
+					break;
+				}
+				case Op_Sqrt:     r = sqrtf(fx); break;
+				case Op_Step:     r = fy >= fx ? 1 : 0; break;
+				case Op_Tan:      r = tanf(fx); break;
+				case Op_TanH:     r = tanhf(fx); break;
+				case Op_Trunc:    r = truncf(fx); break;
+				default:
+					err = std::string("unsupported intrinsic ") + OpKindToString(op->opKind);
+					return false;
+				}
+			}
+			break;
+		}
+	}
+	else
+	{
+		err = std::string("unsupported expression ") + expr->GetNodeTypeName();
+		return false;
+	}
+
+	for (int i = 0; i < out.count; ++i)
+		out.v[i] = RefConvert(out.v[i], out.kind);
+	return true;
+}
+
+// the folder only leaves constants, scalar constants cast to vectors and lists of constants
+static bool IsFoldedConstant(const Expr* expr)
+{
+	if (dyn_cast<const ConstExpr>(expr))
+		return true;
+	if (!dyn_cast<const CastExpr>(expr) && !dyn_cast<const InitListExpr>(expr))
+		return false;
+	for (const ASTNode* ch = expr->firstChild; ch; ch = ch->next)
+		if (!IsFoldedConstant(ch->ToExpr()))
+			return false;
+	return true;
+}
+
+/* structural SPIR-V module check (spirv-val is used additionally when available),
+	outputs the decorations as "<target> <decoration> [<args>]" lines */
+static bool CheckSPIRVModule(const std::string& code, std::string& decorations, std::string& error)
+{
+	char bfr[256];
+	if (code.size() % 4 || code.size() < 20)
+	{
+		error = "module size is not a multiple of 4 or is too small";
+		return false;
+	}
+	std::vector<uint32_t> words(code.size() / 4);
+	memcpy(words.data(), code.data(), code.size());
+	if (words[0] != 0x07230203 || words[1] != 0x00010000 || words[4] != 0)
+	{
+		error = "bad module header";
+		return false;
+	}
+	uint32_t bound = words[3];
+	std::vector<bool> defined(bound, false);
+	std::unordered_map<uint32_t, std::string> names;
+	std::unordered_map<uint64_t, std::string> memberNames;
+	int numEntryPoints = 0, numMemoryModels = 0, fnDepth = 0;
+	bool inBlock = false;
+	for (size_t i = 5; i < words.size(); )
+	{
+		uint32_t op = words[i] & 0xffff;
+		uint32_t len = words[i] >> 16;
+		if (len == 0 || i + len > words.size())
+		{
+			sgrx_snprintf(bfr, sizeof(bfr), "bad instruction length at word %zu", i);
+			error = bfr;
+			return false;
+		}
+		const uint32_t* w = &words[i];
+		uint32_t resultID = 0;
+		if ((op >= 19 && op <= 33) || op == 248) // types, label
+			resultID = len > 1 ? w[1] : 0;
+		else if ((op >= 41 && op <= 46) || op == 54 || op == 55 || op == 59) // constants, function, variable
+			resultID = len > 2 ? w[2] : 0;
+		if (resultID)
+		{
+			if (resultID >= bound || defined[resultID])
+			{
+				sgrx_snprintf(bfr, sizeof(bfr), "result id %u is out of bounds or redefined (op %u)", resultID, op);
+				error = bfr;
+				return false;
+			}
+			defined[resultID] = true;
+		}
+		switch (op)
+		{
+		case 5: names[w[1]] = (const char*) &w[2]; break; // OpName
+		case 6: memberNames[(uint64_t(w[1]) << 32) | w[2]] = (const char*) &w[3]; break; // OpMemberName
+		case 14: numMemoryModels++; break;
+		case 15: numEntryPoints++; break;
+		case 54: fnDepth++; break;
+		case 56: fnDepth--; break;
+		case 248: // OpLabel
+			if (inBlock)
+			{
+				error = "block is not terminated";
+				return false;
+			}
+			inBlock = true;
+			break;
+		case 249: case 250: case 252: case 253: case 254: case 255: // terminators
+			if (!inBlock)
+			{
+				error = "terminator outside of a block";
+				return false;
+			}
+			inBlock = false;
+			break;
+		default:
+			if (fnDepth && !inBlock && op != 55 && op != 56)
+			{
+				sgrx_snprintf(bfr, sizeof(bfr), "instruction (op %u) after the block terminator", op);
+				error = bfr;
+				return false;
+			}
+			break;
+		}
+		if (fnDepth < 0 || fnDepth > 1)
+		{
+			error = "unbalanced OpFunction/OpFunctionEnd";
+			return false;
+		}
+		i += len;
+	}
+	if (numEntryPoints != 1 || numMemoryModels != 1 || fnDepth != 0 || inBlock)
+	{
+		error = "expected one entry point, one memory model and complete functions";
+		return false;
+	}
+
+	static const char* decorationNames[] =
+	{
+		"RelaxedPrecision", "SpecId", "Block", "BufferBlock", "RowMajor", "ColMajor", "ArrayStride",
+		"MatrixStride", "GLSLShared", "GLSLPacked", "CPacked", "BuiltIn", "", "NoPerspective", "Flat",
+	};
+	decorations = "\n";
+	for (size_t i = 5; i < words.size(); i += words[i] >> 16)
+	{
+		uint32_t op = words[i] & 0xffff;
+		uint32_t len = words[i] >> 16;
+		if (op != 71 && op != 72)
+			continue;
+		const uint32_t* w = &words[i];
+		auto it = names.find(w[1]);
+		decorations += it != names.end() ? it->second : "_";
+		uint32_t at = 2;
+		if (op == 72)
+		{
+			auto mit = memberNames.find((uint64_t(w[1]) << 32) | w[2]);
+			decorations += ".";
+			decorations += mit != memberNames.end() ? mit->second : "_";
+			at = 3;
+		}
+		uint32_t dec = w[at++];
+		const char* decName = nullptr;
+		switch (dec)
+		{
+		case 30: decName = "Location"; break;
+		case 33: decName = "Binding"; break;
+		case 34: decName = "DescriptorSet"; break;
+		case 35: decName = "Offset"; break;
+		default: decName = dec < sizeof(decorationNames) / sizeof(decorationNames[0]) ? decorationNames[dec] : "";
+		}
+		if (*decName)
+			decorations += std::string(" ") + decName;
+		else
+		{
+			sgrx_snprintf(bfr, sizeof(bfr), " Decoration%u", dec);
+			decorations += bfr;
+		}
+		for (; at < len; ++at)
+		{
+			sgrx_snprintf(bfr, sizeof(bfr), " %u", w[at]);
+			decorations += bfr;
+		}
+		decorations += "\n";
+	}
+	return true;
+}
 
 static void exec_test(const char* fname, const char* nameonly)
 {
 	bool hasErrors = false;
 	FILE* fpe = fopen(outfile_errors, "a");
-	numallocs = 0;
 
 	fprintf(fpe, "\n>>> test: %s\n", nameonly);
 	printf("> running %20s\t", nameonly);
@@ -267,6 +888,14 @@ static void exec_test(const char* fname, const char* nameonly)
 		std::string lastShader;
 		std::string lastErrors;
 		std::string lastVarDump;
+		std::string lastSPIRVDecorations;
+		std::string prevSPIRVDecorations;
+		std::vector<uint32_t> lastPreshaderCode;
+		std::vector<std::pair<std::string, size_t>> lastPreshaderInputs; // name, number of values
+		std::vector<std::pair<std::string, size_t>> lastPreshaderOutputs;
+		std::string lastPreshaderResult;
+		std::vector<PackageTestShader> packageShaders;
+		bool lastCodeOverflow = false;
 		char testName[64] = "<unknown>";
 		std::string testFile = GetFileContents<std::string>(fname);
 		/* parse contents
@@ -388,6 +1017,8 @@ static void exec_test(const char* fname, const char* nameonly)
 					ifo.outVarStrBufSize = nextBuildVarStrBufSize;
 					cfg.interfaceOutput  = &ifo;
 				}
+				if (nextPackageAdd)
+					cfg.interfaceOutput = &ifo;
 				if (nextSlotAssignRequest)
 				{
 					cfg.outputFlags |= HOC_OF_SPECIFY_REGISTERS;
@@ -398,10 +1029,159 @@ static void exec_test(const char* fname, const char* nameonly)
 					cfg.outputFlags |= HOC_OF_HLSL3_BUFFER_SLOTS;
 					nextHLSLSM3BufferRegsAreSlots = false;
 				}
+				if (nextFastMath)
+				{
+					cfg.outputFlags |= HOC_OF_FAST_MATH;
+					nextFastMath = false;
+				}
+				if (nextPreshader)
+				{
+					cfg.outputFlags |= HOC_OF_PRESHADER;
+					nextPreshader = false;
+				}
+				if (nextNativeHalf)
+				{
+					cfg.outputFlags |= HOC_OF_NATIVE_HALF;
+					nextNativeHalf = false;
+				}
+				if (nextAutoPrecision)
+				{
+					cfg.outputFlags |= HOC_OF_GLSL_AUTO_PRECISION;
+					nextAutoPrecision = false;
+				}
+				if (nextPackVaryings)
+				{
+					cfg.outputFlags |= HOC_OF_GLSL_PACK_VARYINGS;
+					nextPackVaryings = false;
+				}
+				if (nextPackUniforms)
+				{
+					cfg.outputFlags |= HOC_OF_HLSL3_PACK_UNIFORMS;
+					nextPackUniforms = false;
+				}
+				if (nextUsageMasks)
+				{
+					cfg.outputFlags |= HOC_OF_EXPORT_USAGE_MASKS;
+					nextUsageMasks = false;
+				}
+				if (nextLayout)
+				{
+					cfg.outputFlags |= HOC_OF_EXPORT_LAYOUT;
+					nextLayout = false;
+				}
+				std::vector<std::string> uniformNames;
+				std::vector<std::vector<float>> uniformData;
+				std::vector<HOC_UniformValue> uniformValues;
+				if (!nextUniformNames.empty())
+				{
+					uniformNames.swap(nextUniformNames);
+					uniformData.swap(nextUniformValues);
+					for (size_t i = 0; i < uniformNames.size(); ++i)
+					{
+						HOC_UniformValue uv = { uniformNames[i].c_str(),
+							uniformData[i].data(), uint32_t(uniformData[i].size()) };
+						uniformValues.push_back(uv);
+					}
+					HOC_UniformValue term = { nullptr, nullptr, 0 };
+					uniformValues.push_back(term);
+					cfg.uniformValues = uniformValues.data();
+				}
+				if (nextOptimizationLevel >= 0)
+				{
+					cfg.optimizationLevel = uint8_t(nextOptimizationLevel);
+					nextOptimizationLevel = -1;
+				}
+				if (nextMaxUnrollSize >= 0)
+				{
+					cfg.maxUnrollSize = uint32_t(nextMaxUnrollSize);
+					nextMaxUnrollSize = -1;
+				}
+				HOC_CodeOutput co;
+				char* codeBuf = nullptr;
+				size_t userAllocsBefore = numCodeBufUserAllocs;
+				if (nextCodeBufRequest)
+				{
+					if (nextCodeBufSize)
+						codeBuf = new char[nextCodeBufSize];
+					co.outBuf        = codeBuf;
+					co.outBufSize    = nextCodeBufSize;
+					co.overflowAlloc = nextCodeBufAlloc;
+					if (nextCodeBufUserAlloc)
+					{
+						co.allocFunc     = CodeBufUserAlloc;
+						co.allocUserData = &numCodeBufUserAllocs;
+					}
+					cfg.codeOutput = &co;
+				}
 				lastExec = HOC_CompileShader("<memory>", bc, &cfg);
 				lastShader = strCode;
+				if (nextCodeBufRequest)
+				{
+					nextCodeBufRequest = false;
+					lastCodeOverflow = co.didOverflow;
+					if (!strCode.empty())
+					{
+						printf("[%s] ERROR in code buffer: code also written to the stream\n", testName);
+						hasErrors = true;
+					}
+					if (numCodeBufUserAllocs - userAllocsBefore != (co.didOverflow && co.overflowAlloc && co.allocFunc ? 1u : 0u))
+					{
+						printf("[%s] ERROR in code buffer: unexpected number of user allocations\n", testName);
+						hasErrors = true;
+					}
+					if (lastExec)
+					{
+						// compare with the stream output, it's also used for further checks
+						std::string strErrors2;
+						toErrors.userData = &strErrors2;
+						cfg.codeOutput = nullptr;
+						cfg.ASTDumpStream = nullptr;
+						HOC_CompileShader("<memory>", bc, &cfg);
+						lastShader = strCode;
+
+						std::string expCode = strCode;
+						if (co.didOverflow && !co.overflowAlloc)
+							expCode.resize(co.outBufSize ? co.outBufSize - 1 : 0);
+						if (co.outCodeSize != strCode.size() ||
+							(co.outBuf ? expCode != co.outBuf : co.outBufSize != 0))
+						{
+							printf("[%s] ERROR in code buffer: expected '%s' (%zu), got '%s' (%zu)\n",
+								testName, expCode.c_str(), strCode.size(),
+								co.outBuf ? co.outBuf : "<null>", co.outCodeSize);
+							hasErrors = true;
+						}
+					}
+					if (co.outBuf != codeBuf && co.allocFunc)
+						delete [] co.outBuf;
+					HOC_FreeCodeOutputBuffer(&co);
+					delete [] codeBuf;
+				}
 				lastErrors = strErrors;
 				lastByprod = strByprod;
+				if (nextPackageAdd)
+				{
+					nextPackageAdd = false;
+					if (lastExec)
+					{
+						PackageTestShader pts;
+						pts.name = nextPackageName;
+						pts.permutationHash = PackageTestPermutationHash(nextPackageDefines);
+						pts.stage = stage;
+						pts.outputFmt = outputFmt;
+						pts.code = lastShader;
+						HOC_TextOutput to = { &HOC_WriteStr_String<std::string>, &pts.varDump };
+						HOC_DumpShaderInterfaceOutput(&ifo, &to);
+						pts.vars.assign(ifo.outVarBuf, ifo.outVarBuf + ifo.outVarBufSize);
+						pts.varStr.assign(ifo.outVarStrBuf, ifo.outVarStrBufSize);
+						pts.preshader.assign(ifo.outPreshaderBuf, ifo.outPreshaderBuf + ifo.outPreshaderBufSize);
+						pts.usageMask.assign(ifo.outUsageMaskBuf, ifo.outUsageMaskBuf + ifo.outUsageMaskBufSize);
+						pts.layout.assign(ifo.outLayoutBuf, ifo.outLayoutBuf + ifo.outLayoutBufSize);
+						pts.location.assign(ifo.outLocationBuf, ifo.outLocationBuf + ifo.outLocationBufSize);
+						packageShaders.push_back(pts);
+					}
+					if (!nextBuildVarRequest)
+						HOC_FreeInterfaceOutputBuffers(&ifo);
+				}
 				if (nextBuildVarRequest)
 				{
 					nextBuildVarRequest = false;
@@ -412,6 +1192,22 @@ static void exec_test(const char* fname, const char* nameonly)
 						HOC_TextOutput to = { &HOC_WriteStr_String<std::string>, &lastVarDump };
 						HOC_DumpShaderInterfaceOutput(&ifo, &to);
 					}
+					lastPreshaderCode.clear();
+					lastPreshaderInputs.clear();
+					lastPreshaderOutputs.clear();
+					if (lastExec)
+					{
+						lastPreshaderCode.assign(ifo.outPreshaderBuf, ifo.outPreshaderBuf + ifo.outPreshaderBufSize);
+						for (size_t i = 0; i < ifo.outVarBufSize; ++i)
+						{
+							const ShaderVariable& sv = ifo.outVarBuf[i];
+							size_t count = (sv.sizeX ? sv.sizeX : 1) * (sv.sizeY ? sv.sizeY : 1) * (sv.arraySize ? sv.arraySize : 1);
+							if (sv.svType == SVT_PreshaderInput)
+								lastPreshaderInputs.push_back(std::make_pair(&ifo.outVarStrBuf[sv.name], count));
+							else if (sv.svType == SVT_PreshaderOutput)
+								lastPreshaderOutputs.push_back(std::make_pair(&ifo.outVarStrBuf[sv.name], count));
+						}
+					}
 					HOC_FreeInterfaceOutputBuffers(&ifo);
 				}
 				double tm2 = GetTime();
@@ -423,13 +1219,66 @@ static void exec_test(const char* fname, const char* nameonly)
 					longestMyBuildShader = testName;
 				}
 				fprintf(fp, "%s", lastByprod.c_str());
-				fprintf(fp, "%s", lastShader.c_str());
+				if (outputFmt == OSF_SPIRV)
+					fprintf(fp, "<SPIR-V, %zu bytes>\n", lastShader.size());
+				else
+					fprintf(fp, "%s", lastShader.c_str());
 				fprintf(fpe, "-- [%s] memory allocated: %zu blocks, %zu bytes\n",
 					testName, g_numAllocs - allocsBefore, g_numAllocBytes - allocBytesBefore);
 				fprintf(fpe, "-- compile (errors) --\n%s", lastErrors.c_str());
 				delete[] bc;
 				chkempty(testName);
 			};
+			// syntax: <VS entry point> <PS entry point>, both are compiled from the same source
+			auto CompilePair = [&](OutputShaderFormat outputFmt)
+			{
+				std::string vsEntry = decoded_value.substr(0, decoded_value.find(' '));
+				std::string psEntry = decoded_value.substr(decoded_value.find(' ') + 1);
+				std::string strErrors, strVSCode, strPSCode;
+				HOC_TextOutput toErrors = { &HOC_WriteStr_String<std::string>, &strErrors };
+				HOC_TextOutput toVSCode = { &HOC_WriteStr_String<std::string>, &strVSCode };
+				HOC_TextOutput toPSCode = { &HOC_WriteStr_String<std::string>, &strPSCode };
+				HOC_InterfaceOutput vsIfo, psIfo;
+				HOC_Config vsCfg, psCfg;
+				vsCfg.entryPoint = vsEntry.c_str();
+				psCfg.entryPoint = psEntry.c_str();
+				vsCfg.stage = ShaderStage_Vertex;
+				psCfg.stage = ShaderStage_Pixel;
+				vsCfg.outputFmt = psCfg.outputFmt = outputFmt;
+				vsCfg.outputFlags |= HOC_OF_EXPORT_VARYINGS;
+				if (nextPackVaryings)
+				{
+					vsCfg.outputFlags |= HOC_OF_GLSL_PACK_VARYINGS;
+					nextPackVaryings = false;
+				}
+				psCfg.outputFlags = vsCfg.outputFlags;
+				vsCfg.loadIncludeFileFunc = psCfg.loadIncludeFileFunc = LoadIncludeFileTest;
+				vsCfg.loadIncludeFileUserData = psCfg.loadIncludeFileUserData = &includes;
+				vsCfg.errorOutputStream = psCfg.errorOutputStream = &toErrors;
+				vsCfg.codeOutputStream = &toVSCode;
+				psCfg.codeOutputStream = &toPSCode;
+				vsCfg.interfaceOutput = &vsIfo;
+				psCfg.interfaceOutput = &psIfo;
+				lastExec = HOC_CompileShaderPair("<memory>", lastSource.c_str(), &vsCfg,
+					"<memory>", lastSource.c_str(), &psCfg);
+				lastShader = strVSCode + strPSCode;
+				lastErrors = strErrors;
+				lastByprod.clear();
+				lastVarDump = "\n";
+				if (lastExec)
+				{
+					HOC_TextOutput to = { &HOC_WriteStr_String<std::string>, &lastVarDump };
+					HOC_DumpShaderInterfaceOutput(&vsIfo, &to);
+					lastVarDump += "--\n";
+					HOC_DumpShaderInterfaceOutput(&psIfo, &to);
+				}
+				HOC_FreeInterfaceOutputBuffers(&vsIfo);
+				HOC_FreeInterfaceOutputBuffers(&psIfo);
+				fprintf(fp, "\ncompile pair: %s\n", lastExec ? "SUCCESS" : "FAILURE");
+				fprintf(fp, "%s", lastShader.c_str());
+				fprintf(fpe, "-- compile pair (errors) --\n%s", lastErrors.c_str());
+				chkempty(testName);
+			};
 			auto Result = [&](const char* expected)
 			{
 				const char* lastExecStr = "<unknown>";
@@ -644,6 +1493,34 @@ static void exec_test(const char* fname, const char* nameonly)
 				}
 			};
 
+			auto SPIRV = [&]()
+			{
+				std::string error;
+				if (!CheckSPIRVModule(lastShader, lastSPIRVDecorations, error))
+				{
+					printf("[%s] ERROR in '%s': invalid SPIR-V module: %s\n", testName, ident.c_str(), error.c_str());
+					hasErrors = true;
+					return;
+				}
+				fprintf(fp, "-- spirv decorations --%s", lastSPIRVDecorations.c_str());
+				if (!g_runSPIRVV)
+					return;
+
+				mkdir(".tmp");
+				SetFileContents(".tmp/shader.rcmp.spv", lastShader);
+
+				// a missing spirv-val fails as well, validation is only skipped with --no-spirvval
+				int ret = system("spirv-val --target-env vulkan1.0 .tmp/shader.rcmp.spv 1>.tmp/shader.rcmp.out 2>&1");
+				auto outRcmp = GetFileContents<std::string>(".tmp/shader.rcmp.out", true);
+				fprintf(fp, "-- spirv-val --\nRECOMPILED:\n%s\n", outRcmp.c_str());
+				if (ret != 0 || outRcmp.find("error") != std::string::npos)
+				{
+					printf("[%s] ERROR in '%s': validation of recompiled shader failed, errors:\n%s\n",
+						testName, ident.c_str(), outRcmp.c_str());
+					hasErrors = true;
+				}
+			};
+
 			/* PROCESS ACTION */
 			if (ident.size() >= 2 && ident[0] == '/' && ident[1] == '/')
 			{
@@ -694,6 +1571,377 @@ static void exec_test(const char* fname, const char* nameonly)
 			{
 				nextHLSLSM3BufferRegsAreSlots = true;
 			}
+			else if (ident == "request_fast_math")
+			{
+				nextFastMath = true;
+			}
+			else if (ident == "request_preshader")
+			{
+				nextPreshader = true;
+			}
+			else if (ident == "request_native_half")
+			{
+				nextNativeHalf = true;
+			}
+			else if (ident == "request_auto_precision")
+			{
+				nextAutoPrecision = true;
+			}
+			else if (ident == "request_pack_varyings")
+			{
+				nextPackVaryings = true;
+			}
+			else if (ident == "request_pack_uniforms")
+			{
+				nextPackUniforms = true;
+			}
+			else if (ident == "request_usage_masks")
+			{
+				nextUsageMasks = true;
+			}
+			else if (ident == "request_layout")
+			{
+				nextLayout = true;
+			}
+			else if (ident == "request_package_add")
+			{
+				// syntax: <name> [<define>[=<value>] ...], adds the next compiled shader to the test package
+				nextPackageAdd = true;
+				nextPackageName.clear();
+				nextPackageDefines.clear();
+				size_t pos = 0;
+				while (pos < decoded_value.size())
+				{
+					size_t end = decoded_value.find(' ', pos);
+					if (end == std::string::npos)
+						end = decoded_value.size();
+					if (end > pos)
+					{
+						if (nextPackageName.empty())
+							nextPackageName = decoded_value.substr(pos, end - pos);
+						else
+							nextPackageDefines.push_back(decoded_value.substr(pos, end - pos));
+					}
+					pos = end + 1;
+				}
+			}
+			else if (ident == "verify_package")
+			{
+				// builds a package from all added shaders, looks each one up and compares it to the original
+				HOC_PackageBuilder* pb = HOC_CreatePackageBuilder();
+				for (const auto& pts : packageShaders)
+				{
+					HOC_InterfaceOutput ifo;
+					ifo.outVarBuf = const_cast<ShaderVariable*>(pts.vars.data());
+					ifo.outVarBufSize = pts.vars.size();
+					ifo.outVarStrBuf = const_cast<char*>(pts.varStr.data());
+					ifo.outVarStrBufSize = pts.varStr.size();
+					ifo.outPreshaderBuf = const_cast<uint32_t*>(pts.preshader.data());
+					ifo.outPreshaderBufSize = pts.preshader.size();
+					ifo.outUsageMaskBuf = const_cast<uint32_t*>(pts.usageMask.data());
+					ifo.outUsageMaskBufSize = pts.usageMask.size();
+					ifo.outLayoutBuf = const_cast<HOC_ShaderVariableLayout*>(pts.layout.data());
+					ifo.outLayoutBufSize = pts.layout.size();
+					ifo.outLocationBuf = const_cast<int32_t*>(pts.location.data());
+					ifo.outLocationBufSize = pts.location.size();
+					if (!HOC_PackageAddShader(pb, pts.name.c_str(), pts.stage, pts.outputFmt, pts.permutationHash,
+						pts.code.c_str(), pts.code.size(), &ifo))
+					{
+						printf("[%s] ERROR in 'verify_package': failed to add '%s'\n", testName, pts.name.c_str());
+						hasErrors = true;
+					}
+				}
+				if (!packageShaders.empty() && HOC_PackageAddShader(pb, packageShaders[0].name.c_str(),
+					packageShaders[0].stage, packageShaders[0].outputFmt, packageShaders[0].permutationHash, "", 0, nullptr))
+				{
+					printf("[%s] ERROR in 'verify_package': duplicate shader was added\n", testName);
+					hasErrors = true;
+				}
+				std::string pkgData;
+				HOC_TextOutput toPkg = { &HOC_WriteStr_String<std::string>, &pkgData };
+				if (!HOC_WritePackage(pb, &toPkg))
+				{
+					printf("[%s] ERROR in 'verify_package': failed to write the package\n", testName);
+					hasErrors = true;
+				}
+				HOC_DestroyPackageBuilder(pb);
+				chkempty(testName);
+
+				// the package is used in place, as if it was memory-mapped
+				std::vector<uint32_t> pkgMem((pkgData.size() + 3) / 4);
+				memcpy(pkgMem.data(), pkgData.data(), pkgData.size());
+				std::string listing = "\n";
+				if (auto* pkg = HOC_OpenPackage(pkgMem.data(), pkgData.size()))
+				{
+					for (const auto& pts : packageShaders)
+					{
+						char bfr[256];
+						snprintf(bfr, sizeof(bfr), "%s %s %d %016llx", pts.name.c_str(),
+							pts.stage == ShaderStage_Vertex ? "vertex" : "pixel",
+							int(pts.outputFmt), (unsigned long long) pts.permutationHash);
+						listing += bfr;
+						auto* ps = HOC_FindPackageShader(pkg, pts.name.c_str(), pts.stage, pts.outputFmt, pts.permutationHash);
+						if (!ps)
+						{
+							listing += " NOT FOUND\n";
+							continue;
+						}
+						HOC_InterfaceOutput ifo;
+						HOC_GetPackageInterfaceOutput(pkg, ps, &ifo);
+						std::string varDump;
+						HOC_TextOutput to = { &HOC_WriteStr_String<std::string>, &varDump };
+						HOC_DumpShaderInterfaceOutput(&ifo, &to);
+						const char* code = (const char*) pkg + ps->code;
+						snprintf(bfr, sizeof(bfr), " vars=%u%s%s\n", ps->numVars,
+							ps->codeSize == pts.code.size() && code == pts.code ? "" : " CODE MISMATCH",
+							varDump == pts.varDump ? "" : " VARS MISMATCH");
+						listing += bfr;
+						if (HOC_FindPackageShader(pkg, pts.name.c_str(), pts.stage, pts.outputFmt, pts.permutationHash + 1))
+							listing += "found with a different permutation\n";
+					}
+
+					// corrupted copies must be rejected when opened
+					struct Corruption { size_t offset; uint32_t value; };
+					const size_t shader0 = pkg->shaderOffset;
+					const size_t nameSizeOff = shader0 + offsetof(HOC_PackageShader, nameSize);
+					const size_t bucketOff = pkg->bucketOffset;
+					std::vector<Corruption> corruptions;
+					corruptions.push_back({ 8, uint32_t(pkgData.size() - 1) }); // truncated
+					corruptions.push_back({ nameSizeOff, pkgMem[nameSizeOff / 4] - 1 }); // name not terminated
+					for (uint32_t b = 0; b < pkg->numBuckets; ++b)
+						corruptions.push_back({ bucketOff + b * 4, pkg->numShaders });
+					for (size_t f = offsetof(HOC_PackageShader, code); f < sizeof(HOC_PackageShader); f += 4)
+						corruptions.push_back({ shader0 + f, f % 8 == offsetof(HOC_PackageShader, code) % 8 ? 0xfffffff0 : 0x3ffffff0 });
+					corruptions.push_back({ shader0 + offsetof(HOC_PackageShader, name), 0xfffffff0 });
+					for (const auto& c : corruptions)
+					{
+						std::vector<uint32_t> badMem = pkgMem;
+						badMem[c.offset / 4] = c.value;
+						size_t badSize = c.offset == 8 ? c.value : pkgData.size();
+						if (HOC_OpenPackage(badMem.data(), badSize))
+						{
+							printf("[%s] ERROR in 'verify_package': package with %08x at %u was not rejected\n",
+								testName, c.value, unsigned(c.offset));
+							hasErrors = true;
+						}
+					}
+				}
+				else
+					listing += "failed to open the package\n";
+				if (!memstreq_nnl(listing.c_str(), decoded_value.c_str()))
+				{
+					printf("[%s] ERROR in 'verify_package': expected '%s', got '%s'\n",
+						testName, decoded_value.c_str(), listing.c_str());
+					hasErrors = true;
+				}
+			}
+			else if (ident == "run_preshader")
+			{
+				// syntax: <name>=<value>[,<value>...] ... (for each preshader input of the last build)
+				std::vector<std::vector<float>> inputData(lastPreshaderInputs.size());
+				std::vector<std::vector<float>> outputData(lastPreshaderOutputs.size());
+				std::vector<const float*> inputs;
+				std::vector<float*> outputs;
+				const char* p = decoded_value.c_str();
+				while (*p)
+				{
+					while (*p == ' ' || *p == '\n' || *p == '\t')
+						p++;
+					const char* eq = strchr(p, '=');
+					if (!*p || !eq)
+						break;
+					std::string name(p, eq);
+					std::vector<float> values;
+					p = eq;
+					do
+					{
+						char* end;
+						values.push_back(strtof(p + 1, &end));
+						p = end;
+					}
+					while (*p == ',');
+					for (size_t i = 0; i < lastPreshaderInputs.size(); ++i)
+						if (lastPreshaderInputs[i].first == name)
+							inputData[i] = values;
+				}
+				for (size_t i = 0; i < inputData.size(); ++i)
+				{
+					if (inputData[i].size() != lastPreshaderInputs[i].second)
+					{
+						printf("[%s] ERROR in 'run_preshader': expected %zu values for '%s', got %zu\n",
+							testName, lastPreshaderInputs[i].second,
+							lastPreshaderInputs[i].first.c_str(), inputData[i].size());
+						hasErrors = true;
+						inputData[i].resize(lastPreshaderInputs[i].second);
+					}
+					inputs.push_back(inputData[i].data());
+				}
+				for (size_t i = 0; i < outputData.size(); ++i)
+				{
+					outputData[i].resize(lastPreshaderOutputs[i].second);
+					outputs.push_back(outputData[i].data());
+				}
+
+				lastPreshaderResult = "\n";
+				if (!HOC_RunPreshader(lastPreshaderCode.data(), lastPreshaderCode.size(), inputs.data(), outputs.data()))
+				{
+					lastPreshaderResult += "failed\n";
+				}
+				else
+				{
+					for (size_t i = 0; i < outputData.size(); ++i)
+					{
+						lastPreshaderResult += lastPreshaderOutputs[i].first;
+						for (size_t j = 0; j < outputData[i].size(); ++j)
+						{
+							char bfr[32];
+							snprintf(bfr, sizeof(bfr), "%s%g", j ? "," : "=", outputData[i][j]);
+							lastPreshaderResult += bfr;
+						}
+						lastPreshaderResult += "\n";
+					}
+				}
+			}
+			else if (ident == "verify_preshader")
+			{
+				if (!memstreq_nnl(lastPreshaderResult.c_str(), decoded_value.c_str()))
+				{
+					printf("[%s] ERROR in 'verify_preshader': expected '%s', got '%s'\n",
+						testName, decoded_value.c_str(), lastPreshaderResult.c_str());
+					hasErrors = true;
+				}
+			}
+			else if (ident == "verify_folding")
+			{
+				// syntax: one "[!]<type> <expression>" per line, '!' - must not be folded
+				// folds each expression in-process and compares the constant to the reference evaluator
+				const char* p = decoded_value.c_str();
+				while (*p)
+				{
+					const char* end = strchr(p, '\n');
+					if (!end)
+						end = p + strlen(p);
+					std::string line(p, end);
+					p = *end ? end + 1 : end;
+					if (line.empty())
+						continue;
+					bool expectFolded = line[0] != '!';
+					if (!expectFolded)
+						line.erase(0, 1);
+
+					size_t sp = line.find(' ');
+					std::string code = line.substr(0, sp) + " f() { return " + line.substr(sp + 1) + "; }\n"
+						"float4 main() : POSITION { return 0; }\n";
+					HOC_Config cfg;
+					StringStream errs;
+					Diagnostic diag(&errs, "<folding>");
+					Parser parser(diag, &cfg);
+					const char* featureDefs[] = { nullptr };
+					ReturnStmt* ret = nullptr;
+					if (parser.ParseCode(code.c_str(), featureDefs) && !diag.hasErrors)
+					{
+						for (ASTNode* ch = parser.ast.functionList.firstChild; ch; ch = ch->next)
+							if (ch->ToFunction()->name == "f")
+								ret = ch->ToFunction()->firstRetStmt;
+					}
+					if (!ret)
+					{
+						printf("[%s] ERROR in 'verify_folding': '%s' failed to parse:\n%s\n",
+							testName, line.c_str(), errs.str().c_str());
+						hasErrors = true;
+						continue;
+					}
+
+					RefValue expected, folded;
+					std::string err;
+					if (expectFolded && !RefEval(ret->GetExpr(), expected, err))
+					{
+						printf("[%s] ERROR in 'verify_folding': '%s' cannot be evaluated: %s\n",
+							testName, line.c_str(), err.c_str());
+						hasErrors = true;
+						continue;
+					}
+					ConstantPropagation().RunOnAST(parser.ast);
+					if (IsFoldedConstant(ret->GetExpr()) != expectFolded)
+					{
+						printf("[%s] ERROR in 'verify_folding': '%s' was %s\n",
+							testName, line.c_str(), expectFolded ? "not folded" : "folded");
+						hasErrors = true;
+						continue;
+					}
+					if (!expectFolded)
+						continue;
+					if (!RefEval(ret->GetExpr(), folded, err) || folded.count != expected.count)
+					{
+						printf("[%s] ERROR in 'verify_folding': '%s' folded to an invalid constant\n",
+							testName, line.c_str());
+						hasErrors = true;
+						continue;
+					}
+					for (int i = 0; i < expected.count; ++i)
+					{
+						double a = expected.v[i], b = folded.v[i];
+						double tolerance = expected.kind == ASTType::Float32 ? 1e-5 * (fabs(a) > 1 ? fabs(a) : 1) : 0;
+						if (fabs(a - b) > tolerance)
+						{
+							printf("[%s] ERROR in 'verify_folding': '%s'[%d] - expected %.9g, folded %.9g\n",
+								testName, line.c_str(), i, a, b);
+							hasErrors = true;
+						}
+					}
+				}
+			}
+			else if (ident == "request_uniform_values")
+			{
+				// syntax: <name>=<value>[,<value>...] ...
+				nextUniformNames.clear();
+				nextUniformValues.clear();
+				const char* p = decoded_value.c_str();
+				while (*p)
+				{
+					while (*p == ' ' || *p == '\n' || *p == '\t')
+						p++;
+					const char* eq = strchr(p, '=');
+					if (!*p || !eq)
+						break;
+					nextUniformNames.push_back(std::string(p, eq));
+					nextUniformValues.push_back(std::vector<float>());
+					p = eq;
+					do
+					{
+						char* end;
+						nextUniformValues.back().push_back(strtof(p + 1, &end));
+						p = end;
+					}
+					while (*p == ',');
+				}
+			}
+			else if (ident == "request_optimization_level")
+			{
+				nextOptimizationLevel = atoi(decoded_value.c_str());
+			}
+			else if (ident == "request_max_unroll_size")
+			{
+				nextMaxUnrollSize = atoi(decoded_value.c_str());
+			}
+			else if (ident == "request_code_buffer")
+			{
+				// syntax: <size> [noalloc|useralloc]
+				nextCodeBufRequest = true;
+				nextCodeBufSize = strtoul(decoded_value.c_str(), nullptr, 10);
+				nextCodeBufAlloc = decoded_value.find("noalloc") == std::string::npos;
+				nextCodeBufUserAlloc = decoded_value.find("useralloc") != std::string::npos;
+			}
+			else if (ident == "check_code_overflow")
+			{
+				bool exp = decoded_value == "1";
+				if (lastCodeOverflow != exp)
+				{
+					printf("[%s] ERROR in 'check_code_overflow': expected %d, got %d\n",
+						testName, int(exp), int(lastCodeOverflow));
+					hasErrors = true;
+				}
+			}
 			else if (ident == "verify_vars")
 			{
 				if (!memstreq_nnl(lastVarDump.c_str(), decoded_value.c_str()))
@@ -748,6 +1996,11 @@ static void exec_test(const char* fname, const char* nameonly)
 				Compile(decoded_value == "pixel" ? ShaderStage_Pixel : ShaderStage_Vertex, OSF_GLSL_ES_100);
 				Result("false");
 			}
+			else if (ident == "compile_fail_spirv")
+			{
+				Compile(GetShaderStage(decoded_value), OSF_SPIRV);
+				Result("false");
+			}
 			else if (ident == "hlsl_before_after")
 			{
 				HLSLBeforeAfter(decoded_value);
@@ -788,6 +2041,73 @@ static void exec_test(const char* fname, const char* nameonly)
 				if (Result("true"))
 					GLSL(decoded_value);
 			}
+			else if (ident == "compile_glsl_330")
+			{
+				Compile(GetShaderStage(decoded_value), OSF_GLSL_330);
+				if (Result("true"))
+					GLSL(decoded_value);
+			}
+			else if (ident == "compile_glsl_es300")
+			{
+				Compile(GetShaderStage(decoded_value), OSF_GLSL_ES_300);
+				if (Result("true"))
+					GLSL(decoded_value);
+			}
+			else if (ident == "compile_spirv")
+			{
+				Compile(GetShaderStage(decoded_value), OSF_SPIRV);
+				prevSPIRVDecorations = lastSPIRVDecorations;
+				lastSPIRVDecorations = "\n";
+				if (Result("true"))
+					SPIRV();
+			}
+			else if (ident == "spirv_decorations")
+			{
+				if (!memstreq_nnl(lastSPIRVDecorations.c_str(), decoded_value.c_str()))
+				{
+					printf("[%s] ERROR in 'spirv_decorations': expected '%s', got '%s'\n",
+						testName, decoded_value.c_str(), lastSPIRVDecorations.c_str());
+					hasErrors = true;
+				}
+			}
+			else if (ident == "spirv_matching_locations")
+			{
+				// stages compiled separately: each varying location of the last shader must be in the previous one
+				for (size_t pos = lastSPIRVDecorations.find("\nV2P_"); pos != std::string::npos;
+					pos = lastSPIRVDecorations.find("\nV2P_", pos + 1))
+				{
+					size_t end = lastSPIRVDecorations.find('\n', pos + 1);
+					std::string line = lastSPIRVDecorations.substr(pos,
+						end != std::string::npos ? end - pos + 1 : std::string::npos);
+					if (line.find(" Location ") != std::string::npos &&
+						prevSPIRVDecorations.find(line) == std::string::npos)
+					{
+						printf("[%s] ERROR in 'spirv_matching_locations': '%s' not found in the previous shader\n",
+							testName, line.substr(1, line.size() - 2).c_str());
+						hasErrors = true;
+					}
+				}
+			}
+			else if (ident == "compile_pair_hlsl")
+			{
+				CompilePair(OSF_HLSL_SM3);
+				Result("true");
+			}
+			else if (ident == "compile_pair_hlsl4")
+			{
+				CompilePair(OSF_HLSL_SM4);
+				Result("true");
+			}
+			else if (ident == "compile_pair_glsl")
+			{
+				CompilePair(OSF_GLSL_140);
+				Result("true");
+			}
+			else if (ident == "compile_pair_glsl_es100")
+			{
+				CompilePair(OSF_GLSL_ES_100);
+				Result("true");
+			}
 			else if (ident == "in_shader")
 			{
 				if (lastShader.find(decoded_value) == String::npos)
@@ -885,7 +2205,7 @@ static void exec_tests(const char* dirname)
 int main(int argc, char** argv)
 {
 	int i;
-	char *testName = NULL, *dirname = "tests";
+	const char *testName = NULL, *dirname = "tests";
 	setvbuf(stdout, NULL, _IONBF, 0);
 	printf("\n//\n/// ShaderCompiler test framework\n//\n");
 
@@ -899,8 +2219,12 @@ int main(int argc, char** argv)
 			g_runFXC = false;
 		else if (!strcmp(argv[i], "--no-glslv"))
 			g_runGLSLV = false;
+		else if (!strcmp(argv[i], "--no-spirvval"))
+			g_runSPIRVV = false;
 	}
 	printf("- test directory: %s\n", dirname);
+	if (!g_runSPIRVV)
+		printf("- spirv-val disabled, SPIR-V output is only checked structurally\n");
 	if (testName)
 	{
 		printf("- one test: %s\n", testName);
@@ -919,6 +2243,6 @@ int main(int argc, char** argv)
 
 	printf("\n///\n/// Tests failed:  %d  / %d\n///\n", tests_failed, tests_executed);
 
-	return 0;
+	return tests_failed ? 1 : 0;
 }
 
@@ -116,6 +116,15 @@ compile_hlsl4 ``
 compile_glsl ``
 compile_glsl_es100 ``
 
+// `ternary op second choice cast`
+source `float4 main(float4 p : POSITION) : POSITION { return (p.x > 0 ? p : 2) + (p.y > 0 ? 1 : p); }`
+compile_hlsl4 ``
+compile_glsl ``
+in_shader `? ATTR_POSITION0 : vec4(2))`
+in_shader `? vec4(1) : ATTR_POSITION0)`
+compile_glsl_es100 ``
+in_shader `? ATTR_POSITION0 : vec4(2))`
+
 // `extra semicolon parsing`
 source `float4 main() : POSITION { ;; return 0; ;;;; }`
 compile_hlsl_before_after ``
@@ -143,3 +152,24 @@ compile_hlsl_before_after ``
 compile_hlsl4 ``
 compile_glsl ``
 compile_glsl_es100 ``
+
+// `code output buffer`
+source `float4 main(float4 p : POSITION) : POSITION { return p * 0.5; }`
+request_code_buffer `4096`
+compile_hlsl_before_after ``
+check_code_overflow `0`
+in_shader `POSITION`
+request_code_buffer `16`
+compile_hlsl4 ``
+check_code_overflow `1`
+in_shader `SV_POSITION`
+request_code_buffer `16 noalloc`
+compile_glsl ``
+check_code_overflow `1`
+request_code_buffer `0 noalloc`
+compile_glsl_es100 ``
+check_code_overflow `1`
+request_code_buffer `0 useralloc`
+compile_glsl_es100 ``
+check_code_overflow `1`
+in_shader `gl_Position`
@@ -300,6 +300,214 @@ verify_vars `
 VSInput Float32x4 ATTR_POSITION0 :POSITION #0
 `
 
+// `explicit layout locations`
+source `
+float4x4 WVP;
+void main(float4 pos : POSITION, float4x3 inst : TEXCOORD4, float2 uv : TEXCOORD0,
+	out float4 opos : POSITION, out float2 ouv : TEXCOORD0)
+{
+	opos = mul(float4(mul(pos, inst), 1), WVP);
+	ouv = uv;
+}`
+request_vars ``
+compile_glsl_330 ``
+in_shader `#version 330`
+in_shader `layout(location=0) in vec4 ATTR_POSITION0;`
+in_shader `layout(location=5) in vec2 ATTR_TEXCOORD0;`
+in_shader `out vec2 V2P_TEXCOORD0;`
+verify_vars `
+Uniform Float32x4x4 WVP
+VSInput Float32x4 ATTR_POSITION0 :POSITION #0 loc=0
+VSInput Float32x4x3 ATTR_TEXCOORD4 :TEXCOORD #4 loc=1
+VSInput Float32x2 ATTR_TEXCOORD0 :TEXCOORD #0 loc=5
+`
+request_vars ``
+compile_glsl_es300 ``
+in_shader `#version 300 es`
+in_shader `layout(location=1) in mat4x3 ATTR_TEXCOORD4;`
+verify_vars `
+Uniform Float32x4x4 WVP
+VSInput Float32x4 ATTR_POSITION0 :POSITION #0 loc=0
+VSInput Float32x4x3 ATTR_TEXCOORD4 :TEXCOORD #4 loc=1
+VSInput Float32x2 ATTR_TEXCOORD0 :TEXCOORD #0 loc=5
+`
+request_vars ``
+compile_glsl ``
+verify_vars `
+Uniform Float32x4x4 WVP
+VSInput Float32x4 ATTR_POSITION0 :POSITION #0
+VSInput Float32x4x3 ATTR_TEXCOORD4 :TEXCOORD #4
+VSInput Float32x2 ATTR_TEXCOORD0 :TEXCOORD #0
+`
+
+// `explicit layout locations - pixel`
+source `
+sampler1D Ramp;
+sampler1Dcmp Shadow;
+void main(float2 uv : TEXCOORD0, out float4 c0 : COLOR0, out float4 c2 : COLOR2)
+{
+	c0 = tex1D(Ramp, uv.x);
+	c2 = tex1Dcmp(Shadow, uv.x, uv.y);
+}`
+request_vars ``
+compile_glsl_330 `-S frag`
+in_shader `in vec2 V2P_TEXCOORD0;`
+in_shader `layout(location=2) out vec4 PSCOLOR2;`
+in_shader `sampler1DShadow`
+verify_vars `
+Sampler Sampler1D Ramp
+Sampler Sampler1DComp Shadow
+PSOutputColor Float32x4 PSCOLOR0 #0 loc=0
+PSOutputColor Float32x4 PSCOLOR2 #2 loc=2
+`
+request_vars ``
+compile_glsl_es300 `-S frag`
+in_shader `precision highp sampler2DShadow;`
+in_shader `layout(location=0) out vec4 PSCOLOR0;`
+in_shader `uniform sampler2DShadow Shadow;`
+verify_vars `
+Sampler Sampler2D Ramp
+Sampler Sampler2DComp Shadow
+PSOutputColor Float32x4 PSCOLOR0 #0 loc=0
+PSOutputColor Float32x4 PSCOLOR2 #2 loc=2
+`
+
+// `SPIR-V explicit decorations`
+source `
+cbuffer Camera : register(b2) { float4x4 WVP; float3 eye; float fade; };
+float scale;
+void main(float4 pos : POSITION, float3 nrm : NORMAL, float2 uv : TEXCOORD0,
+	out float4 opos : POSITION, out float2 ouv : TEXCOORD0, out float4 ocol : COLOR0)
+{
+	opos = mul(pos * scale, WVP);
+	ouv = uv;
+	ocol = float4(dot(normalize(eye - pos.xyz), nrm) * fade, 0, 0, 1);
+}`
+request_vars ``
+compile_spirv ``
+spirv_decorations `
+CBUF0.scale Offset 0
+CBUF0 Block
+CBUF0 DescriptorSet 0
+CBUF0 Binding 0
+CBUF2.WVP Offset 0
+CBUF2.WVP ColMajor
+CBUF2.WVP MatrixStride 16
+CBUF2.eye Offset 64
+CBUF2.fade Offset 76
+CBUF2 Block
+CBUF2 DescriptorSet 0
+CBUF2 Binding 2
+ATTR_POSITION0 Location 0
+ATTR_NORMAL0 Location 1
+ATTR_TEXCOORD0 Location 2
+gl_Position BuiltIn 0
+V2P_TEXCOORD0 Location 2
+V2P_COLOR0 Location 0
+`
+verify_vars `
+UniformBlockBegin None CBUF0 #0
+  Uniform Float32 scale #0
+UniformBlockEnd None CBUF0 #0
+UniformBlockBegin None CBUF2 #2
+  Uniform Float32x4x4 WVP #0
+  Uniform Float32x3 eye #16
+  Uniform Float32 fade #20
+UniformBlockEnd None CBUF2 #2
+VSInput Float32x4 ATTR_POSITION0 :POSITION #0 loc=0
+VSInput Float32x3 ATTR_NORMAL0 :NORMAL #0 loc=1
+VSInput Float32x2 ATTR_TEXCOORD0 :TEXCOORD #0 loc=2
+`
+
+// `SPIR-V explicit decorations - pixel`
+source `
+sampler2D Diffuse : register(s3);
+sampler2Dcmp Shadow : register(s5);
+float4 tint;
+float4 main(float2 uv : TEXCOORD0, float4 col : COLOR0, float4 vp : VPOS, out float dep : DEPTH) : COLOR
+{
+	float4 c = tex2D(Diffuse, uv) * col * tint;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (c.a < 0.1)
+			break;
+		c.rgb *= tex2Dcmp(Shadow, uv + i * 0.01, vp.z);
+	}
+	dep = vp.z;
+	return c;
+}`
+request_vars ``
+compile_spirv `-S frag`
+spirv_decorations `
+CBUF0.tint Offset 0
+CBUF0 Block
+CBUF0 DescriptorSet 0
+CBUF0 Binding 0
+SAMPLER3 DescriptorSet 1
+SAMPLER3 Binding 3
+SAMPLER5 DescriptorSet 1
+SAMPLER5 Binding 5
+V2P_TEXCOORD0 Location 2
+V2P_COLOR0 Location 0
+gl_FragCoord BuiltIn 15
+gl_FragDepth BuiltIn 22
+PSCOLOR0 Location 0
+`
+verify_vars `
+UniformBlockBegin None CBUF0 #0
+  Uniform Float32x4 tint #0
+UniformBlockEnd None CBUF0 #0
+Sampler Sampler2D SAMPLER3 #3
+Sampler Sampler2DComp SAMPLER5 #5
+PSOutputDepth Float32 gl_FragDepth
+PSOutputColor Float32x4 PSCOLOR0 #0 loc=0
+`
+
+// `SPIR-V varying locations of separate stages`
+source `
+void main(float4 p : POSITION, out float4 op : POSITION, out float2 uv0 : TEXCOORD0, out float3 uv3 : TEXCOORD3,
+	out float4 c1 : COLOR1, out float f : FOG, out float3 n : NORMAL)
+{
+	op = p; uv0 = p.xy; uv3 = p.xyz; c1 = p.wzyx; f = p.w; n = p.zyx;
+}`
+compile_spirv ``
+spirv_decorations `
+ATTR_POSITION0 Location 0
+gl_Position BuiltIn 0
+V2P_TEXCOORD0 Location 2
+V2P_TEXCOORD3 Location 5
+V2P_COLOR1 Location 1
+V2P_FOG0 Location 18
+V2P_NORMAL0 Location 19
+`
+source `
+float4 main(float3 n : NORMAL, float4 c1 : COLOR1, float3 uv3 : TEXCOORD3) : COLOR
+{
+	return c1 * float4(n * uv3, 1);
+}`
+compile_spirv `-S frag`
+spirv_matching_locations ``
+spirv_decorations `
+V2P_NORMAL0 Location 19
+V2P_COLOR1 Location 1
+V2P_TEXCOORD3 Location 5
+PSCOLOR0 Location 0
+`
+
+// `SPIR-V varying locations - unsupported semantics`
+source `
+float4 main(float4 v : SOMETHING) : COLOR { return v; }`
+compile_fail_spirv `-S frag`
+source `
+float4 main(float4 v : TEXCOORD16) : COLOR { return v; }`
+compile_fail_spirv `-S frag`
+source `
+float4 main(float4x4 m : TEXCOORD14) : COLOR { return m[0]; }`
+compile_fail_spirv `-S frag`
+source `
+float4 main(float4x2 m : TEXCOORD0, float4 v : TEXCOORD1) : COLOR { return m[0].xyxy + v; }`
+compile_fail_spirv `-S frag`
+
 // `struct I/O 3a`
 source `
 struct vdata { float4 Position : POSITION; };
@@ -684,3 +892,435 @@ compile_glsl_es100 ``
 source `float4 main() : POSITION { float a;
 	++a; a = 1; return a; }`
 compile_fail ``
+
+// `half promotion`
+source `
+half4 main( half4 c : COLOR0, float4 f : TEXCOORD0 ) : COLOR
+{
+	half4 a = c * 0.5 + 1;
+	half4 b = a > 0.25 ? a : -0.5;
+	return a * b + c * f.x;
+}`
+request_native_half ``
+request_vars ``
+compile_hlsl_before_after `/T ps_3_0`
+in_shader `(half4)0.5`
+in_shader `(half4)1`
+not_in_shader `(float4)a`
+verify_vars `
+PSOutputColor Float16x4 _tmp0 #0
+`
+compile_hlsl_before_after `/T ps_3_0`
+in_shader `(((float4)c)*((float4)0.5f))`
+in_shader `((float4)a) > ((float4)0.25f)`
+compile_glsl_es100 `-S frag`
+in_shader `mediump vec4 a = mediump vec4(`
+
+// `native half`
+source `
+sampler2D Tex;
+half4 Tint;
+half Scales[2];
+cbuffer Params { half Bias; };
+half3 Lum( half3 c ){ return c * 0.5 + dot( c, half3( 0.3, 0.59, 0.11 ) ); }
+half4 main( float2 uv : TEXCOORD0, half4 col : COLOR0 ) : COLOR
+{
+	half4 t = tex2D( Tex, uv );
+	half3 l = Lum( t.rgb ) * Scales[1] + Bias;
+	return half4( l, 1 ) * Tint * col;
+}`
+request_native_half ``
+request_vars ``
+compile_hlsl4 `/T ps_4_0`
+in_shader `uniform float4 Tint;`
+in_shader `uniform float Scales[2];`
+in_shader `uniform float Bias;`
+in_shader `min16float4 t = `
+in_shader `in min16float4 col : COLOR0`
+not_in_shader `half`
+verify_vars `
+Sampler Sampler2D Tex
+Uniform Float32x4 Tint
+Uniform Float32[2] Scales
+UniformBlockBegin None Params
+  Uniform Float32 Bias
+UniformBlockEnd None Params
+PSOutputColor Float16x4 _tmp0 #0
+`
+request_native_half ``
+compile_glsl_es100 `-S frag`
+in_shader `uniform vec4 Tint;`
+in_shader `varying mediump vec4 V2P_COLOR0;`
+in_shader `mediump vec4 t = `
+not_in_shader `mediump vec4(`
+not_in_shader `mediump vec3(`
+request_native_half ``
+compile_glsl `-S frag`
+in_shader `mediump vec3 l = `
+compile_glsl_es100 `-S frag`
+in_shader `varying mediump vec4 V2P_COLOR0;`
+in_shader `mediump vec4 t = mediump vec4(`
+
+// `packed varyings`
+source `
+float4x4 WVP;
+struct V2P
+{
+	float4 pos : POSITION;
+	float2 uv : TEXCOORD0;
+	float fog : TEXCOORD1;
+	float3 nrm : TEXCOORD2;
+	float2 uv2 : TEXCOORD3;
+	float2 unread : TEXCOORD4;
+	float4 col : COLOR0;
+};
+V2P vsmain( float4 p : POSITION, float3 n : NORMAL, float2 t : TEXCOORD0 )
+{
+	V2P o;
+	o.pos = mul( p, WVP );
+	o.uv = t;
+	o.uv2 = t * 2;
+	o.unread = t * 3;
+	o.fog = o.pos.z;
+	o.nrm = n;
+	o.col = 1;
+	return o;
+}
+struct PSIn
+{
+	float4 col : COLOR0;
+	float3 nrm : TEXCOORD2;
+	float2 uv2 : TEXCOORD3;
+	float fog : TEXCOORD1;
+	float2 uv : TEXCOORD0;
+	float notWritten : TEXCOORD5;
+};
+sampler2D Tex;
+float4 psmain( PSIn i ) : COLOR
+{
+	return tex2D( Tex, i.uv + i.uv2 ) * i.col * i.fog + float4( i.nrm, i.notWritten );
+}`
+request_pack_varyings ``
+compile_pair_glsl_es100 `vsmain psmain`
+in_shader `varying vec4 V2P_PACK0;`
+in_shader `varying vec4 V2P_PACK1;`
+in_shader `varying vec4 V2P_COLOR0;`
+not_in_shader `V2P_PACK2`
+not_in_shader `TEXCOORD4`
+in_shader `V2P_PACK0.xyz`
+in_shader `V2P_PACK1.xy`
+in_shader `V2P_PACK1.zw`
+in_shader `V2P_PACK0.w`
+verify_vars `
+Uniform Float32x4x4 WVP
+VSInput Float32x4 ATTR_POSITION0 :POSITION #0
+VSInput Float32x3 ATTR_NORMAL0 :NORMAL #0
+VSInput Float32x2 ATTR_TEXCOORD0 :TEXCOORD #0
+VSOutput Float32x4 gl_Position :POSITION #0
+VSOutput Float32x4 V2P_COLOR0 :COLOR #0
+VSOutput Float32x4 V2P_PACK0 :PACK #0
+VSOutput Float32x4 V2P_PACK1 :PACK #1
+PackedVarying Float32x3 V2P_PACK0.xyz :TEXCOORD #2
+PackedVarying Float32x2 V2P_PACK1.xy :TEXCOORD #0
+PackedVarying Float32x2 V2P_PACK1.zw :TEXCOORD #3
+PackedVarying Float32 V2P_PACK0.w :TEXCOORD #1
+--
+Sampler Sampler2D Tex
+PSOutputColor Float32x4 gl_FragColor #0
+PSInput Float32x4 V2P_COLOR0 :COLOR #0
+PSInput Float32 V2P_TEXCOORD5 :TEXCOORD #5
+PSInput Float32x4 V2P_PACK0 :PACK #0
+PSInput Float32x4 V2P_PACK1 :PACK #1
+PackedVarying Float32x3 V2P_PACK0.xyz :TEXCOORD #2
+PackedVarying Float32x2 V2P_PACK1.zw :TEXCOORD #3
+PackedVarying Float32 V2P_PACK0.w :TEXCOORD #1
+PackedVarying Float32x2 V2P_PACK1.xy :TEXCOORD #0
+`
+request_pack_varyings ``
+compile_pair_glsl `vsmain psmain`
+in_shader `out vec4 V2P_PACK1;`
+in_shader `in vec4 V2P_PACK1;`
+compile_pair_glsl `vsmain psmain`
+not_in_shader `V2P_PACK`
+
+// `packed varyings - single stage`
+source `
+float4 main( float2 uv : TEXCOORD0, float fog : TEXCOORD1 ) : COLOR { return uv.xyxy * fog; }`
+request_pack_varyings ``
+compile_fail_glsl_es100 `pixel`
+check_err `<memory>: error: varying packing is only supported by HOC_CompileShaderPair
+`
+
+// `paired VS/PS varying trimming`
+source `
+float4x4 WVP;
+float4 UVScale;
+float4 Tint;
+struct V2P
+{
+	float4 pos : POSITION;
+	float2 uv : TEXCOORD0;
+	float4 tint : TEXCOORD1;
+	float3 nrm : TEXCOORD2;
+};
+V2P vsmain( float4 p : POSITION, float3 n : NORMAL, float2 t : TEXCOORD0 )
+{
+	V2P o;
+	o.pos = mul( p, WVP );
+	o.uv = t * UVScale.xy + UVScale.zw;
+	o.tint = Tint * 2;
+	o.nrm = n;
+	return o;
+}
+sampler2D Tex;
+float4 psmain( V2P i ) : COLOR
+{
+	return tex2D( Tex, i.uv );
+}`
+compile_pair_hlsl `vsmain psmain`
+not_in_shader `Tint`
+not_in_shader `_tint`
+not_in_shader `i_nrm`
+verify_vars `
+Uniform Float32x4x4 WVP
+Uniform Float32x4 UVScale
+VSInput Float32x4 p :POSITION #0
+VSInput Float32x3 n :NORMAL #0
+VSInput Float32x2 t :TEXCOORD #0
+VSOutput Float32x4 _pos :POSITION #0
+VSOutput Float32x2 _uv :TEXCOORD #0
+--
+Sampler Sampler2D Tex
+PSOutputColor Float32x4 _tmp0 #0
+PSInput Float32x2 i_uv :TEXCOORD #0
+`
+compile_pair_hlsl4 `vsmain psmain`
+not_in_shader `Tint`
+not_in_shader `_tint`
+in_shader `void psmain(in float2 i_uv : TEXCOORD0,out float4 _tmp0 : SV_TARGET)`
+compile_pair_glsl_es100 `vsmain psmain`
+not_in_shader `Tint`
+not_in_shader `ATTR_NORMAL0`
+not_in_shader `V2P_TEXCOORD1`
+in_shader `varying vec2 V2P_TEXCOORD0;`
+
+// `SM3 uniform packing`
+source `
+float4x4 WVP;
+float3 LightDir;
+float3 LightColor : register(c5);
+float2 UVScale;
+float2 UVOffset;
+half Alpha;
+float Unpacked4;
+float4 Full;
+float4 main( float4 p : POSITION, float3 n : NORMAL, float2 t : TEXCOORD0 ) : POSITION
+{
+	return mul( p, WVP ) + float4( LightDir * dot( n, LightColor ), Alpha ) + float4( t * UVScale + UVOffset, 0, 0 ) + Full;
+}`
+request_pack_uniforms ``
+request_usage_masks ``
+request_vars ``
+compile_hlsl ``
+in_shader `uniform float4 UNI_PACK0 : register(c0);`
+in_shader `uniform float4 UNI_PACK1 : register(c1);`
+in_shader `UNI_PACK0.xyz`
+in_shader `UNI_PACK1.zw`
+not_in_shader `UNI_PACK2`
+in_shader `register(c5)`
+verify_vars `
+Uniform Float32x4x4 WVP read=0xffff
+Uniform Float32x3 LightColor #5 read=0x7
+Uniform Float32x4 Full read=0xf
+Uniform Float32x4 UNI_PACK0 #0 read=0xf
+Uniform Float32x4 UNI_PACK1 #1 read=0xf
+VSInput Float32x4 p :POSITION #0
+VSInput Float32x3 n :NORMAL #0
+VSInput Float32x2 t :TEXCOORD #0
+PackedUniform Float32x3 LightDir :UNI_PACK0.xyz #0 read=0x7
+PackedUniform Float32x2 UVOffset :UNI_PACK1.xy #4 read=0x3
+PackedUniform Float32x2 UVScale :UNI_PACK1.zw #6 read=0x3
+PackedUniform Float16 Alpha :UNI_PACK0.w #3 read=0x1
+`
+request_pack_uniforms ``
+compile_hlsl4 ``
+not_in_shader `UNI_PACK`
+
+// `uniform usage masks`
+source `
+float4x4 WVP;
+float4 Params;
+float4 Bones[64];
+float4 Palette[3];
+float3 Unused;
+struct Light { float3 dir; float4 color; };
+Light Lights[2];
+cbuffer Material
+{
+	float4 Diffuse;
+	float2 Tiling;
+};
+float4 main( float4 p : POSITION, int i : BLENDINDICES ) : POSITION
+{
+	float4 r = mul( p, WVP ) * Params.y + Bones[2] + Bones[3].zw.xyxy;
+	r += Lights[1].color * Diffuse.x + float4( Tiling, 0, 0 );
+	return r + Palette[i].x;
+}`
+request_usage_masks ``
+request_vars ``
+compile_hlsl4 ``
+verify_vars `
+Uniform Float32x4x4 WVP read=0xffff
+Uniform Float32x4 Params read=0x2
+Uniform Float32x4[64] Bones read=0xcf00,0x0,0x0,0x0,0x0,0x0,0x0,0x0
+Uniform Float32x4[3] Palette read=0x111
+StructBegin None[2] Lights
+  Uniform Float32x3 dir read=0x0
+  Uniform Float32x4 color read=0xf
+StructEnd None[2] Lights
+UniformBlockBegin None Material
+  Uniform Float32x4 Diffuse read=0x1
+  Uniform Float32x2 Tiling read=0x3
+UniformBlockEnd None Material
+VSInput Int32 i :BLENDINDICES #0
+VSInput Float32x4 p :POSITION #0
+`
+
+// `uniform block layout`
+source `
+float4 Tint;
+float Scale;
+struct Light { float3 dir; float4 color; };
+cbuffer Frame
+{
+	float3 LightDir;
+	float Intensity;
+	float2 UVScale;
+	float4 Colors[3];
+	float Fade;
+	float4x3 Bone;
+	float2 Offsets[2];
+	float Tail;
+	Light L;
+	float After;
+};
+float4 main( float4 p : POSITION ) : POSITION
+{
+	float4 r = Tint * Scale + float4( LightDir * Intensity, Fade ) + Colors[0] + Colors[1] + Colors[2];
+	r.xy += UVScale + Offsets[0] + Offsets[1] + Tail + After;
+	r.xyz += mul( p, Bone ) + L.dir;
+	return r + L.color;
+}`
+request_layout ``
+request_vars ``
+compile_hlsl4 ``
+verify_vars `
+Uniform Float32x4 Tint offset=0 size=16
+Uniform Float32 Scale offset=16 size=4
+UniformBlockBegin None Frame offset=0 size=224
+  Uniform Float32x3 LightDir offset=0 size=12
+  Uniform Float32 Intensity offset=12 size=4
+  Uniform Float32x2 UVScale offset=16 size=8
+  Uniform Float32x4[3] Colors offset=32 size=48 astride=16
+  Uniform Float32 Fade offset=80 size=4
+  Uniform Float32x4x3 Bone offset=96 size=48 mstride=16
+  Uniform Float32x2[2] Offsets offset=144 size=24 astride=16
+  Uniform Float32 Tail offset=168 size=4
+  StructBegin None L offset=176 size=32
+    Uniform Float32x3 dir offset=176 size=12
+    Uniform Float32x4 color offset=192 size=16
+  StructEnd None L offset=176 size=32
+  Uniform Float32 After offset=208 size=4
+UniformBlockEnd None Frame offset=0 size=224
+VSInput Float32x4 p :POSITION #0
+`
+request_layout ``
+request_vars ``
+compile_glsl ``
+verify_vars `
+Uniform Float32x4 Tint size=16
+Uniform Float32 Scale size=4
+UniformBlockBegin None Frame offset=0 size=256
+  Uniform Float32x3 LightDir offset=0 size=12
+  Uniform Float32 Intensity offset=12 size=4
+  Uniform Float32x2 UVScale offset=16 size=8
+  Uniform Float32x4[3] Colors offset=32 size=48 astride=16
+  Uniform Float32 Fade offset=80 size=4
+  Uniform Float32x4x3 Bone offset=96 size=60 mstride=16
+  Uniform Float32x2[2] Offsets offset=160 size=24 astride=16
+  Uniform Float32 Tail offset=192 size=4
+  StructBegin None L offset=208 size=32
+    Uniform Float32x3 dir offset=208 size=12
+    Uniform Float32x4 color offset=224 size=16
+  StructEnd None L offset=208 size=32
+  Uniform Float32 After offset=240 size=4
+UniformBlockEnd None Frame offset=0 size=256
+VSInput Float32x4 ATTR_POSITION0 :POSITION #0
+`
+request_layout ``
+request_vars ``
+compile_hlsl ``
+verify_vars `
+Uniform Float32x4 Tint size=16
+Uniform Float32 Scale size=4
+UniformBlockBegin None Frame offset=0 size=256
+  Uniform Float32x3 LightDir offset=0 size=12
+  Uniform Float32 Intensity offset=16 size=4
+  Uniform Float32x2 UVScale offset=32 size=8
+  Uniform Float32x4[3] Colors offset=48 size=48 astride=16
+  Uniform Float32 Fade offset=96 size=4
+  Uniform Float32x4x3 Bone offset=112 size=48 mstride=16
+  Uniform Float32x2[2] Offsets offset=160 size=24 astride=16
+  Uniform Float32 Tail offset=192 size=4
+  StructBegin None L offset=208 size=32
+    Uniform Float32x3 dir offset=208 size=12
+    Uniform Float32x4 color offset=224 size=16
+  StructEnd None L offset=208 size=32
+  Uniform Float32 After offset=240 size=4
+UniformBlockEnd None Frame offset=0 size=256
+VSInput Float32x4 p :POSITION #0
+`
+
+// `shader package`
+source `
+float4x4 WVP;
+float4 Tint;
+float4 main( float4 p : POSITION ) : POSITION
+{
+#ifdef TINTED
+	return mul( p, WVP ) * Tint;
+#else
+	return mul( p, WVP );
+#endif
+}`
+request_package_add `simple`
+compile_hlsl4 ``
+request_package_add `simple`
+compile_glsl ``
+request_package_add `simple`
+compile_glsl_es100 ``
+source_replace `#ifdef TINTED=>#if 1`
+request_layout ``
+request_package_add `simple TINTED`
+compile_hlsl4 ``
+request_package_add `simple TINTED QUALITY=2`
+compile_hlsl ``
+source `
+sampler2D Tex;
+float4 main( float2 uv : TEXCOORD0 ) : COLOR
+{
+	return tex2D( Tex, uv );
+}`
+request_package_add `simple`
+compile_glsl `-S frag`
+request_package_add `simple`
+compile_glsl_330 `-S frag`
+verify_package `
+simple vertex 1 0000000000000000 vars=2
+simple vertex 2 0000000000000000 vars=2
+simple vertex 3 0000000000000000 vars=2
+simple vertex 1 003bca63a8192148 vars=3
+simple vertex 0 eb2779670ce8a791 vars=3
+simple pixel 2 0000000000000000 vars=2
+simple pixel 4 0000000000000000 vars=2
+`
@@ -286,6 +286,13 @@ float4 fun { return 0.0; }
 `
 compile_hlsl ``
 
+// `nested macro invocation`
+source `
+#define M0(x) (x)
+#define M1(x) M0((x) * 0.5)
+float4 main(float4 a : POSITION) : POSITION { return M0(M0(a)) + M1(M1(a)); }`
+compile_hlsl ``
+
 // `token pasting`
 source `
 #define paster(a,i) a##i
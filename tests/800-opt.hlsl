@@ -31,11 +31,73 @@ source `
 float4 adder( float a, float b ){ return a + b; }
 float4 main() : POSITION { return adder( 12345.0, 23456.0 ); }
 `
-//compile_hlsl_before_after ``
-//not_in_shader `__ret F5adder`
-//not_in_shader `__ret adder`
-//not_in_shader `float4 adder`
-//compile_glsl ``
+compile_hlsl_before_after ``
+not_in_shader `adder`
+not_in_shader `12345`
+compile_glsl ``
+
+// `function inlining - out parameters and multiple returns`
+source `
+float4 outval;
+float4 sel( float4 v, out float4 o, inout float4 io )
+{
+	o = v * 2;
+	io += v;
+	if( v.x > 0 ) return v;
+	else if( v.y > 0 ) return -v;
+	return io;
+}
+float4 main( float4 p : POSITION ) : POSITION
+{
+	float4 a, b = outval;
+	float4 r = sel( p, a, b );
+	return r + a + b;
+}
+`
+compile_hlsl_before_after ``
+not_in_shader `sel`
+in_shader `_inl`
+compile_glsl ``
+not_in_shader `sel`
+
+// `function inlining - cost model`
+source `
+float4 big( float4 v )
+{
+	float4 t = v;
+	for( int i = 0; i < 8; ++i ){ t = t * v + sin( t ) * cos( v ) + t.wzyx * v.yxwz + exp( t ); t.x += 1; }
+	return t * v + sin( t ) * cos( v ) + t.wzyx * v.yxwz + exp( t ) + log( abs( t ) + 1 );
+}
+float4 main( float4 p : POSITION, float4 q : TEXCOORD0 ) : POSITION
+{
+	return big( p ) + big( q ) + big( p * q ) + big( p + q ) + big( p - q ) + big( q.wzyx ) + big( p.wzyx ) + big( q * 2 );
+}
+`
+compile_hlsl ``
+in_shader `big_IV4f(p)`
+
+// `function inlining - growth budget`
+source `
+float4 f0( float4 v ){ return sin( v ) * 2; }
+float4 f1( float4 v ){ float4 t = f0( v ); return t * t + f0( v.wzyx ); }
+float4 f2( float4 v ){ float4 t = f1( v ); return t + f1( t ); }
+float4 f3( float4 v ){ return f2( v ) * 3; }
+float4 mid( float4 v ){ float4 t = v * v + sin( v ); t = t * v + cos( t ); return t * t.wzyx + exp( t ); }
+float4 main( float4 p : POSITION, float4 q : TEXCOORD0 ) : POSITION
+{
+	float4 a = mid( p );
+	float4 b = mid( q );
+	float4 c = mid( p * q );
+	return f3( a + b + c );
+}
+`
+compile_hlsl ``
+not_in_shader `mid`
+not_in_shader `f0_`
+not_in_shader `f2_`
+not_in_shader `f3_`
+in_shader `f1_IV4f(_inl`
+compile_glsl ``
 
 // `if/else - constant condition 1`
 source `
@@ -60,3 +122,739 @@ float4 main() : POSITION { if( true - true ) return 12345; return 23456; }
 compile_hlsl_before_after ``
 not_in_shader `12345`
 compile_glsl ``
+
+// `constant folding - vectors`
+source `
+float4 main() : POSITION { return float4( 1, 2, 3, 4 ).wzyx * 2 + float4( 0.5, 0.5, 0.5, 0.5 ).x; }
+`
+compile_hlsl_before_after ``
+in_shader `8.5f, 6.5f, 4.5f, 2.5f`
+compile_glsl ``
+in_shader `vec4(8.5, 6.5, 4.5, 2.5)`
+
+// `constant folding - intrinsics`
+source `
+float4 main() : POSITION
+{
+	return float4( dot( float4( 1, 2, 3, 4 ), float4( 4, 3, 2, 1 ) ) + 12,
+		length( float2( 3, 4 ) ), pow( 2.0, 10.0 ), saturate( 3.5 ) );
+}
+`
+compile_hlsl_before_after ``
+in_shader `32.0f, 5.0f, 1024.0f, 1.0f`
+not_in_shader `dot`
+not_in_shader `pow`
+compile_glsl ``
+
+// `constant folding - matrices`
+source `
+float4 main() : POSITION
+{
+	return float4( mul( float2x2( 1, 2, 3, 4 ), float2( 1, 1 ) ), mul( float2( 1, 1 ), float2x2( 1, 2, 3, 4 ) ) );
+}
+`
+compile_hlsl_before_after ``
+in_shader `3.0f, 7.0f, 4.0f, 6.0f`
+not_in_shader `mul`
+compile_glsl ``
+in_shader `vec4(3.0, 7.0, 4.0, 6.0)`
+
+// `constant folding - int and bool`
+source `
+float4 main() : POSITION
+{
+	return float4( 17 / 4, -9 / 4, 7 % 4, all( bool3( true, 1, 2 ) ) && !any( bool2( false, 0 ) ) );
+}
+`
+compile_hlsl_before_after ``
+in_shader `float4(4, -2, 3, true)`
+compile_glsl ``
+
+// `constant folding - index, swizzle and ternary`
+source `
+float4 main() : POSITION
+{
+	return float4( 5, 6, 7, 8 )[ 2 ] + ( 1 > 2 ? 3.0 : float2( 0, 1 ).x );
+}
+`
+compile_hlsl_before_after ``
+in_shader `7.0f`
+compile_glsl ``
+
+// `constant folding - invalid results are not folded`
+source `
+float4 main() : POSITION { return sqrt( -1.0 ); }
+`
+compile_hlsl_before_after ``
+in_shader `sqrt`
+compile_glsl ``
+in_shader `sqrt`
+
+// `constant folding - differential`
+verify_folding `
+float 1.5 + 2.25 * 3 - 0.5 / 4
+float4 float4( 1, 2, 3, 4 ).wzyx * 2 + float4( 0.5, 0.25, 0, 1 )
+float3 -float3( 1, -2, 3 ).zyx
+float 7.5 % 2
+float -7.5 % 2
+float2 float2( 5, 6 ) / float2( 4, 3 )
+int 17 / 4 + -9 / 4 * 10
+int -7 % 3
+int 2147483647 + 1
+int 65536 * 65536 + 3
+int -2147483647 - 1
+int ~5 ^ 12 | 3 & 6
+int 1 << 31
+int -16 >> 2
+int3 int3( 5, -5, 7 ) / 2
+bool 1 < 2 && 3 >= 3 || false
+bool2 bool2( true, false ) && bool2( true, true )
+bool !( 2 == 2.0 ) || 1.5 != 1.5
+bool4 float4( 1, 2, 3, 4 ) > 2.5
+int -( 5 - 8 )
+float 1 > 2 ? 3.0 : 4.5
+float3 bool3( true, false, true ) ? float3( 1, 2, 3 ) : float3( 4, 5, 6 )
+float float4( 5, 6, 7, 8 )[ 2 ] + float2( 0, 1 ).y
+float3 (float3) 2.5
+int int( -3.75 ) + int( 3.75 )
+bool bool( 0.5 )
+float2 float4( 1, 2, 3, 4 ).xz
+float4 sin( float4( 0.5, 1, 1.5, 2 ) ) + cos( 0.25 )
+float4 float4( tan( 0.3 ), asin( 0.5 ), acos( 0.5 ), atan( 2 ) )
+float4 float4( atan2( 1, -2 ), sinh( 0.5 ), cosh( 0.5 ), tanh( 0.5 ) )
+float4 float4( exp( 1.5 ), exp2( 3.5 ), log( 10 ), log2( 10 ) )
+float4 float4( log10( 50 ), sqrt( 2 ), rsqrt( 8 ), pow( 2.5, 3.5 ) )
+float4 float4( floor( -1.5 ), ceil( -1.5 ), frac( -1.25 ), trunc( -1.75 ) )
+float4 float4( round( 1.25 ), abs( -3 ), sign( -0.5 ), saturate( 1.5 ) )
+float4 float4( fmod( -7, 3 ), ldexp( 1.5, 4 ), lerp( 2, 10, 0.25 ), smoothstep( 0, 4, 1 ) )
+float4 float4( min( 1, 2 ), max( 1, 2 ), clamp( 5, 1, 3 ), step( 0.5, 0.25 ) )
+float4 float4( degrees( 1 ), radians( 90 ), 0, 0 )
+int4 int4( abs( -4 ), sign( -9 ), min( 3, -3 ), clamp( 9, 0, 5 ) )
+float dot( float4( 1, 2, 3, 4 ), float4( 4, 3, 2, 1 ) )
+int dot( int3( 1, 2, 3 ), int3( -4, 5, 6 ) )
+float length( float3( 1, 2, 2 ) ) + distance( float2( 1, 1 ), float2( 4, 5 ) )
+float3 normalize( float3( 1, 2, 3 ) )
+float3 cross( float3( 1, 2, 3 ), float3( -2, 0.5, 4 ) )
+float3 reflect( float3( 1, -1, 0 ), normalize( float3( 0, 1, 1 ) ) )
+bool2 bool2( all( bool3( true, 1, 2 ) ), any( float2( 0, 0 ) ) )
+float2 mul( float2x2( 1, 2, 3, 4 ), float2( 1, -1 ) )
+float3 mul( float2( 1, -1 ), float2x3( 1, 2, 3, 4, 5, 6 ) )
+float2x2 mul( float2x3( 1, 2, 3, 4, 5, 6 ), float3x2( 1, 0, 0, 1, 2, 3 ) )
+float determinant( float3x3( 2, 0, 1, 1, 3, 2, 1, 1, 1 ) ) + determinant( float2x2( 1, 2, 3, 4 ) )
+float mul( 3, 0.5 )
+!float sqrt( -1.0 )
+!float pow( -2, 2 )
+!float log( 0 )
+!float 1.0 / 0
+!int 5 / 0
+!int -2147483647 - 1 / -1 % 0
+!float3 normalize( float3( 0, 0, 0 ) )
+`
+
+// `variable constants - static const branch removal`
+source `
+static const bool USE_FOG = false;
+static const int MODE = 2;
+float4 fogColor;
+float4 main( float4 p : POSITION, float t : TEXCOORD0 ) : POSITION
+{
+	float4 c = p;
+	if( USE_FOG )
+		c = lerp( c, fogColor, t );
+	if( MODE == 2 )
+		c *= 12345;
+	else
+		c *= 23456;
+	return c;
+}
+`
+compile_hlsl_before_after ``
+not_in_shader `fogColor`
+not_in_shader `lerp`
+not_in_shader `23456`
+in_shader `12345`
+compile_glsl ``
+not_in_shader `lerp`
+not_in_shader `23456`
+
+// `variable constants - merging branches`
+source `
+float4 main( float4 p : POSITION, float t : TEXCOORD0 ) : POSITION
+{
+	int mode = 2;
+	float scale;
+	if( mode * 2 == 4 )
+		scale = 1234;
+	else
+		scale = 2345;
+	float bias = 0;
+	if( t > 0.5 )
+		bias = 3456;
+	else
+		bias = 3456;
+	float acc = 1;
+	acc *= scale;
+	acc += bias;
+	return p * acc;
+}
+`
+compile_hlsl_before_after ``
+in_shader `4690.0f`
+not_in_shader `2345`
+compile_glsl ``
+in_shader `4690.0`
+
+// `variable constants - loops and conditional writes`
+source `
+float4 main( float4 p : POSITION, float t : TEXCOORD0 ) : POSITION
+{
+	float a = 1234;
+	bool c = t > 0 && ( a = 2345 ) > 0;
+	float b = 0;
+	for( int i = 0; i < 4; ++i )
+		b = b + i;
+	float d = 3456;
+	if( t > 1 )
+		d = 4567;
+	return p * float4( a, b, d, 0 );
+}
+`
+request_max_unroll_size `0`
+compile_hlsl_before_after ``
+in_shader `float4(a, b, d, 0`
+request_max_unroll_size `0`
+compile_glsl ``
+in_shader `vec4(a, b, d, 0`
+
+// `dead stores - overwritten and write-only locals`
+source `
+float4 main( float4 p : POSITION ) : POSITION
+{
+	float4 x = 12345;
+	x = p;
+	float3x3 unusedMtx = float3x3( 1, 2, 3, 4, 5, 6, 7, 8, 9 );
+	float unusedVal = 23456;
+	unusedVal = x.y;
+	return x;
+}
+`
+compile_hlsl_before_after ``
+not_in_shader `12345`
+not_in_shader `unusedMtx`
+not_in_shader `unusedVal`
+compile_glsl ``
+not_in_shader `12345`
+not_in_shader `unusedMtx`
+not_in_shader `unusedVal`
+
+// `dead stores - side effects and loops`
+source `
+float4 outval;
+void getval( out float4 v ){ v = outval; for( int i = 0; i < 4; ++i ) if( outval[i] < 0 ) return; } // not inlined
+float4 main( float4 p : POSITION, float t : TEXCOORD0 ) : POSITION
+{
+	float4 unusedOut = 12345;
+	getval( unusedOut );
+	float4 carried = 0;
+	float4 sum = 0;
+	for( int i = 0; i < 4; ++i )
+	{
+		sum += carried;
+		carried = p * i;
+	}
+	return sum;
+}
+`
+request_max_unroll_size `0`
+compile_hlsl_before_after ``
+not_in_shader `12345`
+in_shader `getval`
+in_shader `(carried = `
+request_max_unroll_size `0`
+compile_glsl ``
+in_shader `getval`
+in_shader `(carried = `
+
+// `common subexpressions - repeated expressions`
+source `
+float3 L;
+sampler2D tex;
+float4 main( float3 N : NORMAL, float2 uv : TEXCOORD0 ) : COLOR
+{
+	float3 n = normalize( N );
+	float d1 = dot( normalize( N ), L );
+	float d2 = dot( normalize( N ), -L );
+	float4 c = tex2D( tex, uv * 2 ) + tex2D( tex, uv * 2 ).wzyx;
+	return c * d1 * d2 + n.xyzz;
+}
+`
+request_optimization_level `2`
+compile_hlsl_before_after `/T ps_3_0`
+not_in_shader `dot(normalize`
+in_shader `dot(n,L)`
+in_shader `dot(n,(-L))`
+in_shader `= tex2D(tex,`
+not_in_shader `+ tex2D(`
+request_optimization_level `2`
+compile_glsl `-S frag`
+not_in_shader `dot(normalize`
+not_in_shader `+ texture(`
+compile_hlsl_before_after `/T ps_3_0`
+in_shader `dot(normalize(N),L)`
+
+// `common subexpressions - writes and control flow`
+source `
+float4 main( float3 N : NORMAL, float x : TEXCOORD0, float y : TEXCOORD1 ) : POSITION
+{
+	float a = x * y;
+	x += 1;
+	float b = x * y;
+	float4 c = 0;
+	for( int i = 0; i < 3; ++i )
+	{
+		c.x += x * y;
+		x += 1;
+		c.y += x * y;
+	}
+	return float4( a, b, x * y, 0 ) + c;
+}
+`
+request_optimization_level `2`
+request_max_unroll_size `0`
+compile_hlsl_before_after ``
+not_in_shader `b = a`
+not_in_shader `_tmp1 = (x*y)`
+not_in_shader `+= b`
+request_optimization_level `2`
+request_max_unroll_size `0`
+compile_glsl ``
+not_in_shader `_tmp1 = `
+
+// `common subexpressions - single-use temporaries`
+source `
+float3 L;
+float4 main( float3 N : NORMAL, float3 V : TEXCOORD0 ) : COLOR
+{
+	float a = saturate( dot( normalize( N ), L ) ) * 2;
+	float b = saturate( dot( normalize( N ), L ) ) * 3 + length( V * 2 ) + dot( V * 2, L );
+	return float4( a, b, 0, 0 );
+}
+`
+request_optimization_level `2`
+compile_hlsl_before_after `/T ps_3_0`
+in_shader `_tmp0 = saturate(dot(normalize(N),L));`
+in_shader `_tmp1 = (V*((float3)2));`
+in_shader `length(_tmp1)) + dot(_tmp1,L)`
+not_in_shader `_tmp2 = dot(`
+request_optimization_level `2`
+compile_glsl `-S frag`
+in_shader `_tmp0 = clamp(dot(normalize(V2P_NORMAL0),L),0.0,1.0);`
+not_in_shader `= normalize(V2P_NORMAL0);`
+
+// `optimization level 0`
+source `
+float4 main( float4 p : POSITION ) : POSITION
+{
+	float unused = 12345;
+	float4 x = 23456;
+	x = p;
+	return x * (2 + 3);
+}
+`
+request_optimization_level `0`
+compile_hlsl_before_after ``
+not_in_shader `(2 + 3)`
+not_in_shader `12345`
+in_shader `23456`
+request_optimization_level `0`
+compile_glsl ``
+in_shader `(x*vec4(5))`
+not_in_shader `12345`
+in_shader `23456`
+compile_glsl ``
+not_in_shader `23456`
+
+// `loop unrolling - constant trip count`
+source `
+sampler2D tex;
+float2 texelSize;
+float weights[5];
+float4 main( float2 uv : TEXCOORD0 ) : COLOR
+{
+	float4 sum = 0;
+	for( int i = -2; i <= 2; ++i )
+	{
+		float2 offset = texelSize * float2( i, 0 );
+		sum += tex2D( tex, uv + offset ) * weights[ i + 2 ];
+	}
+	return sum;
+}
+`
+compile_hlsl_before_after `/T ps_3_0`
+not_in_shader `for(`
+in_shader `float2(-2, 0)`
+in_shader `weights[4]`
+compile_glsl_es100 `-S frag`
+not_in_shader `for(`
+in_shader `weights[4]`
+request_max_unroll_size `0`
+compile_hlsl `/T ps_3_0`
+in_shader `for(`
+
+// `loop unrolling - unsupported loops and the final index`
+source `
+float4 vals[8];
+float4 main( float4 p : POSITION ) : POSITION
+{
+	float4 a = 0;
+	for( int i = 0; i < 8; i++ )
+	{
+		if( vals[i].x > p.x )
+			break;
+		a += vals[i];
+	}
+	for( int j = 0; j < 100; j++ )
+		a += vals[j % 8] * p;
+	for( int k = 0; k < 4; k++ )
+	{
+		a += vals[k];
+		k += 1;
+	}
+	int n;
+	for( n = 6; n > 0; n -= 2 )
+		a += vals[n];
+	return a * n;
+}
+`
+compile_hlsl_before_after ``
+in_shader `int i = 0;`
+in_shader `int j = 0;`
+in_shader `int k = 0;`
+not_in_shader `n = 6`
+in_shader `vals[2]`
+compile_glsl ``
+in_shader `int i = 0;`
+not_in_shader `n = 6`
+
+// `loop invariant code motion`
+source `
+float4 u0;
+float4 u1;
+float scale;
+int count;
+float4 vals[64];
+float4 main( float4 p : POSITION ) : POSITION
+{
+	float4 a = 0;
+	for( int i = 0; i < count * 2; i++ )
+		a += vals[i] * normalize( u0 + u1 ) * p.x;
+	for( int j = 0; j < 100; j++ )
+	{
+		a += vals[j % 64] * sin( u0 * scale ) + a.yzwx;
+		for( int m = 0; m < 50; m++ )
+			a += vals[m] * exp( u1 ) + cos( p * j );
+	}
+	int n = 0;
+	do
+	{
+		a += u0 * ( u1 + scale );
+		n++;
+	}
+	while( n < count + 3 );
+	return a;
+}
+`
+compile_hlsl_before_after ``
+in_shader ` = (count*2);`
+in_shader `(vals[i]*normalize(`
+in_shader ` = sin((u0*`
+in_shader ` = exp(u1);`
+in_shader ` = cos((p*`
+in_shader ` = (count + 3);`
+in_shader ` = (u0*(u1 + `
+compile_glsl ``
+in_shader ` = exp(u1);`
+in_shader ` = (count + 3);`
+compile_glsl_es100 ``
+in_shader ` = exp(u1);`
+
+// `algebraic simplification - exact rewrites`
+source `
+float4 u;
+int k;
+bool b;
+float4 main( float4 p : POSITION ) : POSITION
+{
+	float4 r = p * 1 + u * -1 + k * 0 + pow( p, 2.0 ) + pow( u.x, 0.5 );
+	r += ( p + 0 ) + ( u - 0 ) + p / 4 + p / 3 + (-(-u.yx)).xyxy;
+	r += saturate( saturate( p ) ) + normalize( normalize( u ) ) + abs( -u );
+	r += (float4)(float4)p.wzyx.yx.xxyy + (float4)(int)p.x;
+	if( !!b )
+		r = pow( p * u, 2 );
+	return r;
+}
+`
+compile_hlsl_before_after ``
+not_in_shader `*1`
+in_shader `-u`
+not_in_shader `k*`
+in_shader `(p*p)`
+in_shader `pow(u.x,`
+in_shader `(p + ((float4)0))`
+not_in_shader `u - `
+not_in_shader `/ 4`
+in_shader `(p / ((float4)3))`
+in_shader `u.yxyx`
+not_in_shader `saturate(saturate(`
+not_in_shader `normalize(normalize(`
+in_shader `abs(u)`
+in_shader `p.zzww`
+in_shader `(int)p.x`
+not_in_shader `!!`
+not_in_shader `!(!`
+in_shader `pow((p*u),`
+compile_glsl ``
+in_shader `(ATTR_POSITION0*ATTR_POSITION0)`
+in_shader `ATTR_POSITION0.zzww`
+compile_glsl_es100 ``
+in_shader `(ATTR_POSITION0*ATTR_POSITION0)`
+
+// `algebraic simplification - fast math`
+source `
+float4 u;
+float4 main( float4 p : POSITION ) : POSITION
+{
+	return p * 0 + ( u + 0 ) + pow( p, 0.5 ) + p / 3 + ( 0 - u.x );
+}
+`
+request_fast_math ``
+compile_hlsl ``
+not_in_shader `*0`
+not_in_shader `+ 0`
+in_shader `sqrt(p)`
+not_in_shader `(p / ((float4)3))`
+in_shader `-u.x`
+
+// `uniform specialization`
+source `
+float4 color;
+float4x4 mtx;
+int numLights;
+bool useFog;
+float4 lightDirs[4];
+cbuffer Material
+{
+	float4 tint;
+	float quality;
+};
+float4 main( float4 p : POSITION ) : POSITION
+{
+	float4 r = mul( p, mtx ) * color;
+	for( int i = 0; i < numLights; ++i )
+		r += lightDirs[i] * tint;
+	if( useFog )
+		r *= quality;
+	return r;
+}
+`
+request_uniform_values `color=1 mtx=1,0,0,0,0,2,0,0,0,0,3,0,0,0,0,1 numLights=2 useFog=0 tint=0.5,1,1,1`
+request_vars ``
+compile_hlsl_before_after ``
+not_in_shader `color`
+not_in_shader `numLights`
+not_in_shader `useFog`
+in_shader `float4 tint;`
+in_shader `lightDirs[1]`
+verify_vars `
+Uniform Float32x4[4] lightDirs
+UniformBlockBegin None Material
+  Uniform Float32x4 tint
+  Uniform Float32 quality
+UniformBlockEnd None Material
+VSInput Float32x4 p :POSITION #0
+RemovedUniform Float32x4 color
+RemovedUniform Float32x4x4 mtx
+RemovedUniform Int32 numLights
+RemovedUniform Bool useFog
+`
+request_uniform_values `mtx=1,0,0,0,0,2,0,0,0,0,3,0,0,0,0,1`
+compile_glsl ``
+not_in_shader `mtx`
+in_shader `[1][1] = 2.0)`
+request_uniform_values `mtx=1,2`
+compile_fail ``
+check_err `<memory>: error: cannot specialize uniform 'mtx' - expected 1 or 16 values
+`
+request_uniform_values `color=1 colour=2`
+compile_fail ``
+check_err `<memory>: error: cannot specialize uniform 'colour' - not found
+`
+request_uniform_values `i=1`
+compile_fail ``
+check_err `<memory>: error: cannot specialize uniform 'i' - not found
+`
+
+
+// `preshader`
+source `
+float4x4 World;
+float4x4 ViewProj;
+float3 LightDir;
+float FarPlane;
+float4 Params[2];
+int Count;
+float Bias;
+float4 main( float4 p : POSITION, out float4 c : COLOR0 ) : POSITION
+{
+	c = float4( normalize( LightDir ) * ( 1.0 / FarPlane ), Count * 2 );
+	c += Params[1].yxzw * p.x * ( 1.0 / FarPlane );
+	Bias += 1;
+	c += Bias * 2;
+	return mul( p, mul( World, ViewProj ) ) * ( 1.0 / FarPlane );
+}
+`
+request_preshader ``
+request_vars ``
+compile_hlsl_before_after ``
+not_in_shader `World`
+not_in_shader `normalize`
+in_shader `(Bias*2.0f)`
+verify_vars `
+Uniform Float32x4[2] Params
+Uniform Float32 Bias
+Uniform Float32x4 _preshader0
+Uniform Float32 _preshader1
+Uniform Float32x4x4 _preshader2
+VSInput Float32x4 p :POSITION #0
+PreshaderInput Float32x3 LightDir
+PreshaderInput Float32 FarPlane
+PreshaderInput Int32 Count
+PreshaderInput Float32x4x4 World
+PreshaderInput Float32x4x4 ViewProj
+PreshaderOutput Float32x4 _preshader0
+PreshaderOutput Float32 _preshader1
+PreshaderOutput Float32x4x4 _preshader2
+`
+run_preshader `World=2,0,0,0,0,2,0,0,0,0,2,0,0,0,0,1 ViewProj=1,0,0,0,0,1,0,0,0,0,1,0,5,6,7,1 LightDir=3,0,4 FarPlane=2 Count=3`
+verify_preshader `
+_preshader0=0.3,0,0.4,6
+_preshader1=0.5
+_preshader2=2,0,0,0,0,2,0,0,0,0,2,0,5,6,7,1
+`
+run_preshader `World=2,0,0,0,0,2,0,0,0,0,2,0,0,0,0,1 ViewProj=1,0,0,0,0,1,0,0,0,0,1,0,5,6,7,1 LightDir=3,0,4 FarPlane=0 Count=3`
+verify_preshader `
+failed
+`
+request_preshader ``
+compile_glsl ``
+in_shader `uniform mat4 _preshader2;`
+not_in_shader `ViewProj`
+
+// `GLSL ES precision inference`
+source `
+sampler2D Tex;
+float4 Tint;
+float4 main( float4 col : COLOR0, float2 uv : TEXCOORD0 ) : COLOR
+{
+	float4 t = tex2D( Tex, uv );
+	float3 l = t.rgb * 0.5 + col.a;
+	float2 uv2 = uv * 2;
+	float4 c = t * col;
+	float4 t2 = tex2D( Tex, uv2 + c.xy );
+	return float4( l, 1 ) * Tint + t2 / 4;
+}
+`
+request_auto_precision ``
+compile_glsl_es100 `-S frag`
+in_shader `varying vec4 V2P_COLOR0;`
+in_shader `varying vec2 V2P_TEXCOORD0;`
+in_shader `mediump vec4 t = `
+in_shader `  vec3 l = `
+in_shader `mediump vec4 t2 = `
+in_shader `  vec4 c = `
+in_shader `  vec2 uv2 = `
+compile_glsl_es100 `-S frag`
+not_in_shader `mediump`
+
+// `GLSL ES precision inference - value ranges`
+source `
+sampler2D Tex;
+float4 main( float2 uv : TEXCOORD0 ) : COLOR
+{
+	float4 t = tex2D( Tex, uv );
+	float3 l = t.rgb * 0.5 + t.a * 0.25;
+	float4 big = tex2D( Tex, uv.yx ) * 255 * 255 * 255;
+	float depth = dot( tex2D( Tex, uv * 2 ), float4( 1, 1 / 255.0, 1 / 65025.0, 1 / 16581375.0 ) );
+	float3 n = normalize( t.xyz * 2 - 1 );
+	return float4( l * n, 1 ) + big / 16777216 + depth;
+}
+`
+request_auto_precision ``
+compile_glsl_es100 `-S frag`
+in_shader `mediump vec4 t = `
+in_shader `mediump vec3 l = `
+in_shader `mediump vec3 n = `
+in_shader `  vec4 big = `
+in_shader `  float depth = `
+
+// `GLSL ES precision inference - mediump expressions`
+source `
+sampler2D Tex;
+float4 main( float2 uv : TEXCOORD0 ) : COLOR
+{
+	float4 t = tex2D( Tex, uv );
+	float4 s = tex2D( Tex, uv * 2 );
+	return t * 255 * 255 * 255 + s;
+}
+`
+request_auto_precision ``
+compile_glsl_es100 `-S frag`
+in_shader `  vec4 t = `
+in_shader `mediump vec4 s = `
+
+// `GLSL ES precision inference - loop accumulation`
+source `
+sampler2D Tex;
+float4 main( float2 uv : TEXCOORD0, float count : TEXCOORD1 ) : COLOR
+{
+	float4 acc = 0;
+	for( int i = 0; i < 64; ++i )
+		acc += tex2D( Tex, uv + float2( i, 0 ) );
+	float4 sum = 0;
+	for( float j = 0; j < count; j += 1 )
+		sum = sum + tex2D( Tex, uv * j );
+	float4 avg = 0;
+	for( int k = 0; k < 2; ++k )
+		avg += tex2D( Tex, uv * k ) * 0.5;
+	return acc / 64 + sum + avg;
+}
+`
+request_auto_precision ``
+compile_glsl_es100 `-S frag`
+not_in_shader `mediump vec4 acc`
+not_in_shader `mediump vec4 sum`
+in_shader `mediump vec4 avg`
+
+// `dead struct member stores`
+source `
+float4x4 WVP;
+float4 Tint;
+struct Data
+{
+	float4 pos;
+	float4 tint;
+};
+float4 main( float4 p : POSITION ) : POSITION
+{
+	Data d;
+	d.pos = mul( p, WVP );
+	d.tint = Tint * 2;
+	Data c = d;
+	return c.pos;
+}`
+compile_hlsl ``
+not_in_shader `Tint`
+not_in_shader `.tint`
+in_shader `.pos = `
+compile_glsl ``
+not_in_shader `Tint`
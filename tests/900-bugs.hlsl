@@ -178,3 +178,85 @@ float4 main() : POSITION {
 	float2x2 m1 = float2x2(float2(0.25,0.5), float2(0.75, 1));
 	return float4(m1._m00, m1._m01, m1._m10, m1._m11); }`
 compile_hlsl ``
+
+// `bug 15 - matrix row index typed as scalar`
+source `
+float3x4 M;
+float4 main() : POSITION {
+	float4 r = M[1] * 2;
+	return r + M[1].y + M[0][1] + dot(M[2], r); }`
+compile_hlsl ``
+compile_hlsl4 ``
+compile_glsl ``
+in_shader `vec4(M[1].y)`
+compile_glsl_es100 ``
+compile_spirv ``
+
+// `bug 16 - GLSL matrix swizzle element typed as vector`
+source `
+float4x4 M;
+float4 main(float4 p : POSITION) : POSITION {
+	float4 v = M._m11;
+	float4x4 W = M;
+	W._m01_m10 = p.zw;
+	return v + W._m01; }`
+compile_hlsl ``
+compile_glsl ``
+in_shader `vec4 v = vec4(M[1][1]);`
+in_shader `(v + vec4(W[1][0]))`
+compile_glsl_es100 ``
+in_shader `vec4 v = vec4(M[1][1]);`
+compile_spirv ``
+
+// `bug 17 - GLSL non-square matrix construction out of range`
+source `
+float4 main(float4 p : POSITION) : POSITION {
+	float3x2 W = float3x2(p.x, p.y, p.z, p.w, 1, 2);
+	return float4(W[0], W[2]); }`
+compile_hlsl ``
+compile_glsl ``
+in_shader `(W[0][1] = ATTR_POSITION0.y);`
+in_shader `(W[1][0] = ATTR_POSITION0.z);`
+in_shader `(W[2][1] = 2.0);`
+compile_glsl_es100 ``
+in_shader `(W[2][1] = 2.0);`
+compile_spirv ``
+
+// `bug 18 - GLSL non-square matrix swizzle elements`
+source `
+float3x4 M;
+float4 main(float4 p : POSITION) : POSITION {
+	float3x2 W = (float3x2) 0;
+	W._m00_m21 = p.xy;
+	W._m10 += p.z;
+	return float4(M._m00_m12 + W._m00_m21, M._m13, W._m10); }`
+compile_hlsl ``
+compile_glsl ``
+in_shader `(W[2][1] = _tmp0[1]);`
+in_shader `(W[1][0] += ATTR_POSITION0.z);`
+in_shader `vec2(M[0][0], M[1][2])`
+in_shader `M[1][3]`
+compile_glsl_es100 ``
+in_shader `vec2(M[0][0], M[1][2])`
+compile_spirv ``
+
+// `bug 19 - GLSL matrix intrinsic columns typed as matrices/assert`
+source `
+float3x4 N;
+float4 main(float4 p : POSITION) : POSITION {
+	float3x4 r = float3x4(round(N));
+	return r[0] + r[2]; }`
+compile_hlsl ``
+compile_glsl ``
+in_shader `mat3x4(round(N[0]), round(N[1]), round(N[2]))`
+compile_glsl_es100 ``
+compile_spirv ``
+
+// `bug 20 - all/any on vector followed by a sibling expression/crash`
+source `
+float4 main(float4 p : TEXCOORD0) : COLOR {
+	return all(p > 0) ? 1 : any(p) ? 0.5 : 0; }`
+compile_hlsl ``
+compile_glsl ``
+compile_glsl_es100 ``
+compile_spirv ``